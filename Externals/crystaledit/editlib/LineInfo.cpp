@@ -21,6 +21,7 @@ LineInfo::LineInfo()
 , m_nEolChars(0)
 , m_dwFlags(0)
 , m_dwRevisionNumber(0)
+, m_nColumnCount(-1)
 {
 };
 
@@ -30,6 +31,7 @@ LineInfo::LineInfo()
  */
 void LineInfo::Clear()
 {
+  m_nColumnCount = -1;
   if (m_pcLine != nullptr)
     {
       delete[] m_pcLine;
@@ -48,6 +50,7 @@ void LineInfo::Clear()
  */
 void LineInfo::FreeBuffer()
 {
+  m_nColumnCount = -1;
   if (m_pcLine != nullptr)
     {
       delete[] m_pcLine;
@@ -65,6 +68,7 @@ void LineInfo::FreeBuffer()
  */
 void LineInfo::Create(LPCTSTR pszLine, size_t nLength)
 {
+  m_nColumnCount = -1;
   if (nLength == 0)
     {
       CreateEmpty();
@@ -99,6 +103,7 @@ void LineInfo::Create(LPCTSTR pszLine, size_t nLength)
  */
 void LineInfo::CreateEmpty()
 {
+  m_nColumnCount = -1;
   m_nLength = 0;
   m_nEolChars = 0;
   m_nMax = ALIGN_BUF_SIZE (m_nLength + 1);
@@ -114,6 +119,7 @@ void LineInfo::CreateEmpty()
  */
 void LineInfo::Append(LPCTSTR pszChars, size_t nLength, bool bDetectEol)
 {
+  m_nColumnCount = -1;
   ASSERT (nLength <= INT_MAX);		// assert "positive int"
   size_t nBufNeeded = m_nLength + m_nEolChars + nLength + 1;
   if (nBufNeeded > m_nMax)
@@ -180,6 +186,7 @@ LPCTSTR LineInfo::GetEol() const
  */
 bool LineInfo::ChangeEol(LPCTSTR lpEOL)
 {
+  m_nColumnCount = -1;
   const int nNewEolChars = (int) _tcslen(lpEOL);
 
   // Check if we really are changing EOL.
@@ -213,11 +220,12 @@ bool LineInfo::ChangeEol(LPCTSTR lpEOL)
  */
 void LineInfo::Delete(size_t nStartChar, size_t nEndChar)
 {
+  m_nColumnCount = -1;
   if (nEndChar < Length() || m_nEolChars)
     {
       // preserve characters after deleted range by shifting up
-      memcpy (m_pcLine + nStartChar, m_pcLine + nEndChar,
-              sizeof (TCHAR) * (FullLength() - nEndChar));
+      memmove (m_pcLine + nStartChar, m_pcLine + nEndChar,
+               sizeof (TCHAR) * (FullLength() - nEndChar));
     }
   size_t nDelete = (nEndChar - nStartChar);
   if (nDelete <= m_nLength)
@@ -242,6 +250,7 @@ void LineInfo::Delete(size_t nStartChar, size_t nEndChar)
  */
 void LineInfo::DeleteEnd(size_t nStartChar)
 {
+  m_nColumnCount = -1;
   m_nLength = nStartChar;
   ASSERT (m_nLength <= INT_MAX);		// assert "positive int"
   if (m_pcLine != nullptr)
@@ -255,6 +264,7 @@ void LineInfo::DeleteEnd(size_t nStartChar)
  */
 void LineInfo::CopyFrom(const LineInfo &li)
 {
+  m_nColumnCount = -1;
   delete [] m_pcLine;
   m_pcLine = new TCHAR[li.m_nMax];
   memcpy(m_pcLine, li.m_pcLine, li.m_nMax * sizeof(TCHAR));
@@ -265,6 +275,7 @@ void LineInfo::CopyFrom(const LineInfo &li)
  */
 void LineInfo::RemoveEol()
 {
+  m_nColumnCount = -1;
   if (HasEol())
   {
     m_pcLine[m_nLength] = '\0';
@@ -42,6 +42,10 @@ public:
     size_t FullLength() const { return m_nLength + m_nEolChars; }
     /** @brief Return line length. */
     size_t Length() const { return m_nLength; }
+    /** @brief Return cached count of field delimiters, -1 if not counted since the line changed. */
+    int GetColumnCountCache() const { return m_nColumnCount; }
+    /** @brief Cache count of field delimiters, see CCrystalTextBuffer::GetColumnCount(). */
+    void SetColumnCountCache(int nColumnCount) const { m_nColumnCount = nColumnCount; }
 
     /** @brief Is the char an EOL char? */
     static bool IsEol(TCHAR ch)
@@ -60,4 +64,5 @@ private:
     size_t m_nMax; /**< Allocated space for line data. */
     size_t m_nLength; /**< Line length (without EOL bytes). */
     int m_nEolChars; /**< # of EOL bytes. */
+    mutable int m_nColumnCount; /**< Cached count of field delimiters, -1 if not known. */
   };
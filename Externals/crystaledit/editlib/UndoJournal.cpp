@@ -0,0 +1,374 @@
+/**
+ * @file  UndoJournal.cpp
+ *
+ * @brief Implementation of UndoJournal and UndoArena classes.
+ */
+
+#include "stdafx.h"
+#include "UndoJournal.h"
+#include <algorithm>
+#include <utility>
+
+#ifdef _DEBUG
+#define new DEBUG_NEW
+#endif
+
+//  Size of arena chunks, larger data gets a chunk of its own
+static const size_t UNDO_CHUNK_SIZE = 64 * 1024;
+
+UndoArena::UndoArena ()
+: m_nMemoryUsage (0)
+, m_pFile (nullptr)
+, m_nFileSize (0)
+, m_bFileFailed (false)
+, m_nMemoryLimit (0)
+, m_nSize (0)
+{
+}
+
+UndoArena::~UndoArena ()
+{
+  Clear ();
+}
+
+/**
+ * @brief Append data to the arena.
+ * @param [in] pData Data to append, the data is kept in one piece.
+ * @param [in] nBytes Size of data.
+ * @param [in] nAlign Alignment of the data, power of two.
+ * @return Arena offset of the data.
+ */
+size_t UndoArena::
+Append (const void * pData, size_t nBytes, size_t nAlign)
+{
+  if (nBytes == 0)
+    return m_nSize;
+  size_t nPos = 0;
+  if (!m_aChunks.empty ())
+    {
+      Chunk & last = m_aChunks.back ();
+      nPos = (last.nSize + nAlign - 1) & ~(nAlign - 1);
+    }
+  if (m_aChunks.empty () || !m_aChunks.back ().pData || nPos + nBytes > m_aChunks.back ().nCapacity)
+    {
+      Chunk chunk;
+      chunk.nCapacity = (std::max) (nBytes, UNDO_CHUNK_SIZE);
+      chunk.pData.reset (new BYTE[chunk.nCapacity]);
+      chunk.nBegin = m_nSize;
+      chunk.nSize = 0;
+      chunk.nFileOffset = -1;
+      m_nMemoryUsage += chunk.nCapacity;
+      m_aChunks.push_back (std::move (chunk));
+      nPos = 0;
+    }
+  Chunk & last = m_aChunks.back ();
+  memcpy (last.pData.get () + nPos, pData, nBytes);
+  last.nSize = nPos + nBytes;
+  m_nSize = last.nBegin + last.nSize;
+  SpillChunks (m_aChunks.size () - 1);
+  return last.nBegin + nPos;
+}
+
+/**
+ * @brief Append data right after the end of the arena, if it fits in the last chunk.
+ * @return false if the data didn't fit, nothing is appended then.
+ */
+bool UndoArena::
+Extend (const void * pData, size_t nBytes)
+{
+  if (m_aChunks.empty ())
+    return false;
+  Chunk & last = m_aChunks.back ();
+  if (!last.pData || last.nBegin + last.nSize != m_nSize || last.nSize + nBytes > last.nCapacity)
+    return false;
+  memcpy (last.pData.get () + last.nSize, pData, nBytes);
+  last.nSize += nBytes;
+  m_nSize += nBytes;
+  return true;
+}
+
+/**
+ * @brief Get data stored by Append().
+ * The pointer is valid until the next call to the arena.
+ * @return Pointer to the data, nullptr if it could not be read back from the file.
+ */
+const void * UndoArena::
+Get (size_t nOffset, size_t nBytes) const
+{
+  ASSERT (nOffset + nBytes <= m_nSize);
+  if (nBytes == 0 || m_aChunks.empty ())
+    return nullptr;
+  size_t nChunk = FindChunk (nOffset);
+  if (!LoadChunk (nChunk))
+    return nullptr;
+  SpillChunks (nChunk);
+  const Chunk & chunk = m_aChunks[nChunk];
+  ASSERT (nOffset + nBytes <= chunk.nBegin + chunk.nSize);
+  return chunk.pData.get () + (nOffset - chunk.nBegin);
+}
+
+/**
+ * @brief Remove data after given size.
+ */
+void UndoArena::
+Truncate (size_t nSize)
+{
+  if (nSize >= m_nSize)
+    return;
+  while (!m_aChunks.empty () && m_aChunks.back ().nBegin >= nSize)
+    {
+      if (m_aChunks.back ().pData)
+        m_nMemoryUsage -= m_aChunks.back ().nCapacity;
+      m_aChunks.pop_back ();
+    }
+  m_nSize = nSize;
+  if (m_aChunks.empty ())
+    return;
+  //  The last chunk is written to again, so its file copy is not valid any
+  //  more. If it can't be read back, it stays in the file as it is and the
+  //  next Append() starts a new chunk at the truncated size.
+  size_t nLast = m_aChunks.size () - 1;
+  if (!LoadChunk (nLast))
+    return;
+  Chunk & last = m_aChunks[nLast];
+  last.nSize = nSize - last.nBegin;
+  last.nFileOffset = -1;
+}
+
+/**
+ * @brief Remove all data and the temporary file.
+ */
+void UndoArena::
+Clear ()
+{
+  m_aChunks.clear ();
+  m_nMemoryUsage = 0;
+  m_nSize = 0;
+  if (m_pFile != nullptr)
+    fclose (m_pFile);
+  m_pFile = nullptr;
+  m_nFileSize = 0;
+  m_bFileFailed = false;
+}
+
+/**
+ * @brief Set how many bytes the arena may keep in memory, 0 for no limit.
+ */
+void UndoArena::
+SetMemoryLimit (size_t nBytes)
+{
+  m_nMemoryLimit = nBytes;
+  if (!m_aChunks.empty ())
+    SpillChunks (m_aChunks.size () - 1);
+}
+
+size_t UndoArena::
+FindChunk (size_t nOffset) const
+{
+  auto it = std::upper_bound (m_aChunks.begin (), m_aChunks.end (), nOffset,
+      [] (size_t nOffset, const Chunk & chunk) { return nOffset < chunk.nBegin; });
+  ASSERT (it != m_aChunks.begin ());
+  return static_cast<size_t>(it - m_aChunks.begin ()) - 1;
+}
+
+/**
+ * @brief Read chunk back from the temporary file, if it is not in memory.
+ */
+bool UndoArena::
+LoadChunk (size_t nChunk) const
+{
+  Chunk & chunk = m_aChunks[nChunk];
+  if (chunk.pData)
+    return true;
+  ASSERT (m_pFile != nullptr && chunk.nFileOffset >= 0);
+  std::unique_ptr<BYTE[]> pData (new BYTE[chunk.nSize]);
+  if (_fseeki64 (m_pFile, chunk.nFileOffset, SEEK_SET) != 0 ||
+      fread (pData.get (), 1, chunk.nSize, m_pFile) != chunk.nSize)
+    return false;
+  //  The chunk was full when written, it is not appended to any more
+  chunk.pData = std::move (pData);
+  chunk.nCapacity = chunk.nSize;
+  m_nMemoryUsage += chunk.nCapacity;
+  return true;
+}
+
+/**
+ * @brief Write chunk to the end of the temporary file, creating the file first if needed.
+ */
+bool UndoArena::
+WriteChunk (Chunk & chunk) const
+{
+  if (m_pFile == nullptr)
+    {
+      if (m_bFileFailed)
+        return false;
+      TCHAR szTempPath[MAX_PATH], szTempFile[MAX_PATH];
+      //  'T' keeps the file in cache if possible, 'D' deletes it when closed
+      if (GetTempPath (MAX_PATH, szTempPath) == 0 ||
+          GetTempFileName (szTempPath, _T ("UND"), 0, szTempFile) == 0 ||
+          _tfopen_s (&m_pFile, szTempFile, _T ("w+bTD")) != 0)
+        {
+          m_pFile = nullptr;
+          m_bFileFailed = true;
+          return false;
+        }
+    }
+  if (_fseeki64 (m_pFile, m_nFileSize, SEEK_SET) != 0 ||
+      fwrite (chunk.pData.get (), 1, chunk.nSize, m_pFile) != chunk.nSize)
+    {
+      m_bFileFailed = true;
+      return false;
+    }
+  chunk.nFileOffset = m_nFileSize;
+  m_nFileSize += chunk.nSize;
+  return true;
+}
+
+/**
+ * @brief Move oldest chunks to the temporary file until memory usage is within the limit.
+ * @param [in] nKeep Index of chunk which must stay in memory.
+ * The last chunk is never spilled, as it is still appended to.
+ */
+void UndoArena::
+SpillChunks (size_t nKeep) const
+{
+  if (m_nMemoryLimit == 0)
+    return;
+  for (size_t i = 0; i + 1 < m_aChunks.size () && m_nMemoryUsage > m_nMemoryLimit; ++i)
+    {
+      Chunk & chunk = m_aChunks[i];
+      if (i == nKeep || !chunk.pData)
+        continue;
+      if (chunk.nFileOffset < 0 && !WriteChunk (chunk))
+        return;
+      m_nMemoryUsage -= chunk.nCapacity;
+      chunk.pData.reset ();
+    }
+}
+
+UndoJournal::UndoJournal ()
+: m_nLastTextLength (0)
+{
+}
+
+void UndoJournal::
+clear ()
+{
+  m_aRecords.clear ();
+  m_arena.Clear ();
+  m_nLastTextLength = 0;
+}
+
+/**
+ * @brief Remove records after given count.
+ * Only removing is supported, the journal never grows by resize().
+ */
+void UndoJournal::
+resize (size_t nSize)
+{
+  ASSERT (nSize <= m_aRecords.size ());
+  if (nSize >= m_aRecords.size ())
+    return;
+  //  Data of a record starts with its revision numbers
+  m_arena.Truncate (m_aRecords[nSize].m_nRevisionOffset);
+  m_aRecords.resize (nSize);
+  if (m_aRecords.empty ())
+    m_arena.Clear ();
+  m_nLastTextLength = m_aRecords.empty () ? 0 : m_aRecords.back ().m_nTextLength;
+}
+
+/**
+ * @brief Add record, storing its text and revision numbers to the arena.
+ */
+void UndoJournal::
+push_back (const UndoRecord & ur, LPCTSTR pszText, size_t cchText,
+           const DWORD * pdwRevisionNumbers, size_t nRevisionCount)
+{
+  //  Text goes last, so that typing can extend it in place
+  UndoRecord rec = ur;
+  rec.m_nRevisionOffset = m_arena.Append (pdwRevisionNumbers, nRevisionCount * sizeof (DWORD), sizeof (DWORD));
+  rec.m_nRevisionCount = nRevisionCount;
+  rec.m_nTextOffset = m_arena.Append (pszText, cchText * sizeof (TCHAR), sizeof (TCHAR));
+  rec.m_nTextLength = cchText;
+
+  //  Optimize memory allocation
+  if (m_aRecords.capacity () == m_aRecords.size ())
+    {
+      if (m_aRecords.size () < 1025)
+        m_aRecords.reserve ((std::max) (m_aRecords.size () * 2, static_cast<size_t>(16)));
+      else
+        m_aRecords.reserve (m_aRecords.size () + 1024);
+    }
+  m_aRecords.push_back (rec);
+  m_nLastTextLength = cchText;
+}
+
+/**
+ * @brief Append text to the text of the last record.
+ * @return false if the text could not be added in place, the record is not changed then.
+ */
+bool UndoJournal::
+AppendText (LPCTSTR pszText, size_t cchText)
+{
+  if (m_aRecords.empty ())
+    return false;
+  UndoRecord & rec = m_aRecords.back ();
+  if (rec.m_nTextOffset + rec.m_nTextLength * sizeof (TCHAR) != m_arena.GetSize () ||
+      !m_arena.Extend (pszText, cchText * sizeof (TCHAR)))
+    return false;
+  rec.m_nTextLength += cchText;
+  m_nLastTextLength = cchText;
+  return true;
+}
+
+/**
+ * @brief Get text of a record.
+ * The pointer is valid until the next call to the journal, the text is not
+ * zero-terminated.
+ * @return Text, nullptr if it could not be read back from the temporary file.
+ */
+LPCTSTR UndoJournal::
+GetText (const UndoRecord & ur) const
+{
+  if (ur.m_nTextLength == 0)
+    return _T ("");
+  return static_cast<LPCTSTR>(m_arena.Get (ur.m_nTextOffset, ur.m_nTextLength * sizeof (TCHAR)));
+}
+
+/**
+ * @brief Get the text the last edit added to a record.
+ * For the last record this is the part appended by the last push_back() or
+ * AppendText(), for other records the whole text.
+ */
+LPCTSTR UndoJournal::
+GetLastText (size_t nIndex, size_t & cchText) const
+{
+  const UndoRecord & ur = m_aRecords[nIndex];
+  LPCTSTR pszText = GetText (ur);
+  cchText = ur.m_nTextLength;
+  if (pszText != nullptr && nIndex + 1 == m_aRecords.size () && m_nLastTextLength <= cchText)
+    {
+      pszText += cchText - m_nLastTextLength;
+      cchText = m_nLastTextLength;
+    }
+  return pszText;
+}
+
+/**
+ * @brief Get revision numbers saved with a record, GetRevisionCount() of them.
+ * The pointer is valid until the next call to the journal.
+ */
+const DWORD * UndoJournal::
+GetRevisionNumbers (const UndoRecord & ur) const
+{
+  return static_cast<const DWORD *>(m_arena.Get (ur.m_nRevisionOffset, ur.m_nRevisionCount * sizeof (DWORD)));
+}
+
+/**
+ * @brief Get bytes the journal takes in memory.
+ */
+size_t UndoJournal::
+GetMemoryUsage () const
+{
+  return m_aRecords.capacity () * sizeof (UndoRecord) + m_arena.GetMemoryUsage ();
+}
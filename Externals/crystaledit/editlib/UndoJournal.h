@@ -0,0 +1,104 @@
+/**
+ * @file UndoJournal.h
+ *
+ * @brief Declaration for UndoJournal class.
+ *
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include "UndoRecord.h"
+
+/**
+ * @brief Append-only storage for the texts and revision numbers of undo records.
+ *
+ * Data is appended to chunks and only ever removed from the end, in the
+ * same order the undo records are removed. When the chunks held in memory
+ * take more than the memory limit, the oldest ones are written to a
+ * temporary file and read back when their data is needed again.
+ */
+class UndoArena
+{
+public:
+  UndoArena ();
+  ~UndoArena ();
+
+  size_t Append (const void * pData, size_t nBytes, size_t nAlign);
+  bool Extend (const void * pData, size_t nBytes);
+  const void * Get (size_t nOffset, size_t nBytes) const;
+  void Truncate (size_t nSize);
+  void Clear ();
+  void SetMemoryLimit (size_t nBytes);
+  size_t GetSize () const { return m_nSize; }
+  size_t GetMemoryUsage () const { return m_nMemoryUsage; }
+
+private:
+  UndoArena (const UndoArena &) = delete;
+  UndoArena & operator= (const UndoArena &) = delete;
+
+  struct Chunk
+  {
+    std::unique_ptr<BYTE[]> pData; //  nullptr while the chunk is in the file only
+    size_t nBegin;            //  Arena offset of the first byte
+    size_t nSize;
+    size_t nCapacity;
+    __int64 nFileOffset;      //  Offset in the file, -1 if not written
+  };
+
+  size_t FindChunk (size_t nOffset) const;
+  bool LoadChunk (size_t nChunk) const;
+  bool WriteChunk (Chunk & chunk) const;
+  void SpillChunks (size_t nKeep) const;
+
+  //  Loading and spilling chunks doesn't change the data, so they are
+  //  allowed for const access too
+  mutable std::vector<Chunk> m_aChunks;
+  mutable size_t m_nMemoryUsage; //  Bytes allocated by chunks in memory
+  mutable FILE * m_pFile;
+  mutable __int64 m_nFileSize;
+  mutable bool m_bFileFailed;
+  size_t m_nMemoryLimit;    //  0 for no limit
+  size_t m_nSize;
+};
+
+/**
+ * @brief Undo records of a text buffer.
+ *
+ * Replaces a vector of self-contained records, each of which allocated its
+ * own text and revision number array. Here the records are small fixed size
+ * structures and their data goes to one UndoArena. Consecutive characters
+ * typed in one undo group are stored as one record by AppendText().
+ *
+ * Access to the records is vector-like, removing records is only possible
+ * from the end, as edits after undo do.
+ */
+class UndoJournal
+{
+public:
+  UndoJournal ();
+
+  size_t size () const { return m_aRecords.size (); }
+  const UndoRecord & operator[] (size_t nIndex) const { return m_aRecords[nIndex]; }
+  UndoRecord & operator[] (size_t nIndex) { return m_aRecords[nIndex]; }
+  const UndoRecord & back () const { return m_aRecords.back (); }
+  void clear ();
+  void resize (size_t nSize);
+  void push_back (const UndoRecord & ur, LPCTSTR pszText, size_t cchText,
+                  const DWORD * pdwRevisionNumbers, size_t nRevisionCount);
+  bool AppendText (LPCTSTR pszText, size_t cchText);
+
+  LPCTSTR GetText (const UndoRecord & ur) const;
+  LPCTSTR GetLastText (size_t nIndex, size_t & cchText) const;
+  const DWORD * GetRevisionNumbers (const UndoRecord & ur) const;
+
+  void SetMemoryLimit (size_t nBytes) { m_arena.SetMemoryLimit (nBytes); }
+  size_t GetMemoryUsage () const;
+
+private:
+  std::vector<UndoRecord> m_aRecords;
+  UndoArena m_arena;
+  size_t m_nLastTextLength; //  Characters added by the last push_back() or AppendText()
+};
@@ -9,85 +9,63 @@
 
 #pragma once
 
+#include <memory>
+#include <vector>
+#include "LineInfo.h"
+
+/**
+ * @brief Line array kept by an undo record replacing all lines at once.
+ * Undo and redo swap it with the lines of the buffer.
+ */
+struct SavedLines
+{
+  std::vector<LineInfo> m_aLines;
+
+  ~SavedLines ()
+  {
+    for (auto & li : m_aLines)
+      li.FreeBuffer ();
+  }
+};
+
+/**
+ * @brief One edit action in the undo journal.
+ * The text and saved revision numbers of the action are kept in the arena
+ * of the UndoJournal owning the record, so records are cheap to copy.
+ */
 class UndoRecord
 {
 public:
   DWORD m_dwFlags;
   CPoint m_ptStartPos, m_ptEndPos;  //  Block of text participating
   int m_nAction;            //  For information only: action type
-  CDWordArray *m_paSavedRevisionNumbers;
+  std::shared_ptr<SavedLines> m_pSavedLines; //  Lines swapped in by undo/redo, if any
 
 private:
-  //  TCHAR   *m_pcText;
-  //  Since in most cases we have 1 character here,
-  //  we should invent a better way. Note: 2 * sizeof(WORD) <= sizeof(TCHAR*)
-  //
-  //  Here we will use the following trick: on Win32 platforms high-order word
-  //  of any pointer will be != 0. So we can store 1 character strings without
-  //  allocating memory.
-  //
-  struct TextBuffer
-  {
-    size_t size;
-    TCHAR data[1];
-  };
+  friend class UndoJournal;
+  size_t m_nTextOffset;     //  Arena offset of the text
+  size_t m_nTextLength;     //  Text length in characters
+  size_t m_nRevisionOffset; //  Arena offset of the saved revision numbers
+  size_t m_nRevisionCount;
 
-  union
-  {
-    TextBuffer *m_pszText;     //  For cases when we have > 1 character strings
-    TCHAR m_szText[2];    //  For single-character strings
-  };
-
-  public:
-  UndoRecord () // default constructor
-    : m_dwFlags(0)
-    , m_nAction(0)
-    , m_paSavedRevisionNumbers(nullptr)
-    , m_pszText(nullptr)
-  {
-  }
-
-  UndoRecord (const UndoRecord & src) // copy constructor
+public:
+  UndoRecord ()
     : m_dwFlags(0)
     , m_nAction(0)
-    , m_paSavedRevisionNumbers(nullptr)
-    , m_pszText(nullptr)
-  {
-    UndoRecord::Clone(src);
-  }
-
-  virtual void Clone(const UndoRecord &src);
-
-  virtual UndoRecord & operator=(const UndoRecord & src) // copy assignment
+    , m_nTextOffset(0)
+    , m_nTextLength(0)
+    , m_nRevisionOffset(0)
+    , m_nRevisionCount(0)
   {
-    Clone(src);
-    return *this;
   }
 
-  virtual ~UndoRecord () // destructor
-  {
-    FreeText();
-    delete m_paSavedRevisionNumbers;
-  }
-
-  void SetText (LPCTSTR pszText, size_t cchText);
-  void FreeText ();
-
-  LPCTSTR GetText () const
+  size_t GetTextLength () const
   {
-    // See the m_szText/m_pszText definition
-    // Check if m_pszText is a pointer by removing bits having
-    // possible char value
-    if (((INT_PTR)m_pszText >> 16) != 0)
-      return m_pszText->data;
-    return m_szText;
+    return m_nTextLength;
   }
 
-  size_t GetTextLength () const
+  size_t GetRevisionCount () const
   {
-    if (((INT_PTR)m_pszText >> 16) != 0)
-      return m_pszText->size;
-    return 1;
+    return m_nRevisionCount;
   }
 };
-
@@ -62,10 +62,11 @@
 
 #include "StdAfx.h"
 #include <vector>
+#include <algorithm>
 #include <malloc.h>
 #include "editcmd.h"
 #include "LineInfo.h"
-#include "UndoRecord.h"
+#include "UndoJournal.h"
 #include "ccrystaltextbuffer.h"
 #include "ccrystaltextview.h"
 #include "utils/filesup.h"
@@ -133,6 +134,16 @@ RecalcPoint (CPoint & ptPoint)
   ptPoint = m_ptStart;
 }
 
+void CCrystalTextBuffer::CReplaceLinesContext::
+RecalcPoint (CPoint & ptPoint)
+{
+  ASSERT (m_nFirstChangedLine < m_nLineCount);
+  if (ptPoint.y < m_nFirstChangedLine)
+    return;
+  ptPoint.x = 0;
+  ptPoint.y = m_nFirstChangedLine;
+}
+
 
 /////////////////////////////////////////////////////////////////////////////
 // CCrystalTextBuffer
@@ -1346,15 +1357,11 @@ GetUndoActionCode (int & nAction, POSITION pos /*= nullptr*/ ) const
 
   //  Advance to next undo group
   nPosition--;
-  std::vector<UndoRecord>::const_iterator iter = m_aUndoBuf.begin () + nPosition;
-  while (((*iter).m_dwFlags & UNDO_BEGINGROUP) == 0)
-    {
-      --iter;
-      --nPosition;
-    }
+  while ((m_aUndoBuf[nPosition].m_dwFlags & UNDO_BEGINGROUP) == 0)
+    --nPosition;
 
   //  Get description
-  nAction = (*iter).m_nAction;
+  nAction = m_aUndoBuf[nPosition].m_nAction;
 
   //  Now, if we stop at zero position, this will be the last action,
   //  since we return (POSITION) nPosition
@@ -1387,15 +1394,8 @@ GetRedoActionCode (int & nAction, POSITION pos /*= nullptr*/ ) const
 
   //  Advance to next undo group
   nPosition++;
-  if (nPosition < static_cast<intptr_t>(m_aUndoBuf.size ()))
-    {
-      std::vector<UndoRecord>::const_iterator iter = m_aUndoBuf.begin () + nPosition;
-      while (iter != m_aUndoBuf.end () && ((*iter).m_dwFlags & UNDO_BEGINGROUP) == 0)
-        {
-          ++iter;
-          ++nPosition;
-        }
-    }
+  while (nPosition < static_cast<intptr_t>(m_aUndoBuf.size ()) && (m_aUndoBuf[nPosition].m_dwFlags & UNDO_BEGINGROUP) == 0)
+    ++nPosition;
   if (nPosition >= static_cast<intptr_t>(m_aUndoBuf.size ()))
     return nullptr;                //  No more redo actions!
 
@@ -1458,7 +1458,12 @@ Undo (CCrystalTextView * pSource, CPoint & ptCursorPos)
       CPoint apparent_ptStartPos = ur.m_ptStartPos;
       CPoint apparent_ptEndPos = ur.m_ptEndPos;
 
-      if (ur.m_dwFlags & UNDO_INSERT)
+      if (ur.m_dwFlags & UNDO_LINES)
+        {
+          InternalSwapLines (pSource, ur.m_pSavedLines->m_aLines, apparent_ptStartPos.y);
+          ptCursorPos = m_ptLastChange;
+        }
+      else if (ur.m_dwFlags & UNDO_INSERT)
         {
           if (!UndoInsert(pSource, ptCursorPos, apparent_ptStartPos, apparent_ptEndPos, ur))
             {
@@ -1470,7 +1475,8 @@ Undo (CCrystalTextView * pSource, CPoint & ptCursorPos)
       else
         {
           int nEndLine, nEndChar;
-          if (!InsertText(pSource, apparent_ptStartPos.y, apparent_ptStartPos.x, ur.GetText(), ur.GetTextLength(), nEndLine, nEndChar, 0, false))
+          LPCTSTR pszText = GetUndoText (ur);
+          if (pszText == nullptr || !InsertText(pSource, apparent_ptStartPos.y, apparent_ptStartPos.x, pszText, ur.GetTextLength(), nEndLine, nEndChar, 0, false))
             {
               ASSERT(false);
               failed = true;
@@ -1480,7 +1486,9 @@ Undo (CCrystalTextView * pSource, CPoint & ptCursorPos)
         }
 
       // restore line revision numbers
-      RestoreRevisionNumbers(ur.m_ptStartPos.y, ur.m_paSavedRevisionNumbers);
+      const DWORD *pdwSavedRevisionNumbers = m_aUndoBuf.GetRevisionNumbers (ur);
+      if (pdwSavedRevisionNumbers != nullptr)
+        RestoreRevisionNumbers(ur.m_ptStartPos.y, pdwSavedRevisionNumbers, ur.GetRevisionCount ());
 
       if (ur.m_dwFlags & UNDO_BEGINGROUP)
         break;
@@ -1511,6 +1519,24 @@ Redo (CCrystalTextView * pSource, CPoint & ptCursorPos)
   ASSERT ((m_aUndoBuf[0].m_dwFlags & UNDO_BEGINGROUP) != 0);
   ASSERT ((m_aUndoBuf[m_nUndoPosition].m_dwFlags & UNDO_BEGINGROUP) != 0);
 
+  //  A group is redone completely or not at all. Check first that the
+  //  texts of the group can be read back, so that nothing is changed if
+  //  the temporary file of the undo journal fails.
+  const int nGroupStart = m_nUndoPosition;
+  int nGroupEnd = nGroupStart;
+  do
+    {
+      const UndoRecord & ur = m_aUndoBuf[nGroupEnd];
+      if ((ur.m_dwFlags & (UNDO_INSERT | UNDO_LINES)) == UNDO_INSERT && GetUndoText (ur) == nullptr)
+        {
+          m_aUndoBuf.resize (nGroupStart);
+          return false;
+        }
+      ++nGroupEnd;
+    }
+  while (static_cast<size_t>(nGroupEnd) < m_aUndoBuf.size () &&
+         (m_aUndoBuf[nGroupEnd].m_dwFlags & UNDO_BEGINGROUP) == 0);
+
   for (;;)
     {
       const UndoRecord ur = GetUndoRecord(m_nUndoPosition);
@@ -1518,11 +1544,28 @@ Redo (CCrystalTextView * pSource, CPoint & ptCursorPos)
       CPoint apparent_ptEndPos = ur.m_ptEndPos;
 
       // now we can use normal insertTxt or deleteText
-      if (ur.m_dwFlags & UNDO_INSERT)
+      if (ur.m_dwFlags & UNDO_LINES)
+        {
+          InternalSwapLines (pSource, ur.m_pSavedLines->m_aLines, apparent_ptStartPos.y);
+          ptCursorPos = m_ptLastChange;
+        }
+      else if (ur.m_dwFlags & UNDO_INSERT)
         {
           int nEndLine, nEndChar;
+          LPCTSTR pszText = GetUndoText (ur);
+          if (pszText == nullptr)
+            {
+              //  The text could not be read back after all. Take back the
+              //  part of the group already redone, then drop the group and
+              //  the records after it. If that undo fails too, Undo() has
+              //  cleared the whole stack.
+              if (m_nUndoPosition > nGroupStart && !Undo (pSource, ptCursorPos))
+                return false;
+              m_aUndoBuf.resize (nGroupStart);
+              return false;
+            }
           VERIFY(InsertText (pSource, apparent_ptStartPos.y, apparent_ptStartPos.x,
-            ur.GetText(), ur.GetTextLength(), nEndLine, nEndChar, 0, false));
+            pszText, ur.GetTextLength(), nEndLine, nEndChar, 0, false));
           ptCursorPos = m_ptLastChange;
         }
       else
@@ -1532,7 +1575,8 @@ Redo (CCrystalTextView * pSource, CPoint & ptCursorPos)
 #ifdef _DEBUG
               CString text;
               GetTextWithoutEmptys (apparent_ptStartPos.y, apparent_ptStartPos.x, apparent_ptEndPos.y, apparent_ptEndPos.x, text, CRLFSTYLE::AUTOMATIC, false);
-              ASSERT (static_cast<size_t>(text.GetLength()) == ur.GetTextLength() && memcmp(text, ur.GetText(), text.GetLength() * sizeof(TCHAR)) == 0);
+              LPCTSTR pszText = GetUndoText (ur);
+              ASSERT (static_cast<size_t>(text.GetLength()) == ur.GetTextLength() && (pszText == nullptr || memcmp(text, pszText, text.GetLength() * sizeof(TCHAR)) == 0));
 #endif
               VERIFY(DeleteText(pSource, apparent_ptStartPos.y, apparent_ptStartPos.x, 
                 apparent_ptEndPos.y, apparent_ptEndPos.x, 0, false, false));
@@ -1571,6 +1615,26 @@ AddUndoRecord (bool bInsert, const CPoint & ptStartPos,
       m_aUndoBuf.resize (m_nUndoPosition);
     }
 
+  //  Characters typed one after another on the same line within one undo
+  //  group extend the previous record instead of adding one per character.
+  //  Its saved revision number is the one from before the first character.
+  //  A record the saved state points at is not extended.
+  if (bInsert && !m_bUndoBeginGroup && nActionType == CE_ACTION_TYPING &&
+      m_nUndoPosition > 0 && m_nSyncPosition != m_nUndoPosition && ptStartPos.y == ptEndPos.y &&
+      std::find_if (pszText, pszText + cchText, LineInfo::IsEol) == pszText + cchText)
+    {
+      const UndoRecord & prev = m_aUndoBuf.back ();
+      if ((prev.m_dwFlags & (UNDO_INSERT | UNDO_LINES)) == UNDO_INSERT &&
+          prev.m_nAction == CE_ACTION_TYPING && prev.m_ptEndPos == ptStartPos &&
+          prev.m_ptStartPos.y == prev.m_ptEndPos.y &&
+          m_aUndoBuf.AppendText (pszText, cchText))
+        {
+          m_aUndoBuf[m_nUndoPosition - 1].m_ptEndPos = ptEndPos;
+          delete paSavedRevisionNumbers;
+          return;
+        }
+    }
+
   //  Add new record
   UndoRecord ur;
   ur.m_dwFlags = bInsert ? UNDO_INSERT : 0;
@@ -1582,20 +1646,13 @@ AddUndoRecord (bool bInsert, const CPoint & ptStartPos,
     }
   ur.m_ptStartPos = ptStartPos;
   ur.m_ptEndPos = ptEndPos;
-  ur.SetText (pszText, cchText);
-  ur.m_paSavedRevisionNumbers = paSavedRevisionNumbers;
-
-  // Optimize memory allocation
-  if (m_aUndoBuf.capacity() == m_aUndoBuf.size())
+  if (paSavedRevisionNumbers != nullptr)
     {
-      if (m_aUndoBuf.size() == 0)
-        m_aUndoBuf.reserve(16);
-      else if (m_aUndoBuf.size() < 1025)
-        m_aUndoBuf.reserve(m_aUndoBuf.size() * 2);
-      else
-        m_aUndoBuf.reserve(m_aUndoBuf.size() + 1024);
+      m_aUndoBuf.push_back (ur, pszText, cchText, paSavedRevisionNumbers->GetData (), paSavedRevisionNumbers->GetSize ());
+      delete paSavedRevisionNumbers;
     }
-  m_aUndoBuf.push_back (ur);
+  else
+    m_aUndoBuf.push_back (ur, pszText, cchText, nullptr, 0);
   m_nUndoPosition = (int) m_aUndoBuf.size ();
 }
 
@@ -1763,10 +1820,10 @@ CopyRevisionNumbers(int nStartLine, int nEndLine) const
 }
 
 void CCrystalTextBuffer::
-RestoreRevisionNumbers(int nStartLine, CDWordArray *paSavedRevisionNumbers)
+RestoreRevisionNumbers(int nStartLine, const DWORD *pdwSavedRevisionNumbers, size_t nCount)
 {
-  for (int i = 0; i < paSavedRevisionNumbers->GetSize(); i++)
-    m_aLines[nStartLine + i].m_dwRevisionNumber = (*paSavedRevisionNumbers)[i];
+  for (size_t i = 0; i < nCount; i++)
+    m_aLines[nStartLine + i].m_dwRevisionNumber = pdwSavedRevisionNumbers[i];
 }
 
 bool CCrystalTextBuffer::			/* virtual base */
@@ -1801,6 +1858,89 @@ DeleteText2 (CCrystalTextView * pSource, int nStartLine, int nStartChar,
   return true;
 }
 
+/**
+ * @brief Replace all lines of the buffer at once.
+ * Editing many blocks one by one shifts the rest of the line array and
+ * adds an undo record with a copy of the text for every block. This
+ * replaces the whole line array in one step instead, and its only undo
+ * record keeps the previous line array, so that undo and redo just swap
+ * the arrays again.
+ * @param [in] pSource A view from which the lines are replaced.
+ * @param [in] aLines New lines, the buffer takes them over (also on failure).
+ *   Their flags and revision numbers are kept as they are.
+ * @param [in] nFirstChangedLine First line differing from current lines.
+ * @param [in] nAction Edit action.
+ * @param [in] bHistory Save replacement for undo/redo?
+ * @return true if the replacement succeeded, false otherwise.
+ * @note Line numbers are apparent (screen) line numbers, not real
+ * line numbers in the file.
+ */
+bool CCrystalTextBuffer::
+ReplaceAllLines (CCrystalTextView * pSource, std::vector<LineInfo> && aLines,
+    int nFirstChangedLine, int nAction /*= CE_ACTION_UNKNOWN*/, bool bHistory /*= true*/)
+{
+  ASSERT (m_bInit);             //  Text buffer not yet initialized.
+  //  You must call InitNew() or LoadFromFile() first!
+
+  std::shared_ptr<SavedLines> pSavedLines (new SavedLines);
+  pSavedLines->m_aLines = std::move (aLines);
+  if (m_bReadOnly || pSavedLines->m_aLines.empty ())
+    return false;
+
+  nFirstChangedLine = (std::min) (nFirstChangedLine, (std::min) (GetLineCount (),
+      static_cast<int>(pSavedLines->m_aLines.size ())) - 1);
+
+  bool bGroupFlag = false;
+  if (bHistory)
+    {
+      if (!m_bUndoGroup)
+        {
+          BeginUndoGroup ();
+          bGroupFlag = true;
+        }
+      // The record is added while its position refers to the current lines
+      AddUndoRecord (false, CPoint (0, nFirstChangedLine), CPoint (0, nFirstChangedLine),
+                     _T (""), 0, nAction, new CDWordArray);
+      UndoRecord & ur = m_aUndoBuf[m_nUndoPosition - 1];
+      ur.m_dwFlags |= UNDO_LINES;
+      ur.m_pSavedLines = pSavedLines;
+    }
+
+  InternalSwapLines (pSource, pSavedLines->m_aLines, nFirstChangedLine);
+
+  if (bGroupFlag)
+    FlushUndoGroup (pSource);
+
+  return true;
+}
+
+/**
+ * @brief Swap line array of the buffer and notify the views once.
+ * @param [in] nFirstChangedLine Points of the views after this line are
+ *   moved to its beginning.
+ */
+void CCrystalTextBuffer::
+InternalSwapLines (CCrystalTextView * pSource, std::vector<LineInfo> & aLines, int nFirstChangedLine)
+{
+  SwapLines (aLines);
+
+  CReplaceLinesContext context;
+  context.m_nLineCount = GetLineCount ();
+  context.m_nFirstChangedLine = (std::min) (nFirstChangedLine, context.m_nLineCount - 1);
+  UpdateViews (pSource, &context, UPDATE_HORZRANGE | UPDATE_VERTRANGE, context.m_nFirstChangedLine);
+
+  if (!m_bModified)
+    SetModified (true);
+  // remember current cursor position as last editing position
+  m_ptLastChange = CPoint (0, context.m_nFirstChangedLine);
+}
+
+void CCrystalTextBuffer::			/* virtual base */
+SwapLines (std::vector<LineInfo> & aLines)
+{
+  m_aLines.swap (aLines);
+}
+
 bool CCrystalTextBuffer::
 GetActionDescription (int nAction, CString & desc) const
 {
@@ -1901,7 +2041,11 @@ FlushUndoGroup (CCrystalTextView * pSource)
       ASSERT (static_cast<size_t>(m_nUndoPosition) <= m_aUndoBuf.size());
       if (m_nUndoPosition > 0)
         {
-          pSource->OnEditOperation (m_aUndoBuf[m_nUndoPosition - 1].m_nAction, m_aUndoBuf[m_nUndoPosition - 1].GetText (), m_aUndoBuf[m_nUndoPosition - 1].GetTextLength ());
+          //  Consecutive typing shares one record, pass only what was typed last
+          size_t cchText;
+          LPCTSTR pszText = m_aUndoBuf.GetLastText (m_nUndoPosition - 1, cchText);
+          if (pszText != nullptr)
+            pSource->OnEditOperation (m_aUndoBuf[m_nUndoPosition - 1].m_nAction, pszText, cchText);
         }
     }
   m_bUndoGroup = false;
@@ -2019,55 +2163,92 @@ void CCrystalTextBuffer::SetColumnWidth (int nColumnIndex, int nColumnWidth)
   m_pSharedTableProps->m_aColumnWidths[nColumnIndex] = nColumnWidth;
 }
 
+/**
+ * @brief Return count of field delimiters outside quotes in a line.
+ * The count is cached in the line until the line changes, as paint and
+ * cursor code asks for it again and again.
+ */
 int CCrystalTextBuffer::GetColumnCount (int nLineIndex) const
 {
   ASSERT( nLineIndex >= 0 );
-  int nColumnCount = 0;
-  const TCHAR* pszLine = GetLineChars (nLineIndex);
-  int nLength = GetLineLength (nLineIndex);
+  const LineInfo& li = m_aLines[nLineIndex];
+  int nColumnCount = li.GetColumnCountCache ();
+  if (nColumnCount >= 0)
+    return nColumnCount;
+  nColumnCount = 0;
+  const TCHAR* pszLine = li.GetLine ();
+  const size_t nLength = li.Length ();
   bool bInQuote = false;
-  for (int j = 0; j < nLength; ++j)
+  for (size_t j = 0; j < nLength; ++j)
     {
       if (pszLine[j] == m_cFieldEnclosure)
         bInQuote = !bInQuote;
       else if (!bInQuote && pszLine[j] == m_cFieldDelimiter)
         ++nColumnCount;
     }
+  li.SetColumnCountCache (nColumnCount);
   return nColumnCount;
 }
 
+/**
+ * @brief Forget cached column counts, after delimiter or enclosure changed.
+ */
+void CCrystalTextBuffer::InvalidateColumnCounts ()
+{
+  for (const auto& li : m_aLines)
+    li.SetColumnCountCache (-1);
+}
+
+/**
+ * @brief Join lines of records having newlines in quoted fields.
+ * The records are built in one pass into a new line array, instead of
+ * erasing the continuation lines one by one from the middle of the array.
+ */
 void CCrystalTextBuffer::JoinLinesForTableEditingMode ()
 {
   if (!m_bAllowNewlinesInQuotes)
       return;
-  size_t nLineCount = m_aLines.size ();
-  size_t j = 0;
-  bool bInQuote = false;
+  const size_t nLineCount = m_aLines.size ();
+  std::vector<LineInfo> aRecords;
+  aRecords.reserve (nLineCount);
+  std::basic_string<TCHAR> record;
   for (size_t i = 0; i < nLineCount;)
     {
-      const TCHAR* pszChars = m_aLines[i].GetLine ();
-      const size_t nLineLength = m_aLines[i].FullLength ();
-      for (; j < nLineLength; ++j)
+      // Find the last line of the record
+      size_t nLast = i;
+      bool bInQuote = false;
+      for (;;)
         {
-          if (pszChars[j] == m_cFieldEnclosure)
-            bInQuote = !bInQuote;
+          const TCHAR* pszChars = m_aLines[nLast].GetLine ();
+          const size_t nLineLength = m_aLines[nLast].FullLength ();
+          for (size_t j = 0; j < nLineLength; ++j)
+            {
+              if (pszChars[j] == m_cFieldEnclosure)
+                bInQuote = !bInQuote;
+            }
+          if (!bInQuote || nLast == nLineCount - 1)
+            break;
+          ++nLast;
         }
-      m_aLines[i].m_dwRevisionNumber = 0;
-      if (bInQuote && i < nLineCount - 1)
+      if (nLast == i)
+        aRecords.push_back (m_aLines[i]);
+      else
         {
-          std::basic_string<TCHAR> line(m_aLines[i].GetLine (), m_aLines[i].FullLength ());
-          line.append (m_aLines[i + 1].GetLine (), m_aLines[i + 1].FullLength ());
-          m_aLines[i].FreeBuffer ();
-          m_aLines[i].Create (line.c_str (), line.size ());
-          m_aLines[i + 1].FreeBuffer ();
-          m_aLines.erase (m_aLines.begin () + i + 1);
-          --nLineCount;
-          continue;
+          record.clear ();
+          for (size_t k = i; k <= nLast; ++k)
+            {
+              record.append (m_aLines[k].GetLine (), m_aLines[k].FullLength ());
+              m_aLines[k].FreeBuffer ();
+            }
+          LineInfo li;
+          li.Create (record.c_str (), record.size ());
+          li.m_dwFlags = m_aLines[i].m_dwFlags;
+          aRecords.push_back (li);
         }
-      ++i;
-      j = 0;
-      bInQuote = false;
+      aRecords.back ().m_dwRevisionNumber = 0;
+      i = nLast + 1;
     }
+  m_aLines.swap (aRecords);
   m_aUndoBuf.clear();
   m_nUndoPosition = 0;
   m_bModified = false;
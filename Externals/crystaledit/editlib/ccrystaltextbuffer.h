@@ -33,7 +33,7 @@
 
 #include <vector>
 #include "LineInfo.h"
-#include "UndoRecord.h"
+#include "UndoJournal.h"
 #include "ccrystaltextview.h"
 
 #ifndef __AFXTEMPL_H__
@@ -129,6 +129,7 @@ protected :
     enum : unsigned
     {
       UNDO_INSERT = 0x0001U,
+      UNDO_LINES = 0x0002U,
       UNDO_BEGINGROUP = 0x0100U
     };
 
@@ -146,11 +147,18 @@ public :
         virtual void RecalcPoint (CPoint & ptPoint);
       };
 
+class EDITPADC_CLASS CReplaceLinesContext : public CUpdateContext
+      {
+public :
+        int m_nFirstChangedLine, m_nLineCount;
+        virtual void RecalcPoint (CPoint & ptPoint);
+      };
+
     //  Lines of text
     std::vector<LineInfo> m_aLines; /**< Text lines. */
 
     //  Undo
-    std::vector<UndoRecord> m_aUndoBuf; /**< Undo records. */
+    UndoJournal m_aUndoBuf; /**< Undo records. */
     int m_nUndoPosition;
     int m_nSyncPosition;
     bool m_bUndoGroup, m_bUndoBeginGroup;
@@ -184,15 +192,18 @@ public :
     //  Implementation
     bool InternalInsertText (CCrystalTextView * pSource, int nLine, int nPos, LPCTSTR pszText, size_t cchText, int &nEndLine, int &nEndChar);
     bool InternalDeleteText (CCrystalTextView * pSource, int nStartLine, int nStartPos, int nEndLine, int nEndPos);
+    void InternalSwapLines (CCrystalTextView * pSource, std::vector<LineInfo> & aLines, int nFirstChangedLine);
+    virtual void SwapLines (std::vector<LineInfo> & aLines);
     CString StripTail (int i, size_t bytes);
 
     //  [JRT] Support For Descriptions On Undo/Redo Actions
     virtual void AddUndoRecord (bool bInsert, const CPoint & ptStartPos, const CPoint & ptEndPos,
                                 LPCTSTR pszText, size_t cchText, int nActionType = CE_ACTION_UNKNOWN, CDWordArray *paSavedRevisionNumbers = nullptr);
     virtual UndoRecord GetUndoRecord (int nUndoPos) const { return m_aUndoBuf[nUndoPos]; }
+    LPCTSTR GetUndoText (const UndoRecord & ur) const { return m_aUndoBuf.GetText (ur); }
 
     virtual CDWordArray *CopyRevisionNumbers(int nStartLine, int nEndLine) const;
-    virtual void RestoreRevisionNumbers(int nStartLine, CDWordArray *psaSavedRevisionNumbers);
+    virtual void RestoreRevisionNumbers(int nStartLine, const DWORD *pdwSavedRevisionNumbers, size_t nCount);
 
     //  Overridable: provide action description
     virtual bool GetActionDescription (int nAction, CString & desc) const;
@@ -262,6 +273,7 @@ public :
     virtual bool InsertText (CCrystalTextView * pSource, int nLine, int nPos, LPCTSTR pszText, size_t cchText, int &nEndLine, int &nEndChar, int nAction = CE_ACTION_UNKNOWN, bool bHistory = true);
     virtual bool DeleteText (CCrystalTextView * pSource, int nStartLine, int nStartPos, int nEndLine, int nEndPos, int nAction = CE_ACTION_UNKNOWN, bool bHistory = true, bool bExcludeInvisibleLines = true);
     virtual bool DeleteText2 (CCrystalTextView * pSource, int nStartLine, int nStartPos, int nEndLine, int nEndPos, int nAction = CE_ACTION_UNKNOWN, bool bHistory = true);
+    bool ReplaceAllLines (CCrystalTextView * pSource, std::vector<LineInfo> && aLines, int nFirstChangedLine, int nAction = CE_ACTION_UNKNOWN, bool bHistory = true);
 
     //  Undo/Redo
     bool CanUndo () const;
@@ -269,6 +281,7 @@ public :
     virtual bool Undo (CCrystalTextView * pSource, CPoint & ptCursorPos);
     virtual bool UndoInsert (CCrystalTextView * pSource, CPoint & ptCursorPos, const CPoint apparent_ptStartPos, CPoint const apparent_ptEndPos, const UndoRecord & ur);
     virtual bool Redo (CCrystalTextView * pSource, CPoint & ptCursorPos);
+    void SetUndoMemoryLimit (size_t nBytes) { m_aUndoBuf.SetMemoryLimit (nBytes); }
 
     //  Undo grouping
     virtual void BeginUndoGroup (bool bMergeWithPrevious = false);
@@ -317,15 +330,26 @@ public :
     int  GetColumnCount (int nLineIndex) const;
     void SetAllowNewlinesInQuotes (bool bAllowNewlinesInQuotes) { m_bAllowNewlinesInQuotes = bAllowNewlinesInQuotes; }
     TCHAR GetAllowNewlinesInQuotes () const { return m_bAllowNewlinesInQuotes; }
-    void SetFieldDelimiter (TCHAR cFieldDelimiter) { m_cFieldDelimiter = cFieldDelimiter; }
+    void SetFieldDelimiter (TCHAR cFieldDelimiter)
+    {
+      if (m_cFieldDelimiter != cFieldDelimiter)
+        InvalidateColumnCounts ();
+      m_cFieldDelimiter = cFieldDelimiter;
+    }
     TCHAR GetFieldDelimiter () const { return m_cFieldDelimiter; }
-    void SetFieldEnclosure (TCHAR cFieldEnclosure) { m_cFieldEnclosure = cFieldEnclosure; }
+    void SetFieldEnclosure (TCHAR cFieldEnclosure)
+    {
+      if (m_cFieldEnclosure != cFieldEnclosure)
+        InvalidateColumnCounts ();
+      m_cFieldEnclosure = cFieldEnclosure;
+    }
     TCHAR GetFieldEnclosure () const { return m_cFieldEnclosure; }
     bool GetTableEditing () const { return m_bTableEditing; }
     void SetTableEditing (bool bTableEditing) { m_bTableEditing = bTableEditing; }
     void JoinLinesForTableEditingMode ();
     void SplitLinesForTableEditingMode ();
     void InvalidateColumns ();
+    void InvalidateColumnCounts ();
     std::vector<CCrystalTextBuffer*> GetTextBufferList () const { return m_pSharedTableProps->m_textBufferList; }
 
     // More bookmarks
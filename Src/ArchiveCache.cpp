@@ -0,0 +1,389 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  ArchiveCache.cpp
+ *
+ * @brief Implementation of ArchiveCache class
+ */
+
+#include "pch.h"
+#include "ArchiveCache.h"
+#include <algorithm>
+#include <Poco/FileStream.h>
+#include <Poco/StreamCopier.h>
+#include <Poco/Exception.h>
+#include "ArchiveReader.h"
+#include "Environment.h"
+#include "TFile.h"
+#include "paths.h"
+#include "unicoder.h"
+#include "DebugNew.h"
+
+/**
+ * @brief Extensions of archives opened when found inside archives.
+ * Other entries are not tried, as testing a compressed entry needs
+ * inflating it.
+ */
+static const TCHAR *const NestedArchiveExtensions[] =
+{
+	_T(".zip"), _T(".jar"), _T(".war"), _T(".ear"), _T(".apk"), _T(".aar"),
+	_T(".nupkg"), _T(".vsix"), _T(".whl"), _T(".tar"),
+};
+
+/**
+ * @brief Most memory all nested archives inflated to memory may take.
+ * Readers are kept until the compare ends, so further compressed nested
+ * archives are compared as files.
+ */
+static const uint64_t MaxNestedMemory = 512 * 1024 * 1024;
+
+static bool IsNestedArchiveName(const String& name)
+{
+	const String ext = strutils::makelower(paths::FindExtension(name));
+	return std::any_of(std::begin(NestedArchiveExtensions), std::end(NestedArchiveExtensions),
+		[&ext](const TCHAR *archiveExt) { return ext == archiveExt; });
+}
+
+static String StripTrailingSlash(const String& path)
+{
+	return paths::EndsWithSlash(path) ? path.substr(0, path.length() - 1) : path;
+}
+
+ArchiveCache::ArchiveCache()
+: m_nNestedMemory(0)
+, m_nTempFiles(0)
+{
+}
+
+ArchiveCache::~ArchiveCache()
+{
+	if (!m_sTempDir.empty())
+	{
+		try
+		{
+			TFile(m_sTempDir).remove(true);
+		}
+		catch (...)
+		{
+		}
+	}
+}
+
+/**
+ * @brief Is file a zip or tar archive this class can walk into?
+ */
+bool ArchiveCache::IsArchive(const String& path)
+{
+	return ArchiveReader::OpenFile(ucr::toUTF8(path)) != nullptr;
+}
+
+/**
+ * @brief Open archive given as compared folder.
+ * @return false if the file is not a supported archive.
+ */
+bool ArchiveCache::AddRoot(const String& path)
+{
+	std::unique_ptr<ArchiveReader> reader = ArchiveReader::OpenFile(ucr::toUTF8(path));
+	if (reader == nullptr)
+		return false;
+	Poco::FastMutex::ScopedLock lock(m_mutex);
+	m_readers[StripTrailingSlash(path)] = std::move(reader);
+	return true;
+}
+
+/**
+ * @brief Find innermost opened archive containing a path.
+ * @param [out] name Normalized name of the path in the archive, empty
+ * for the root of the archive.
+ * @return Reader of the archive, or nullptr if path is not in an archive.
+ */
+ArchiveReader *ArchiveCache::Resolve(const String& path, std::string& name)
+{
+	const String fullPath = StripTrailingSlash(path);
+	Poco::FastMutex::ScopedLock lock(m_mutex);
+	if (m_readers.empty())
+		return nullptr;
+	String prefix = fullPath;
+	while (true)
+	{
+		auto it = m_readers.find(prefix);
+		if (it != m_readers.end())
+		{
+			name = prefix.length() < fullPath.length() ?
+				ArchiveReader::NormalizeName(ucr::toUTF8(fullPath.substr(prefix.length() + 1))) : std::string();
+			return it->second.get();
+		}
+		const size_t pos = prefix.find_last_of(_T("\\/"));
+		if (pos == String::npos)
+			return nullptr;
+		prefix.erase(pos);
+	}
+}
+
+/**
+ * @brief Is path inside an opened archive?
+ * The archive files themselves are not inside an archive, unless nested.
+ */
+bool ArchiveCache::IsInArchive(const String& path)
+{
+	std::string name;
+	if (Resolve(path, name) == nullptr)
+		return false;
+	if (!name.empty())
+		return true;
+	return Resolve(paths::GetParentPath(StripTrailingSlash(path)), name) != nullptr;
+}
+
+/**
+ * @brief Close all opened archives, before walking them again.
+ * Files already extracted are kept.
+ */
+void ArchiveCache::Clear()
+{
+	Poco::FastMutex::ScopedLock lock(m_mutex);
+	m_readers.clear();
+	m_nNestedMemory = 0;
+}
+
+/**
+ * @brief Load arrays with folders & files in a folder of an archive.
+ * Items are like those LoadAndSortFiles() loads from disk. Archives
+ * inside the archive are loaded as files, see OpenNestedArchives().
+ * @return false if sDir is not in an opened archive, arrays are not
+ * changed then.
+ */
+bool ArchiveCache::LoadAndSortFiles(const String& sDir, DirItemArray * dirs, DirItemArray * files, bool casesensitive)
+{
+	std::string folder;
+	ArchiveReader *reader = Resolve(sDir, folder);
+	if (reader == nullptr)
+		return false;
+
+	InternedString dir(sDir);
+	for (const ArchiveEntry *entry : reader->ListFolder(folder))
+	{
+		const size_t sep = entry->name.rfind('/');
+		const String leaf = ucr::toTString(sep == std::string::npos ? entry->name : entry->name.substr(sep + 1));
+		const bool bIsDirectory = entry->directory;
+
+		CollatedDirItem ent;
+		ent.mtime = Poco::Timestamp::fromEpochTime(static_cast<std::time_t>((std::max)(entry->mtime, static_cast<int64_t>(0))));
+		ent.ctime = ent.mtime;
+		ent.size = bIsDirectory ? DirItem::FILE_SIZE_NONE : entry->size;
+		ent.path = dir;
+		ent.filename = leaf;
+		ent.flags.attributes = FILE_ATTRIBUTE_READONLY | (bIsDirectory ? FILE_ATTRIBUTE_DIRECTORY : 0);
+		(bIsDirectory ? dirs : files)->push_back(ent);
+	}
+	SortFiles(dirs, casesensitive);
+	SortFiles(files, casesensitive);
+	return true;
+}
+
+/**
+ * @brief Open archives inside archives and move them from files to folders.
+ * A nested archive is opened only when all sides have a file of that name
+ * in an archive, so entries on one side only are never inflated. Entries
+ * with the same size and CRC-32 on all sides are identical and stay files,
+ * as do entries that fail to open on any side or would exceed the memory
+ * allowed for inflated archives.
+ * @param [in] sDir Folder listed on each side.
+ * @param [in,out] dirs Sorted folders of each side.
+ * @param [in,out] files Sorted files of each side.
+ */
+void ArchiveCache::OpenNestedArchives(const String sDir[], int nDirs, DirItemArray dirs[], DirItemArray files[])
+{
+	ArchiveReader *readers[3];
+	std::string folders[3];
+	for (int i = 0; i < nDirs; ++i)
+	{
+		readers[i] = Resolve(sDir[i], folders[i]);
+		if (readers[i] == nullptr)
+			return;
+	}
+
+	auto collkeyLess = [](const CollatedDirItem& item1, const CollatedDirItem& item2) { return collkeycmp(item1, item2) < 0; };
+	// Backwards, so that moving an item keeps the positions of those before
+	for (size_t n = files[0].size(); n-- > 0; )
+	{
+		if (!IsNestedArchiveName(files[0][n].filename.get()))
+			continue;
+
+		// Find the entry on all sides
+		size_t pos[3] = { n };
+		const ArchiveEntry *entries[3];
+		bool bAll = true;
+		bool bSameCrc = true;
+		for (int i = 0; i < nDirs && bAll; ++i)
+		{
+			if (i > 0)
+			{
+				auto it = std::lower_bound(files[i].begin(), files[i].end(), files[0][n], collkeyLess);
+				bAll = it != files[i].end() && collkeycmp(*it, files[0][n]) == 0;
+				if (!bAll)
+					break;
+				pos[i] = it - files[i].begin();
+			}
+			const std::string leafUTF8 = ucr::toUTF8(files[i][pos[i]].filename);
+			entries[i] = readers[i]->FindEntry(folders[i].empty() ? leafUTF8 : folders[i] + "/" + leafUTF8);
+			bAll = entries[i] != nullptr && !entries[i]->directory;
+			if (bAll && i > 0 && (!entries[i]->hasCrc || !entries[0]->hasCrc ||
+				entries[i]->size != entries[0]->size || entries[i]->crc != entries[0]->crc))
+				bSameCrc = false;
+		}
+		if (!bAll || bSameCrc)
+			continue;
+
+		// Reserve memory of inflated archives before opening them
+		uint64_t nMemory = 0;
+		for (int i = 0; i < nDirs; ++i)
+			nMemory += readers[i]->GetNestedMemorySize(*entries[i]);
+		{
+			Poco::FastMutex::ScopedLock lock(m_mutex);
+			if (m_nNestedMemory + nMemory > MaxNestedMemory)
+				continue;
+			m_nNestedMemory += nMemory;
+		}
+		std::unique_ptr<ArchiveReader> nested[3];
+		bool bOpened = true;
+		for (int i = 0; i < nDirs && bOpened; ++i)
+		{
+			nested[i] = readers[i]->OpenNested(*entries[i]);
+			bOpened = nested[i] != nullptr;
+		}
+		{
+			Poco::FastMutex::ScopedLock lock(m_mutex);
+			if (!bOpened)
+			{
+				m_nNestedMemory -= nMemory;
+				continue;
+			}
+			for (int i = 0; i < nDirs; ++i)
+				m_readers[StripTrailingSlash(sDir[i]) + _T("\\") + files[i][pos[i]].filename.get()] = std::move(nested[i]);
+		}
+
+		for (int i = 0; i < nDirs; ++i)
+		{
+			CollatedDirItem ent = files[i][pos[i]];
+			files[i].erase(files[i].begin() + pos[i]);
+			ent.size = DirItem::FILE_SIZE_NONE;
+			ent.flags.attributes |= FILE_ATTRIBUTE_DIRECTORY;
+			dirs[i].insert(std::upper_bound(dirs[i].begin(), dirs[i].end(), ent, collkeyLess), ent);
+		}
+	}
+}
+
+/**
+ * @brief Get size and CRC-32 stored for a file in an archive.
+ * @return false if path is not a file in an archive, or the archive has
+ * no checksums (tar).
+ */
+bool ArchiveCache::GetStoredChecksum(const String& path, uint64_t& size, uint32_t& crc)
+{
+	std::string name;
+	ArchiveReader *reader = Resolve(path, name);
+	const ArchiveEntry *entry = (reader != nullptr && !name.empty()) ? reader->FindEntry(name) : nullptr;
+	if (entry == nullptr || entry->directory || !entry->hasCrc)
+		return false;
+	size = entry->size;
+	crc = entry->crc;
+	return true;
+}
+
+/**
+ * @brief Write contents of a file in an archive to destPath.
+ * @return false if the entry could not be read or written, destPath is
+ * removed then.
+ */
+bool ArchiveCache::ExtractEntry(ArchiveReader& reader, const ArchiveEntry& entry, const String& destPath)
+{
+	std::unique_ptr<std::istream> stream = reader.OpenEntry(entry);
+	if (stream == nullptr)
+		return false;
+	try
+	{
+		Poco::FileOutputStream out(ucr::toUTF8(destPath), std::ios::out | std::ios::binary | std::ios::trunc);
+		const uint64_t copied = Poco::StreamCopier::copyStream64(*stream, out);
+		out.close();
+		if (copied == entry.size && !stream->bad())
+			return true;
+	}
+	catch (Poco::Exception&)
+	{
+	}
+	try { TFile(destPath).remove(); } catch (...) {}
+	return false;
+}
+
+/**
+ * @brief Write a folder in an archive and all below it to destPath.
+ * Archives in the folder are written as files, also when opened by
+ * OpenNestedArchives().
+ */
+bool ArchiveCache::ExtractFolder(ArchiveReader& reader, const std::string& folder, const String& destPath)
+{
+	if (!paths::CreateIfNeeded(destPath))
+		return false;
+	for (const ArchiveEntry *entry : reader.ListFolder(folder))
+	{
+		const size_t sep = entry->name.rfind('/');
+		const String entryPath = paths::ConcatPath(destPath,
+			ucr::toTString(sep == std::string::npos ? entry->name : entry->name.substr(sep + 1)));
+		if (entry->directory ? !ExtractFolder(reader, entry->name, entryPath) : !ExtractEntry(reader, *entry, entryPath))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Extract file in an archive to a temporary file.
+ * The temporary file keeps the name of the entry after a unique prefix,
+ * so that file masks of plugins and filters still match it. Caller
+ * deletes the file.
+ * @return Path of temporary file, empty if entry could not be extracted.
+ */
+String ArchiveCache::ExtractToTempFile(const String& path)
+{
+	std::string name;
+	ArchiveReader *reader = Resolve(path, name);
+	const ArchiveEntry *entry = (reader != nullptr && !name.empty()) ? reader->FindEntry(name) : nullptr;
+	if (entry == nullptr)
+		return String();
+
+	String tempPath;
+	{
+		Poco::FastMutex::ScopedLock lock(m_mutex);
+		if (m_sTempDir.empty())
+			m_sTempDir = env::GetTempChildPath();
+		tempPath = paths::ConcatPath(m_sTempDir,
+			strutils::format(_T("%u_%s"), ++m_nTempFiles, paths::FindFileName(path)));
+	}
+	return ExtractEntry(*reader, *entry, tempPath) ? tempPath : String();
+}
+
+/**
+ * @brief Extract file or folder in an archive for the GUI.
+ * File compares and file operations need real files, so they fall back
+ * to extracting the items they use. Items are extracted to a folder of
+ * their own in the WinMerge temporary folder, which is removed when
+ * WinMerge exits, like archives extracted by 7-Zip, so that they may
+ * outlive the cache.
+ * @return Path of extracted file or folder, empty if path is not in an
+ * opened archive or could not be extracted.
+ */
+String ArchiveCache::Extract(const String& path)
+{
+	std::string name;
+	ArchiveReader *reader = Resolve(path, name);
+	if (reader == nullptr)
+		return String();
+	const ArchiveEntry *entry = name.empty() ? nullptr : reader->FindEntry(name);
+	if (!name.empty() && entry == nullptr)
+		return String();
+	const String tempDir = env::GetTempChildPath();
+	const String tempPath = paths::ConcatPath(tempDir, paths::FindFileName(StripTrailingSlash(path)));
+	if (entry != nullptr && !entry->directory ?
+		ExtractEntry(*reader, *entry, tempPath) : ExtractFolder(*reader, name, tempPath))
+		return tempPath;
+	try { TFile(tempDir).remove(true); } catch (...) {}
+	return String();
+}
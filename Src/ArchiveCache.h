@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  ArchiveCache.h
+ *
+ * @brief Declaration of ArchiveCache class
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <Poco/Mutex.h>
+#include "UnicodeString.h"
+#include "DirTravel.h"
+
+class ArchiveReader;
+struct ArchiveEntry;
+
+/**
+ * @brief Archives walked by folder compare without extracting them.
+ *
+ * Paths inside an archive are written as if the archive were a folder,
+ * e.g. "C:\a.zip\dir\file.txt". Folders are listed from the zip central
+ * directory or the tar headers. Archives inside archives are listed as
+ * folders too, when OpenNestedArchives() finds them on all sides. Only
+ * entries whose contents must be compared are extracted, one at a time,
+ * to temporary files. Extract() extracts items the GUI needs as real
+ * files or folders, for file compares and file operations.
+ *
+ * Used from the collect and compare threads at once.
+ */
+class ArchiveCache
+{
+public:
+	ArchiveCache();
+	~ArchiveCache();
+
+	static bool IsArchive(const String& path);
+	bool AddRoot(const String& path);
+	void Clear();
+	bool LoadAndSortFiles(const String& sDir, DirItemArray * dirs, DirItemArray * files, bool casesensitive);
+	void OpenNestedArchives(const String sDir[], int nDirs, DirItemArray dirs[], DirItemArray files[]);
+	bool IsInArchive(const String& path);
+	bool GetStoredChecksum(const String& path, uint64_t& size, uint32_t& crc);
+	String ExtractToTempFile(const String& path);
+	String Extract(const String& path);
+
+private:
+	ArchiveReader *Resolve(const String& path, std::string& name);
+	static bool ExtractEntry(ArchiveReader& reader, const ArchiveEntry& entry, const String& destPath);
+	static bool ExtractFolder(ArchiveReader& reader, const std::string& folder, const String& destPath);
+
+	std::map<String, std::unique_ptr<ArchiveReader>> m_readers; /**< Opened archives by path, nested ones too */
+	uint64_t m_nNestedMemory; /**< Bytes of nested archives inflated to memory */
+	Poco::FastMutex m_mutex; /**< Guards m_readers and m_nNestedMemory */
+	String m_sTempDir; /**< Folder of extracted entries, created on first use */
+	std::atomic<unsigned> m_nTempFiles;
+};
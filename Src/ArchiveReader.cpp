@@ -0,0 +1,761 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  ArchiveReader.cpp
+ *
+ * @brief Implementation of ArchiveReader class
+ */
+
+#include "pch.h"
+#include "ArchiveReader.h"
+#include <algorithm>
+#include <cstring>
+#include <streambuf>
+#include <Poco/FileStream.h>
+#include <Poco/InflatingStream.h>
+#include <Poco/Exception.h>
+#include "DebugNew.h"
+
+namespace
+{
+
+/** @brief Size of blocks read from the archive file by entry streams. */
+const size_t ReadBufferSize = 64 * 1024;
+/** @brief Largest zip central directory read to memory. */
+const uint64_t MaxCentralDirectorySize = 1024 * 1024 * 1024;
+/** @brief Largest tar extended header (long name or pax header). */
+const uint64_t MaxTarExtendedHeaderSize = 1024 * 1024;
+
+const uint32_t ZipLocalHeaderSignature = 0x04034b50;
+const uint32_t ZipCentralHeaderSignature = 0x02014b50;
+const uint32_t ZipEndOfCentralDirSignature = 0x06054b50;
+const uint32_t Zip64EndOfCentralDirSignature = 0x06064b50;
+const uint32_t Zip64LocatorSignature = 0x07064b50;
+
+inline unsigned Get16(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+inline uint32_t Get32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline uint64_t Get64(const unsigned char *p)
+{
+	return Get32(p) | (static_cast<uint64_t>(Get32(p + 4)) << 32);
+}
+
+/** @brief Days from 1970-01-01 to given date of the Gregorian calendar. */
+int64_t DaysFromCivil(int y, unsigned m, unsigned d)
+{
+	y -= m <= 2;
+	const int64_t era = (y >= 0 ? y : y - 399) / 400;
+	const unsigned yoe = static_cast<unsigned>(y - era * 400);
+	const unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + static_cast<int64_t>(doe) - 719468;
+}
+
+/** @brief Convert MS-DOS date and time of a zip entry to seconds since 1970. */
+int64_t DosTimeToUnix(unsigned date, unsigned time)
+{
+	const unsigned month = (date >> 5) & 0x0f;
+	const unsigned day = date & 0x1f;
+	if (month < 1 || month > 12 || day < 1)
+		return 0;
+	const int64_t days = DaysFromCivil(1980 + (date >> 9), month, day);
+	return days * 86400 + (time >> 11) * 3600 + ((time >> 5) & 0x3f) * 60 + (time & 0x1f) * 2;
+}
+
+/** @brief CP437 characters 0x80-0xFF, for zip entry names without UTF-8 flag. */
+const unsigned short Cp437High[128] =
+{
+	0x00C7, 0x00FC, 0x00E9, 0x00E2, 0x00E4, 0x00E0, 0x00E5, 0x00E7, 0x00EA, 0x00EB, 0x00E8, 0x00EF, 0x00EE, 0x00EC, 0x00C4, 0x00C5,
+	0x00C9, 0x00E6, 0x00C6, 0x00F4, 0x00F6, 0x00F2, 0x00FB, 0x00F9, 0x00FF, 0x00D6, 0x00DC, 0x00A2, 0x00A3, 0x00A5, 0x20A7, 0x0192,
+	0x00E1, 0x00ED, 0x00F3, 0x00FA, 0x00F1, 0x00D1, 0x00AA, 0x00BA, 0x00BF, 0x2310, 0x00AC, 0x00BD, 0x00BC, 0x00A1, 0x00AB, 0x00BB,
+	0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556, 0x2555, 0x2563, 0x2551, 0x2557, 0x255D, 0x255C, 0x255B, 0x2510,
+	0x2514, 0x2534, 0x252C, 0x251C, 0x2500, 0x253C, 0x255E, 0x255F, 0x255A, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256C, 0x2567,
+	0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256B, 0x256A, 0x2518, 0x250C, 0x2588, 0x2584, 0x258C, 0x2590, 0x2580,
+	0x03B1, 0x00DF, 0x0393, 0x03C0, 0x03A3, 0x03C3, 0x00B5, 0x03C4, 0x03A6, 0x0398, 0x03A9, 0x03B4, 0x221E, 0x03C6, 0x03B5, 0x2229,
+	0x2261, 0x00B1, 0x2265, 0x2264, 0x2320, 0x2321, 0x00F7, 0x2248, 0x00B0, 0x2219, 0x00B7, 0x221A, 0x207F, 0x00B2, 0x25A0, 0x00A0,
+};
+
+std::string Cp437ToUtf8(const std::string& str)
+{
+	std::string result;
+	result.reserve(str.size() * 2);
+	for (unsigned char c : str)
+	{
+		const unsigned ch = c < 0x80 ? c : Cp437High[c - 0x80];
+		if (ch < 0x80)
+			result += static_cast<char>(ch);
+		else if (ch < 0x800)
+		{
+			result += static_cast<char>(0xC0 | (ch >> 6));
+			result += static_cast<char>(0x80 | (ch & 0x3F));
+		}
+		else
+		{
+			result += static_cast<char>(0xE0 | (ch >> 12));
+			result += static_cast<char>(0x80 | ((ch >> 6) & 0x3F));
+			result += static_cast<char>(0x80 | (ch & 0x3F));
+		}
+	}
+	return result;
+}
+
+bool IsUtf8(const std::string& str)
+{
+	for (size_t i = 0; i < str.size(); )
+	{
+		const unsigned char c = str[i];
+		const size_t len = c < 0x80 ? 1 : (c & 0xE0) == 0xC0 ? 2 : (c & 0xF0) == 0xE0 ? 3 : (c & 0xF8) == 0xF0 ? 4 : 0;
+		if (len == 0 || i + len > str.size())
+			return false;
+		for (size_t j = 1; j < len; ++j)
+		{
+			if ((static_cast<unsigned char>(str[i + j]) & 0xC0) != 0x80)
+				return false;
+		}
+		i += len;
+	}
+	return true;
+}
+
+/** @brief Get NUL-terminated string from a fixed size tar header field. */
+std::string TarField(const unsigned char *p, size_t len)
+{
+	const char *s = reinterpret_cast<const char *>(p);
+	return std::string(s, std::find(s, s + len, '\0'));
+}
+
+/**
+ * @brief Parse numeric tar header field.
+ * Numbers are octal, or big-endian binary if the high bit of the first
+ * byte is set (GNU extension for sizes of 8 GB and more).
+ */
+uint64_t TarNumber(const unsigned char *p, size_t len)
+{
+	uint64_t value = 0;
+	if (p[0] & 0x80)
+	{
+		value = p[0] & 0x7f;
+		for (size_t i = 1; i < len; ++i)
+			value = (value << 8) | p[i];
+		return value;
+	}
+	size_t i = 0;
+	while (i < len && (p[i] == ' ' || p[i] == '\0'))
+		++i;
+	for (; i < len && p[i] >= '0' && p[i] <= '7'; ++i)
+		value = value * 8 + (p[i] - '0');
+	return value;
+}
+
+/** @brief Does the checksum of a tar header match? */
+bool CheckTarHeader(const unsigned char *h)
+{
+	unsigned sum = 0;
+	for (int i = 0; i < 512; ++i)
+		sum += (i >= 148 && i < 156) ? ' ' : h[i];
+	return sum == TarNumber(h + 148, 8);
+}
+
+bool IsZeroBlock(const unsigned char *h)
+{
+	return std::all_of(h, h + 512, [](unsigned char c) { return c == 0; });
+}
+
+/** @brief Parse pax extended header records ("<len> <key>=<value>\n"). */
+void ParsePaxHeader(const std::string& data, std::map<std::string, std::string>& headers)
+{
+	size_t pos = 0;
+	while (pos < data.size())
+	{
+		const size_t space = data.find(' ', pos);
+		if (space == std::string::npos)
+			break;
+		const size_t len = strtoul(data.c_str() + pos, nullptr, 10);
+		if (len <= space - pos || pos + len > data.size())
+			break;
+		const std::string record = data.substr(space + 1, pos + len - space - 2);
+		const size_t eq = record.find('=');
+		if (eq != std::string::npos)
+			headers[record.substr(0, eq)] = record.substr(eq + 1);
+		pos += len;
+	}
+}
+
+/**
+ * @brief Seekable stream buffer over a memory block it owns.
+ */
+class BufferStreamBuf : public std::streambuf
+{
+public:
+	explicit BufferStreamBuf(std::vector<char>&& data) : m_data(std::move(data))
+	{
+		setg(m_data.data(), m_data.data(), m_data.data() + m_data.size());
+	}
+
+protected:
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override
+	{
+		const off_type base = dir == std::ios_base::beg ? 0 : dir == std::ios_base::cur ? gptr() - eback() : static_cast<off_type>(m_data.size());
+		const off_type pos = base + off;
+		if (pos < 0 || pos > static_cast<off_type>(m_data.size()))
+			return pos_type(off_type(-1));
+		setg(m_data.data(), m_data.data() + pos, m_data.data() + m_data.size());
+		return pos_type(pos);
+	}
+
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+	{
+		return seekoff(off_type(pos), std::ios_base::beg, which);
+	}
+
+private:
+	std::vector<char> m_data;
+};
+
+class BufferStream : public std::istream
+{
+public:
+	explicit BufferStream(std::vector<char>&& data) : std::istream(nullptr), m_buf(std::move(data))
+	{
+		rdbuf(&m_buf);
+	}
+
+private:
+	BufferStreamBuf m_buf;
+};
+
+}
+
+/**
+ * @brief Seekable stream buffer reading a byte range of the archive.
+ */
+class ArchiveReader::RangeStreamBuf : public std::streambuf
+{
+public:
+	RangeStreamBuf(ArchiveReader& reader, uint64_t begin, uint64_t end)
+	: m_reader(reader), m_begin(begin), m_end(end), m_pos(begin), m_buffer(ReadBufferSize)
+	{
+	}
+
+protected:
+	int_type underflow() override
+	{
+		if (gptr() < egptr())
+			return traits_type::to_int_type(*gptr());
+		const size_t len = static_cast<size_t>((std::min)(static_cast<uint64_t>(m_buffer.size()), m_end - m_pos));
+		const size_t read = len > 0 ? m_reader.ReadAt(m_pos, m_buffer.data(), len) : 0;
+		if (read == 0)
+			return traits_type::eof();
+		m_pos += read;
+		setg(m_buffer.data(), m_buffer.data(), m_buffer.data() + read);
+		return traits_type::to_int_type(*gptr());
+	}
+
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override
+	{
+		const int64_t size = static_cast<int64_t>(m_end - m_begin);
+		const int64_t cur = static_cast<int64_t>(m_pos - m_begin) - (egptr() - gptr());
+		const int64_t base = dir == std::ios_base::beg ? 0 : dir == std::ios_base::cur ? cur : size;
+		const int64_t pos = base + off;
+		if (pos < 0 || pos > size)
+			return pos_type(off_type(-1));
+		m_pos = m_begin + pos;
+		setg(nullptr, nullptr, nullptr);
+		return pos_type(pos);
+	}
+
+	pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+	{
+		return seekoff(off_type(pos), std::ios_base::beg, which);
+	}
+
+private:
+	ArchiveReader& m_reader;
+	const uint64_t m_begin;
+	const uint64_t m_end;
+	uint64_t m_pos; /**< Archive offset of the end of buffered data */
+	std::vector<char> m_buffer;
+};
+
+/**
+ * @brief Stream of the contents of an entry, inflated if needed.
+ */
+class ArchiveReader::EntryStream : public std::istream
+{
+public:
+	EntryStream(ArchiveReader& reader, uint64_t begin, uint64_t end, bool deflated)
+	: std::istream(nullptr), m_range(reader, begin, end), m_rangeStream(&m_range)
+	{
+		if (deflated)
+		{
+			// Negative window bits: raw deflate data without zlib header
+			m_inflater.reset(new Poco::InflatingInputStream(m_rangeStream, -15));
+			rdbuf(m_inflater->rdbuf());
+		}
+		else
+			rdbuf(&m_range);
+	}
+
+private:
+	RangeStreamBuf m_range;
+	std::istream m_rangeStream;
+	std::unique_ptr<Poco::InflatingInputStream> m_inflater;
+};
+
+ArchiveReader::ArchiveReader(std::unique_ptr<std::istream> stream, Format format)
+: m_stream(std::move(stream))
+, m_streamSize(0)
+, m_format(format)
+{
+	m_stream->clear();
+	m_stream->seekg(0, std::ios::end);
+	const std::streamoff size = m_stream->tellg();
+	m_streamSize = size > 0 ? static_cast<uint64_t>(size) : 0;
+}
+
+/**
+ * @brief Detect archive format from the head of a stream.
+ * The stream is left positioned at its beginning.
+ */
+ArchiveReader::Format ArchiveReader::DetectFormat(std::istream& stream)
+{
+	unsigned char head[512] = {};
+	stream.clear();
+	stream.seekg(0);
+	stream.read(reinterpret_cast<char *>(head), sizeof(head));
+	const std::streamsize len = stream.gcount();
+	stream.clear();
+	stream.seekg(0);
+	if (len >= 4 && (Get32(head) == ZipLocalHeaderSignature || Get32(head) == ZipEndOfCentralDirSignature))
+		return FORMAT_ZIP;
+	if (len == 512 && !IsZeroBlock(head) && CheckTarHeader(head))
+		return FORMAT_TAR;
+	return FORMAT_UNKNOWN;
+}
+
+/**
+ * @brief Open archive from a seekable stream.
+ * @return Reader listing the entries, or nullptr if the stream is not a
+ * supported archive or its directory is corrupt.
+ */
+std::unique_ptr<ArchiveReader> ArchiveReader::Open(std::unique_ptr<std::istream> stream)
+{
+	if (stream == nullptr || !*stream)
+		return nullptr;
+	const Format format = DetectFormat(*stream);
+	if (format == FORMAT_UNKNOWN)
+		return nullptr;
+	std::unique_ptr<ArchiveReader> reader(new ArchiveReader(std::move(stream), format));
+	try
+	{
+		if (!(format == FORMAT_ZIP ? reader->ReadZip() : reader->ReadTar()))
+			return nullptr;
+	}
+	catch (std::exception&)
+	{
+		return nullptr;
+	}
+	reader->BuildIndex();
+	return reader;
+}
+
+/**
+ * @brief Open archive file.
+ * @param [in] path UTF-8 path of the file.
+ */
+std::unique_ptr<ArchiveReader> ArchiveReader::OpenFile(const std::string& path)
+{
+	try
+	{
+		return Open(std::unique_ptr<std::istream>(new Poco::FileInputStream(path, std::ios::in | std::ios::binary)));
+	}
+	catch (Poco::Exception&)
+	{
+		return nullptr;
+	}
+}
+
+/**
+ * @brief Normalize entry name: '/' separators, no empty, "." or trailing
+ * components.
+ * @return Normalized name, empty if the name refers outside the archive.
+ */
+std::string ArchiveReader::NormalizeName(const std::string& name)
+{
+	std::string result;
+	size_t pos = 0;
+	while (pos <= name.size())
+	{
+		size_t sep = name.find_first_of("/\\", pos);
+		if (sep == std::string::npos)
+			sep = name.size();
+		const std::string component = name.substr(pos, sep - pos);
+		pos = sep + 1;
+		if (component.empty() || component == ".")
+			continue;
+		if (component == "..")
+			return std::string();
+		if (!result.empty())
+			result += '/';
+		result += component;
+	}
+	return result;
+}
+
+/**
+ * @brief Read bytes from the archive stream.
+ * @return Number of bytes read.
+ */
+size_t ArchiveReader::ReadAt(uint64_t offset, void *buf, size_t len)
+{
+	Poco::FastMutex::ScopedLock lock(m_mutex);
+	m_stream->clear();
+	m_stream->seekg(static_cast<std::streamoff>(offset));
+	if (!*m_stream)
+		return 0;
+	m_stream->read(static_cast<char *>(buf), static_cast<std::streamsize>(len));
+	return static_cast<size_t>(m_stream->gcount());
+}
+
+/**
+ * @brief Add entry, replacing an earlier entry of the same name.
+ */
+void ArchiveReader::AddEntry(ArchiveEntry&& entry)
+{
+	if (entry.name.empty())
+		return;
+	auto it = m_names.find(entry.name);
+	if (it != m_names.end())
+		m_entries[it->second] = std::move(entry);
+	else
+	{
+		m_names.emplace(entry.name, m_entries.size());
+		m_entries.push_back(std::move(entry));
+	}
+}
+
+/**
+ * @brief Index entries by folder, adding folders which have no entry of
+ * their own.
+ */
+void ArchiveReader::BuildIndex()
+{
+	for (size_t i = 0; i < m_entries.size(); ++i)
+	{
+		const std::string name = m_entries[i].name;
+		const size_t sep = name.rfind('/');
+		const std::string parent = sep == std::string::npos ? std::string() : name.substr(0, sep);
+		if (!parent.empty() && m_names.find(parent) == m_names.end())
+		{
+			// Appended folder is indexed later in this loop, adding its parent
+			ArchiveEntry folder;
+			folder.name = parent;
+			folder.directory = true;
+			folder.mtime = m_entries[i].mtime;
+			AddEntry(std::move(folder));
+		}
+		m_folders[parent].push_back(i);
+	}
+}
+
+/**
+ * @brief Read zip central directory.
+ */
+bool ArchiveReader::ReadZip()
+{
+	const uint64_t tailSize = (std::min)(m_streamSize, static_cast<uint64_t>(0xFFFF + 22));
+	if (tailSize < 22)
+		return false;
+	std::vector<unsigned char> tail(static_cast<size_t>(tailSize));
+	if (ReadAt(m_streamSize - tailSize, tail.data(), tail.size()) != tail.size())
+		return false;
+	size_t eocd = tail.size() - 22 + 1;
+	while (eocd-- > 0)
+	{
+		if (Get32(&tail[eocd]) == ZipEndOfCentralDirSignature)
+			break;
+	}
+	if (eocd == static_cast<size_t>(-1))
+		return false;
+	uint64_t count = Get16(&tail[eocd + 10]);
+	uint64_t cdSize = Get32(&tail[eocd + 12]);
+	uint64_t cdOffset = Get32(&tail[eocd + 16]);
+	const uint64_t eocdOffset = m_streamSize - tailSize + eocd;
+	if ((count == 0xFFFF || cdSize == 0xFFFFFFFF || cdOffset == 0xFFFFFFFF) && eocdOffset >= 20)
+	{
+		unsigned char locator[20], eocd64[56];
+		if (ReadAt(eocdOffset - 20, locator, sizeof(locator)) == sizeof(locator) &&
+			Get32(locator) == Zip64LocatorSignature &&
+			ReadAt(Get64(locator + 8), eocd64, sizeof(eocd64)) == sizeof(eocd64) &&
+			Get32(eocd64) == Zip64EndOfCentralDirSignature)
+		{
+			count = Get64(eocd64 + 32);
+			cdSize = Get64(eocd64 + 40);
+			cdOffset = Get64(eocd64 + 48);
+		}
+	}
+	if (cdSize > MaxCentralDirectorySize || cdOffset > m_streamSize || cdSize > m_streamSize - cdOffset)
+		return false;
+
+	std::vector<unsigned char> cd(static_cast<size_t>(cdSize));
+	if (ReadAt(cdOffset, cd.data(), cd.size()) != cd.size())
+		return false;
+	size_t pos = 0;
+	for (uint64_t n = 0; n < count; ++n)
+	{
+		if (pos + 46 > cd.size())
+			return false;
+		const unsigned char *h = &cd[pos];
+		if (Get32(h) != ZipCentralHeaderSignature)
+			return false;
+		const unsigned hostSystem = h[5];
+		const unsigned flags = Get16(h + 8);
+		const size_t nameLen = Get16(h + 28);
+		const size_t extraLen = Get16(h + 30);
+		const size_t commentLen = Get16(h + 32);
+		const uint32_t attributes = Get32(h + 38);
+		if (pos + 46 + nameLen + extraLen + commentLen > cd.size())
+			return false;
+
+		ArchiveEntry entry;
+		entry.method = Get16(h + 10);
+		entry.mtime = DosTimeToUnix(Get16(h + 14), Get16(h + 12));
+		entry.crc = Get32(h + 16);
+		entry.hasCrc = true;
+		entry.packedSize = Get32(h + 20);
+		entry.size = Get32(h + 24);
+		entry.offset = Get32(h + 42);
+		entry.encrypted = (flags & 1) != 0;
+
+		std::string name(reinterpret_cast<const char *>(h + 46), nameLen);
+		const unsigned char *extra = h + 46 + nameLen;
+		for (size_t e = 0; e + 4 <= extraLen; )
+		{
+			const unsigned id = Get16(extra + e);
+			const size_t len = (std::min)(static_cast<size_t>(Get16(extra + e + 2)), extraLen - e - 4);
+			const unsigned char *data = extra + e + 4;
+			if (id == 0x0001)
+			{
+				// Zip64 extended information, only fields not fitting 32 bits
+				size_t field = 0;
+				if (entry.size == 0xFFFFFFFF && field + 8 <= len)
+				{
+					entry.size = Get64(data + field);
+					field += 8;
+				}
+				if (entry.packedSize == 0xFFFFFFFF && field + 8 <= len)
+				{
+					entry.packedSize = Get64(data + field);
+					field += 8;
+				}
+				if (entry.offset == 0xFFFFFFFF && field + 8 <= len)
+				{
+					entry.offset = Get64(data + field);
+					field += 8;
+				}
+			}
+			else if (id == 0x5455 && len >= 5 && (data[0] & 1))
+			{
+				// Extended timestamp, UTC modification time
+				entry.mtime = static_cast<int32_t>(Get32(data + 1));
+			}
+			e += 4 + len;
+		}
+
+		entry.directory = (!name.empty() && (name.back() == '/' || name.back() == '\\')) ||
+			(hostSystem == 0 && (attributes & 0x10) != 0);
+		if ((flags & 0x800) == 0 && !IsUtf8(name))
+			name = Cp437ToUtf8(name);
+		entry.name = NormalizeName(name);
+		if (entry.directory)
+		{
+			entry.size = 0;
+			entry.hasCrc = false;
+		}
+		AddEntry(std::move(entry));
+		pos += 46 + nameLen + extraLen + commentLen;
+	}
+	return true;
+}
+
+/**
+ * @brief Read tar headers.
+ * Supports ustar, GNU long names and pax path, size and mtime records.
+ * Links and special files are not listed.
+ */
+bool ArchiveReader::ReadTar()
+{
+	uint64_t pos = 0;
+	std::string longName;
+	std::map<std::string, std::string> pax;
+	unsigned char h[512];
+	while (pos + 512 <= m_streamSize)
+	{
+		if (ReadAt(pos, h, sizeof(h)) != sizeof(h))
+			return false;
+		if (IsZeroBlock(h))
+			break;
+		if (!CheckTarHeader(h))
+			return false;
+		const char type = static_cast<char>(h[156]);
+		uint64_t size = TarNumber(h + 124, 12);
+		const uint64_t dataOffset = pos + 512;
+
+		if (type == 'L' || type == 'x' || type == 'g' || type == 'K')
+		{
+			if (size > MaxTarExtendedHeaderSize)
+				return false;
+			std::string data(static_cast<size_t>(size), '\0');
+			if (ReadAt(dataOffset, &data[0], data.size()) != data.size())
+				return false;
+			if (type == 'L')
+				longName = data.c_str();
+			else if (type == 'x')
+				ParsePaxHeader(data, pax);
+			pos = dataOffset + (size + 511) / 512 * 512;
+			continue;
+		}
+
+		ArchiveEntry entry;
+		std::string name;
+		if (!longName.empty())
+			name = longName;
+		else
+		{
+			name = TarField(h, 100);
+			const std::string prefix = memcmp(h + 257, "ustar", 5) == 0 ? TarField(h + 345, 155) : std::string();
+			if (!prefix.empty())
+				name = prefix + "/" + name;
+		}
+		entry.mtime = static_cast<int64_t>(TarNumber(h + 136, 12));
+		auto it = pax.find("path");
+		if (it != pax.end())
+			name = it->second;
+		it = pax.find("size");
+		if (it != pax.end())
+			size = strtoull(it->second.c_str(), nullptr, 10);
+		it = pax.find("mtime");
+		if (it != pax.end())
+			entry.mtime = strtoll(it->second.c_str(), nullptr, 10);
+		longName.clear();
+		pax.clear();
+
+		if (type == '0' || type == '\0' || type == '7' || type == '5')
+		{
+			entry.directory = type == '5' || (!name.empty() && name.back() == '/');
+			entry.name = NormalizeName(name);
+			entry.size = entry.directory ? 0 : size;
+			entry.packedSize = entry.size;
+			entry.offset = dataOffset;
+			AddEntry(std::move(entry));
+		}
+		if (size > m_streamSize)
+			return false;
+		pos = dataOffset + (size + 511) / 512 * 512;
+	}
+	return true;
+}
+
+const ArchiveEntry *ArchiveReader::FindEntry(const std::string& name) const
+{
+	auto it = m_names.find(name);
+	return it != m_names.end() ? &m_entries[it->second] : nullptr;
+}
+
+/**
+ * @brief List files and folders of a folder of the archive.
+ * @param [in] folder Normalized folder name, empty for the root.
+ */
+std::vector<const ArchiveEntry *> ArchiveReader::ListFolder(const std::string& folder) const
+{
+	std::vector<const ArchiveEntry *> entries;
+	auto it = m_folders.find(folder);
+	if (it != m_folders.end())
+	{
+		for (size_t i : it->second)
+			entries.push_back(&m_entries[i]);
+	}
+	return entries;
+}
+
+/**
+ * @brief Can the contents of entry be read?
+ * Encrypted entries and compression methods other than deflate are not
+ * supported.
+ */
+bool ArchiveReader::CanRead(const ArchiveEntry& entry) const
+{
+	if (entry.directory || entry.encrypted)
+		return false;
+	return m_format == FORMAT_TAR || entry.method == 0 || entry.method == 8;
+}
+
+/**
+ * @brief Get range of the stored data of an entry in the archive.
+ */
+bool ArchiveReader::GetDataRange(const ArchiveEntry& entry, uint64_t& begin, uint64_t& end)
+{
+	begin = entry.offset;
+	if (m_format == FORMAT_ZIP)
+	{
+		unsigned char h[30];
+		if (ReadAt(entry.offset, h, sizeof(h)) != sizeof(h) || Get32(h) != ZipLocalHeaderSignature)
+			return false;
+		begin = entry.offset + sizeof(h) + Get16(h + 26) + Get16(h + 28);
+	}
+	if (begin > m_streamSize || entry.packedSize > m_streamSize - begin)
+		return false;
+	end = begin + entry.packedSize;
+	return true;
+}
+
+/**
+ * @brief Open stream of the uncompressed contents of an entry.
+ * Data is read from the archive in blocks as the stream is read.
+ * @return Stream, or nullptr if the entry can't be read.
+ */
+std::unique_ptr<std::istream> ArchiveReader::OpenEntry(const ArchiveEntry& entry)
+{
+	uint64_t begin, end;
+	if (!CanRead(entry) || !GetDataRange(entry, begin, end))
+		return nullptr;
+	return std::unique_ptr<std::istream>(new EntryStream(*this, begin, end, m_format == FORMAT_ZIP && entry.method == 8));
+}
+
+/**
+ * @brief Open archive stored as an entry of this archive.
+ * @return Reader, or nullptr if the entry is not a supported archive.
+ */
+std::unique_ptr<ArchiveReader> ArchiveReader::OpenNested(const ArchiveEntry& entry)
+{
+	uint64_t begin, end;
+	if (!CanRead(entry) || !GetDataRange(entry, begin, end))
+		return nullptr;
+	if (m_format == FORMAT_TAR || entry.method == 0)
+		return Open(std::unique_ptr<std::istream>(new EntryStream(*this, begin, end, false)));
+
+	// Inflated stream can't seek, read it to memory
+	if (entry.size > MaxNestedInflateSize)
+		return nullptr;
+	std::unique_ptr<std::istream> stream = OpenEntry(entry);
+	std::vector<char> data(static_cast<size_t>(entry.size));
+	stream->read(data.data(), static_cast<std::streamsize>(data.size()));
+	if (static_cast<size_t>(stream->gcount()) != data.size())
+		return nullptr;
+	return Open(std::unique_ptr<std::istream>(new BufferStream(std::move(data))));
+}
+
+/**
+ * @brief Get bytes of memory a reader opened by OpenNested() keeps.
+ * Compressed entries are inflated to memory, stored ones are read in place.
+ */
+uint64_t ArchiveReader::GetNestedMemorySize(const ArchiveEntry& entry) const
+{
+	return (m_format == FORMAT_TAR || entry.method == 0) ? 0 : entry.size;
+}
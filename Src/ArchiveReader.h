@@ -0,0 +1,100 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  ArchiveReader.h
+ *
+ * @brief Declaration of ArchiveReader class
+ */
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <Poco/Mutex.h>
+
+/**
+ * @brief File or folder stored in an archive.
+ */
+struct ArchiveEntry
+{
+	std::string name; /**< UTF-8 path in archive, folders separated by '/' */
+	bool directory = false;
+	uint64_t size = 0; /**< Uncompressed size in bytes */
+	uint32_t crc = 0; /**< CRC-32 of uncompressed data, valid if hasCrc */
+	bool hasCrc = false;
+	int64_t mtime = 0; /**< Modification time, seconds since January 1, 1970 */
+
+	// Where the data is, only used by ArchiveReader
+	uint64_t offset = 0; /**< zip: offset of local header, tar: offset of data */
+	uint64_t packedSize = 0; /**< Size of stored data */
+	int method = 0; /**< zip compression method, 0 = stored, 8 = deflated */
+	bool encrypted = false;
+};
+
+/**
+ * @brief Reads zip and tar archives without extracting them.
+ *
+ * Entries are listed from the central directory of a zip file or from the
+ * headers of a tar file, so listing does not read the entry data. The
+ * contents of an entry are read as a stream, on demand. An archive stored
+ * in another archive is opened with OpenNested(); stored entries are read
+ * in place, compressed ones are inflated to memory.
+ *
+ * Entries can be read by several threads at once: reads from the archive
+ * file are serialized, inflating is not. Streams and nested readers refer
+ * to the reader they were opened from, which must outlive them.
+ */
+class ArchiveReader
+{
+public:
+	enum Format
+	{
+		FORMAT_UNKNOWN,
+		FORMAT_ZIP,
+		FORMAT_TAR,
+	};
+
+	/** @brief Largest compressed nested archive inflated to memory. */
+	static const uint64_t MaxNestedInflateSize = 256 * 1024 * 1024;
+
+	static Format DetectFormat(std::istream& stream);
+	static std::unique_ptr<ArchiveReader> Open(std::unique_ptr<std::istream> stream);
+	static std::unique_ptr<ArchiveReader> OpenFile(const std::string& path);
+
+	Format GetFormat() const { return m_format; }
+	const std::vector<ArchiveEntry>& GetEntries() const { return m_entries; }
+	const ArchiveEntry *FindEntry(const std::string& name) const;
+	std::vector<const ArchiveEntry *> ListFolder(const std::string& folder) const;
+
+	bool CanRead(const ArchiveEntry& entry) const;
+	std::unique_ptr<std::istream> OpenEntry(const ArchiveEntry& entry);
+	std::unique_ptr<ArchiveReader> OpenNested(const ArchiveEntry& entry);
+	uint64_t GetNestedMemorySize(const ArchiveEntry& entry) const;
+
+	static std::string NormalizeName(const std::string& name);
+
+private:
+	class RangeStreamBuf;
+	class EntryStream;
+
+	ArchiveReader(std::unique_ptr<std::istream> stream, Format format);
+	ArchiveReader(const ArchiveReader&) = delete;
+	ArchiveReader& operator=(const ArchiveReader&) = delete;
+
+	bool ReadZip();
+	bool ReadTar();
+	void AddEntry(ArchiveEntry&& entry);
+	void BuildIndex();
+	size_t ReadAt(uint64_t offset, void *buf, size_t len);
+	bool GetDataRange(const ArchiveEntry& entry, uint64_t& begin, uint64_t& end);
+
+	std::unique_ptr<std::istream> m_stream;
+	uint64_t m_streamSize;
+	Format m_format;
+	std::vector<ArchiveEntry> m_entries;
+	std::map<std::string, size_t> m_names; /**< Index of entry by name */
+	std::map<std::string, std::vector<size_t>> m_folders; /**< Children of folders, "" is the root */
+	Poco::FastMutex m_mutex; /**< Serializes reads of m_stream */
+};
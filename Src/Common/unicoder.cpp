@@ -19,6 +19,10 @@ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLI
 #include <windows.h>
 #include <cassert>
 #include <memory>
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define UNICODER_SSE2 1
+#endif
 #include <Poco/UnicodeConverter.h>
 #include "UnicodeString.h"
 #include "ExConverter.h"
@@ -1117,6 +1121,32 @@ std::string toThreadCP(const std::wstring& str)
 	return to;
 }
 
+/**
+ * @brief Find first byte that is not 7-bit ASCII.
+ * Tests 16 bytes at a time, as most text is plain ASCII.
+ * @param [in] pBuffer Pointer to begin of the buffer.
+ * @param [in] size Size of the buffer in bytes.
+ * @return Offset of the byte, size if all bytes are ASCII.
+ */
+size_t FindNonAscii(const char *pBuffer, size_t size)
+{
+	size_t i = 0;
+#ifdef UNICODER_SSE2
+	for (; i + 16 <= size; i += 16)
+	{
+		// High bits of the 16 bytes, the byte is found below
+		if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(pBuffer + i))) != 0)
+			break;
+	}
+#endif
+	for (; i < size; ++i)
+	{
+		if (static_cast<unsigned char>(pBuffer[i]) >= 0x80)
+			return i;
+	}
+	return size;
+}
+
 // Algorithm originally from:
 // TortoiseMerge - a Diff/Patch program
 // Copyright (C) 2007 - TortoiseSVN
@@ -1124,74 +1154,41 @@ std::string toThreadCP(const std::wstring& str)
  * @brief Check for invalid UTF-8 bytes in buffer.
  * This function checks if there are invalid UTF-8 bytes in the given buffer.
  * If such bytes are found, caller knows this buffer is not valid UTF-8 file.
+ * Runs of ASCII bytes are skipped with FindNonAscii(), so a mostly ASCII
+ * buffer is checked in one fast pass.
  * @param [in] pBuffer Pointer to begin of the buffer.
  * @param [in] size Size of the buffer in bytes.
- * @return true if invalid bytes found, false otherwise.
+ * @return true if invalid bytes found, or if there are no multibyte
+ * characters at all, false otherwise.
  */
 bool CheckForInvalidUtf8(const char *pBuffer, size_t size)
 {
-	unsigned char * pVal2 = (unsigned char *)pBuffer;
-	for (size_t j = 0; j < size; ++j)
-	{
-		if ((*pVal2 == 0xC0) || (*pVal2 == 0xC1) || (*pVal2 >= 0xF5))
-			return true;
-		pVal2++;
-	}
-	pVal2 = (unsigned char *)pBuffer;
+	const unsigned char *pVal = reinterpret_cast<const unsigned char *>(pBuffer);
 	bool bUTF8 = false;
-	for (size_t i = 0; i < size; ++i)
+	size_t i = 0;
+	while ((i += FindNonAscii(pBuffer + i, size - i)) < size)
 	{
-		if ((*pVal2 & 0x80) == 0x00)
-			;
-		else if ((*pVal2 & 0xE0) == 0xC0)
-		{
-			if (i >= size - 1)
-				return true;
-			pVal2++;
-			i++;
-			if ((*pVal2 & 0xC0) != 0x80)
-				return true;
-			bUTF8 = true;
-		}
-		else if ((*pVal2 & 0xF0) == 0xE0)
-		{
-			if (i >= size - 2)
-				return true;
-			pVal2++;
-			i++;
-			if ((*pVal2 & 0xC0) != 0x80)
-				return true;
-			pVal2++;
-			i++;
-			if ((*pVal2 & 0xC0) != 0x80)
-				return true;
-			bUTF8 = true;
-		}
-		else if ((*pVal2 & 0xF8) == 0xF0)
+		const unsigned char lead = pVal[i];
+		size_t trail;
+		if (lead >= 0xC2 && lead <= 0xDF)
+			trail = 1;
+		else if ((lead & 0xF0) == 0xE0)
+			trail = 2;
+		else if (lead >= 0xF0 && lead <= 0xF4)
+			trail = 3;
+		else // continuation byte without lead byte, or 0xC0, 0xC1, 0xF5..0xFF
+			return true;
+		if (size - i <= trail)
+			return true;
+		for (size_t j = 1; j <= trail; ++j)
 		{
-			if (i >= size - 3)
-				return true;
-			pVal2++;
-			i++;
-			if ((*pVal2 & 0xC0) != 0x80)
-				return true;
-			pVal2++;
-			i++;
-			if ((*pVal2 & 0xC0) != 0x80)
+			if ((pVal[i + j] & 0xC0) != 0x80)
 				return true;
-			pVal2++;
-			i++;
-			if ((*pVal2 & 0xC0) != 0x80)
-				return true;
-			bUTF8 = true;
 		}
-		else
-			return true;
-		pVal2++;
+		i += trail + 1;
+		bUTF8 = true;
 	}
-	if (bUTF8)
-		return false;
-	return true;
+	return !bUTF8;
 }
 
 /**
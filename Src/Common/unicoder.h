@@ -116,6 +116,7 @@ int CrossConvert(const char* src, unsigned srclen, char* dest, unsigned destsize
 String CrossConvertToStringA(const char* src, unsigned srclen, int cpin, int cpout, bool * lossy);
 #endif
 
+size_t FindNonAscii(const char *pBuffer, size_t size);
 bool CheckForInvalidUtf8(const char *pBuffer, size_t size);
 
 UNICODESET DetermineEncoding(const unsigned char *pBuffer, uint64_t size, bool * pBom);
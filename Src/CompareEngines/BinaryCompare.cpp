@@ -12,11 +12,12 @@
 #include "IAbortable.h"
 #include <io.h>
 #include <fcntl.h>
+#include <algorithm>
 
 namespace CompareEngines
 {
 
-BinaryCompare::BinaryCompare() : m_piAbortable(nullptr)
+BinaryCompare::BinaryCompare() : m_piAbortable(nullptr), m_nBytesRead(0)
 {
 }
 
@@ -33,7 +34,7 @@ void BinaryCompare::SetAbortable(const IAbortable * piAbortable)
 	m_piAbortable = const_cast<IAbortable*>(piAbortable);
 }
 
-static int compare_files(const String& file1, const String& file2, IAbortable *piAbortable)
+static int compare_files(const String& file1, const String& file2, IAbortable *piAbortable, int64_t& nBytesRead)
 {
 	const size_t bufsize = 1024 * 256;
 	int code;
@@ -54,6 +55,7 @@ static int compare_files(const String& file1, const String& file2, IAbortable *p
 			char buf2[bufsize];
 			int size1 = _read(fd1, buf1, sizeof(buf1));
 			int size2 = _read(fd2, buf2, sizeof(buf2));
+			nBytesRead += (std::max)(size1, 0) + (std::max)(size2, 0);
 			if (size1 <= 0 || size2 <= 0)
 			{
 				if (size1 < 0 || size2 < 0)
@@ -88,16 +90,17 @@ static int compare_files(const String& file1, const String& file2, IAbortable *p
  */
 int BinaryCompare::CompareFiles(const PathContext& files, const DIFFITEM &di) const
 {
+	m_nBytesRead = 0;
 	switch (files.GetSize())
 	{
 	case 2:
 		return di.diffFileInfo[0].size != di.diffFileInfo[1].size ? 
-			DIFFCODE::DIFF : compare_files(files[0], files[1], m_piAbortable);
+			DIFFCODE::DIFF : compare_files(files[0], files[1], m_piAbortable, m_nBytesRead);
 	case 3:
 		unsigned code10 = (di.diffFileInfo[1].size != di.diffFileInfo[0].size) ?
-			DIFFCODE::DIFF : compare_files(files[1], files[0], m_piAbortable);
+			DIFFCODE::DIFF : compare_files(files[1], files[0], m_piAbortable, m_nBytesRead);
 		unsigned code12 = (di.diffFileInfo[1].size != di.diffFileInfo[2].size) ?
-			DIFFCODE::DIFF : compare_files(files[1], files[2], m_piAbortable);
+			DIFFCODE::DIFF : compare_files(files[1], files[2], m_piAbortable, m_nBytesRead);
 		unsigned code02 = DIFFCODE::SAME;
 		if (code10 == DIFFCODE::SAME && code12 == DIFFCODE::SAME)
 			return DIFFCODE::SAME;
@@ -108,7 +111,7 @@ int BinaryCompare::CompareFiles(const PathContext& files, const DIFFITEM &di) co
 		else if (code10 == DIFFCODE::DIFF && code12 == DIFFCODE::DIFF)
 		{
 			code02 = di.diffFileInfo[0].size != di.diffFileInfo[2].size ?
-				DIFFCODE::DIFF : compare_files(files[0], files[2], m_piAbortable);
+				DIFFCODE::DIFF : compare_files(files[0], files[2], m_piAbortable, m_nBytesRead);
 			if (code02 == DIFFCODE::SAME)
 				return DIFFCODE::DIFF | DIFFCODE::DIFF2NDONLY;
 		}
@@ -5,6 +5,8 @@
  */
 #pragma once
 
+#include <cstdint>
+
 class DIFFITEM;
 class PathContext;
 class IAbortable;
@@ -23,8 +25,10 @@ public:
 	~BinaryCompare();
 	void SetAbortable(const IAbortable * piAbortable);
 	int CompareFiles(const PathContext& files, const DIFFITEM &di) const;
+	int64_t GetBytesRead() const { return m_nBytesRead; }
 private:
 	IAbortable * m_piAbortable;
+	mutable int64_t m_nBytesRead; /**< Bytes read by last CompareFiles() */
 };
 
 } // namespace CompareEngines
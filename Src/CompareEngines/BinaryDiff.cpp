@@ -0,0 +1,448 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  BinaryDiff.cpp
+ *
+ * @brief Implementation file for BinaryDiff
+ */
+
+#include "pch.h"
+#include "BinaryDiff.h"
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <Poco/SharedMemory.h>
+#include <Poco/Thread.h>
+#include "DiffItem.h"
+#include "PathContext.h"
+#include "TFile.h"
+#include "IAbortable.h"
+#include "DebugNew.h"
+
+using Poco::SharedMemory;
+
+namespace
+{
+
+/** @brief Hash bits that must be zero at a chunk boundary, 12 bits for ~4 KB chunks. */
+const uint64_t ChunkMask = 0xfff0000000000000ULL;
+/** @brief Input size below which both inputs are chunked on this thread. */
+const int64_t ParallelThreshold = 1024 * 1024;
+/** @brief Largest gap in bytes diffed byte by byte. */
+const int64_t MaxByteGap = 64 * 1024;
+
+/** @brief Random values of the gear hash, one per byte value. */
+struct GearTable
+{
+	uint64_t values[256];
+	GearTable()
+	{
+		uint64_t x = 0;
+		for (int i = 0; i < 256; ++i)
+		{
+			// SplitMix64
+			x += 0x9e3779b97f4a7c15ULL;
+			uint64_t z = x;
+			z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+			values[i] = z ^ (z >> 31);
+		}
+	}
+};
+
+const uint64_t *GetGearTable()
+{
+	static const GearTable s_table;
+	return s_table.values;
+}
+
+}
+
+namespace CompareEngines
+{
+
+BinaryDiff::BinaryDiff()
+: m_piAbortable(nullptr)
+, m_data{}
+, m_size{}
+, m_bAborted(false)
+{
+}
+
+BinaryDiff::~BinaryDiff()
+{
+}
+
+/**
+ * @brief Set Abortable-interface.
+ * @param [in] piAbortable Pointer to abortable interface.
+ */
+void BinaryDiff::SetAbortable(const IAbortable * piAbortable)
+{
+	m_piAbortable = const_cast<IAbortable*>(piAbortable);
+}
+
+bool BinaryDiff::ShouldAbort() const
+{
+	return m_piAbortable != nullptr && m_piAbortable->ShouldAbort();
+}
+
+/**
+ * @brief Cut data into content-defined chunks.
+ * A chunk ends where the gear hash of the last 64 bytes has its top bits
+ * zero, so the same boundaries are found in equal data at any offset.
+ * @param [in] data Data to cut.
+ * @param [in] size Size of the data.
+ * @param [out] chunks Chunks found, with FNV-1a hashes of their bytes.
+ */
+void BinaryDiff::FindChunks(const unsigned char *data, int64_t size, std::vector<Chunk>& chunks)
+{
+	const uint64_t FnvOffset = 0xcbf29ce484222325ULL;
+	const uint64_t FnvPrime = 0x100000001b3ULL;
+	const uint64_t *gear = GetGearTable();
+	chunks.clear();
+	chunks.reserve(static_cast<size_t>(size / 4096 + 1));
+	int64_t start = 0;
+	uint64_t gearHash = 0;
+	uint64_t hash = FnvOffset;
+	for (int64_t i = 0; i < size; ++i)
+	{
+		const unsigned char c = data[i];
+		gearHash = (gearHash << 1) + gear[c];
+		hash = (hash ^ c) * FnvPrime;
+		const int64_t len = i + 1 - start;
+		if ((len >= MinChunkSize && (gearHash & ChunkMask) == 0) || len >= MaxChunkSize)
+		{
+			chunks.push_back({ start, len, hash });
+			start = i + 1;
+			gearHash = 0;
+			hash = FnvOffset;
+		}
+	}
+	if (start < size)
+		chunks.push_back({ start, size - start, hash });
+}
+
+/**
+ * @brief Are chunks of both inputs equal?
+ */
+bool BinaryDiff::IsSameChunk(size_t i0, size_t i1) const
+{
+	const Chunk& c0 = m_chunks[0][i0];
+	const Chunk& c1 = m_chunks[1][i1];
+	return c0.hash == c1.hash && c0.size == c1.size &&
+		memcmp(m_data[0] + c0.offset, m_data[1] + c1.offset, static_cast<size_t>(c0.size)) == 0;
+}
+
+/**
+ * @brief Diff two inputs.
+ * @param [in] data0 First input.
+ * @param [in] size0 Size of first input.
+ * @param [in] data1 Second input.
+ * @param [in] size1 Size of second input.
+ * @return false if aborted, differences found are in GetRanges().
+ */
+bool BinaryDiff::Diff(const unsigned char *data0, int64_t size0, const unsigned char *data1, int64_t size1)
+{
+	m_data[0] = data0;
+	m_data[1] = data1;
+	m_size[0] = size0;
+	m_size[1] = size1;
+	m_ranges.clear();
+	m_bAborted = false;
+
+	// Chunking reads every byte, so do the second input on another thread
+	if (size0 + size1 < ParallelThreshold)
+	{
+		FindChunks(data0, size0, m_chunks[0]);
+		FindChunks(data1, size1, m_chunks[1]);
+	}
+	else
+	{
+		Poco::Thread thread;
+		thread.startFunc([this]() { FindChunks(m_data[1], m_size[1], m_chunks[1]); });
+		FindChunks(data0, size0, m_chunks[0]);
+		thread.join();
+	}
+
+	MatchChunks();
+
+	m_chunks[0].clear();
+	m_chunks[1].clear();
+	if (m_bAborted)
+		m_ranges.clear();
+	return !m_bAborted;
+}
+
+/**
+ * @brief Match equal chunks of the inputs and diff the bytes between them.
+ *
+ * Equal chunks at the start and end of a gap are matched first. Then the
+ * chunks found once on both sides of the gap are anchors: the longest
+ * series of anchors in the same order on both sides is matched, and the
+ * gaps between the anchors are matched the same way.
+ */
+void BinaryDiff::MatchChunks()
+{
+	struct Gap
+	{
+		size_t lo[2];
+		size_t hi[2];
+	};
+	struct Count
+	{
+		int count[2];
+		size_t index[2];
+	};
+	std::vector<std::pair<size_t, size_t>> matches;
+	std::vector<Gap> gaps;
+	gaps.push_back({ { 0, 0 }, { m_chunks[0].size(), m_chunks[1].size() } });
+	std::unordered_map<uint64_t, Count> counts;
+	std::vector<std::pair<size_t, size_t>> anchors;
+	std::vector<size_t> tails, prev;
+	while (!gaps.empty())
+	{
+		if (ShouldAbort())
+		{
+			m_bAborted = true;
+			return;
+		}
+		Gap gap = gaps.back();
+		gaps.pop_back();
+		while (gap.lo[0] < gap.hi[0] && gap.lo[1] < gap.hi[1] && IsSameChunk(gap.lo[0], gap.lo[1]))
+		{
+			matches.emplace_back(gap.lo[0], gap.lo[1]);
+			++gap.lo[0];
+			++gap.lo[1];
+		}
+		while (gap.lo[0] < gap.hi[0] && gap.lo[1] < gap.hi[1] && IsSameChunk(gap.hi[0] - 1, gap.hi[1] - 1))
+		{
+			--gap.hi[0];
+			--gap.hi[1];
+			matches.emplace_back(gap.hi[0], gap.hi[1]);
+		}
+		if (gap.lo[0] == gap.hi[0] || gap.lo[1] == gap.hi[1])
+			continue;
+
+		counts.clear();
+		for (int side = 0; side < 2; ++side)
+		{
+			for (size_t i = gap.lo[side]; i < gap.hi[side]; ++i)
+			{
+				Count& c = counts.emplace(m_chunks[side][i].hash, Count{}).first->second;
+				++c.count[side];
+				c.index[side] = i;
+			}
+		}
+		anchors.clear();
+		for (size_t i = gap.lo[0]; i < gap.hi[0]; ++i)
+		{
+			const Count& c = counts[m_chunks[0][i].hash];
+			if (c.count[0] == 1 && c.count[1] == 1 && IsSameChunk(i, c.index[1]))
+				anchors.emplace_back(i, c.index[1]);
+		}
+		if (anchors.empty())
+			continue;
+
+		// Longest increasing subsequence of second side indexes
+		tails.clear();
+		prev.assign(anchors.size(), SIZE_MAX);
+		for (size_t a = 0; a < anchors.size(); ++a)
+		{
+			auto it = std::lower_bound(tails.begin(), tails.end(), anchors[a].second,
+				[&anchors](size_t t, size_t value) { return anchors[t].second < value; });
+			if (it != tails.begin())
+				prev[a] = *(it - 1);
+			if (it == tails.end())
+				tails.push_back(a);
+			else
+				*it = a;
+		}
+		std::vector<std::pair<size_t, size_t>> series;
+		for (size_t a = tails.back(); a != SIZE_MAX; a = prev[a])
+			series.push_back(anchors[a]);
+		std::reverse(series.begin(), series.end());
+
+		// Gaps between anchors, pushed last first so that they are done in order
+		size_t hi[2] = { gap.hi[0], gap.hi[1] };
+		for (auto it = series.rbegin(); it != series.rend(); ++it)
+		{
+			matches.push_back(*it);
+			gaps.push_back({ { it->first + 1, it->second + 1 }, { hi[0], hi[1] } });
+			hi[0] = it->first;
+			hi[1] = it->second;
+		}
+		gaps.push_back({ { gap.lo[0], gap.lo[1] }, { hi[0], hi[1] } });
+	}
+
+	std::sort(matches.begin(), matches.end());
+	int64_t pos[2] = { 0, 0 };
+	for (const auto& match : matches)
+	{
+		const Chunk& c0 = m_chunks[0][match.first];
+		const Chunk& c1 = m_chunks[1][match.second];
+		if (pos[0] < c0.offset || pos[1] < c1.offset)
+			DiffGap(pos[0], c0.offset, pos[1], c1.offset);
+		pos[0] = c0.offset + c0.size;
+		pos[1] = c1.offset + c1.size;
+	}
+	if (pos[0] < m_size[0] || pos[1] < m_size[1])
+		DiffGap(pos[0], m_size[0], pos[1], m_size[1]);
+}
+
+/**
+ * @brief Diff the bytes between matched chunks.
+ */
+void BinaryDiff::DiffGap(int64_t begin0, int64_t end0, int64_t begin1, int64_t end1)
+{
+	while (begin0 < end0 && begin1 < end1 && m_data[0][begin0] == m_data[1][begin1])
+	{
+		++begin0;
+		++begin1;
+	}
+	while (begin0 < end0 && begin1 < end1 && m_data[0][end0 - 1] == m_data[1][end1 - 1])
+	{
+		--end0;
+		--end1;
+	}
+	if (begin0 == end0 && begin1 == end1)
+		return;
+	if (begin0 == end0 || begin1 == end1 ||
+		end0 - begin0 > MaxByteGap || end1 - begin1 > MaxByteGap ||
+		!DiffBytes(begin0, end0, begin1, end1))
+	{
+		AddRange(begin0, end0, begin1, end1);
+	}
+}
+
+/**
+ * @brief Diff bytes with Myers' O(ND) algorithm.
+ * @return false if there are more than MaxByteEdits edits.
+ */
+bool BinaryDiff::DiffBytes(int64_t begin0, int64_t end0, int64_t begin1, int64_t end1)
+{
+	const unsigned char *a = m_data[0] + begin0;
+	const unsigned char *b = m_data[1] + begin1;
+	const int64_t n = end0 - begin0;
+	const int64_t m = end1 - begin1;
+	const int offset = MaxByteEdits + 1;
+	std::vector<int64_t> v(2 * offset + 1, 0);
+	std::vector<std::vector<int64_t>> trace;
+	int dFound = -1;
+	for (int d = 0; d <= MaxByteEdits && dFound < 0; ++d)
+	{
+		trace.push_back(v);
+		for (int k = -d; k <= d; k += 2)
+		{
+			int64_t x = (k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1])) ?
+				v[offset + k + 1] : v[offset + k - 1] + 1;
+			int64_t y = x - k;
+			while (x < n && y < m && a[x] == b[y])
+			{
+				++x;
+				++y;
+			}
+			v[offset + k] = x;
+			if (x >= n && y >= m)
+			{
+				dFound = d;
+				break;
+			}
+		}
+	}
+	if (dFound < 0)
+		return false;
+
+	// Walk back the edits, each deletes or inserts one byte
+	std::vector<std::pair<int64_t, int64_t>> edits; // position before edit, y is -1 for deletions
+	int64_t x = n, y = m;
+	for (int d = dFound; d > 0; --d)
+	{
+		const std::vector<int64_t>& vprev = trace[d];
+		const int64_t k = x - y;
+		const bool bInsert = (k == -d || (k != d && vprev[offset + k - 1] < vprev[offset + k + 1]));
+		const int64_t prevk = bInsert ? k + 1 : k - 1;
+		const int64_t prevx = vprev[offset + prevk];
+		const int64_t prevy = prevx - prevk;
+		edits.emplace_back(prevx, bInsert ? prevy : -1 - prevy);
+		x = prevx;
+		y = prevy;
+	}
+	std::reverse(edits.begin(), edits.end());
+
+	int64_t range[4] = { -1, -1, -1, -1 }; // begin0, end0, begin1, end1
+	for (const auto& edit : edits)
+	{
+		const bool bInsert = edit.second >= 0;
+		const int64_t ex = edit.first;
+		const int64_t ey = bInsert ? edit.second : -1 - edit.second;
+		if (range[0] < 0 || ex != range[1] || ey != range[3])
+		{
+			if (range[0] >= 0)
+				AddRange(begin0 + range[0], begin0 + range[1], begin1 + range[2], begin1 + range[3]);
+			range[0] = range[1] = ex;
+			range[2] = range[3] = ey;
+		}
+		if (bInsert)
+			++range[3];
+		else
+			++range[1];
+	}
+	if (range[0] >= 0)
+		AddRange(begin0 + range[0], begin0 + range[1], begin1 + range[2], begin1 + range[3]);
+	return true;
+}
+
+/**
+ * @brief Add changed bytes, joining them to the previous range if only a
+ * few equal bytes are between.
+ */
+void BinaryDiff::AddRange(int64_t begin0, int64_t end0, int64_t begin1, int64_t end1)
+{
+	if (!m_ranges.empty())
+	{
+		Range& last = m_ranges.back();
+		if (begin0 - last.end[0] < MinEqualRun && begin1 - last.end[1] < MinEqualRun)
+		{
+			last.end[0] = end0;
+			last.end[1] = end1;
+			return;
+		}
+	}
+	m_ranges.push_back({ { begin0, begin1 }, { end0, end1 } });
+}
+
+/**
+ * @brief Diff two files, mapping them to memory.
+ * @param [in] files Paths of the files.
+ * @return DIFFCODE::SAME, DIFFCODE::DIFF, DIFFCODE::CMPERR or DIFFCODE::CMPABORT.
+ */
+int BinaryDiff::CompareFiles(const PathContext& files)
+{
+	std::unique_ptr<SharedMemory> mappings[2];
+	const unsigned char *data[2] = { nullptr, nullptr };
+	int64_t size[2] = { 0, 0 };
+	for (int i = 0; i < 2; ++i)
+	{
+		try
+		{
+			TFile file(files[i]);
+			size[i] = file.getSize();
+			// Empty files can't be mapped
+			if (size[i] > 0)
+			{
+				mappings[i].reset(new SharedMemory(file, SharedMemory::AM_READ));
+				data[i] = reinterpret_cast<const unsigned char *>(mappings[i]->begin());
+			}
+		}
+		catch (Poco::Exception&)
+		{
+			return DIFFCODE::CMPERR;
+		}
+	}
+	if (!Diff(data[0], size[0], data[1], size[1]))
+		return DIFFCODE::CMPABORT;
+	return m_ranges.empty() ? DIFFCODE::SAME : DIFFCODE::DIFF;
+}
+
+} // namespace CompareEngines
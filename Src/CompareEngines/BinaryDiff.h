@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  BinaryDiff.h
+ *
+ * @brief Declaration file for BinaryDiff
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class PathContext;
+class IAbortable;
+
+namespace CompareEngines
+{
+
+/**
+ * @brief Diff of binary data finding inserted, deleted and changed bytes.
+ *
+ * Both inputs are cut into content-defined chunks with a rolling gear hash,
+ * so that chunk boundaries are found again after an insertion or deletion.
+ * Chunks found once in both inputs are matched in order (patience diff) and
+ * the matches are extended over neighbouring equal chunks. The bytes between
+ * matched chunks are diffed byte by byte with Myers' algorithm, or reported
+ * as one changed range if they differ too much.
+ *
+ * All offsets are 64-bit, so the inputs can be memory-mapped files of any
+ * size.
+ */
+class BinaryDiff
+{
+public:
+	/** @brief Changed bytes, [begin, end) on each side, one side may be empty. */
+	struct Range
+	{
+		int64_t begin[2];
+		int64_t end[2];
+	};
+
+	/** @brief Minimum chunk size in bytes. */
+	static const int64_t MinChunkSize = 256;
+	/** @brief Maximum chunk size in bytes, average is about 4 KB. */
+	static const int64_t MaxChunkSize = 64 * 1024;
+	/** @brief Largest number of edits the byte diff of a gap may find. */
+	static const int MaxByteEdits = 256;
+	/** @brief Equal bytes between ranges below which the ranges are joined. */
+	static const int64_t MinEqualRun = 4;
+
+	BinaryDiff();
+	~BinaryDiff();
+	void SetAbortable(const IAbortable * piAbortable);
+	bool Diff(const unsigned char *data0, int64_t size0, const unsigned char *data1, int64_t size1);
+	int CompareFiles(const PathContext& files);
+	const std::vector<Range>& GetRanges() const { return m_ranges; }
+
+private:
+	/** @brief A content-defined chunk of one input. */
+	struct Chunk
+	{
+		int64_t offset;
+		int64_t size;
+		uint64_t hash;
+	};
+
+	static void FindChunks(const unsigned char *data, int64_t size, std::vector<Chunk>& chunks);
+	bool IsSameChunk(size_t i0, size_t i1) const;
+	void MatchChunks();
+	void DiffGap(int64_t begin0, int64_t end0, int64_t begin1, int64_t end1);
+	bool DiffBytes(int64_t begin0, int64_t end0, int64_t begin1, int64_t end1);
+	void AddRange(int64_t begin0, int64_t end0, int64_t begin1, int64_t end1);
+	bool ShouldAbort() const;
+
+	IAbortable * m_piAbortable;
+	const unsigned char *m_data[2];
+	int64_t m_size[2];
+	std::vector<Chunk> m_chunks[2];
+	std::vector<Range> m_ranges;
+	bool m_bAborted;
+};
+
+} // namespace CompareEngines
@@ -33,6 +33,7 @@ ByteCompare::ByteCompare()
 		: m_pOptions(nullptr)
 		, m_piAbortable(nullptr)
 		, m_inf(nullptr)
+		, m_nBytesRead(0)
 {
 }
 
@@ -116,6 +117,7 @@ int ByteCompare::CompareFiles(FileLocation *location)
 		eof[i] = false;
 	}
 
+	m_nBytesRead = 0;
 	ByteComparator comparator(m_pOptions.get());
 
 	// Begin loop
@@ -145,6 +147,7 @@ int ByteCompare::CompareFiles(FileLocation *location)
 				if (rtn < space)
 					eof[i] = true;
 				bfend[i] += rtn;
+				m_nBytesRead += rtn;
 				if (m_inf[0].desc == m_inf[1].desc)
 				{
 					bfstart[1] = bfstart[0];
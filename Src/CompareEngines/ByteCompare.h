@@ -6,6 +6,7 @@
 #pragma once
 
 #include <memory>
+#include <cstdint>
 #include "FileTextStats.h"
 
 class CompareOptions;
@@ -34,12 +35,14 @@ public:
 	void SetFileData(int items, file_data *data);
 	int CompareFiles(FileLocation *location);
 	void GetTextStats(int side, FileTextStats *stats) const;
+	int64_t GetBytesRead() const { return m_nBytesRead; }
 
 private:
 	std::unique_ptr<QuickCompareOptions> m_pOptions; /**< Compare options for diffutils. */
 	IAbortable * m_piAbortable;
 	file_data * m_inf; /**< Compared files data (for diffutils). */
 	FileTextStats m_textStats[2];
+	int64_t m_nBytesRead; /**< Bytes read by last CompareFiles() */
 
 };
 
@@ -6,30 +6,26 @@
 
 #include "pch.h"
 #include "ImageCompare.h"
+#include "ImageDiff.h"
+#include <Poco/SharedMemory.h>
 #include "DiffItem.h"
 #include "PathContext.h"
+#include "TFile.h"
 #include "WinIMergeLib.h"
 #include <Windows.h>
 
+using Poco::SharedMemory;
+
 namespace CompareEngines
 {
 
 ImageCompare::ImageCompare()
 	: m_colorDistanceThreshold(0.0)
 	, m_pImgMergeWindow(nullptr)
+	, m_bImgMergeWindowLoaded(false)
+	, m_pSignatureCache(nullptr)
+	, m_nBytesRead(0)
 {
-	HMODULE hModule = GetModuleHandleW(L"WinIMergeLib.dll");
-	if (hModule == nullptr)
-	{
-		hModule = LoadLibraryW(L"WinIMerge\\WinIMergeLib.dll");
-		if (hModule == nullptr)
-			return;
-	}
-	IImgMergeWindow* (*pfnWinIMerge_CreateWindowless)() =
-		(IImgMergeWindow * (*)())GetProcAddress(hModule, "WinIMerge_CreateWindowless");
-	if (pfnWinIMerge_CreateWindowless == nullptr)
-		return;
-	m_pImgMergeWindow = pfnWinIMerge_CreateWindowless();
 }
 
 ImageCompare::~ImageCompare()
@@ -47,26 +43,132 @@ ImageCompare::~ImageCompare()
 	}
 }
 
-int ImageCompare::compare_files(const String& file1, const String& file2) const
+/**
+ * @brief Get the windowless WinIMergeLib image compare, loading the library
+ * at first use. Only images ImageDiff cannot decode need it.
+ */
+IImgMergeWindow *ImageCompare::GetImgMergeWindow() const
 {
-	if (!m_pImgMergeWindow)
+	if (m_bImgMergeWindowLoaded)
+		return m_pImgMergeWindow;
+	m_bImgMergeWindowLoaded = true;
+	HMODULE hModule = GetModuleHandleW(L"WinIMergeLib.dll");
+	if (hModule == nullptr)
+	{
+		hModule = LoadLibraryW(L"WinIMerge\\WinIMergeLib.dll");
+		if (hModule == nullptr)
+			return nullptr;
+	}
+	IImgMergeWindow* (*pfnWinIMerge_CreateWindowless)() =
+		(IImgMergeWindow * (*)())GetProcAddress(hModule, "WinIMerge_CreateWindowless");
+	if (pfnWinIMerge_CreateWindowless == nullptr)
+		return nullptr;
+	m_pImgMergeWindow = pfnWinIMerge_CreateWindowless();
+	return m_pImgMergeWindow;
+}
+
+/**
+ * @brief Compare two image files.
+ * Files with the same bytes are the same image. Other PNG, BMP and Netpbm
+ * images are compared by ImageDiff: first by their signatures, which are
+ * cached, then pixel by pixel when the signatures are close. Other formats
+ * and images ImageDiff cannot decode are compared by WinIMergeLib.
+ * @param [in] index1 Index of first file in files and di.
+ * @param [in] index2 Index of second file in files and di.
+ */
+int ImageCompare::compare_files(const PathContext& files, const DIFFITEM& di, int index1, int index2) const
+{
+	const int index[2] = { index1, index2 };
+	ImageDiff::Signature signatures[2];
+	bool bCached[2] = { false, false };
+	if (m_pSignatureCache != nullptr)
+	{
+		for (int i = 0; i < 2; ++i)
+		{
+			const DiffFileInfo& info = di.diffFileInfo[index[i]];
+			bCached[i] = m_pSignatureCache->Lookup(files[index[i]], info.size, info.mtime.epochMicroseconds(), signatures[i]);
+		}
+		if (bCached[0] && bCached[1] &&
+			ImageDiff::IsSignatureDifferent(signatures[0], signatures[1], m_colorDistanceThreshold))
+			return DIFFCODE::DIFF;
+	}
+
+	std::unique_ptr<SharedMemory> mappings[2];
+	for (int i = 0; i < 2; ++i)
+	{
+		try
+		{
+			TFile file(files[index[i]]);
+			// Empty files can't be mapped
+			if (file.getSize() > 0)
+				mappings[i].reset(new SharedMemory(file, SharedMemory::AM_READ));
+		}
+		catch (Poco::Exception&)
+		{
+		}
+	}
+	if (mappings[0] != nullptr && mappings[1] != nullptr)
+	{
+		const unsigned char *data[2];
+		size_t size[2];
+		for (int i = 0; i < 2; ++i)
+		{
+			data[i] = reinterpret_cast<const unsigned char *>(mappings[i]->begin());
+			size[i] = static_cast<size_t>(mappings[i]->end() - mappings[i]->begin());
+			m_nBytesRead += size[i];
+		}
+		if (size[0] == size[1] && memcmp(data[0], data[1], size[0]) == 0)
+			return DIFFCODE::SAME;
+
+		try
+		{
+			ImageDiff::Image images[2];
+			if (ImageDiff::Decode(data[0], size[0], images[0]) && ImageDiff::Decode(data[1], size[1], images[1]))
+			{
+				for (int i = 0; i < 2; ++i)
+				{
+					if (bCached[i])
+						continue;
+					ImageDiff::GetSignature(images[i], signatures[i]);
+					if (m_pSignatureCache != nullptr)
+					{
+						const DiffFileInfo& info = di.diffFileInfo[index[i]];
+						m_pSignatureCache->Add(files[index[i]], info.size, info.mtime.epochMicroseconds(), signatures[i]);
+					}
+				}
+				if (ImageDiff::IsSignatureDifferent(signatures[0], signatures[1], m_colorDistanceThreshold))
+					return DIFFCODE::DIFF;
+				return ImageDiff::IsDifferent(images[0], images[1], m_colorDistanceThreshold) ?
+					DIFFCODE::DIFF : DIFFCODE::SAME;
+			}
+		}
+		catch (std::bad_alloc&)
+		{
+			// Decoded pixels of both images didn't fit in memory
+			return DIFFCODE::CMPERR;
+		}
+	}
+
+	IImgMergeWindow *pImgMergeWindow = GetImgMergeWindow();
+	if (!pImgMergeWindow)
 		return DIFFCODE::CMPERR;
 	int code = DIFFCODE::CMPERR;
-	m_pImgMergeWindow->SetColorDistanceThreshold(m_colorDistanceThreshold);
-	if (m_pImgMergeWindow->OpenImages(file1.c_str(), file2.c_str()))
+	pImgMergeWindow->SetColorDistanceThreshold(m_colorDistanceThreshold);
+	m_nBytesRead += di.diffFileInfo[index1].size + di.diffFileInfo[index2].size;
+	if (pImgMergeWindow->OpenImages(files[index1].c_str(), files[index2].c_str()))
 	{
 		bool bImgDiff = true;
-		if (m_pImgMergeWindow->GetPageCount(0) == m_pImgMergeWindow->GetPageCount(1))
+		if (pImgMergeWindow->GetPageCount(0) == pImgMergeWindow->GetPageCount(1))
 		{
-			for (int page = 0; page < m_pImgMergeWindow->GetPageCount(0); ++page)
+			for (int page = 0; page < pImgMergeWindow->GetPageCount(0); ++page)
 			{
-				m_pImgMergeWindow->SetCurrentPageAll(page);
-				if (m_pImgMergeWindow->GetDiffCount() == 0)
+				pImgMergeWindow->SetCurrentPageAll(page);
+				if (pImgMergeWindow->GetDiffCount() == 0)
 					bImgDiff = false;
 			}
 		}
 		code = bImgDiff ? DIFFCODE::DIFF : DIFFCODE::SAME;
-		m_pImgMergeWindow->CloseImages();
+		pImgMergeWindow->CloseImages();
 	}
 	return code;
 }
@@ -78,16 +180,17 @@ int ImageCompare::compare_files(const String& file1, const String& file2) const
  */
 int ImageCompare::CompareFiles(const PathContext& files, const DIFFITEM &di) const
 {
+	m_nBytesRead = 0;
 	switch (files.GetSize())
 	{
 	case 2:
 		return (!di.diffcode.exists(0) || !di.diffcode.exists(1)) ?
-			DIFFCODE::DIFF : compare_files(files[0], files[1]);
+			DIFFCODE::DIFF : compare_files(files, di, 0, 1);
 	case 3:
 		unsigned code10 = (!di.diffcode.exists(1) || !di.diffcode.exists(0)) ?
-			DIFFCODE::DIFF : compare_files(files[1], files[0]);
+			DIFFCODE::DIFF : compare_files(files, di, 1, 0);
 		unsigned code12 = (!di.diffcode.exists(1) || !di.diffcode.exists(2)) ?
-			DIFFCODE::DIFF : compare_files(files[1], files[2]);
+			DIFFCODE::DIFF : compare_files(files, di, 1, 2);
 		unsigned code02 = DIFFCODE::SAME;
 		if (code10 == DIFFCODE::SAME && code12 == DIFFCODE::SAME)
 			return DIFFCODE::SAME;
@@ -98,7 +201,7 @@ int ImageCompare::CompareFiles(const PathContext& files, const DIFFITEM &di) con
 		else if (code10 == DIFFCODE::DIFF && code12 == DIFFCODE::DIFF)
 		{
 			code02 = (!di.diffcode.exists(0) || !di.diffcode.exists(2)) ?
-				DIFFCODE::DIFF : compare_files(files[0], files[2]);
+				DIFFCODE::DIFF : compare_files(files, di, 0, 2);
 			if (code02 == DIFFCODE::SAME)
 				return DIFFCODE::DIFF | DIFFCODE::DIFF2NDONLY;
 		}
@@ -6,6 +6,7 @@
 #pragma once
 
 #include <memory>
+#include <cstdint>
 #include "UnicodeString.h"
 
 class DIFFITEM;
@@ -15,6 +16,8 @@ struct IImgMergeWindow;
 namespace CompareEngines
 {
 
+class ImageSignatureCache;
+
 /**
  * @brief A image compare class.
  * This compare method compares files by their image contents.
@@ -25,13 +28,19 @@ public:
 	ImageCompare();
 	~ImageCompare();
 	int CompareFiles(const PathContext& files, const DIFFITEM &di) const;
+	int64_t GetBytesRead() const { return m_nBytesRead; }
 
     double GetColorDistanceThreshold() const { return m_colorDistanceThreshold; }
     void SetColorDistanceThreshold(double colorDistanceThreshold) { m_colorDistanceThreshold = colorDistanceThreshold; };
+    void SetSignatureCache(ImageSignatureCache *pSignatureCache) { m_pSignatureCache = pSignatureCache; }
 private:
-    int compare_files(const String& file1, const String& file2) const;
+    int compare_files(const PathContext& files, const DIFFITEM& di, int index1, int index2) const;
+    IImgMergeWindow *GetImgMergeWindow() const;
     mutable IImgMergeWindow *m_pImgMergeWindow;
+    mutable bool m_bImgMergeWindowLoaded;
     double m_colorDistanceThreshold;
+    ImageSignatureCache *m_pSignatureCache; /**< Signatures of files compared before, or nullptr */
+    mutable int64_t m_nBytesRead; /**< Bytes read by last CompareFiles() */
 };
 
 } // namespace CompareEngines
@@ -0,0 +1,693 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  ImageDiff.cpp
+ *
+ * @brief Implementation file for ImageDiff
+ */
+
+#include "pch.h"
+#include "ImageDiff.h"
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define IMAGEDIFF_SSE2 1
+#endif
+#include <Poco/MemoryStream.h>
+#include <Poco/InflatingStream.h>
+#include <Poco/Exception.h>
+#include "DebugNew.h"
+
+namespace CompareEngines
+{
+
+namespace
+{
+
+/**
+ * @brief Largest image decoded, in pixels (64 MB of RGBA per image, and
+ * several threads may decode at once). Larger images are left to WinIMergeLib.
+ */
+const int64_t MaxPixels = 16 * 1024 * 1024;
+
+inline uint32_t ReadBE32(const unsigned char *p)
+{
+	return (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+inline unsigned ReadLE16(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+inline uint32_t ReadLE32(const unsigned char *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+/**
+ * @brief Deflate cannot compress data more than this, a larger ratio means
+ * the image data is truncated.
+ */
+const int64_t MaxDeflateRatio = 1032;
+
+/** @brief Is the size of an image sane? */
+inline bool IsValidSize(int64_t width, int64_t height)
+{
+	return width > 0 && height > 0 && width <= MaxPixels / height;
+}
+
+/** @brief Allocate pixels of an image, the size must be valid. */
+void AllocImage(ImageDiff::Image& image, int64_t width, int64_t height)
+{
+	image.width = static_cast<int>(width);
+	image.height = static_cast<int>(height);
+	image.pixels.assign(static_cast<size_t>(width * height * 4), 0);
+}
+
+inline void SetPixel(ImageDiff::Image& image, int x, int y, unsigned r, unsigned g, unsigned b, unsigned a)
+{
+	unsigned char *p = &image.pixels[(static_cast<size_t>(y) * image.width + x) * 4];
+	p[0] = static_cast<unsigned char>(r);
+	p[1] = static_cast<unsigned char>(g);
+	p[2] = static_cast<unsigned char>(b);
+	p[3] = static_cast<unsigned char>(a);
+}
+
+/** @brief Scale a sample of maxValue levels to 0-255. */
+inline unsigned Scale(unsigned value, unsigned maxValue)
+{
+	if (maxValue == 255)
+		return value;
+	if (value >= maxValue)
+		return 255;
+	return (value * 255 + maxValue / 2) / maxValue;
+}
+
+/** @brief Get PNG sample of a row, 16-bit samples as they are. */
+inline unsigned PngSample(const unsigned char *row, size_t index, int bitDepth)
+{
+	switch (bitDepth)
+	{
+	case 8:
+		return row[index];
+	case 16:
+		return (row[index * 2] << 8) | row[index * 2 + 1];
+	default:
+		const size_t bit = index * bitDepth;
+		return (row[bit >> 3] >> (8 - bitDepth - (bit & 7))) & ((1 << bitDepth) - 1);
+	}
+}
+
+inline int Paeth(int a, int b, int c)
+{
+	const int p = a + b - c;
+	const int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+	if (pa <= pb && pa <= pc)
+		return a;
+	return (pb <= pc) ? b : c;
+}
+
+/** @brief Reverse PNG filter of a row in place. */
+bool Unfilter(int filter, unsigned char *row, const unsigned char *prev, size_t rowBytes, size_t bpp)
+{
+	switch (filter)
+	{
+	case 0:
+		break;
+	case 1:
+		for (size_t i = bpp; i < rowBytes; ++i)
+			row[i] = static_cast<unsigned char>(row[i] + row[i - bpp]);
+		break;
+	case 2:
+		for (size_t i = 0; i < rowBytes; ++i)
+			row[i] = static_cast<unsigned char>(row[i] + prev[i]);
+		break;
+	case 3:
+		for (size_t i = 0; i < rowBytes; ++i)
+			row[i] = static_cast<unsigned char>(row[i] + (((i >= bpp) ? row[i - bpp] : 0) + prev[i]) / 2);
+		break;
+	case 4:
+		for (size_t i = 0; i < rowBytes; ++i)
+			row[i] = static_cast<unsigned char>(row[i] +
+				Paeth((i >= bpp) ? row[i - bpp] : 0, prev[i], (i >= bpp) ? prev[i - bpp] : 0));
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Decode a PNG image, all color types and bit depths, interlaced or not.
+ * 16-bit samples are truncated to 8 bits.
+ */
+bool DecodePng(const unsigned char *data, size_t size, ImageDiff::Image& image)
+{
+	int64_t width = 0, height = 0;
+	int bitDepth = 0, colorType = -1, interlace = 0;
+	std::vector<unsigned char> palette; // RGBA entries
+	bool bTransparent = false;
+	unsigned transparent[3] = {};
+	std::string idat;
+
+	for (size_t pos = 8; pos + 12 <= size; )
+	{
+		const uint32_t length = ReadBE32(data + pos);
+		if (length > size - pos - 12)
+			return false;
+		const unsigned char *type = data + pos + 4;
+		const unsigned char *chunk = data + pos + 8;
+		if (memcmp(type, "IHDR", 4) == 0 && length >= 13)
+		{
+			width = ReadBE32(chunk);
+			height = ReadBE32(chunk + 4);
+			bitDepth = chunk[8];
+			colorType = chunk[9];
+			if (chunk[10] != 0 || chunk[11] != 0)
+				return false;
+			interlace = chunk[12];
+		}
+		else if (memcmp(type, "PLTE", 4) == 0)
+		{
+			for (uint32_t i = 0; i + 3 <= length; i += 3)
+				palette.insert(palette.end(), { chunk[i], chunk[i + 1], chunk[i + 2], 255 });
+		}
+		else if (memcmp(type, "tRNS", 4) == 0)
+		{
+			if (colorType == 3)
+			{
+				for (uint32_t i = 0; i < length && i * 4 < palette.size(); ++i)
+					palette[i * 4 + 3] = chunk[i];
+			}
+			else if ((colorType == 0 && length >= 2) || (colorType == 2 && length >= 6))
+			{
+				bTransparent = true;
+				for (uint32_t i = 0; i < length / 2 && i < 3; ++i)
+					transparent[i] = (chunk[i * 2] << 8) | chunk[i * 2 + 1];
+			}
+		}
+		else if (memcmp(type, "IDAT", 4) == 0)
+			idat.append(reinterpret_cast<const char *>(chunk), length);
+		else if (memcmp(type, "IEND", 4) == 0)
+			break;
+		pos += 12 + length;
+	}
+
+	int channels;
+	switch (colorType)
+	{
+	case 0: channels = 1; break;
+	case 2: channels = 3; break;
+	case 3: channels = 1; break;
+	case 4: channels = 2; break;
+	case 6: channels = 4; break;
+	default: return false;
+	}
+	if ((bitDepth != 1 && bitDepth != 2 && bitDepth != 4 && bitDepth != 8 && bitDepth != 16) ||
+		(colorType != 0 && colorType != 3 && bitDepth < 8) || (colorType == 3 && bitDepth > 8) ||
+		(colorType == 3 && palette.empty()) || interlace > 1)
+		return false;
+	if (!IsValidSize(width, height))
+		return false;
+
+	// Pass origin and step of each pass, the whole image if not interlaced
+	static const int adam7[7][4] = {
+		{ 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 },
+		{ 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 } };
+	static const int progressive[1][4] = { { 0, 0, 1, 1 } };
+	const int (*passes)[4] = interlace ? adam7 : progressive;
+	const int nPasses = interlace ? 7 : 1;
+
+	const size_t bitsPerPixel = static_cast<size_t>(channels) * bitDepth;
+	const size_t bpp = (bitsPerPixel + 7) / 8;
+	size_t rawSize = 0;
+	for (int pass = 0; pass < nPasses; ++pass)
+	{
+		const int64_t pw = (width - passes[pass][0] + passes[pass][2] - 1) / passes[pass][2];
+		const int64_t ph = (height - passes[pass][1] + passes[pass][3] - 1) / passes[pass][3];
+		if (pw > 0 && ph > 0)
+			rawSize += static_cast<size_t>(ph) * (1 + (pw * bitsPerPixel + 7) / 8);
+	}
+	if (rawSize / MaxDeflateRatio > idat.size())
+		return false;
+
+	AllocImage(image, width, height);
+	std::vector<unsigned char> raw(rawSize);
+	try
+	{
+		Poco::MemoryInputStream compressed(idat.data(), idat.size());
+		Poco::InflatingInputStream inflater(compressed, Poco::InflatingStreamBuf::STREAM_ZLIB);
+		inflater.read(reinterpret_cast<char *>(raw.data()), rawSize);
+		if (static_cast<size_t>(inflater.gcount()) != rawSize)
+			return false;
+	}
+	catch (Poco::Exception&)
+	{
+		return false;
+	}
+
+	const unsigned maxValue = (1 << (bitDepth == 16 ? 8 : bitDepth)) - 1;
+	const int sampleShift = (bitDepth == 16) ? 8 : 0;
+	size_t offset = 0;
+	for (int pass = 0; pass < nPasses; ++pass)
+	{
+		const int x0 = passes[pass][0], y0 = passes[pass][1], dx = passes[pass][2], dy = passes[pass][3];
+		const int pw = static_cast<int>((width - x0 + dx - 1) / dx);
+		const int ph = static_cast<int>((height - y0 + dy - 1) / dy);
+		if (pw <= 0 || ph <= 0)
+			continue;
+		const size_t rowBytes = (pw * bitsPerPixel + 7) / 8;
+		const std::vector<unsigned char> zeros(rowBytes);
+		const unsigned char *prev = zeros.data();
+		for (int y = 0; y < ph; ++y)
+		{
+			unsigned char *row = &raw[offset + 1];
+			if (!Unfilter(raw[offset], row, prev, rowBytes, bpp))
+				return false;
+			for (int x = 0; x < pw; ++x)
+			{
+				const size_t s = static_cast<size_t>(x) * channels;
+				unsigned r, g, b, a = 255;
+				switch (colorType)
+				{
+				case 0:
+					r = PngSample(row, s, bitDepth);
+					if (bTransparent && r == transparent[0])
+						a = 0;
+					r = g = b = Scale(r >> sampleShift, maxValue);
+					break;
+				case 2:
+					r = PngSample(row, s, bitDepth);
+					g = PngSample(row, s + 1, bitDepth);
+					b = PngSample(row, s + 2, bitDepth);
+					if (bTransparent && r == transparent[0] && g == transparent[1] && b == transparent[2])
+						a = 0;
+					r >>= sampleShift;
+					g >>= sampleShift;
+					b >>= sampleShift;
+					break;
+				case 3:
+				{
+					const size_t index = PngSample(row, s, bitDepth) * 4;
+					if (index >= palette.size())
+						return false;
+					r = palette[index];
+					g = palette[index + 1];
+					b = palette[index + 2];
+					a = palette[index + 3];
+					break;
+				}
+				case 4:
+					r = g = b = PngSample(row, s, bitDepth) >> sampleShift;
+					a = PngSample(row, s + 1, bitDepth) >> sampleShift;
+					break;
+				default:
+					r = PngSample(row, s, bitDepth) >> sampleShift;
+					g = PngSample(row, s + 1, bitDepth) >> sampleShift;
+					b = PngSample(row, s + 2, bitDepth) >> sampleShift;
+					a = PngSample(row, s + 3, bitDepth) >> sampleShift;
+					break;
+				}
+				SetPixel(image, x0 + x * dx, y0 + y * dy, r, g, b, a);
+			}
+			prev = row;
+			offset += 1 + rowBytes;
+		}
+	}
+	return true;
+}
+
+/** @brief Get 8-bit value of the bits of a BMP bit field mask. */
+unsigned MaskValue(uint32_t value, uint32_t mask, unsigned defaultValue)
+{
+	if (mask == 0)
+		return defaultValue;
+	int shift = 0;
+	while (((mask >> shift) & 1) == 0)
+		++shift;
+	int bits = 0;
+	while (shift + bits < 32 && ((mask >> (shift + bits)) & 1) != 0)
+		++bits;
+	const uint32_t v = (value & mask) >> shift;
+	return (bits >= 8) ? (v >> (bits - 8)) : Scale(v, (1u << bits) - 1);
+}
+
+/**
+ * @brief Decode an uncompressed or bit field BMP image.
+ * RLE compressed images are not supported.
+ */
+bool DecodeBmp(const unsigned char *data, size_t size, ImageDiff::Image& image)
+{
+	if (size < 26)
+		return false;
+	const uint32_t offBits = ReadLE32(data + 10);
+	const uint32_t headerSize = ReadLE32(data + 14);
+	int64_t width, height;
+	unsigned bitCount;
+	uint32_t compression = 0, colorsUsed = 0;
+	uint32_t masks[4] = {};
+	size_t paletteEntrySize = 4;
+	if (headerSize == 12)
+	{
+		width = ReadLE16(data + 18);
+		height = static_cast<int16_t>(ReadLE16(data + 20));
+		bitCount = ReadLE16(data + 24);
+		paletteEntrySize = 3;
+	}
+	else if (headerSize >= 40 && headerSize <= size - 14)
+	{
+		width = static_cast<int32_t>(ReadLE32(data + 18));
+		height = static_cast<int32_t>(ReadLE32(data + 22));
+		bitCount = ReadLE16(data + 28);
+		compression = ReadLE32(data + 30);
+		colorsUsed = ReadLE32(data + 46);
+		if (compression == 3 || compression == 6) // BI_BITFIELDS, BI_ALPHABITFIELDS
+		{
+			// Masks are in V4/V5 headers, or follow the header
+			const size_t nMasks = (compression == 6 || headerSize >= 56) ? 4 : 3;
+			if (14 + 40 + nMasks * 4 > size)
+				return false;
+			for (size_t i = 0; i < nMasks; ++i)
+				masks[i] = ReadLE32(data + 14 + 40 + i * 4);
+		}
+		else if (compression != 0)
+			return false;
+	}
+	else
+		return false;
+
+	if (compression == 0)
+	{
+		if (bitCount == 16)
+		{
+			masks[0] = 0x7c00; masks[1] = 0x03e0; masks[2] = 0x001f;
+		}
+		else if (bitCount == 32)
+		{
+			masks[0] = 0xff0000; masks[1] = 0x00ff00; masks[2] = 0x0000ff;
+		}
+	}
+	else if (bitCount != 16 && bitCount != 32)
+		return false;
+	if (bitCount != 1 && bitCount != 4 && bitCount != 8 && bitCount != 16 && bitCount != 24 && bitCount != 32)
+		return false;
+
+	const bool bTopDown = height < 0;
+	if (bTopDown)
+		height = -height;
+	if (!IsValidSize(width, height))
+		return false;
+
+	const unsigned char *palette = data + 14 + headerSize + ((compression == 3 && headerSize == 40) ? 12 : 0);
+	size_t nColors = 0;
+	if (bitCount <= 8)
+	{
+		nColors = (colorsUsed != 0 && colorsUsed < (1u << bitCount)) ? colorsUsed : (1u << bitCount);
+		if (static_cast<size_t>(palette - data) + nColors * paletteEntrySize > size)
+			return false;
+	}
+	const size_t stride = static_cast<size_t>((width * bitCount + 31) / 32) * 4;
+	if (offBits > size || stride * height > size - offBits)
+		return false;
+	AllocImage(image, width, height);
+
+	for (int y = 0; y < image.height; ++y)
+	{
+		const unsigned char *src = data + offBits + stride * (bTopDown ? y : image.height - 1 - y);
+		for (int x = 0; x < image.width; ++x)
+		{
+			switch (bitCount)
+			{
+			case 24:
+				SetPixel(image, x, y, src[x * 3 + 2], src[x * 3 + 1], src[x * 3], 255);
+				break;
+			case 16:
+			case 32:
+			{
+				const uint32_t value = (bitCount == 16) ? ReadLE16(src + x * 2) : ReadLE32(src + x * 4);
+				SetPixel(image, x, y, MaskValue(value, masks[0], 0), MaskValue(value, masks[1], 0),
+					MaskValue(value, masks[2], 0), MaskValue(value, masks[3], 255));
+				break;
+			}
+			default:
+			{
+				const size_t bit = static_cast<size_t>(x) * bitCount;
+				const size_t index = (src[bit >> 3] >> (8 - bitCount - (bit & 7))) & ((1 << bitCount) - 1);
+				if (index >= nColors)
+					return false;
+				const unsigned char *color = palette + index * paletteEntrySize;
+				SetPixel(image, x, y, color[2], color[1], color[0], 255);
+				break;
+			}
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Decode a Netpbm image, ASCII (P1-P3) or binary (P4-P6).
+ */
+bool DecodePnm(const unsigned char *data, size_t size, ImageDiff::Image& image)
+{
+	const int kind = data[1] - '0';
+	size_t pos = 2;
+	auto skipSpace = [&]()
+	{
+		while (pos < size && (isspace(data[pos]) || data[pos] == '#'))
+		{
+			if (data[pos] == '#')
+			{
+				while (pos < size && data[pos] != '\n')
+					++pos;
+			}
+			else
+				++pos;
+		}
+	};
+	auto readNumber = [&](unsigned& value) -> bool
+	{
+		skipSpace();
+		if (pos >= size || !isdigit(data[pos]))
+			return false;
+		value = 0;
+		while (pos < size && isdigit(data[pos]) && value < 0x10000000)
+			value = value * 10 + (data[pos++] - '0');
+		return true;
+	};
+
+	unsigned width, height, maxValue = 1;
+	if (!readNumber(width) || !readNumber(height))
+		return false;
+	if (kind != 1 && kind != 4 && (!readNumber(maxValue) || maxValue == 0 || maxValue > 65535))
+		return false;
+	// One whitespace char separates the header from binary data
+	if (kind >= 4)
+		++pos;
+	if (!IsValidSize(width, height) || pos > size)
+		return false;
+
+	// Check the data size, ASCII samples take at least one char
+	const int channels = (kind == 3 || kind == 6) ? 3 : 1;
+	const size_t sampleSize = (maxValue > 255) ? 2 : 1;
+	const size_t dataSize = (kind == 4) ? static_cast<size_t>((width + 7) / 8) * height :
+		static_cast<size_t>(width) * height * channels * (kind >= 5 ? sampleSize : 1);
+	if (dataSize > size - pos)
+		return false;
+	AllocImage(image, width, height);
+
+	for (unsigned y = 0; y < height; ++y)
+	{
+		for (unsigned x = 0; x < width; ++x)
+		{
+			unsigned samples[3] = {};
+			for (int c = 0; c < channels; ++c)
+			{
+				unsigned& value = samples[c];
+				switch (kind)
+				{
+				case 1:
+					skipSpace();
+					if (pos >= size || (data[pos] != '0' && data[pos] != '1'))
+						return false;
+					value = data[pos++] == '1' ? 0 : 1; // 1 is black
+					break;
+				case 4:
+					value = ((data[pos + (width + 7) / 8 * y + x / 8] >> (7 - x % 8)) & 1) ? 0 : 1;
+					break;
+				case 2:
+				case 3:
+					if (!readNumber(value))
+						return false;
+					break;
+				default:
+					value = (sampleSize == 1) ? data[pos] : ((data[pos] << 8) | data[pos + 1]);
+					pos += sampleSize;
+					break;
+				}
+				value = Scale(value, maxValue);
+			}
+			if (channels == 1)
+				SetPixel(image, x, y, samples[0], samples[0], samples[0], 255);
+			else
+				SetPixel(image, x, y, samples[0], samples[1], samples[2], 255);
+		}
+	}
+	return true;
+}
+
+}
+
+/**
+ * @brief Decode an image in memory.
+ * @return false if the format is not supported or the image is corrupt.
+ */
+bool ImageDiff::Decode(const unsigned char *data, size_t size, Image& image)
+{
+	static const unsigned char pngSignature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	if (size >= 8 && memcmp(data, pngSignature, 8) == 0)
+		return DecodePng(data, size, image);
+	if (size >= 2 && data[0] == 'B' && data[1] == 'M')
+		return DecodeBmp(data, size, image);
+	if (size >= 3 && data[0] == 'P' && data[1] >= '1' && data[1] <= '6' && isspace(data[2]))
+		return DecodePnm(data, size, image);
+	return false;
+}
+
+/**
+ * @brief Are any pixels of two rows farther apart than allowed?
+ * @param [in] maxDistance2 Largest squared RGBA distance of equal pixels.
+ */
+bool ImageDiff::IsRowDifferent(const unsigned char *row0, const unsigned char *row1, int width, int maxDistance2)
+{
+	if (maxDistance2 <= 0)
+		return memcmp(row0, row1, static_cast<size_t>(width) * 4) != 0;
+	int x = 0;
+#ifdef IMAGEDIFF_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i limit = _mm_set1_epi32(maxDistance2);
+	for (; x + 4 <= width; x += 4)
+	{
+		const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row0 + x * 4));
+		const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row1 + x * 4));
+		// Absolute differences of 4 pixels, squared and summed by channel pairs
+		const __m128i d = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+		const __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(d, zero));
+		const __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(d, zero));
+		const __m128 lof = _mm_castsi128_ps(lo), hif = _mm_castsi128_ps(hi);
+		const __m128i dist2 = _mm_add_epi32(
+			_mm_castps_si128(_mm_shuffle_ps(lof, hif, _MM_SHUFFLE(2, 0, 2, 0))),
+			_mm_castps_si128(_mm_shuffle_ps(lof, hif, _MM_SHUFFLE(3, 1, 3, 1))));
+		if (_mm_movemask_epi8(_mm_cmpgt_epi32(dist2, limit)) != 0)
+			return true;
+	}
+#endif
+	for (; x < width; ++x)
+	{
+		int dist2 = 0;
+		for (int c = 0; c < 4; ++c)
+		{
+			const int d = row0[x * 4 + c] - row1[x * 4 + c];
+			dist2 += d * d;
+		}
+		if (dist2 > maxDistance2)
+			return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Do two images differ?
+ * Images of different size always differ. Pixels are equal when the
+ * distance of their RGBA values is not above the threshold, as in
+ * WinIMergeLib.
+ */
+bool ImageDiff::IsDifferent(const Image& image0, const Image& image1, double colorDistanceThreshold)
+{
+	if (image0.width != image1.width || image0.height != image1.height)
+		return true;
+	const double threshold2 = colorDistanceThreshold * colorDistanceThreshold;
+	if (colorDistanceThreshold > 0 && threshold2 >= MaxDistance2)
+		return false;
+	const int maxDistance2 = (colorDistanceThreshold > 0) ? static_cast<int>(threshold2) : 0;
+	const size_t stride = static_cast<size_t>(image0.width) * 4;
+	for (int y = 0; y < image0.height; ++y)
+	{
+		if (IsRowDifferent(&image0.pixels[y * stride], &image1.pixels[y * stride], image0.width, maxDistance2))
+			return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Get the signature of an image.
+ */
+void ImageDiff::GetSignature(const Image& image, Signature& signature)
+{
+	const int n = Signature::GridSize;
+	signature.width = image.width;
+	signature.height = image.height;
+	for (int cy = 0; cy < n; ++cy)
+	{
+		const int y0 = static_cast<int>(static_cast<int64_t>(image.height) * cy / n);
+		const int y1 = static_cast<int>(static_cast<int64_t>(image.height) * (cy + 1) / n);
+		for (int cx = 0; cx < n; ++cx)
+		{
+			const int x0 = static_cast<int>(static_cast<int64_t>(image.width) * cx / n);
+			const int x1 = static_cast<int>(static_cast<int64_t>(image.width) * (cx + 1) / n);
+			uint64_t sum = 0;
+			for (int y = y0; y < y1; ++y)
+			{
+				const unsigned char *p = &image.pixels[(static_cast<size_t>(y) * image.width + x0) * 4];
+				for (int x = x0; x < x1; ++x, p += 4)
+					sum += 77 * p[0] + 150 * p[1] + 29 * p[2];
+			}
+			const int64_t count = static_cast<int64_t>(y1 - y0) * (x1 - x0);
+			signature.luma[cy * n + cx] = static_cast<uint16_t>(count > 0 ? sum / count : 0);
+		}
+	}
+}
+
+/**
+ * @brief Do the signatures show that two images differ?
+ * Where every pixel of two images is within the threshold, so is every
+ * channel and the mean luminance of every cell. A cell farther apart than
+ * that means the images differ. Equal signatures do not mean equal images.
+ */
+bool ImageDiff::IsSignatureDifferent(const Signature& signature0, const Signature& signature1, double colorDistanceThreshold)
+{
+	if (signature0.width != signature1.width || signature0.height != signature1.height)
+		return true;
+	// One unit more for the rounding of the means
+	const double maxDifference = (colorDistanceThreshold > 0 ? colorDistanceThreshold * 256 : 0) + 1;
+	for (int i = 0; i < Signature::GridSize * Signature::GridSize; ++i)
+	{
+		if (abs(signature0.luma[i] - signature1.luma[i]) > maxDifference)
+			return true;
+	}
+	return false;
+}
+
+/**
+ * @brief Get the signature of a file, if it has not changed since it was added.
+ */
+bool ImageSignatureCache::Lookup(const String& path, int64_t size, int64_t mtime, ImageDiff::Signature& signature) const
+{
+	Poco::FastMutex::ScopedLock lock(m_mutex);
+	auto it = m_entries.find(path);
+	if (it == m_entries.end() || it->second.size != size || it->second.mtime != mtime)
+		return false;
+	signature = it->second.signature;
+	return true;
+}
+
+void ImageSignatureCache::Add(const String& path, int64_t size, int64_t mtime, const ImageDiff::Signature& signature)
+{
+	Poco::FastMutex::ScopedLock lock(m_mutex);
+	m_entries[path] = { size, mtime, signature };
+}
+
+} // namespace CompareEngines
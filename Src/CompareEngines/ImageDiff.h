@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  ImageDiff.h
+ *
+ * @brief Declaration file for ImageDiff
+ */
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <Poco/Mutex.h>
+#include "UnicodeString.h"
+
+namespace CompareEngines
+{
+
+/**
+ * @brief Built-in decoding and comparing of images.
+ *
+ * PNG, BMP and Netpbm (PBM/PGM/PPM) images are decoded to 8-bit RGBA
+ * pixels without WinIMergeLib, so images in these formats can be compared
+ * headless and by several threads at once. Two pixels are equal when the
+ * distance of their RGBA values is not above the color distance threshold.
+ * Rows are compared with SSE2 where available, and the compare stops at
+ * the first different pixel. Images larger than 16M pixels are not decoded.
+ *
+ * A signature of an image (its size and the mean luminance of 8x8 cells)
+ * is a cheap prefilter: when the signatures differ by more than the
+ * threshold allows, the images differ and the pixels need not be compared.
+ */
+class ImageDiff
+{
+public:
+	/** @brief Decoded image, RGBA pixels row by row from the top. */
+	struct Image
+	{
+		int width = 0;
+		int height = 0;
+		std::vector<unsigned char> pixels;
+	};
+
+	/** @brief Perceptual hash of an image, mean luminance of cells of a grid. */
+	struct Signature
+	{
+		static const int GridSize = 8;
+		int width = 0;
+		int height = 0;
+		uint16_t luma[GridSize * GridSize] = {}; /**< Luminance in 1/256 units */
+	};
+
+	/** @brief Largest squared distance of two RGBA values. */
+	static const int MaxDistance2 = 4 * 255 * 255;
+
+	static bool Decode(const unsigned char *data, size_t size, Image& image);
+	static bool IsDifferent(const Image& image0, const Image& image1, double colorDistanceThreshold);
+	static void GetSignature(const Image& image, Signature& signature);
+	static bool IsSignatureDifferent(const Signature& signature0, const Signature& signature1, double colorDistanceThreshold);
+	static bool IsRowDifferent(const unsigned char *row0, const unsigned char *row1, int width, int maxDistance2);
+};
+
+/**
+ * @brief Signatures of image files, kept over compares of a folder compare.
+ * An entry is valid while the size and modification time of the file are
+ * the same. The cache can be used from several compare threads.
+ */
+class ImageSignatureCache
+{
+public:
+	bool Lookup(const String& path, int64_t size, int64_t mtime, ImageDiff::Signature& signature) const;
+	void Add(const String& path, int64_t size, int64_t mtime, const ImageDiff::Signature& signature);
+
+private:
+	struct Entry
+	{
+		int64_t size;
+		int64_t mtime;
+		ImageDiff::Signature signature;
+	};
+	mutable Poco::FastMutex m_mutex;
+	std::unordered_map<String, Entry> m_entries;
+};
+
+} // namespace CompareEngines
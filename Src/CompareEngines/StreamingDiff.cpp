@@ -0,0 +1,580 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  StreamingDiff.cpp
+ *
+ * @brief Implementation file for StreamingDiff
+ */
+
+#include "pch.h"
+#include "StreamingDiff.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <ostream>
+#include <io.h>
+#include <fcntl.h>
+#include "CompareOptions.h"
+#include "DiffItem.h"
+#include "DiffList.h"
+#include "IAbortable.h"
+#include "PathContext.h"
+#include "TFile.h"
+#include "unicoder.h"
+#include "xdiff_gnudiff_compat.h"
+extern "C" {
+#include "../../Externals/xdiff/xinclude.h"
+}
+
+namespace CompareEngines
+{
+
+/** @brief Size of the block read from a file at a time. */
+static const size_t ReadBufferSize = 256 * 1024;
+
+/** @brief Smallest allowed window size, also the longest line read at once. */
+static const size_t MinWindowSize = 64 * 1024;
+
+/** @brief How many lines to compare between checks for abort. */
+static const int64_t AbortCheckLines = 4096;
+
+/**
+ * @brief Reads a file line by line, in blocks.
+ * A line stays valid until the next call of ReadLine(). Lines longer than
+ * the given maximum length are returned in pieces.
+ */
+class StreamingDiff::LineReader
+{
+public:
+	explicit LineReader(FileTextStats& stats)
+		: m_fd(-1), m_begin(0), m_end(0), m_bEof(false), m_bError(false), m_stats(stats)
+	{
+	}
+
+	~LineReader()
+	{
+		if (m_fd != -1)
+			_close(m_fd);
+	}
+
+	bool Open(const String& path)
+	{
+		_tsopen_s(&m_fd, TFile(path).wpath().c_str(), O_BINARY | O_RDONLY, _SH_DENYNO, _S_IREAD);
+		m_buffer.resize(ReadBufferSize);
+		return m_fd != -1;
+	}
+
+	bool ReadLine(const char *& line, size_t & len, size_t nMaxLen)
+	{
+		for (;;)
+		{
+			const char *begin = m_buffer.data() + m_begin;
+			const size_t size = m_end - m_begin;
+			const char *eol = static_cast<const char *>(memchr(begin, '\n', (std::min)(size, nMaxLen)));
+			if (eol != nullptr || m_bEof || size >= nMaxLen)
+			{
+				len = eol != nullptr ? eol - begin + 1 : (std::min)(size, nMaxLen);
+				if (len == 0)
+					return false;
+				line = begin;
+				m_begin += len;
+				UpdateTextStats(line, len);
+				return true;
+			}
+			Fill();
+		}
+	}
+
+	bool IsError() const { return m_bError; }
+
+private:
+	/** @brief Move the partial line to the start of buffer and read more. */
+	void Fill()
+	{
+		if (m_begin > 0)
+		{
+			memmove(&m_buffer[0], &m_buffer[m_begin], m_end - m_begin);
+			m_end -= m_begin;
+			m_begin = 0;
+		}
+		if (m_end == m_buffer.size())
+			m_buffer.resize(m_buffer.size() * 2);
+		const unsigned size = static_cast<unsigned>((std::min)(m_buffer.size() - m_end, static_cast<size_t>(INT_MAX)));
+		const int nRead = _read(m_fd, &m_buffer[m_end], size);
+		if (nRead <= 0)
+		{
+			m_bEof = true;
+			m_bError = nRead < 0;
+		}
+		else
+			m_end += nRead;
+	}
+
+	void UpdateTextStats(const char *line, size_t len)
+	{
+		if (line[len - 1] == '\n')
+		{
+			if (len > 1 && line[len - 2] == '\r')
+				++m_stats.ncrlfs;
+			else
+				++m_stats.nlfs;
+		}
+		for (const char *p = line; (p = static_cast<const char *>(memchr(p, 0, line + len - p))) != nullptr; ++p)
+			++m_stats.nzeros;
+	}
+
+	int m_fd;
+	std::vector<char> m_buffer;
+	size_t m_begin; /**< Start of the unread data in buffer */
+	size_t m_end; /**< End of data in buffer */
+	bool m_bEof;
+	bool m_bError;
+	FileTextStats& m_stats;
+};
+
+static unsigned long HashLine(const char *line, size_t len, unsigned long flags)
+{
+	return xdl_hash_record(&line, line + len, flags);
+}
+
+static int hunk_func(long start_a, long count_a, long start_b, long count_b, void *cb_data)
+{
+	return 0;
+}
+
+/**
+ * @brief Format a line range of an unified diff hunk header.
+ */
+static std::string FormatRange(int64_t begin, long count)
+{
+	if (count == 1)
+		return std::to_string(begin + 1);
+	// An empty range refers to the line before it
+	return std::to_string(count == 0 ? begin : begin + 1) + "," + std::to_string(count);
+}
+
+void StreamingDiff::Window::Append(const char *line, size_t len, unsigned long hash)
+{
+	text.append(line, len);
+	offsets.push_back(text.size());
+	hashes.push_back(hash);
+}
+
+/**
+ * @brief Drop lines from the start of the window.
+ */
+void StreamingDiff::Window::Erase(size_t count)
+{
+	if (count == 0)
+		return;
+	const size_t size = offsets[count];
+	text.erase(0, size);
+	offsets.erase(offsets.begin(), offsets.begin() + count);
+	for (auto& offset : offsets)
+		offset -= size;
+	hashes.erase(hashes.begin(), hashes.begin() + count);
+	next = next > count ? next - count : 0;
+}
+
+StreamingDiff::StreamingDiff()
+	: m_xdlFlags(0)
+	, m_piAbortable(nullptr)
+	, m_nWindowSize(DefaultWindowSize)
+	, m_pDiffList(nullptr)
+	, m_pPatch(nullptr)
+	, m_nLines{}
+	, m_nDiffs(0)
+	, m_nTrivialDiffs(0)
+	, m_bPatchHeaderWritten(false)
+{
+}
+
+StreamingDiff::~StreamingDiff()
+{
+}
+
+/**
+ * @brief Set compare options from general compare options.
+ * Whitespace, case, EOL and blank line options and the diff algorithm are
+ * used, the same way as with xdiff in the file compare.
+ */
+void StreamingDiff::SetCompareOptions(const CompareOptions & options)
+{
+	m_xdlFlags = make_xdl_flags(DiffutilsOptions(options));
+}
+
+/**
+ * @brief Set Abortable-interface.
+ * @param [in] piAbortable Pointer to abortable interface.
+ */
+void StreamingDiff::SetAbortable(const IAbortable * piAbortable)
+{
+	m_piAbortable = const_cast<IAbortable*>(piAbortable);
+}
+
+/**
+ * @brief Set the maximum size of both windows together.
+ * Lines longer than a quarter of this are split.
+ */
+void StreamingDiff::SetWindowSize(size_t nWindowSize)
+{
+	m_nWindowSize = (std::max)(nWindowSize, MinWindowSize);
+}
+
+bool StreamingDiff::ShouldAbort() const
+{
+	return m_piAbortable != nullptr && m_piAbortable->ShouldAbort();
+}
+
+/**
+ * @brief Diff two files in one pass.
+ * @param [in] files Files to compare.
+ * @return DIFFCODE
+ */
+int StreamingDiff::CompareFiles(const PathContext & files)
+{
+	if (files.GetSize() != 2)
+		return DIFFCODE::CMPERR;
+
+	for (int i = 0; i < 2; ++i)
+	{
+		m_sPaths[i] = files[i];
+		m_textStats[i].clear();
+		m_pReaders[i].reset(new LineReader(m_textStats[i]));
+		m_windows[i] = Window();
+		m_anchors[i].clear();
+		m_nLines[i] = 0;
+	}
+	m_nDiffs = 0;
+	m_nTrivialDiffs = 0;
+	m_bPatchHeaderWritten = false;
+
+	int code = DIFFCODE::CMPERR;
+	if (m_pReaders[0]->Open(files[0]) && m_pReaders[1]->Open(files[1]))
+	{
+		for (;;)
+		{
+			const char *line[2] = {};
+			size_t len[2] = {};
+			bool bFromWindow[2];
+			bool bRead[2];
+			for (int i = 0; i < 2; ++i)
+			{
+				bFromWindow[i] = m_windows[i].next < m_windows[i].GetLineCount();
+				bRead[i] = ReadLine(i, line[i], len[i]);
+			}
+			if (!bRead[0] && !bRead[1])
+			{
+				code = DIFFCODE::SAME;
+				break;
+			}
+			if (bRead[0] && bRead[1] && xdl_recmatch(line[0], static_cast<long>(len[0]), line[1], static_cast<long>(len[1]), m_xdlFlags))
+			{
+				++m_nLines[0];
+				++m_nLines[1];
+				if (m_nLines[0] % AbortCheckLines == 0 && ShouldAbort())
+				{
+					code = DIFFCODE::CMPABORT;
+					break;
+				}
+				continue;
+			}
+
+			// Put the different lines to windows, then read ahead until the
+			// files are in step again
+			for (int i = 0; i < 2; ++i)
+			{
+				Window& window = m_windows[i];
+				if (bFromWindow[i])
+					--window.next;
+				else if (bRead[i])
+					window.Append(line[i], len[i], HashLine(line[i], len[i], m_xdlFlags));
+				window.Erase(window.next);
+			}
+			if (!Resync())
+			{
+				code = DIFFCODE::CMPABORT;
+				break;
+			}
+		}
+		if (m_pReaders[0]->IsError() || m_pReaders[1]->IsError())
+			code = DIFFCODE::CMPERR;
+	}
+
+	for (int i = 0; i < 2; ++i)
+	{
+		m_pReaders[i].reset();
+		m_windows[i] = Window();
+		m_anchors[i].clear();
+	}
+
+	if (code != DIFFCODE::SAME)
+		return code;
+
+	if (m_nDiffs > 0)
+		code = DIFFCODE::DIFF;
+	if (m_textStats[0].nzeros > 0 || m_textStats[1].nzeros > 0)
+	{
+		code |= DIFFCODE::BIN;
+		if (m_textStats[0].nzeros > 0)
+			code |= DIFFCODE::BINSIDE1;
+		if (m_textStats[1].nzeros > 0)
+			code |= DIFFCODE::BINSIDE2;
+	}
+	else
+		code |= DIFFCODE::TEXT;
+	return code;
+}
+
+/**
+ * @brief Get next line of a file to compare in step.
+ * Lines left in the window after the last anchor come first.
+ */
+bool StreamingDiff::ReadLine(int side, const char *& line, size_t & len)
+{
+	Window& window = m_windows[side];
+	if (window.next < window.GetLineCount())
+	{
+		line = window.GetLine(window.next);
+		len = window.GetLineLength(window.next);
+		++window.next;
+		return true;
+	}
+	window.Erase(window.next);
+	return m_pReaders[side]->ReadLine(line, len, m_nWindowSize / 4);
+}
+
+/**
+ * @brief Read ahead both files until they are in step again, and diff the
+ * lines read until then.
+ * Lines are read from both files in turns, so that the anchor found first is
+ * the one nearest to the start of both windows.
+ * @return false if the compare was aborted.
+ */
+bool StreamingDiff::Resync()
+{
+	m_anchors[0].clear();
+	m_anchors[1].clear();
+	size_t indexed[2] = { 0, 0 };
+	bool bEof[2] = { false, false };
+	for (;;)
+	{
+		if (ShouldAbort())
+			return false;
+		const bool bFull = m_windows[0].text.size() + m_windows[1].text.size() >= m_nWindowSize;
+		bool bMore = false;
+		for (int i = 0; i < 2; ++i)
+		{
+			Window& window = m_windows[i];
+			if (indexed[i] == window.GetLineCount())
+			{
+				const char *line;
+				size_t len;
+				if (bEof[i] || bFull)
+					continue;
+				if (!m_pReaders[i]->ReadLine(line, len, m_nWindowSize / 4))
+				{
+					bEof[i] = true;
+					continue;
+				}
+				window.Append(line, len, HashLine(line, len, m_xdlFlags));
+			}
+			bMore = true;
+			++indexed[i];
+			size_t posOther;
+			if (indexed[i] >= AnchorLines && FindAnchor(i, indexed[i] - AnchorLines, posOther))
+			{
+				size_t count[2];
+				count[i] = indexed[i] - AnchorLines;
+				count[1 - i] = posOther;
+				return DiffWindows(count);
+			}
+		}
+		if (!bMore)
+		{
+			// End of files or windows full without an anchor
+			const size_t count[2] = { m_windows[0].GetLineCount(), m_windows[1].GetLineCount() };
+			return DiffWindows(count);
+		}
+	}
+}
+
+unsigned long StreamingDiff::GetAnchorHash(int side, size_t pos) const
+{
+	unsigned long hash = 0;
+	for (int i = 0; i < AnchorLines; ++i)
+		hash = hash * 31 + m_windows[side].hashes[pos + i];
+	return hash;
+}
+
+/**
+ * @brief Look for the lines starting at @p pos in the other window.
+ * If they are not found, they are remembered for lookups from the other
+ * window, unless equal lines were already remembered.
+ * @param [in] side Window of the lines.
+ * @param [in] pos First line of the anchor in the window.
+ * @param [out] posOther First line of the anchor in the other window.
+ * @return true if the anchor was found.
+ */
+bool StreamingDiff::FindAnchor(int side, size_t pos, size_t & posOther)
+{
+	auto isEqual = [this, side, pos](int sideOther, size_t pos2)
+	{
+		const Window& window = m_windows[side];
+		const Window& other = m_windows[sideOther];
+		for (int i = 0; i < AnchorLines; ++i)
+		{
+			if (!xdl_recmatch(window.GetLine(pos + i), static_cast<long>(window.GetLineLength(pos + i)),
+					other.GetLine(pos2 + i), static_cast<long>(other.GetLineLength(pos2 + i)), m_xdlFlags))
+				return false;
+		}
+		return true;
+	};
+
+	const unsigned long hash = GetAnchorHash(side, pos);
+	auto range = m_anchors[1 - side].equal_range(hash);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		if (isEqual(1 - side, it->second))
+		{
+			posOther = it->second;
+			return true;
+		}
+	}
+	range = m_anchors[side].equal_range(hash);
+	if (std::none_of(range.first, range.second, [&](const std::pair<const unsigned long, size_t>& anchor) { return isEqual(side, anchor.second); }))
+		m_anchors[side].emplace(hash, pos);
+	return false;
+}
+
+/**
+ * @brief Diff lines at the start of both windows, then drop them.
+ * @param [in] count Count of lines to diff in both windows.
+ * @return true
+ */
+bool StreamingDiff::DiffWindows(const size_t count[2])
+{
+	mmfile_t mmfile[2];
+	for (int i = 0; i < 2; ++i)
+	{
+		mmfile[i].ptr = const_cast<char *>(m_windows[i].text.data());
+		mmfile[i].size = static_cast<long>(m_windows[i].offsets[count[i]]);
+	}
+
+	xdfenv_t xe;
+	xdchange_t *xscr = nullptr;
+	xpparam_t xpp = { 0 };
+	xdemitconf_t xecfg = { 0 };
+	xdemitcb_t ecb = { 0 };
+	xpp.flags = m_xdlFlags;
+	xecfg.hunk_func = hunk_func;
+	if (xdl_diff_modified(&mmfile[0], &mmfile[1], &xpp, &xecfg, &ecb, &xe, &xscr) == 0)
+	{
+		for (xdchange_t *xcur = xscr; xcur != nullptr; xcur = xcur->next)
+		{
+			const int64_t begin[2] = { m_nLines[0] + xcur->i1, m_nLines[1] + xcur->i2 };
+			const long lines[2] = { xcur->chg1, xcur->chg2 };
+			AddHunk(begin, lines, xcur->ignore != 0);
+		}
+		xdl_free_script(xscr);
+		xdl_free_env(&xe);
+	}
+	else if (count[0] > 0 || count[1] > 0)
+	{
+		// Out of memory, report the windows as one difference
+		const long lines[2] = { static_cast<long>(count[0]), static_cast<long>(count[1]) };
+		AddHunk(m_nLines, lines, false);
+	}
+
+	for (int i = 0; i < 2; ++i)
+	{
+		m_windows[i].Erase(count[i]);
+		m_nLines[i] += count[i];
+		m_anchors[i].clear();
+	}
+	return true;
+}
+
+/**
+ * @brief Add a difference to counts, diff list and patch.
+ * @param [in] begin First line of the difference in both files, 0-based.
+ * @param [in] count Count of lines in both files.
+ * @param [in] bTrivial Is the difference ignored?
+ */
+void StreamingDiff::AddHunk(const int64_t begin[2], const long count[2], bool bTrivial)
+{
+	if (bTrivial)
+		++m_nTrivialDiffs;
+	else
+		++m_nDiffs;
+
+	// Diff list line numbers are int, beyond that only counts are kept
+	if (m_pDiffList != nullptr && begin[0] + count[0] <= INT_MAX && begin[1] + count[1] <= INT_MAX)
+	{
+		DIFFRANGE dr;
+		for (int i = 0; i < 2; ++i)
+		{
+			dr.begin[i] = static_cast<int>(begin[i]);
+			dr.end[i] = static_cast<int>(begin[i] + count[i] - 1);
+		}
+		dr.begin[2] = -1;
+		dr.end[2] = -1;
+		dr.op = bTrivial ? OP_TRIVIAL : OP_DIFF;
+		m_pDiffList->AddDiff(dr);
+	}
+
+	if (m_pPatch != nullptr && !bTrivial)
+		WriteHunk(begin, count);
+}
+
+/**
+ * @brief Write a difference as an unified diff hunk without context lines.
+ */
+void StreamingDiff::WriteHunk(const int64_t begin[2], const long count[2])
+{
+	std::ostream& out = *m_pPatch;
+	if (!m_bPatchHeaderWritten)
+	{
+		out << "--- " << ucr::toUTF8(m_sPaths[0]) << "\n";
+		out << "+++ " << ucr::toUTF8(m_sPaths[1]) << "\n";
+		m_bPatchHeaderWritten = true;
+	}
+	out << "@@ -" << FormatRange(begin[0], count[0]) << " +" << FormatRange(begin[1], count[1]) << " @@\n";
+	static const char prefix[2] = { '-', '+' };
+	for (int i = 0; i < 2; ++i)
+	{
+		const Window& window = m_windows[i];
+		const size_t first = static_cast<size_t>(begin[i] - m_nLines[i]);
+		for (size_t pos = first; pos < first + count[i]; ++pos)
+		{
+			const char *line = window.GetLine(pos);
+			const size_t len = window.GetLineLength(pos);
+			out << prefix[i];
+			out.write(line, len);
+			if (line[len - 1] != '\n')
+				out << "\n\\ No newline at end of file\n";
+		}
+	}
+}
+
+/**
+ * @brief Return counts of differences found by last compare.
+ * @param [out] nDiffs Count of significant differences.
+ * @param [out] nTrivialDiffs Count of ignored differences.
+ */
+void StreamingDiff::GetDiffCounts(int & nDiffs, int & nTrivialDiffs) const
+{
+	nDiffs = m_nDiffs;
+	nTrivialDiffs = m_nTrivialDiffs;
+}
+
+/**
+ * @brief Return text statistics for last compare.
+ * @param [in] side For which file to return statistics.
+ * @param [out] stats Stats as asked.
+ */
+void StreamingDiff::GetTextStats(int side, FileTextStats *stats) const
+{
+	*stats = m_textStats[side];
+}
+
+} // namespace CompareEngines
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  StreamingDiff.h
+ *
+ * @brief Declaration file for StreamingDiff
+ */
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "FileTextStats.h"
+#include "UnicodeString.h"
+
+class CompareOptions;
+class DiffList;
+class IAbortable;
+class PathContext;
+
+namespace CompareEngines
+{
+
+/**
+ * @brief Line diff of files too large to be loaded into memory.
+ *
+ * Both files are read once from start to end. As long as the files are in
+ * step, lines are compared as they are read and dropped. At the first
+ * different line both files are read into windows until AnchorLines equal
+ * lines in a row are found in both windows. The lines before this anchor
+ * are diffed with xdiff, then the files are in step again after the anchor.
+ * If no anchor is found before the windows get full, the windows are diffed
+ * as they are, so that memory use stays bounded even if the files have
+ * nothing in common.
+ *
+ * The result is the same as a full diff when no difference is larger than
+ * the window, which is the usual case with database exports and logs. The
+ * files must be in an 8-bit encoding or UTF-8. Moved blocks, line filters
+ * and substitution filters are not supported.
+ */
+class StreamingDiff
+{
+public:
+	/** @brief Count of equal lines in a row needed to get files in step. */
+	static const int AnchorLines = 4;
+	/** @brief Default for the maximum size of both windows together. */
+	static const size_t DefaultWindowSize = 64 * 1024 * 1024;
+
+	StreamingDiff();
+	~StreamingDiff();
+
+	void SetCompareOptions(const CompareOptions & options);
+	void SetAbortable(const IAbortable * piAbortable);
+	void SetWindowSize(size_t nWindowSize);
+	void SetCreateDiffList(DiffList *pDiffList) { m_pDiffList = pDiffList; }
+	void SetPatchStream(std::ostream *pPatch) { m_pPatch = pPatch; }
+	int CompareFiles(const PathContext & files);
+	void GetDiffCounts(int & nDiffs, int & nTrivialDiffs) const;
+	void GetTextStats(int side, FileTextStats *stats) const;
+	int64_t GetLineCount(int side) const { return m_nLines[side]; }
+
+private:
+	class LineReader;
+
+	/** @brief Lines read ahead from one file, stored back to back. */
+	struct Window
+	{
+		std::string text;
+		std::vector<size_t> offsets; /**< Start of each line and end of last line */
+		std::vector<unsigned long> hashes;
+		size_t next; /**< First line not yet compared in step */
+
+		Window() : offsets(1, 0), next(0) {}
+		size_t GetLineCount() const { return offsets.size() - 1; }
+		const char *GetLine(size_t i) const { return text.data() + offsets[i]; }
+		size_t GetLineLength(size_t i) const { return offsets[i + 1] - offsets[i]; }
+		void Append(const char *line, size_t len, unsigned long hash);
+		void Erase(size_t count);
+	};
+
+	bool ReadLine(int side, const char *& line, size_t & len);
+	bool Resync();
+	bool FindAnchor(int side, size_t pos, size_t & posOther);
+	unsigned long GetAnchorHash(int side, size_t pos) const;
+	bool DiffWindows(const size_t count[2]);
+	void AddHunk(const int64_t begin[2], const long count[2], bool bTrivial);
+	void WriteHunk(const int64_t begin[2], const long count[2]);
+	bool ShouldAbort() const;
+
+	unsigned long m_xdlFlags; /**< Compare options as xdiff flags */
+	IAbortable * m_piAbortable;
+	size_t m_nWindowSize;
+	DiffList * m_pDiffList; /**< Diff list to add differences to, or nullptr */
+	std::ostream * m_pPatch; /**< Stream to write unified diff to, or nullptr */
+	String m_sPaths[2];
+	std::unique_ptr<LineReader> m_pReaders[2];
+	Window m_windows[2];
+	std::unordered_multimap<unsigned long, size_t> m_anchors[2]; /**< Anchor hash to window line */
+	int64_t m_nLines[2]; /**< Lines compared so far, line number of first window line */
+	int m_nDiffs;
+	int m_nTrivialDiffs;
+	bool m_bPatchHeaderWritten;
+	FileTextStats m_textStats[2];
+};
+
+} // namespace CompareEngines
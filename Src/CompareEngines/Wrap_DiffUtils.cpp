@@ -278,12 +278,20 @@ bool DiffUtils::RegExpFilter(int StartPos, int EndPos, const file_data *pinf) co
 
 	while (line <= EndPos && linesMatch)
 	{
-		size_t len = pinf->linbuf[line + 1] - pinf->linbuf[line];
-		const char *string = pinf->linbuf[line];
-		size_t stringlen = linelen(string, len);
-		if (!m_pFilterList->Match(std::string(string, stringlen), m_codepage))
+		if (pinf->filtered_flag != nullptr && line >= 0 && line < pinf->filtered_lines)
 		{
-			linesMatch = false;
+			// Matched when diffutils read the file
+			linesMatch = pinf->filtered_flag[line] != 0;
+		}
+		else
+		{
+			size_t len = pinf->linbuf[line + 1] - pinf->linbuf[line];
+			const char *string = pinf->linbuf[line];
+			size_t stringlen = linelen(string, len);
+			if (!m_pFilterList->Match(std::string(string, stringlen), m_codepage))
+			{
+				linesMatch = false;
+			}
 		}
 		++line;
 	}
@@ -313,6 +321,7 @@ bool DiffUtils::Diff2Files(struct change ** diffs, int depth,
 	SE_Handler seh;
 	try
 	{
+		DiffutilsLineFilter lineFilter(m_pFilterList, m_codepage);
 		*diffs = diff_2_files(m_inf, depth, bin_status, bMovedBlocks, bin_file);
 	}
 	catch (SE_Exception&)
@@ -8,6 +8,9 @@
 #include "stdafx.h"
 #include "CompareStatisticsDlg.h"
 #include "CompareStats.h"
+#include "FileOrFolderSelect.h"
+#include "locality.h"
+#include <fstream>
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -28,6 +31,7 @@ CompareStatisticsDlg::CompareStatisticsDlg(const CompareStats* pStats, CWnd* pPa
 
 BEGIN_MESSAGE_MAP(CompareStatisticsDlg, CTrDialog)
 	//{{AFX_MSG_MAP(SaveClosingDlg)
+	ON_BN_CLICKED(IDC_STAT_EXPORT_TRACE, OnBnClickedExportTrace)
 	//}}AFX_MSG_MAP
 END_MESSAGE_MAP()
 
@@ -123,6 +127,69 @@ BOOL CompareStatisticsDlg::OnInitDialog()
 		}
 	}
 
+	ShowPhaseTimes();
+
+	// Trace events are appended by compare threads while compare runs
+	EnableDlgItem(IDC_STAT_EXPORT_TRACE, m_pCompareStats->HasTrace() &&
+		m_pCompareStats->GetCompareState() == CompareStats::STATE_IDLE);
+
 	return FALSE;  // return TRUE unless you set the focus to a control
 	              // EXCEPTION: OCX Property Pages should return FALSE
 }
+
+/**
+ * @brief Show time spent in each compare phase and file read counters.
+ * Times are summed over all compare threads, so they can add up to more
+ * than the wall clock time of the compare.
+ */
+void CompareStatisticsDlg::ShowPhaseTimes()
+{
+	static const struct { CompareStats::PHASE phase; const char *name; } phaseNames[] =
+	{
+		{ CompareStats::PHASE_ENUMERATE, "Enumerating folders" },
+		{ CompareStats::PHASE_FILTER,    "Filtering" },
+		{ CompareStats::PHASE_ENCODING,  "Detecting encodings" },
+		{ CompareStats::PHASE_PLUGIN,    "Running plugins" },
+		{ CompareStats::PHASE_READ,      "Reading files" },
+		{ CompareStats::PHASE_COMPARE,   "Comparing files" },
+		{ CompareStats::PHASE_UI,        "Updating display" },
+	};
+
+	String text;
+	for (auto&& map : phaseNames)
+	{
+		text += strutils::format(_("%s: %.1f ms (%d times)"),
+			tr(map.name),
+			m_pCompareStats->GetPhaseTime(map.phase) / 1000.0,
+			static_cast<int>(m_pCompareStats->GetPhaseCount(map.phase)));
+		text += _T("\r\n");
+	}
+	text += strutils::format_string1(_("Bytes read: %1"), locality::NumToLocaleStr(m_pCompareStats->GetCounter(CompareStats::COUNTER_BYTES_READ)));
+	text += _T("\r\n");
+	text += strutils::format_string1(_("Files opened: %1"), locality::NumToLocaleStr(m_pCompareStats->GetCounter(CompareStats::COUNTER_FILES_OPENED)));
+	text += _T("\r\n");
+	text += strutils::format_string1(_("Reused encoding detections: %1"), locality::NumToLocaleStr(m_pCompareStats->GetCounter(CompareStats::COUNTER_ENCODINGS_REUSED)));
+	text += _T("\r\n");
+	text += strutils::format_string1(_("Reused open files: %1"), locality::NumToLocaleStr(m_pCompareStats->GetCounter(CompareStats::COUNTER_FILES_REUSED)));
+	text += _T("\r\n");
+	text += strutils::format_string1(_("Files decided by stored checksums: %1"), locality::NumToLocaleStr(m_pCompareStats->GetCounter(CompareStats::COUNTER_STORED_CHECKSUMS)));
+	SetDlgItemText(IDC_STAT_PHASES, text);
+}
+
+/**
+ * @brief Save compare phases of all threads as a Chrome trace file.
+ * The file can be opened in chrome://tracing or Perfetto.
+ */
+void CompareStatisticsDlg::OnBnClickedExportTrace()
+{
+	String path;
+	if (!SelectFile(GetSafeHwnd(), path, false, nullptr, _T(""),
+			_("Trace Files (*.json)|*.json|All Files (*.*)|*.*||"), _T("json")))
+		return;
+
+	std::ofstream file(path);
+	m_pCompareStats->WriteTrace(file);
+	file.close();
+	if (!file)
+		AfxMessageBox(strutils::format_string1(_("Could not write to file %1."), path).c_str(), MB_ICONSTOP);
+}
@@ -31,9 +31,14 @@ protected:
 	// Generated message map functions
 	//{{AFX_MSG(CompareStatisticsDlg)
 	afx_msg BOOL OnInitDialog() override;
+	afx_msg void OnBnClickedExportTrace();
 	//}}AFX_MSG
 	DECLARE_MESSAGE_MAP()
 
+// Implementation methods
+private:
+	void ShowPhaseTimes();
+
 // Implementation data
 private:
 	const CompareStats * m_pCompareStats; /**< Compare statistics structure. */
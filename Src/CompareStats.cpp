@@ -9,8 +9,14 @@
 #include <cassert>
 #include <cstring>
 #include <atomic>
+#include <ostream>
 #include "DiffItem.h"
 
+/** @brief Maximum number of trace events kept, about 16 bytes each. */
+static const int MaxTraceEvents = 256 * 1024;
+
+static std::atomic<unsigned> s_nNextSerial(1);
+
 /** 
  * @brief Constructor, initializes critical section.
  */
@@ -21,6 +27,9 @@ CompareStats::CompareStats(int nDirs)
 , m_bCompareDone(false)
 , m_nDirs(nDirs)
 , m_counts()
+, m_nSerial(s_nNextSerial++)
+, m_startTime(std::chrono::steady_clock::now())
+, m_nTraceEvents(0)
 {
 }
 
@@ -83,6 +92,12 @@ void CompareStats::Reset()
 	m_nTotalItems = 0;
 	m_nComparedItems = 0;
 	m_bCompareDone = false;
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto& threadCounters : m_threadCounters)
+		threadCounters.second->Clear();
+	m_nTraceEvents = 0;
+	m_startTime = std::chrono::steady_clock::now();
 }
 
 /** 
@@ -180,3 +195,154 @@ void CompareStats::Swap(int idx1, int idx2)
 	m_counts[RESULT_LDIRUNIQUE  + idx2] = m_counts[RESULT_LDIRUNIQUE  + idx1].exchange(m_counts[RESULT_LDIRUNIQUE  + idx2]);
 	m_counts[RESULT_LDIRMISSING + idx2] = m_counts[RESULT_LDIRMISSING + idx1].exchange(m_counts[RESULT_LDIRMISSING + idx2]);
 }
+
+CompareStats::ThreadCounters::ThreadCounters(int nThread)
+: m_nThread(nThread)
+{
+	Clear();
+}
+
+void CompareStats::ThreadCounters::Clear()
+{
+	for (auto& time : m_nPhaseTimes)
+		time = 0;
+	for (auto& count : m_nPhaseCounts)
+		count = 0;
+	for (auto& counter : m_nCounters)
+		counter = 0;
+	m_events.clear();
+}
+
+/**
+ * @brief Return counters of calling thread, created on first use.
+ * The counters of the last used instance are cached per thread, so that
+ * the lock is only taken when a thread switches between instances.
+ */
+CompareStats::ThreadCounters &CompareStats::GetThreadCounters()
+{
+	thread_local unsigned t_nSerial = 0;
+	thread_local ThreadCounters *t_pCounters = nullptr;
+	if (t_nSerial != m_nSerial)
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		std::unique_ptr<ThreadCounters>& pCounters = m_threadCounters[std::this_thread::get_id()];
+		if (pCounters == nullptr)
+			pCounters.reset(new ThreadCounters(static_cast<int>(m_threadCounters.size())));
+		t_pCounters = pCounters.get();
+		t_nSerial = m_nSerial;
+	}
+	return *t_pCounters;
+}
+
+/**
+ * @brief Add time spent in a phase by calling thread.
+ * @param [in] start Start time from Now().
+ * @param [in] end End time from Now().
+ */
+void CompareStats::AddPhaseTime(PHASE phase, int64_t start, int64_t end)
+{
+	ThreadCounters &counters = GetThreadCounters();
+	counters.m_nPhaseTimes[phase].store(counters.m_nPhaseTimes[phase].load(std::memory_order_relaxed) + end - start, std::memory_order_relaxed);
+	counters.m_nPhaseCounts[phase].store(counters.m_nPhaseCounts[phase].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	if (m_nTraceEvents.load(std::memory_order_relaxed) < MaxTraceEvents)
+	{
+		++m_nTraceEvents;
+		counters.m_events.push_back({ start, static_cast<int32_t>(end - start), phase });
+	}
+}
+
+/**
+ * @brief Add to a counter of calling thread.
+ */
+void CompareStats::AddCounter(COUNTER counter, int64_t value)
+{
+	ThreadCounters &counters = GetThreadCounters();
+	counters.m_nCounters[counter].store(counters.m_nCounters[counter].load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Return microseconds spent in a phase, summed over threads.
+ */
+int64_t CompareStats::GetPhaseTime(PHASE phase) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	int64_t total = 0;
+	for (const auto& threadCounters : m_threadCounters)
+		total += threadCounters.second->m_nPhaseTimes[phase];
+	return total;
+}
+
+/**
+ * @brief Return how many times a phase was entered, summed over threads.
+ */
+int64_t CompareStats::GetPhaseCount(PHASE phase) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	int64_t total = 0;
+	for (const auto& threadCounters : m_threadCounters)
+		total += threadCounters.second->m_nPhaseCounts[phase];
+	return total;
+}
+
+/**
+ * @brief Return value of a counter, summed over threads.
+ */
+int64_t CompareStats::GetCounter(COUNTER counter) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	int64_t total = 0;
+	for (const auto& threadCounters : m_threadCounters)
+		total += threadCounters.second->m_nCounters[counter];
+	return total;
+}
+
+/**
+ * @brief Return name of phase used in trace files.
+ */
+const char *CompareStats::GetPhaseName(PHASE phase)
+{
+	static const char *const names[] =
+	{
+		"enumerate", "filter", "encoding", "plugin", "read", "compare", "ui",
+	};
+	static_assert(sizeof(names) / sizeof(names[0]) == PHASE_COUNT, "Name missing for a phase");
+	return names[phase];
+}
+
+/**
+ * @brief Write timed phases in Chrome trace event format.
+ * The file can be opened in chrome://tracing or https://ui.perfetto.dev.
+ * Call this when no compare is running, threads append events during
+ * compare.
+ */
+void CompareStats::WriteTrace(std::ostream& out) const
+{
+	static const char *const counterNames[] =
+	{
+		"bytes_read", "files_opened", "encodings_reused", "files_reused", "stored_checksums",
+	};
+	static_assert(sizeof(counterNames) / sizeof(counterNames[0]) == COUNTER_COUNT, "Name missing for a counter");
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	out << "{\"traceEvents\":[\n";
+	bool bFirst = true;
+	int64_t counters[COUNTER_COUNT] = {};
+	for (const auto& threadCounters : m_threadCounters)
+	{
+		const ThreadCounters& thread = *threadCounters.second;
+		out << (bFirst ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread.m_nThread
+			<< ",\"args\":{\"name\":\"Thread " << thread.m_nThread << "\"}}";
+		bFirst = false;
+		for (const TraceEvent& event : thread.m_events)
+		{
+			out << ",\n{\"name\":\"" << GetPhaseName(event.phase) << "\",\"cat\":\"compare\",\"ph\":\"X\",\"ts\":" << event.start
+				<< ",\"dur\":" << event.duration << ",\"pid\":1,\"tid\":" << thread.m_nThread << "}";
+		}
+		for (int i = 0; i < COUNTER_COUNT; ++i)
+			counters[i] += thread.m_nCounters[i];
+	}
+	out << "\n],\n\"displayTimeUnit\":\"ms\",\n\"otherData\":{";
+	for (int i = 0; i < COUNTER_COUNT; ++i)
+		out << "\"" << counterNames[i] << "\":" << counters[i] << ",";
+	out << "\"truncated\":" << (m_nTraceEvents >= MaxTraceEvents ? "true" : "false") << "}}\n";
+}
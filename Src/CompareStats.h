@@ -8,6 +8,13 @@
 #include <atomic>
 #include <vector>
 #include <array>
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 class DIFFITEM;
 
@@ -67,6 +74,57 @@ public:
 		RESULT_COUNT  //THIS MUST BE THE LAST ITEM
 	};
 
+	/**
+	* @brief Compare phases whose time is measured.
+	*/
+	enum PHASE
+	{
+		PHASE_ENUMERATE = 0, /**< Reading folder listings */
+		PHASE_FILTER, /**< Testing items against file filters */
+		PHASE_ENCODING, /**< Guessing file encodings */
+		PHASE_PLUGIN, /**< Unpacking and prediffing with plugins */
+		PHASE_READ, /**< Opening and reading files */
+		PHASE_COMPARE, /**< Diff algorithm and byte compares */
+		PHASE_UI, /**< Refreshing folder compare window */
+		PHASE_COUNT  //THIS MUST BE THE LAST ITEM
+	};
+
+	/**
+	* @brief Counters of work done by compare.
+	*/
+	enum COUNTER
+	{
+		COUNTER_BYTES_READ = 0,
+		COUNTER_FILES_OPENED,
+		COUNTER_ENCODINGS_REUSED, /**< Encodings detected from blocks read by precompare */
+		COUNTER_FILES_REUSED, /**< Files kept open from precompare instead of opened again */
+		COUNTER_STORED_CHECKSUMS, /**< Archived files decided by stored CRCs instead of read */
+		COUNTER_COUNT  //THIS MUST BE THE LAST ITEM
+	};
+
+	/**
+	* @brief Adds time from construction to destruction to a phase.
+	* Does nothing if the stats pointer is null, so that code shared with
+	* compares not having stats can be timed too.
+	*/
+	class ScopedPhase
+	{
+	public:
+		ScopedPhase(CompareStats *pStats, PHASE phase)
+			: m_pStats(pStats), m_phase(phase), m_start(pStats ? pStats->Now() : 0) {}
+		~ScopedPhase()
+		{
+			if (m_pStats != nullptr)
+				m_pStats->AddPhaseTime(m_phase, m_start, m_pStats->Now());
+		}
+	private:
+		ScopedPhase(const ScopedPhase&) = delete;
+		ScopedPhase& operator=(const ScopedPhase&) = delete;
+		CompareStats *m_pStats;
+		PHASE m_phase;
+		int64_t m_start;
+	};
+
 	explicit CompareStats(int nDirs);
 	~CompareStats();
 	void SetCompareThreadCount(int nCompareThreads)
@@ -94,7 +152,43 @@ public:
 	void Swap(int idx1, int idx2);
 	int GetCompareDirs() const { return m_nDirs; }
 
+	int64_t Now() const;
+	void AddPhaseTime(PHASE phase, int64_t start, int64_t end);
+	void AddCounter(COUNTER counter, int64_t value = 1);
+	int64_t GetPhaseTime(PHASE phase) const;
+	int64_t GetPhaseCount(PHASE phase) const;
+	int64_t GetCounter(COUNTER counter) const;
+	bool HasTrace() const { return m_nTraceEvents > 0; }
+	void WriteTrace(std::ostream& out) const;
+	static const char *GetPhaseName(PHASE phase);
+
 private:
+	/** @brief Timed phase, written to trace file. */
+	struct TraceEvent
+	{
+		int64_t start; /**< Microseconds from start of compare */
+		int32_t duration;
+		PHASE phase;
+	};
+
+	/**
+	 * @brief Phase times and counters of one thread.
+	 * Only the owning thread updates these, so plain loads and stores of
+	 * the atomics are enough and threads don't contend.
+	 */
+	struct ThreadCounters
+	{
+		explicit ThreadCounters(int nThread);
+		void Clear();
+		int m_nThread; /**< Thread number in trace */
+		std::atomic<int64_t> m_nPhaseTimes[PHASE_COUNT]; /**< Microseconds */
+		std::atomic<int64_t> m_nPhaseCounts[PHASE_COUNT];
+		std::atomic<int64_t> m_nCounters[COUNTER_COUNT];
+		std::vector<TraceEvent> m_events;
+	};
+
+	ThreadCounters &GetThreadCounters();
+
 	std::array<std::atomic_int, RESULT_COUNT> m_counts; /**< Table storing result counts */
 	std::atomic_int m_nTotalItems; /**< Total items found to compare */
 	std::atomic_int m_nComparedItems; /**< Compared items so far */
@@ -110,8 +204,22 @@ private:
 	};
 	std::vector<ThreadState> m_rgThreadState;
 
+	const unsigned m_nSerial; /**< Identifies this instance in thread-local cache */
+	std::chrono::steady_clock::time_point m_startTime; /**< Start of compare, trace times are relative to this */
+	mutable std::mutex m_mutex; /**< Guards m_threadCounters */
+	std::map<std::thread::id, std::unique_ptr<ThreadCounters>> m_threadCounters;
+	std::atomic_int m_nTraceEvents; /**< Trace events recorded by all threads */
 };
 
+/**
+ * @brief Return microseconds since start of compare.
+ */
+inline int64_t CompareStats::Now() const
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now() - m_startTime).count();
+}
+
 /** 
  * @brief Increase found items (dirs and files) count.
  * @param [in] count Amount of items to add.
@@ -51,13 +51,17 @@ CDiffContext::CDiffContext(const PathContext & paths, int compareMethod)
 , m_bPluginsEnabled(false)
 , m_bRecursive(false)
 , m_bWalkUniques(true)
+, m_bCollectSkipped(true)
 , m_bIgnoreReparsePoints(false)
 , m_bIgnoreCodepage(false)
 , m_iGuessEncodingType(0)
 , m_nQuickCompareLimit(0)
 , m_nBinaryCompareLimit(0)
+, m_nStreamingCompareLimit(0)
 , m_bEnableImageCompare(false)
 , m_dColorDistanceThreshold(0.0)
+, m_pImageSignatureCache(nullptr)
+, m_pArchiveCache(nullptr)
 {
 	int index;
 	for (index = 0; index < paths.GetSize(); index++)
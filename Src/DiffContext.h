@@ -12,15 +12,17 @@
 #include "DiffItemList.h"
 #include "FilterList.h"
 #include "SubstitutionList.h"
+#include "CompareStats.h"
 
 class PackingInfo;
 class PrediffingInfo;
 class IDiffFilter;
-class CompareStats;
 class IAbortable;
 class CDiffWrapper;
 class CompareOptions;
 struct DIFFOPTIONS;
+namespace CompareEngines { class ImageSignatureCache; }
+class ArchiveCache;
 
 /** Interface to a provider of plugin info */
 class IPluginInfos
@@ -151,6 +153,17 @@ public:
 
 	const DIFFOPTIONS *GetOptions() const { return m_pOptions.get(); }
 
+	/**
+	 * Add to a counter of compare statistics, if there are statistics.
+	 * @param [in] counter Counter to add to.
+	 * @param [in] value Value to add.
+	 */
+	void AddCounter(CompareStats::COUNTER counter, int64_t value = 1) const
+	{
+		if (m_pCompareStats != nullptr)
+			m_pCompareStats->AddCounter(counter, value);
+	}
+
 	void GetComparePaths(const DIFFITEM& di, PathContext& tFiles) const;
 	String GetFilteredFilenames(const DIFFITEM& di) const;
 	static String GetFilteredFilenames(const PathContext& paths) { return strutils::join(paths.begin(), paths.end(), _T("|")); }
@@ -181,6 +194,16 @@ public:
 
 	int m_nBinaryCompareLimit;
 
+	/**
+	 * Threshold size for switching to streaming diff.
+	 * When diffutils compare is selected, text files bigger (in bytes) than
+	 * this value are diffed in one pass with bounded memory instead of
+	 * falling back to quick compare. 0 disables streaming diff.
+	 * Line and substitution filters are not applied, different files get
+	 * DIFFCODE::UNFILTERED when filters are set.
+	 */
+	int64_t m_nStreamingCompareLimit;
+
 	/**
 	 * Walk into unique folders and add contents.
 	 * This enables/disables walking into unique folders. If we don't walk into
@@ -191,10 +214,20 @@ public:
 	 * This value is true by default.
 	 */
 	bool m_bWalkUniques;
+	/**
+	 * Create items for files excluded by the file filter.
+	 * If false, excluded files are only counted in the compare statistics,
+	 * as they are tested against the filter while collecting.
+	 *
+	 * This value is true by default.
+	 */
+	bool m_bCollectSkipped;
 	bool m_bIgnoreReparsePoints;
 	bool m_bIgnoreCodepage;
 	bool m_bEnableImageCompare;
 	double m_dColorDistanceThreshold;
+	CompareEngines::ImageSignatureCache *m_pImageSignatureCache; /**< Signatures of images kept over compares, or nullptr */
+	ArchiveCache *m_pArchiveCache; /**< Archives compared without extracting, or nullptr */
 
 	bool m_bRecursive; /**< Do we include subfolders to compare? */
 	bool m_bPluginsEnabled; /**< Are plugins enabled? */
@@ -0,0 +1,56 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  DiffCopyLines.h
+ *
+ * @brief Declaration of ForEachCopiedLine() helper
+ */
+#pragma once
+
+#include <vector>
+
+/**
+ * @brief Flags of source lines not copied with a difference: ghost lines
+ * (LF_GHOST) and lines hidden by filters or "hide identical lines"
+ * (LF_INVISIBLE).
+ */
+constexpr unsigned long LF_NOT_COPIED = 0x00400000UL | 0x80000000UL;
+
+/**
+ * @brief Difference copied to the destination side.
+ */
+struct DiffCopyRange
+{
+	int begin; /**< First line of the difference */
+	int end; /**< Last line of the difference */
+	int srcPane; /**< Side the lines are copied from */
+};
+
+/**
+ * @brief Walk the lines of the destination after copying differences to it.
+ * Lines outside the differences stay as they are. The lines of each
+ * difference are replaced by the lines of its source side, except those
+ * with LF_NOT_COPIED flags, the same lines ListCopy() copies.
+ * @param [in] nLineCount Count of lines of the sides.
+ * @param [in] dstPane Destination side.
+ * @param [in] diffs Copied differences, in ascending order.
+ * @param [in] getFlags getFlags(pane, line) returns the flags of a line.
+ * @param [in] addLine addLine(pane, line) is called for each line of the result.
+ */
+template<typename GetFlags, typename AddLine>
+void ForEachCopiedLine(int nLineCount, int dstPane, const std::vector<DiffCopyRange>& diffs,
+	GetFlags getFlags, AddLine addLine)
+{
+	int nLine = 0;
+	for (const auto& diff : diffs)
+	{
+		for (; nLine < diff.begin; ++nLine)
+			addLine(dstPane, nLine);
+		for (; nLine <= diff.end; ++nLine)
+		{
+			if ((getFlags(diff.srcPane, nLine) & LF_NOT_COPIED) == 0)
+				addLine(diff.srcPane, nLine);
+		}
+	}
+	for (; nLine < nLineCount; ++nLine)
+		addLine(dstPane, nLine);
+}
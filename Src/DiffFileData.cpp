@@ -16,6 +16,7 @@
 #include "TFile.h"
 #include "FileTransform.h"
 #include "unicoder.h"
+#include "OpenedFile.h"
 #include "DebugNew.h"
 
 /**
@@ -47,6 +48,24 @@ bool DiffFileData::OpenFiles(const String& szFilepath1, const String& szFilepath
 	return b;
 }
 
+/**
+ * @brief Take over already opened files (return false if failure)
+ * Bytes the files have buffered are handed to diffutils, so they are not
+ * read again. The files are closed after this call.
+ */
+bool DiffFileData::OpenFiles(OpenedFile& file1, OpenedFile& file2)
+{
+	m_FileLocation[0].setPath(file1.GetPath());
+	m_FileLocation[1].setPath(file2.GetPath());
+	OpenedFile *files[2] = { &file1, &file2 };
+	bool b = DoOpenFiles(files);
+	if (!b)
+		Reset();
+	file1.Close();
+	file2.Close();
+	return b;
+}
+
 /** @brief stash away true names for display, before opening files */
 void DiffFileData::SetDisplayFilepaths(const String& szTrueFilepath1, const String& szTrueFilepath2)
 {
@@ -55,11 +74,31 @@ void DiffFileData::SetDisplayFilepaths(const String& szTrueFilepath1, const Stri
 }
 
 
-/** @brief Open file descriptors in the inf structure (return false if failure) */
-bool DiffFileData::DoOpenFiles()
+/**
+ * @brief Open file descriptors in the inf structure (return false if failure)
+ * @param [in] files Already opened files to take over, or nullptr.
+ */
+bool DiffFileData::DoOpenFiles(OpenedFile *files[2])
 {
 	Reset();
 
+	const bool bSameFile = strutils::compare_nocase(m_FileLocation[0].filepath,
+			m_FileLocation[1].filepath) == 0;
+	if (files != nullptr)
+	{
+		m_used = true; // let cleanup_file_buffers() free taken over buffers
+		for (int i = 0; i < (bSameFile ? 1 : 2); ++i)
+		{
+			char *buffer = nullptr;
+			size_t bufsize = 0, buffered = 0;
+			if (!files[i]->Detach(m_inf[i].desc, buffer, bufsize, buffered))
+				return false;
+			m_inf[i].buffer = buffer;
+			m_inf[i].bufsize = bufsize;
+			m_inf[i].buffered_chars = buffered;
+		}
+	}
+
 	for (int i = 0; i < 2; ++i)
 	{
 		// Fill in 8-bit versions of names for diffutils (WinMerge doesn't use these)
@@ -87,8 +126,7 @@ bool DiffFileData::DoOpenFiles()
 			return false;
 		}
 		
-		if (strutils::compare_nocase(m_FileLocation[0].filepath,
-				m_FileLocation[1].filepath) == 0)
+		if (bSameFile)
 		{
 			m_inf[1].desc = m_inf[0].desc;
 		}
@@ -13,6 +13,7 @@
 // forward declarations needed by DiffFileData
 struct file_data;
 class PrediffingInfo;
+class OpenedFile;
 class CDiffContext;
 
 /**
@@ -29,6 +30,7 @@ struct DiffFileData
 	~DiffFileData();
 
 	bool OpenFiles(const String& szFilepath1, const String& szFilepath2);
+	bool OpenFiles(OpenedFile& file1, OpenedFile& file2);
 	void Reset();
 	void Close() { Reset(); }
 	void SetDisplayFilepaths(const String& szTrueFilepath1, const String& szTrueFilepath2);
@@ -45,5 +47,5 @@ struct DiffFileData
 	String m_sDisplayFilepath[2];
 
 private:
-	bool DoOpenFiles();
+	bool DoOpenFiles(OpenedFile *files[2] = nullptr);
 };
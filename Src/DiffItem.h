@@ -53,6 +53,7 @@ struct DIFFCODE
 		COMPAREFLAGS=0x7000U, NOCMP=0x0000U, DIFF=0x1000U, SAME=0x2000U, CMPERR=0x3000U, CMPABORT=0x4000U,
 		COMPAREFLAGS3WAY=0x18000U, DIFFALL=0x0000U, DIFF1STONLY=0x8000U, DIFF2NDONLY=0x10000U, DIFF3RDONLY=0x18000U,
 		FILTERFLAGS=0x20000U, INCLUDED=0x00000U, SKIPPED=0x20000U,
+		UNFILTEREDFLAGS=0x40000U, UNFILTERED=0x40000U, // different by a compare not applying line and substitution filters
 		SCANFLAGS=0x100000U, NEEDSCAN=0x100000U,
 		THREEWAYFLAGS=0x200000U, THREEWAY=0x200000U,
 		SIDEFLAGS=0x70000000U, FIRST=0x10000000U, SECOND=0x20000000U, THIRD=0x40000000U, BOTH=0x30000000U, ALL=0x70000000U,
@@ -153,6 +154,7 @@ public:
 	bool isText() const { return Check(diffcode, DIFFCODE::TEXTFLAGS, DIFFCODE::TEXT); }
 	bool isBin() const { return (diffcode & DIFFCODE::BIN) != 0; }
 	bool isImage() const { return (diffcode & DIFFCODE::IMAGE) != 0; }
+	bool isUnfiltered() const { return (diffcode & DIFFCODE::UNFILTERED) != 0; }
 	// rescan
 	bool isScanNeeded() const { return ((diffcode & DIFFCODE::SCANFLAGS) == DIFFCODE::NEEDSCAN); }
 
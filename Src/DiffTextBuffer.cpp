@@ -146,9 +146,11 @@ AddUndoRecord(bool bInsert, const CPoint & ptStartPos,
 		int nActionType /*= CE_ACTION_UNKNOWN*/,
 		CDWordArray *paSavedRevisionNumbers /*= nullptr*/)
 {
+	const int nUndoPosition = m_nUndoPosition;
 	CGhostTextBuffer::AddUndoRecord(bInsert, ptStartPos, ptEndPos, pszText,
 		cchText, nActionType, paSavedRevisionNumbers);
-	if (m_aUndoBuf[m_nUndoPosition - 1].m_dwFlags & UNDO_BEGINGROUP)
+	// Typing may have extended the previous record instead of adding one
+	if (m_nUndoPosition != nUndoPosition && (m_aUndoBuf[m_nUndoPosition - 1].m_dwFlags & UNDO_BEGINGROUP))
 	{
 		m_pOwnerDoc->undoTgt.erase(m_pOwnerDoc->curUndo, m_pOwnerDoc->undoTgt.end());
 		m_pOwnerDoc->undoTgt.push_back(m_nThisPane);
@@ -219,6 +221,11 @@ OnNotifyLineHasBeenEdited(int nLine)
  * - FRESULT_ERROR : loading failed, sError contains error message
  * - FRESULT_BINARY : file is binary file
  * @note If this method fails, it calls InitNew so the CDiffTextBuffer is in a valid state
+ * @todo Files are decoded completely into lines which own their text, and
+ * CGhostTextBuffer stores ghost lines like real ones. A read-only mode for
+ * very large files needs copy-on-write line text shared with a mapped view
+ * of the file, a line index built lazily, and ghost lines kept only in the
+ * reality blocks.
  */
 int CDiffTextBuffer::LoadFromFile(LPCTSTR pszFileNameInit,
 		PackingInfo& infoUnpacker, LPCTSTR sToFindUnpacker, bool & readOnly,
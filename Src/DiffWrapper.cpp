@@ -25,6 +25,7 @@
 #include <Poco/Debugger.h>
 #include <Poco/StringTokenizer.h>
 #include <Poco/Exception.h>
+#include <Poco/Thread.h>
 #include "DiffContext.h"
 #include "coretools.h"
 #include "DiffList.h"
@@ -339,6 +340,24 @@ void CDiffWrapper::PostFilter(PostFilterContext& ctxt, int LineNumberLeft, int Q
 			LineNumberLeft, ctxt.nParsedLineEndLeft, file_data_ary[0].linbuf + file_data_ary[0].linbuf_base, LineDataLeft, m_pFilterCommentsDef);
 		ctxt.dwCookieRight = GetCommentsFilteredText(ctxt.dwCookieRight,
 			LineNumberRight, ctxt.nParsedLineEndRight, file_data_ary[1].linbuf + file_data_ary[1].linbuf_base, LineDataRight, m_pFilterCommentsDef);
+
+		if (m_pSubstitutionList)
+		{
+			LineDataLeft = m_pSubstitutionList->Subst(LineDataLeft);
+			LineDataRight = m_pSubstitutionList->Subst(LineDataRight);
+		}
+	}
+	else if (m_pSubstitutionList)
+	{
+		// Substitute each file once, hunks take their lines from the result
+		if (!ctxt.pSubstitutedLeft)
+			ctxt.pSubstitutedLeft = m_pSubstitutionList->SubstLines(file_data_ary[0].linbuf + file_data_ary[0].linbuf_base,
+				file_data_ary[0].valid_lines - file_data_ary[0].linbuf_base);
+		if (!ctxt.pSubstitutedRight)
+			ctxt.pSubstitutedRight = m_pSubstitutionList->SubstLines(file_data_ary[1].linbuf + file_data_ary[1].linbuf_base,
+				file_data_ary[1].valid_lines - file_data_ary[1].linbuf_base);
+		LineDataLeft = ctxt.pSubstitutedLeft->GetLines(LineNumberLeft, QtyLinesLeft);
+		LineDataRight = ctxt.pSubstitutedRight->GetLines(LineNumberRight, QtyLinesRight);
 	}
 	else
 	{
@@ -350,12 +369,6 @@ void CDiffWrapper::PostFilter(PostFilterContext& ctxt, int LineNumberLeft, int Q
 			- file_data_ary[1].linbuf[LineNumberRight + file_data_ary[1].linbuf_base]);
 	}
 
-	if (m_pSubstitutionList)
-	{
-		LineDataLeft = m_pSubstitutionList->Subst(LineDataLeft);
-		LineDataRight = m_pSubstitutionList->Subst(LineDataRight);
-	}
-
 	if (m_options.m_ignoreWhitespace == WHITESPACE_IGNORE_ALL)
 	{
 		//Ignore character case
@@ -492,14 +505,26 @@ bool CDiffWrapper::RunFileDiff()
 			return false;
 		}
 
-		bRet = Diff2Files(&script10, &diffdata10, &bin_flag10, nullptr);
-
 		if (!diffdata12.OpenFiles(strFileTemp[1], strFileTemp[2]))
 		{
 			return false;
 		}
 
-		bRet = Diff2Files(&script12, &diffdata12, &bin_flag12, nullptr);
+		// The two pairwise compares (including moved block detection) are
+		// independent, so compare middle and right files on another thread.
+		// diffutils options are thread-local and must be set there too.
+		bool bRet12 = true;
+		Poco::Thread thread12;
+		thread12.startFunc([&]()
+			{
+				m_options.SetToDiffUtils();
+				bRet12 = Diff2Files(&script12, &diffdata12, &bin_flag12, nullptr);
+			});
+
+		bRet = Diff2Files(&script10, &diffdata10, &bin_flag10, nullptr);
+
+		thread12.join();
+		bRet = bRet && bRet12;
 	}
 
 	// First determine what happened during comparison
@@ -806,6 +831,7 @@ bool CDiffWrapper::Diff2Files(struct change ** diffs, DiffFileData *diffData,
 	SE_Handler seh;
 	try
 	{
+		DiffutilsLineFilter lineFilter(m_pFilterList.get(), ucr::CP_UTF_8);
 		if (m_options.m_diffAlgorithm != DIFF_ALGORITHM_DEFAULT)
 		{
 			unsigned xdl_flags = make_xdl_flags(m_options);
@@ -869,19 +895,47 @@ bool CDiffWrapper::RegExpFilter(int StartPos, int EndPos, const file_data *pinf)
 
 	while (line <= EndPos && linesMatch)
 	{
-		size_t len = pinf->linbuf[line + 1] - pinf->linbuf[line];
-		const char *string = pinf->linbuf[line];
-		size_t stringlen = linelen(string, len);
-		if (!m_pFilterList->Match(std::string(string, stringlen)))
-
+		if (pinf->filtered_flag != nullptr && line >= 0 && line < pinf->filtered_lines)
 		{
-			linesMatch = false;
+			// Matched when diffutils read the file
+			linesMatch = pinf->filtered_flag[line] != 0;
+		}
+		else
+		{
+			size_t len = pinf->linbuf[line + 1] - pinf->linbuf[line];
+			const char *string = pinf->linbuf[line];
+			size_t stringlen = linelen(string, len);
+			if (!m_pFilterList->Match(std::string(string, stringlen)))
+			{
+				linesMatch = false;
+			}
 		}
 		++line;
 	}
 	return linesMatch;
 }
 
+DiffutilsLineFilter::DiffutilsLineFilter(const FilterList *pFilterList, int codepage)
+	: m_pFilterList(pFilterList)
+	, m_codepage(codepage)
+{
+	const bool bFilter = pFilterList != nullptr && pFilterList->HasRegExps();
+	line_filter_fn = bFilter ? MatchLines : nullptr;
+	line_filter_data = bFilter ? this : nullptr;
+}
+
+DiffutilsLineFilter::~DiffutilsLineFilter()
+{
+	line_filter_fn = nullptr;
+	line_filter_data = nullptr;
+}
+
+void DiffutilsLineFilter::MatchLines(void *data, const char *const *lines, int nlines, char *flags)
+{
+	const DiffutilsLineFilter *pThis = static_cast<const DiffutilsLineFilter *>(data);
+	pThis->m_pFilterList->MatchLines(lines, nlines, flags, pThis->m_codepage);
+}
+
 /**
  * @brief Walk the diff utils change script, building the WinMerge list of diff blocks
  */
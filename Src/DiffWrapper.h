@@ -25,6 +25,7 @@ struct file_data;
 class MovedLines;
 class FilterList;
 class SubstitutionList;
+struct SubstitutedLines;
 namespace CrystalLineParser { struct TextDefinition; };
 
 /** @enum COMPARE_TYPE
@@ -145,6 +146,25 @@ struct PostFilterContext
 	int nParsedLineEndRight = -1;
 	unsigned dwCookieLeft = 0;
 	unsigned dwCookieRight = 0;
+	std::shared_ptr<const SubstitutedLines> pSubstitutedLeft; /**< Substituted lines of left file, made on first use */
+	std::shared_ptr<const SubstitutedLines> pSubstitutedRight;
+};
+
+/**
+ * @brief Makes diffutils match line filters while it reads the files.
+ * The filters are set for the lifetime of the object, on this thread.
+ */
+class DiffutilsLineFilter
+{
+public:
+	DiffutilsLineFilter(const FilterList *pFilterList, int codepage);
+	~DiffutilsLineFilter();
+
+private:
+	static void MatchLines(void *data, const char *const *lines, int nlines, char *flags);
+
+	const FilterList *m_pFilterList;
+	int m_codepage;
 };
 
 /**
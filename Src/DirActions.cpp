@@ -20,6 +20,7 @@
 #include "FileActionScript.h"
 #include "locality.h"
 #include "FileFilterHelper.h"
+#include "ArchiveCache.h"
 #include "DebugNew.h"
 
 static void ThrowConfirmCopy(const CDiffContext& ctxt, int origin, int destination, int count,
@@ -1014,6 +1015,21 @@ String GetItemFileName(const CDiffContext& ctxt, const DIFFITEM &di, int index)
 	return paths::ConcatPath(ctxt.GetPath(index), paths::ConcatPath(di.diffFileInfo[index].path, di.diffFileInfo[index].filename));
 }
 
+/**
+ * @brief Get path to read an item from, for opening or copying it.
+ * Items in archives walked by CDiffContext::m_pArchiveCache are extracted,
+ * as file compares, other programs and file operations need real files.
+ * @return Path of the item or of the extracted item, empty if the item
+ * is missing from the archive or could not be extracted.
+ */
+String GetPathToRead(const CDiffContext& ctxt, const String& path)
+{
+	ArchiveCache *pArchives = ctxt.m_pArchiveCache;
+	if (pArchives == nullptr || !pArchives->IsInArchive(path))
+		return path;
+	return pArchives->Extract(path);
+}
+
 PathContext GetItemFileNames(const CDiffContext& ctxt, const DIFFITEM &di)
 {
 	PathContext paths;
@@ -1129,7 +1145,7 @@ void UnsetDiffSide(DIFFITEM& di, int index)
  */
 void SetDiffCompare(DIFFITEM& di, unsigned diffcode)
 {
-	SetDiffStatus(di, diffcode, DIFFCODE::COMPAREFLAGS);
+	SetDiffStatus(di, diffcode, DIFFCODE::COMPAREFLAGS | DIFFCODE::UNFILTEREDFLAGS);
 }
 
 /**
@@ -1211,7 +1227,7 @@ void SetItemViewFlag(CDiffContext& ctxt, unsigned flag, unsigned mask)
  */
 void MarkForRescan(DIFFITEM &di)
 {
-	SetDiffStatus(di, 0, DIFFCODE::TEXTFLAGS | DIFFCODE::SIDEFLAGS | DIFFCODE::COMPAREFLAGS);
+	SetDiffStatus(di, 0, DIFFCODE::TEXTFLAGS | DIFFCODE::SIDEFLAGS | DIFFCODE::COMPAREFLAGS | DIFFCODE::UNFILTEREDFLAGS);
 	SetDiffStatus(di, DIFFCODE::NEEDSCAN, DIFFCODE::SCANFLAGS);
 }
 
@@ -161,6 +161,7 @@ bool GetOpenThreeItems(const CDiffContext& ctxt, DIFFITEM *pos1, DIFFITEM *pos2,
 void GetItemFileNames(const CDiffContext& ctxt, const DIFFITEM& di, String& strLeft, String& strRight);
 PathContext GetItemFileNames(const CDiffContext& ctxt, const DIFFITEM& di);
 String GetItemFileName(const CDiffContext& ctx, const DIFFITEM &di, int index);
+String GetPathToRead(const CDiffContext& ctxt, const String& path);
 int GetColImage(const DIFFITEM &di);
 
 void SetDiffStatus(DIFFITEM& di, unsigned  diffcode, unsigned mask);
@@ -343,12 +344,13 @@ struct DirActions
 		if (di.diffcode.diffcode != 0 && !m_RO[dstidx] && IsItemCopyable(di, srcidx))
 		{
 			FileActionItem act;
-			act.src  = GetItemFileName(m_ctxt, di, srcidx);
+			const String src = GetItemFileName(m_ctxt, di, srcidx);
+			act.src  = GetPathToRead(m_ctxt, src);
 			act.dest = GetItemFileName(m_ctxt, di, dstidx);
 			
 			// We must check that paths still exists
 			if (paths::DoesPathExist(act.src) == paths::DOES_NOT_EXIST)
-				throw ContentsChangedException(act.src);
+				throw ContentsChangedException(src);
 
 			act.context = it.first;
 			act.dirflag = di.diffcode.isDirectory();
@@ -456,11 +458,12 @@ struct DirActions
 			(atype == FileAction::ACT_MOVE ? (!m_RO[index] && IsItemDeletable(di, index)) : true))
 		{
 			FileActionItem act;
-			act.src = GetItemFileName(m_ctxt, di, index);
+			const String src = GetItemFileName(m_ctxt, di, index);
+			act.src = GetPathToRead(m_ctxt, src);
 			 
 			// We must check that path still exists
 			if (paths::DoesPathExist(act.src) == paths::DOES_NOT_EXIST)
-				throw ContentsChangedException(act.src);
+				throw ContentsChangedException(src);
 
 			act.dest = paths::ConcatPath(pscript->m_destBase, di.diffFileInfo[index].GetFile());
 			act.dirflag = di.diffcode.isDirectory();
@@ -41,6 +41,9 @@
 #include "DiffWrapper.h"
 #include "FolderCmp.h"
 #include "DirViewColItems.h"
+#include "DirWatcher.h"
+#include "ImageDiff.h"
+#include "ArchiveCache.h"
 #include <Poco/Semaphore.h>
 
 #ifdef _DEBUG
@@ -155,6 +158,7 @@ void CDirDoc::InitCompare(const PathContext & paths, bool bRecursive, CTempPathC
 	if (m_pCompareStats == nullptr)
 		m_pCompareStats.reset(new CompareStats(m_nDirs));
 
+	m_pArchiveCache.reset();
 	m_pCtxt.reset(new CDiffContext(paths,
 			GetOptionsMgr()->GetInt(OPT_CMP_METHOD)));
 	m_pCtxt->m_bRecursive = bRecursive;
@@ -215,6 +219,30 @@ void CDirDoc::LoadSubstitutionFiltersList(CDiffContext* pCtxt)
 	pCtxt->m_pSubstitutionList = theApp.m_pSubstitutionFiltersList->MakeSubstitutionList();
 }
 
+/**
+ * @brief Open compared zip and tar files to walk them without extracting them.
+ * Other archives were extracted by DecompressArchive() before. Sides in
+ * archives are read-only, file operations and file compares extract the
+ * items they use.
+ */
+void CDirDoc::OpenArchives()
+{
+	if (m_pArchiveCache != nullptr)
+		m_pArchiveCache->Clear();
+	if (m_pTempPathContext != nullptr || GetOptionsMgr()->GetInt(OPT_ARCHIVE_ENABLE) == 0)
+		return;
+	for (int nIndex = 0; nIndex < m_nDirs; nIndex++)
+	{
+		const String path = m_pCtxt->GetNormalizedPath(nIndex);
+		if (paths::DoesPathExist(path) != paths::IS_EXISTING_FILE)
+			continue;
+		if (m_pArchiveCache == nullptr)
+			m_pArchiveCache.reset(new ArchiveCache());
+		if (m_pArchiveCache->AddRoot(path))
+			m_bRO[nIndex] = true;
+	}
+}
+
 void CDirDoc::DiffThreadCallback(int& state)
 {
 	PostMessage(m_pDirView->GetSafeHwnd(), MSG_UI_UPDATE, state, false);
@@ -237,8 +265,10 @@ void CDirDoc::InitDiffContext(CDiffContext *pCtxt)
 	pCtxt->m_bStopAfterFirstDiff = GetOptionsMgr()->GetBool(OPT_CMP_STOP_AFTER_FIRST);
 	pCtxt->m_nQuickCompareLimit = GetOptionsMgr()->GetInt(OPT_CMP_QUICK_LIMIT);
 	pCtxt->m_nBinaryCompareLimit = GetOptionsMgr()->GetInt(OPT_CMP_BINARY_LIMIT);
+	pCtxt->m_nStreamingCompareLimit = static_cast<int64_t>(GetOptionsMgr()->GetInt(OPT_CMP_STREAMING_LIMIT)) * 1024 * 1024;
 	pCtxt->m_bPluginsEnabled = GetOptionsMgr()->GetBool(OPT_PLUGINS_ENABLED);
 	pCtxt->m_bWalkUniques = GetOptionsMgr()->GetBool(OPT_CMP_WALK_UNIQUE_DIRS);
+	pCtxt->m_bCollectSkipped = GetOptionsMgr()->GetBool(OPT_SHOW_SKIPPED);
 	pCtxt->m_bIgnoreReparsePoints = GetOptionsMgr()->GetBool(OPT_CMP_IGNORE_REPARSE_POINTS);
 	pCtxt->m_bIgnoreCodepage = GetOptionsMgr()->GetBool(OPT_CMP_IGNORE_CODEPAGE);
 	pCtxt->m_bEnableImageCompare = GetOptionsMgr()->GetBool(OPT_CMP_ENABLE_IMGCMP_IN_DIRCMP);
@@ -247,8 +277,12 @@ void CDirDoc::InitDiffContext(CDiffContext *pCtxt)
 	m_imgfileFilter.UseMask(true);
 	m_imgfileFilter.SetMask(GetOptionsMgr()->GetString(OPT_CMP_IMG_FILEPATTERNS));
 	pCtxt->m_pImgfileFilter = &m_imgfileFilter;
+	if (pCtxt->m_bEnableImageCompare && m_pImageSignatureCache == nullptr)
+		m_pImageSignatureCache.reset(new CompareEngines::ImageSignatureCache());
+	pCtxt->m_pImageSignatureCache = m_pImageSignatureCache.get();
 
 	pCtxt->m_pCompareStats = m_pCompareStats.get();
+	pCtxt->m_pArchiveCache = m_pArchiveCache.get();
 
 	// Make sure filters are up-to-date
 	theApp.m_pGlobalFileFilter->ReloadUpdatedFilters();
@@ -284,10 +318,15 @@ void CDirDoc::Rescan()
 	{
 		m_pCtxt->RemoveAll();
 		m_pCtxt->InitDiffItemList();
+		OpenArchives();
 	}
 
 	InitDiffContext(m_pCtxt.get());
 
+	// Start watching before scanning, so that changes during the scan are seen
+	if (!m_bMarkedRescan && !m_bGeneratingReport)
+		m_pDirView->SetFolderWatchTimer(StartWatching());
+
 	pf->GetHeaderInterface()->SetPaneCount(m_nDirs);
 	pf->GetHeaderInterface()->SetOnSetFocusCallback([&](int pane) {
 		m_pDirView->SetActivePane(pane);
@@ -545,7 +584,7 @@ void CDirDoc::UpdateChangedItem(const PathContext &paths,
 		UINT diffcode = (bIdentical ? DIFFCODE::SAME : DIFFCODE::DIFF);
 
 		// Update both views and diff context memory
-		m_pCtxt->SetDiffStatusCode(pos, diffcode, DIFFCODE::COMPAREFLAGS);
+		m_pCtxt->SetDiffStatusCode(pos, diffcode, DIFFCODE::COMPAREFLAGS | DIFFCODE::UNFILTEREDFLAGS);
 
 		if (nDiffs != -1 && nTrivialDiffs != -1)
 			m_pCtxt->SetDiffCounts(pos, nDiffs, nTrivialDiffs);
@@ -574,6 +613,70 @@ void CDirDoc::RefreshOptions()
 		m_pCtxt->m_bRecursive = GetOptionsMgr()->GetBool(OPT_CMP_INCLUDE_SUBDIRS);
 	if (m_pDirView != nullptr)
 		m_pDirView->RefreshOptions();
+	if (!GetOptionsMgr()->GetBool(OPT_CMP_WATCH_FOLDERS))
+		StopWatching();
+}
+
+/**
+ * @brief Start watching the compared folders for changes, if enabled.
+ * Folders extracted from archives and archives walked without extracting
+ * them are not watched.
+ * @return `true` if the folders are watched.
+ */
+bool CDirDoc::StartWatching()
+{
+	m_pDirWatcher.reset();
+	if (!GetOptionsMgr()->GetBool(OPT_CMP_WATCH_FOLDERS) || IsArchiveFolders() || m_pArchiveCache != nullptr)
+		return false;
+	m_pDirWatcher.reset(new DirWatcher());
+	if (!m_pDirWatcher->Start(m_pCtxt->GetNormalizedPaths(), m_pCtxt->m_bRecursive))
+	{
+		m_pDirWatcher.reset();
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Stop watching the compared folders.
+ */
+void CDirDoc::StopWatching()
+{
+	m_pDirWatcher.reset();
+	if (m_pDirView != nullptr)
+		m_pDirView->SetFolderWatchTimer(false);
+}
+
+/**
+ * @brief Mark items changed on disk for rescan.
+ * Nothing is done while a compare is running, the changes are kept until
+ * it is finished.
+ * @param [out] bFullRescan Set to `true` if only a full rescan can update results.
+ * @return `true` if items were marked or a full rescan is needed.
+ */
+bool CDirDoc::MarkChangedItems(bool& bFullRescan)
+{
+	bFullRescan = false;
+	if (m_pDirWatcher == nullptr || m_diffThread.GetThreadState() == CDiffThread::THREAD_COMPARING)
+		return false;
+	std::vector<String> changes[3];
+	if (!m_pDirWatcher->GetChanges(changes))
+		return false;
+	int nMarked = 0;
+	for (int nIndex = 0; nIndex < m_nDirs && !bFullRescan; ++nIndex)
+	{
+		for (const auto& relpath : changes[nIndex])
+		{
+			int res = DirScan_MarkChangedItem(m_pCtxt.get(), nIndex, relpath);
+			if (res < 0)
+			{
+				bFullRescan = true;
+				break;
+			}
+			nMarked += res;
+		}
+	}
+	return bFullRescan || nMarked > 0;
 }
 
 /**
@@ -751,6 +854,8 @@ void CDirDoc::Swap(int idx1, int idx2)
 		m_pTempPathContext->Swap(idx1, idx2);
 	m_pCtxt->Swap(idx1, idx2);
 	m_pCompareStats->Swap(idx1, idx2);
+	if (m_pDirWatcher != nullptr)
+		StartWatching();
 	for (int nIndex = 0; nIndex < m_nDirs; nIndex++)
 		UpdateHeaderPath(nIndex);
 	SetTitle(nullptr);
@@ -23,6 +23,9 @@ typedef CTypedPtrList<CPtrList, IMergeDoc *> MergeDocPtrList;
 class DirDocFilterGlobal;
 class DirDocFilterByExtension;
 class CTempPathContext;
+class DirWatcher;
+class ArchiveCache;
+namespace CompareEngines { class ImageSignatureCache; }
 struct FileActionItem;
 struct FileLocation;
 
@@ -103,7 +106,12 @@ public:
 	const CDiffContext & GetDiffContext() const { return *m_pCtxt; }
 	CDiffContext& GetDiffContext() { return *m_pCtxt.get(); }
 	void SetMarkedRescan() {m_bMarkedRescan = true; }
+	bool StartWatching();
+	void StopWatching();
+	bool IsWatching() const { return m_pDirWatcher != nullptr; }
+	bool MarkChangedItems(bool& bFullRescan);
 	const CompareStats * GetCompareStats() const { return m_pCompareStats.get(); };
+	CompareStats * GetCompareStats() { return m_pCompareStats.get(); };
 	bool IsArchiveFolders() const;
 	PluginManager& GetPluginManager() { return m_pluginman; };
 	void Swap(int idx1, int idx2);
@@ -124,6 +132,7 @@ protected:
 	void InitDiffContext(CDiffContext *pCtxt);
 	void LoadLineFilterList(CDiffContext *pCtxt);
 	void LoadSubstitutionFiltersList(CDiffContext* pCtxt);
+	void OpenArchives();
 
 	// Generated message map functions
 	//{{AFX_MSG(CDirDoc)
@@ -145,6 +154,9 @@ private:
 	bool m_bMarkedRescan; /**< If `true` next rescan scans only marked items */
 	bool m_bGeneratingReport;
 	std::unique_ptr<DirCmpReport> m_pReport;
+	std::unique_ptr<DirWatcher> m_pDirWatcher; /**< Watches compared folders, if enabled */
+	std::unique_ptr<CompareEngines::ImageSignatureCache> m_pImageSignatureCache; /**< Image signatures kept over rescans */
+	std::unique_ptr<ArchiveCache> m_pArchiveCache; /**< Compared zip and tar files, walked without extracting them */
 };
 
 /**
@@ -10,9 +10,21 @@
 #include <Poco/File.h>
 #include <Poco/Timestamp.h>
 #include <boost/flyweight.hpp>
+#include <boost/flyweight/no_locking.hpp>
+#include "ShardedFactory.h"
 #include "FileFlags.h"
 #include "UnicodeString.h"
 
+/**
+ * @brief Interned string used for item names and paths.
+ * Interning goes through a sharded factory instead of the global
+ * flyweight lock, as names are interned concurrently by the scan and
+ * compare threads. Interned strings are released with the last item
+ * referring to them.
+ */
+typedef boost::flyweight<String, sharded_factory,
+	sharded_tracking, boost::flyweights::no_locking> InternedString;
+
 /**
  * @brief Information for file.
  * This class stores basic information from a file or folder.
@@ -27,8 +39,8 @@ struct DirItem
 	Poco::Timestamp ctime; /**< time of creation */
 	Poco::Timestamp mtime; /**< time of last modify */
 	Poco::File::FileSize size; /**< file size in bytes, FILE_SIZE_NONE (== -1) means file does not exist*/
-	boost::flyweight<String> filename; /**< filename for this item */
-	boost::flyweight<String> path; /**< full path (excluding filename) for the item */
+	InternedString filename; /**< filename for this item */
+	InternedString path; /**< full path (excluding filename) for the item */
 	FileFlags flags; /**< file attributes */
 	
 	enum : uint64_t { FILE_SIZE_NONE = UINT64_MAX };
@@ -29,6 +29,9 @@
 #include "IAbortable.h"
 #include "DirItem.h"
 #include "DirTravel.h"
+#include "ArchiveCache.h"
+#include "IoScheduler.h"
+#include "ParallelFor.h"
 #include "paths.h"
 #include "Plugins.h"
 #include "MergeApp.h"
@@ -53,7 +56,7 @@ static DIFFITEM *AddToList(const String &sLeftDir, const String &sRightDir, cons
 static DIFFITEM *AddToList(const String &sDir1, const String &sDir2, const String &sDir3, const DirItem *ent1, const DirItem *ent2, const DirItem *ent3,
 	unsigned code, DiffFuncStruct *myStruct, DIFFITEM *parent, int nItems = 3);
 static void UpdateDiffItem(DIFFITEM &di, bool &bExists, CDiffContext *pCtxt);
-static int CompareItems(NotificationQueue &queue, DiffFuncStruct *myStruct, DIFFITEM *parentdiffpos);
+static int CompareItems(NotificationQueue &queue, DiffFuncStruct *myStruct, DIFFITEM *parentdiffpos, bool bKeepOrder);
 
 class WorkNotification: public Poco::Notification
 {
@@ -78,15 +81,21 @@ private:
 class DiffWorker: public Runnable
 {
 public:
-	DiffWorker(NotificationQueue& queue, CDiffContext *pCtxt, int id):
-	  m_queue(queue), m_pCtxt(pCtxt), m_id(id) {}
+	DiffWorker(NotificationQueue& queue, CDiffContext *pCtxt, int id, IoScheduler *pIoScheduler, const int volumes[], bool bSerial):
+	  m_queue(queue), m_pCtxt(pCtxt), m_id(id), m_pIoScheduler(pIoScheduler), m_bSerial(bSerial)
+	{
+		std::copy(volumes, volumes + 3, m_volumes);
+	}
 
 	void run()
 	{
 		FolderCmp fc(m_pCtxt);
+		fc.SetIoScheduler(m_pIoScheduler, m_volumes);
 		// keep the scripts alive during the Rescan
 		// when we exit the thread, we delete this and release the scripts
 		CAssureScriptsForThread scriptsForRescan;
+		// Workers already keep the processors busy, compare each file on one thread
+		parallel::SerialScope serial(m_bSerial);
 
 		AutoPtr<Notification> pNf(m_queue.waitDequeueNotification());
 		while (pNf.get() != nullptr)
@@ -106,6 +115,9 @@ private:
 	NotificationQueue& m_queue;
 	CDiffContext *m_pCtxt;
 	int m_id;
+	IoScheduler *m_pIoScheduler;
+	int m_volumes[3];
+	bool m_bSerial; /**< Run ParallelFor() on this thread only? */
 };
 
 typedef std::shared_ptr<DiffWorker> DiffWorkerPtr;
@@ -120,6 +132,10 @@ typedef std::shared_ptr<DiffWorker> DiffWorkerPtr;
  *   contain into list.
  *
  * Items are tested against file filters in this function.
+ *
+ * Folders in archives opened in CDiffContext::m_pArchiveCache are listed
+ * from the archive instead of the disk, and archives found in them on all
+ * sides are listed as folders.
  * 
  * @param [in] paths Root paths of compare
  * @param [in] leftsubdir Left side subdirectory under root path
@@ -156,8 +172,19 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 	}
 
 	DirItemArray dirs[3], aFiles[3];
-	for (int nIndex = 0; nIndex < nDirs; nIndex++)
-		LoadAndSortFiles(sDir[nIndex], &dirs[nIndex], &aFiles[nIndex], casesensitive);
+	{
+		CompareStats::ScopedPhase phase(pCtxt->m_pCompareStats, CompareStats::PHASE_ENUMERATE);
+		for (int nIndex = 0; nIndex < nDirs; nIndex++)
+		{
+			// Folders in archives are listed from the archive directory
+			if (pCtxt->m_pArchiveCache == nullptr ||
+				!pCtxt->m_pArchiveCache->LoadAndSortFiles(sDir[nIndex], &dirs[nIndex], &aFiles[nIndex], casesensitive))
+				LoadAndSortFiles(sDir[nIndex], &dirs[nIndex], &aFiles[nIndex], casesensitive);
+		}
+		// Archives in archives become folders when all sides have them
+		if (pCtxt->m_pArchiveCache != nullptr)
+			pCtxt->m_pArchiveCache->OpenNestedArchives(sDir, nDirs, dirs, aFiles);
+	}
 
 	// Allow user to abort scanning
 	if (pCtxt->ShouldAbort())
@@ -186,13 +213,13 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 
 		unsigned nDiffCode = DIFFCODE::DIR;
 		// Comparing directories leftDirs[i].name to rightDirs[j].name
-		if (i<dirs[0].size() && (j==dirs[1].size() || collstr(dirs[0][i].filename, dirs[1][j].filename, casesensitive)<0)
-			&& (nDirs < 3 ||      (k==dirs[2].size() || collstr(dirs[0][i].filename, dirs[2][k].filename, casesensitive)<0) ))
+		if (i<dirs[0].size() && (j==dirs[1].size() || collkeycmp(dirs[0][i], dirs[1][j])<0)
+			&& (nDirs < 3 ||      (k==dirs[2].size() || collkeycmp(dirs[0][i], dirs[2][k])<0) ))
 		{
 			nDiffCode |= DIFFCODE::FIRST;
 		}
-		else if (j<dirs[1].size() && (i==dirs[0].size() || collstr(dirs[1][j].filename, dirs[0][i].filename, casesensitive)<0)
-			&& (nDirs < 3 ||      (k==dirs[2].size() || collstr(dirs[1][j].filename, dirs[2][k].filename, casesensitive)<0) ))
+		else if (j<dirs[1].size() && (i==dirs[0].size() || collkeycmp(dirs[1][j], dirs[0][i])<0)
+			&& (nDirs < 3 ||      (k==dirs[2].size() || collkeycmp(dirs[1][j], dirs[2][k])<0) ))
 		{
 			nDiffCode |= DIFFCODE::SECOND;
 		}
@@ -202,23 +229,23 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 		}
 		else
 		{
-			if (k<dirs[2].size() && (i==dirs[0].size() || collstr(dirs[2][k].filename, dirs[0][i].filename, casesensitive)<0)
-				&&                     (j==dirs[1].size() || collstr(dirs[2][k].filename, dirs[1][j].filename, casesensitive)<0) )
+			if (k<dirs[2].size() && (i==dirs[0].size() || collkeycmp(dirs[2][k], dirs[0][i])<0)
+				&&                     (j==dirs[1].size() || collkeycmp(dirs[2][k], dirs[1][j])<0) )
 			{
 				nDiffCode |= DIFFCODE::THIRD;
 			}
-			else if ((i<dirs[0].size() && j<dirs[1].size() && collstr(dirs[0][i].filename, dirs[1][j].filename, casesensitive) == 0)
-				&& (k==dirs[2].size() || collstr(dirs[2][k].filename, dirs[0][i].filename, casesensitive) != 0))
+			else if ((i<dirs[0].size() && j<dirs[1].size() && collkeycmp(dirs[0][i], dirs[1][j]) == 0)
+				&& (k==dirs[2].size() || collkeycmp(dirs[2][k], dirs[0][i]) != 0))
 			{
 				nDiffCode |= DIFFCODE::FIRST | DIFFCODE::SECOND;
 			}
-			else if ((i<dirs[0].size() && k<dirs[2].size() && collstr(dirs[0][i].filename, dirs[2][k].filename, casesensitive) == 0)
-				&& (j==dirs[1].size() || collstr(dirs[1][j].filename, dirs[2][k].filename, casesensitive) != 0))
+			else if ((i<dirs[0].size() && k<dirs[2].size() && collkeycmp(dirs[0][i], dirs[2][k]) == 0)
+				&& (j==dirs[1].size() || collkeycmp(dirs[1][j], dirs[2][k]) != 0))
 			{
 				nDiffCode |= DIFFCODE::FIRST | DIFFCODE::THIRD;
 			}
-			else if ((j<dirs[1].size() && k<dirs[2].size() && collstr(dirs[1][j].filename, dirs[2][k].filename, casesensitive) == 0)
-				&& (i==dirs[0].size() || collstr(dirs[0][i].filename, dirs[1][j].filename, casesensitive) != 0))
+			else if ((j<dirs[1].size() && k<dirs[2].size() && collkeycmp(dirs[1][j], dirs[2][k]) == 0)
+				&& (i==dirs[0].size() || collkeycmp(dirs[0][i], dirs[1][j]) != 0))
 			{
 				nDiffCode |= DIFFCODE::SECOND | DIFFCODE::THIRD;
 			}
@@ -238,7 +265,12 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 
 			// Test against filter so we don't include contents of filtered out directories
 			// Also this is only place we can test for both-sides directories in recursive compare
-			if ((pCtxt->m_piFilterGlobal!=nullptr && !pCtxt->m_piFilterGlobal->includeDir(leftnewsub, rightnewsub)) ||
+			bool bIncluded;
+			{
+				CompareStats::ScopedPhase phase(pCtxt->m_pCompareStats, CompareStats::PHASE_FILTER);
+				bIncluded = pCtxt->m_piFilterGlobal == nullptr || pCtxt->m_piFilterGlobal->includeDir(leftnewsub, rightnewsub);
+			}
+			if (!bIncluded ||
 				(pCtxt->m_bIgnoreReparsePoints && (
 				(nDiffCode & DIFFCODE::FIRST) && (dirs[0][i].flags.attributes & FILE_ATTRIBUTE_REPARSE_POINT) ||
 					(nDiffCode & DIFFCODE::SECOND) && (dirs[1][j].flags.attributes & FILE_ATTRIBUTE_REPARSE_POINT))
@@ -263,7 +295,12 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 
 			// Test against filter so we don't include contents of filtered out directories
 			// Also this is only place we can test for both-sides directories in recursive compare
-			if ((pCtxt->m_piFilterGlobal!=nullptr && !pCtxt->m_piFilterGlobal->includeDir(leftnewsub, middlenewsub, rightnewsub)) ||
+			bool bIncluded;
+			{
+				CompareStats::ScopedPhase phase(pCtxt->m_pCompareStats, CompareStats::PHASE_FILTER);
+				bIncluded = pCtxt->m_piFilterGlobal == nullptr || pCtxt->m_piFilterGlobal->includeDir(leftnewsub, middlenewsub, rightnewsub);
+			}
+			if (!bIncluded ||
 				(pCtxt->m_bIgnoreReparsePoints && (
 				  (nDiffCode & DIFFCODE::FIRST)  && (dirs[0][i].flags.attributes & FILE_ATTRIBUTE_REPARSE_POINT) ||
 				  (nDiffCode & DIFFCODE::SECOND) && (dirs[1][j].flags.attributes & FILE_ATTRIBUTE_REPARSE_POINT) ||
@@ -344,9 +381,9 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 
 		// Comparing file aFiles[0][i].name to aFiles[1][j].name
 		if (i<aFiles[0].size() && (j==aFiles[1].size() ||
-				collstr(aFiles[0][i].filename, aFiles[1][j].filename, casesensitive) < 0)
+				collkeycmp(aFiles[0][i], aFiles[1][j]) < 0)
 			&& (nDirs < 3 || 
-				(k==aFiles[2].size() || collstr(aFiles[0][i].filename, aFiles[2][k].filename, casesensitive)<0) ))
+				(k==aFiles[2].size() || collkeycmp(aFiles[0][i], aFiles[2][k])<0) ))
 		{
 			if (nDirs < 3)
 			{
@@ -363,9 +400,9 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 			continue;
 		}
 		if (j<aFiles[1].size() && (i==aFiles[0].size() ||
-				collstr(aFiles[0][i].filename, aFiles[1][j].filename, casesensitive) > 0)
+				collkeycmp(aFiles[0][i], aFiles[1][j]) > 0)
 			&& (nDirs < 3 ||
-				(k==aFiles[2].size() || collstr(aFiles[1][j].filename, aFiles[2][k].filename, casesensitive)<0) ))
+				(k==aFiles[2].size() || collkeycmp(aFiles[1][j], aFiles[2][k])<0) ))
 		{
 			const unsigned nDiffCode = DIFFCODE::SECOND | DIFFCODE::FILE;
 			if (nDirs < 3)
@@ -379,8 +416,8 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 		if (nDirs == 3)
 		{
 			if (k<aFiles[2].size() && (i==aFiles[0].size() ||
-					collstr(aFiles[2][k].filename, aFiles[0][i].filename, casesensitive)<0)
-				&& (j==aFiles[1].size() || collstr(aFiles[2][k].filename, aFiles[1][j].filename, casesensitive)<0) )
+					collkeycmp(aFiles[2][k], aFiles[0][i])<0)
+				&& (j==aFiles[1].size() || collkeycmp(aFiles[2][k], aFiles[1][j])<0) )
 			{
 				const unsigned nDiffCode = DIFFCODE::THIRD | DIFFCODE::FILE;
 				AddToList(subdir[0], subdir[1], subdir[2], nullptr, nullptr, &aFiles[2][k], nDiffCode, myStruct, parent);
@@ -389,8 +426,8 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 				continue;
 			}
 
-			if ((i<aFiles[0].size() && j<aFiles[1].size() && collstr(aFiles[0][i].filename, aFiles[1][j].filename, casesensitive) == 0)
-			    && (k==aFiles[2].size() || collstr(aFiles[0][i].filename, aFiles[2][k].filename, casesensitive) != 0))
+			if ((i<aFiles[0].size() && j<aFiles[1].size() && collkeycmp(aFiles[0][i], aFiles[1][j]) == 0)
+			    && (k==aFiles[2].size() || collkeycmp(aFiles[0][i], aFiles[2][k]) != 0))
 			{
 				const unsigned nDiffCode = DIFFCODE::FIRST | DIFFCODE::SECOND | DIFFCODE::FILE;
 				AddToList(subdir[0], subdir[1], subdir[2], &aFiles[0][i], &aFiles[1][j], nullptr, nDiffCode, myStruct, parent);
@@ -398,8 +435,8 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 				++j;
 				continue;
 			}
-			else if ((i<aFiles[0].size() && k<aFiles[2].size() && collstr(aFiles[0][i].filename, aFiles[2][k].filename, casesensitive) == 0)
-			    && (j==aFiles[1].size() || collstr(aFiles[1][j].filename, aFiles[2][k].filename, casesensitive) != 0))
+			else if ((i<aFiles[0].size() && k<aFiles[2].size() && collkeycmp(aFiles[0][i], aFiles[2][k]) == 0)
+			    && (j==aFiles[1].size() || collkeycmp(aFiles[1][j], aFiles[2][k]) != 0))
 			{
 				const unsigned nDiffCode = DIFFCODE::FIRST | DIFFCODE::THIRD | DIFFCODE::FILE;
 				AddToList(subdir[0], subdir[1], subdir[2], &aFiles[0][i], nullptr, &aFiles[2][k], nDiffCode, myStruct, parent);
@@ -407,8 +444,8 @@ int DirScan_GetItems(const PathContext &paths, const String subdir[],
 				++k;
 				continue;
 			}
-			else if ((j<aFiles[1].size() && k<aFiles[2].size() && collstr(aFiles[1][j].filename, aFiles[2][k].filename, casesensitive) == 0)
-			    && (i==aFiles[0].size() || collstr(aFiles[0][i].filename, aFiles[1][j].filename, casesensitive) != 0))
+			else if ((j<aFiles[1].size() && k<aFiles[2].size() && collkeycmp(aFiles[1][j], aFiles[2][k]) == 0)
+			    && (i==aFiles[0].size() || collkeycmp(aFiles[0][i], aFiles[1][j]) != 0))
 			{
 				const unsigned nDiffCode = DIFFCODE::SECOND | DIFFCODE::THIRD | DIFFCODE::FILE;
 				AddToList(subdir[0], subdir[1], subdir[2], nullptr, &aFiles[1][j], &aFiles[2][k], nDiffCode, myStruct, parent);
@@ -487,17 +524,33 @@ int DirScan_CompareItems(DiffFuncStruct *myStruct, DIFFITEM *parentdiffpos)
 		}
 	}
 
+	// Limit concurrent reads on spinning disks and network shares,
+	// workers on SSDs run unrestricted as before
+	std::unique_ptr<IoScheduler> pIoScheduler;
+	int volumes[3] = { 0, 0, 0 };
+	if (nworkers > 1 && GetOptionsMgr()->GetBool(OPT_CMP_IO_SCHEDULING))
+	{
+		pIoScheduler.reset(new IoScheduler(nworkers));
+		PathContext paths = myStruct->context->GetNormalizedPaths();
+		for (int i = 0; i < paths.GetSize(); ++i)
+			volumes[i] = pIoScheduler->AddPath(paths[i]);
+		if (!pIoScheduler->IsLimited())
+			pIoScheduler.reset();
+	}
+
 	ThreadPool threadPool(nworkers, nworkers);
 	std::vector<DiffWorkerPtr> workers;
 	NotificationQueue queue;
 	myStruct->context->m_pCompareStats->SetCompareThreadCount(nworkers);
 	for (int i = 0; i < nworkers; ++i)
 	{
-		workers.push_back(DiffWorkerPtr(new DiffWorker(queue, myStruct->context, i)));
+		workers.push_back(DiffWorkerPtr(new DiffWorker(queue, myStruct->context, i, pIoScheduler.get(), volumes, nworkers > 1)));
 		threadPool.start(*workers[i]);
 	}
 
-	int res = CompareItems(queue, myStruct, parentdiffpos);
+	// Keep directory order when reads are limited, so that files next
+	// to each other on disk are read one after another
+	int res = CompareItems(queue, myStruct, parentdiffpos, pIoScheduler != nullptr);
 
 	Thread::sleep(100);
 	queue.wakeUpAll();
@@ -506,7 +559,7 @@ int DirScan_CompareItems(DiffFuncStruct *myStruct, DIFFITEM *parentdiffpos)
 	return res;
 }
 
-static int CompareItems(NotificationQueue& queue, DiffFuncStruct *myStruct, DIFFITEM *parentdiffpos)
+static int CompareItems(NotificationQueue& queue, DiffFuncStruct *myStruct, DIFFITEM *parentdiffpos, bool bKeepOrder)
 {
 	NotificationQueue queueResult;
 	Stopwatch stopwatch;
@@ -539,7 +592,7 @@ static int CompareItems(NotificationQueue& queue, DiffFuncStruct *myStruct, DIFF
 			{	// Only clear DIFF|SAME flags if not CMPERR (eg. both flags together)
 				di.diffcode.diffcode &= ~(DIFFCODE::DIFF | DIFFCODE::SAME);
 			}
-			int ndiff = CompareItems(queue, myStruct, curpos);
+			int ndiff = CompareItems(queue, myStruct, curpos, bKeepOrder);
 			// Propogate sub-directory status to this directory
 			if (ndiff > 0)
 			{	// There were differences in the sub-directories
@@ -560,7 +613,7 @@ static int CompareItems(NotificationQueue& queue, DiffFuncStruct *myStruct, DIFF
 				bCompareFailure = true;
 			}
 		}
-		if (existsalldirs)
+		if (existsalldirs && !bKeepOrder)
 			queue.enqueueUrgentNotification(new WorkNotification(di, queueResult));
 		else
 			queue.enqueueNotification(new WorkNotification(di, queueResult));
@@ -757,6 +810,115 @@ int DirScan_UpdateMarkedItems(DiffFuncStruct *myStruct, DIFFITEM *parentdiffpos)
 	}
 	return ncount;
 }
+
+/**
+ * @brief Mark item for rescan, see MarkForRescan() in DirActions.cpp.
+ */
+static void markForRescan(DIFFITEM &di)
+{
+	di.diffcode.diffcode &= ~(DIFFCODE::TEXTFLAGS | DIFFCODE::SIDEFLAGS | DIFFCODE::COMPAREFLAGS | DIFFCODE::UNFILTEREDFLAGS);
+	di.diffcode.diffcode |= DIFFCODE::NEEDSCAN;
+}
+
+/**
+ * @brief Is a path changed on disk excluded by the file filters?
+ * Folders on the path are tested with the folder filters. The item itself is
+ * tested with the folder filters if it is a folder, else with the file filters.
+ * @param [in] pCtxt Compare context.
+ * @param [in] nIndex Side of the change.
+ * @param [in] relpath Changed path relative to the compared folder of the side.
+ * @param [out] bParentExcluded Set to true if a folder on the path is excluded,
+ * so that the item can't be in the results even as a skipped item.
+ */
+static bool IsExcludedPath(CDiffContext *pCtxt, int nIndex, const String& relpath, bool& bParentExcluded)
+{
+	bParentExcluded = false;
+	if (pCtxt->m_piFilterGlobal == nullptr)
+		return false;
+	String::size_type end = relpath.find_first_of(_T("\\/"));
+	for (; end != String::npos; end = relpath.find_first_of(_T("\\/"), end + 1))
+	{
+		if (!pCtxt->m_piFilterGlobal->includeDir(relpath.substr(0, end)))
+		{
+			bParentExcluded = true;
+			return true;
+		}
+	}
+	if (paths::DoesPathExist(paths::ConcatPath(pCtxt->GetNormalizedPath(nIndex), relpath)) == paths::IS_EXISTING_DIR)
+		return !pCtxt->m_piFilterGlobal->includeDir(relpath);
+	String::size_type slash = relpath.find_last_of(_T("\\/"));
+	return !pCtxt->m_piFilterGlobal->includeFile(slash == String::npos ? relpath : relpath.substr(slash + 1));
+}
+
+/**
+ * @brief Mark the item of a path changed on disk for rescan.
+ *
+ * A changed file is rescanned. A folder is rescanned (its items collected
+ * again) only if it was created or removed, as changes inside it are
+ * reported for the items themselves. A path not in the results is new, so
+ * its nearest parent folder in the results is collected again. Paths
+ * excluded by the file filters are ignored, so that churn in excluded
+ * folders doesn't cause rescans.
+ * Marked items are then updated by DirScan_UpdateMarkedItems().
+ * @param [in] pCtxt Compare context.
+ * @param [in] nIndex Side of the change.
+ * @param [in] relpath Changed path relative to the compared folder of the side.
+ * @return 1 if an item was marked, 0 if no item needs a rescan, -1 if only a
+ * full rescan can update the results: the change is not known (@p relpath is
+ * empty) or a new item is in the compared folder itself.
+ */
+int DirScan_MarkChangedItem(CDiffContext *pCtxt, int nIndex, const String& relpath)
+{
+	if (relpath.empty())
+		return -1;
+	// Skipped items are in the results if collected, but not their contents
+	bool bParentExcluded;
+	if (IsExcludedPath(pCtxt, nIndex, relpath, bParentExcluded) && (bParentExcluded || !pCtxt->m_bCollectSkipped))
+		return 0;
+	DIFFITEM *parent = nullptr;
+	String::size_type start = 0;
+	for (;;)
+	{
+		String::size_type end = relpath.find_first_of(_T("\\/"), start);
+		String name = relpath.substr(start, end == String::npos ? String::npos : end - start);
+		DIFFITEM *found = nullptr;
+		for (DIFFITEM *pos = pCtxt->GetFirstChildDiffPosition(parent); pos != nullptr && found == nullptr; )
+		{
+			DIFFITEM *curpos = pos;
+			const DIFFITEM &di = pCtxt->GetNextSiblingDiffRefPosition(pos);
+			// Items are paired case-insensitively, the name may come from another side
+			for (int i = 0; i < pCtxt->GetCompareDirs(); ++i)
+			{
+				if (di.diffcode.exists(i) && strutils::compare_nocase(di.diffFileInfo[i].filename, name) == 0)
+				{
+					found = curpos;
+					break;
+				}
+			}
+		}
+		if (found == nullptr)
+		{
+			// New item: collect its parent folder again
+			if (parent == nullptr)
+				return -1;
+			markForRescan(*parent);
+			return 1;
+		}
+		if (end == String::npos || !found->diffcode.isDirectory())
+		{
+			if (found->diffcode.isDirectory())
+			{
+				bool bExists = paths::DoesPathExist(paths::ConcatPath(pCtxt->GetNormalizedPath(nIndex), relpath)) == paths::IS_EXISTING_DIR;
+				if (bExists == found->diffcode.exists(nIndex))
+					return 0;
+			}
+			markForRescan(*found);
+			return 1;
+		}
+		parent = found;
+		start = end + 1;
+	}
+}
 /**
  * @brief Update diffitem file/dir infos.
  *
@@ -816,10 +978,14 @@ static void CompareDiffItem(FolderCmp &fc, DIFFITEM &di)
 	else
 	{
 		// 1. Test against filters
-		if (pCtxt->m_piFilterGlobal==nullptr ||
-			(nDirs == 2 && pCtxt->m_piFilterGlobal->includeFile(di.diffFileInfo[0].filename, di.diffFileInfo[1].filename)) ||
-			(nDirs == 3 && pCtxt->m_piFilterGlobal->includeFile(di.diffFileInfo[0].filename, di.diffFileInfo[1].filename, di.diffFileInfo[2].filename))
-			)
+		bool bIncluded;
+		{
+			CompareStats::ScopedPhase phase(pCtxt->m_pCompareStats, CompareStats::PHASE_FILTER);
+			bIncluded = pCtxt->m_piFilterGlobal==nullptr ||
+				(nDirs == 2 && pCtxt->m_piFilterGlobal->includeFile(di.diffFileInfo[0].filename, di.diffFileInfo[1].filename)) ||
+				(nDirs == 3 && pCtxt->m_piFilterGlobal->includeFile(di.diffFileInfo[0].filename, di.diffFileInfo[1].filename, di.diffFileInfo[2].filename));
+		}
+		if (bIncluded)
 		{
 			di.diffcode.diffcode |= DIFFCODE::INCLUDED;
 			di.diffcode.diffcode |= fc.prepAndCompareFiles(di);
@@ -862,11 +1028,33 @@ static DIFFITEM *AddToList(const String& sLeftDir, const String& sRightDir,
 
 /**
  * @brief Add one compare item to list.
+ * @return Added item, or `nullptr` if the item is a file excluded by the
+ * file filter and skipped items are not collected.
  */
 static DIFFITEM *AddToList(const String& sDir1, const String& sDir2, const String& sDir3,
 	const DirItem *ent1, const DirItem *ent2, const DirItem *ent3,
 	unsigned code, DiffFuncStruct *myStruct, DIFFITEM *parent, int nItems /*= 3*/)
 {
+	CDiffContext *pCtxt = myStruct->context;
+	if (!pCtxt->m_bCollectSkipped && pCtxt->m_piFilterGlobal != nullptr &&
+		(code & DIFFCODE::TYPEFLAGS) == DIFFCODE::FILE)
+	{
+		// Test the filter now, as CompareDiffItem() does with the first
+		// side's name, instead of creating an item only to skip it
+		const DirItem *ent = ent1 != nullptr ? ent1 : (ent3 != nullptr ? ent3 : ent2);
+		bool bIncluded;
+		{
+			CompareStats::ScopedPhase phase(pCtxt->m_pCompareStats, CompareStats::PHASE_FILTER);
+			bIncluded = pCtxt->m_piFilterGlobal->includeFile(ent->filename);
+		}
+		if (!bIncluded)
+		{
+			pCtxt->m_pCompareStats->IncreaseTotalItems();
+			pCtxt->m_pCompareStats->AddItem(code | DIFFCODE::SKIPPED);
+			return nullptr;
+		}
+	}
+
 	// We must store both paths - we cannot get paths later
 	// and we need unique item paths for example when items
 	// change to identical
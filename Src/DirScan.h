@@ -17,6 +17,7 @@ struct DiffFuncStruct;
 int DirScan_GetItems(const PathContext &paths, const String subdir[], DiffFuncStruct *myStruct,
 		bool casesensitive, int depth, DIFFITEM *parent, bool bUniques);
 int DirScan_UpdateMarkedItems(DiffFuncStruct *myStruct, DIFFITEM *parentdiffpos);
+int DirScan_MarkChangedItem(CDiffContext *pCtxt, int nIndex, const String& relpath);
 
 int DirScan_CompareItems(DiffFuncStruct *, DIFFITEM *parentdiffpos);
 int DirScan_CompareRequestedItems(DiffFuncStruct *, DIFFITEM *parentdiffpos);
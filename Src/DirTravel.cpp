@@ -8,6 +8,8 @@
 #include "pch.h"
 #include "DirTravel.h"
 #include <algorithm>
+#include <climits>
+#include <vector>
 #include <Poco/DirectoryIterator.h>
 #include <Poco/Timestamp.h>
 #include <windows.h>
@@ -23,7 +25,6 @@ using Poco::DirectoryIterator;
 using Poco::Timestamp;
 
 static void LoadFiles(const String& sDir, DirItemArray * dirs, DirItemArray * files);
-static void Sort(DirItemArray * dirs, bool casesensitive);
 
 /**
  * @brief Load arrays with all directories & files in specified dir
@@ -31,8 +32,8 @@ static void Sort(DirItemArray * dirs, bool casesensitive);
 void LoadAndSortFiles(const String& sDir, DirItemArray * dirs, DirItemArray * files, bool casesensitive)
 {
 	LoadFiles(sDir, dirs, files);
-	Sort(dirs, casesensitive);
-	Sort(files, casesensitive);
+	SortFiles(dirs, casesensitive);
+	SortFiles(files, casesensitive);
 }
 
 /**
@@ -49,7 +50,7 @@ void LoadAndSortFiles(const String& sDir, DirItemArray * dirs, DirItemArray * fi
  */
 static void LoadFiles(const String& sDir, DirItemArray * dirs, DirItemArray * files)
 {
-	boost::flyweight<String> dir(sDir);
+	InternedString dir(sDir);
 #if 0
 	DirectoryIterator it(ucr::toUTF8(sDir));
 	DirectoryIterator end;
@@ -60,7 +61,7 @@ static void LoadFiles(const String& sDir, DirItemArray * dirs, DirItemArray * fi
 		if (bIsDirectory)
 			continue;
 
-		DirItem ent;
+		CollatedDirItem ent;
 		ent.ctime = it->created();
 		if (ent.ctime < 0)
 			ent.ctime = 0;
@@ -91,7 +92,7 @@ static void LoadFiles(const String& sDir, DirItemArray * dirs, DirItemArray * fi
 			if (bIsDirectory && _tcsstr(_T(".."), ff.cFileName))
 				continue;
 
-			DirItem ent;
+			CollatedDirItem ent;
 
 			// Save filetimes as seconds since January 1, 1970
 			// Note that times can be < 0 if they are around that 1970..
@@ -123,45 +124,33 @@ static void LoadFiles(const String& sDir, DirItemArray * dirs, DirItemArray * fi
 #endif
 }
 
-static inline int collate(const String &str1, const String &str2)
-{
-	return _tcscoll(str1.c_str(), str2.c_str());
-}
-
-static inline int collate_ignore_case(const String &str1, const String &str2)
-{
-	return _tcsicoll(str1.c_str(), str2.c_str());
-}
-
-
-template<int (*compfunc)(const TCHAR *, const TCHAR *)>
-struct StringComparer
-{
-	bool operator()(const DirItem &elem1, const DirItem &elem2)
-	{
-		return compfunc(elem1.filename.get().c_str(), elem2.filename.get().c_str()) < 0;
-	}
-};
-
 /**
- * @brief sort specified array
+ * @brief Compute collation keys and sort specified array
  */
-static void Sort(DirItemArray * dirs, bool casesensitive)
+void SortFiles(DirItemArray * dirs, bool casesensitive)
 {
-	if (casesensitive)
-        std::sort(dirs->begin(), dirs->end(), StringComparer<_tcscoll>());
-	else
-		std::sort(dirs->begin(), dirs->end(), StringComparer<_tcsicoll>());
+	for (auto& item : *dirs)
+		item.collkey = collkey(item.filename, casesensitive);
+	std::sort(dirs->begin(), dirs->end(),
+		[](const CollatedDirItem &elem1, const CollatedDirItem &elem2) { return collkeycmp(elem1, elem2) < 0; });
 }
 
 /**
- * @brief  Compare (NLS aware) two strings, either case-sensitive or
- * case-insensitive as caller specifies
+ * @brief Compute NLS aware sort key for a string.
+ * Ordinal comparison of two keys gives the locale collation order of the
+ * strings. The case-insensitive key is the key of the lowercased string.
+ * Every key starts with a kind marker: strings the locale can not
+ * transform are keyed by themselves and sort after all collated ones,
+ * so keys of both kinds never compare against each other.
  */
-int collstr(const String & s1, const String & s2, bool casesensitive)
+String collkey(const String & str, bool casesensitive)
 {
-	if (casesensitive)
-		return collate(s1, s2);
-	else
-		return collate_ignore_case(s1, s2);
+	const String src = casesensitive ? str : strutils::makelower(str);
+	size_t len = _tcsxfrm(nullptr, src.c_str(), 0);
+	if (len >= INT_MAX)
+		return _T('\x02') + src;
+	std::vector<TCHAR> buf(len + 2);
+	buf[0] = _T('\x01');
+	_tcsxfrm(buf.data() + 1, src.c_str(), len + 1);
+	return String(buf.data(), len + 1);
 }
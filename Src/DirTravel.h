@@ -8,10 +8,30 @@
 
 #include <vector>
 #include "UnicodeString.h"
+#include "DirItem.h"
 
-struct DirItem;
+/**
+ * @brief DirItem with the collation key of its filename.
+ * The key is computed once when the folder is loaded, so sorting and
+ * walking the sorted lists compare keys ordinally instead of calling
+ * the locale collation again for every pair of names.
+ */
+struct CollatedDirItem : public DirItem
+{
+	String collkey; /**< collation key of filename, see collkey() */
+};
 
-typedef std::vector<DirItem> DirItemArray;
+typedef std::vector<CollatedDirItem> DirItemArray;
 
 void LoadAndSortFiles(const String& sDir, DirItemArray * dirs, DirItemArray * files, bool casesensitive);
-int collstr(const String & s1, const String & s2, bool casesensitive);
+void SortFiles(DirItemArray * dirs, bool casesensitive);
+String collkey(const String & str, bool casesensitive);
+
+/**
+ * @brief Compare two loaded items by their collation keys.
+ * @return Same sign as the locale collation of the filenames of the items.
+ */
+inline int collkeycmp(const CollatedDirItem & item1, const CollatedDirItem & item2)
+{
+	return item1.collkey.compare(item2.collkey);
+}
@@ -83,9 +83,13 @@ const UINT RightCmdFirst = MiddleCmdLast + 1;
 
 enum { 
 	COLUMN_REORDER = 99,
-	STATUSBAR_UPDATE = 100
+	STATUSBAR_UPDATE = 100,
+	FOLDER_WATCH = 101
 };
 
+/** @brief Interval (ms) to check compared folders for changes on disk. */
+static const UINT FolderWatchInterval = 500;
+
 IMPLEMENT_DYNCREATE(CDirView, CListView)
 
 CDirView::CDirView()
@@ -93,6 +97,7 @@ CDirView::CDirView()
 		, m_nHiddenItems(0)
 		, m_pCmpProgressBar(nullptr)
 		, m_compareStart(0)
+		, m_bWatchRescan(false)
 		, m_bTreeMode(false)
 		, m_dirfilter(std::bind(&COptionsMgr::GetBool, GetOptionsMgr(), _1))
 		, m_pShellContextMenuLeft(nullptr)
@@ -466,6 +471,17 @@ void CDirView::StartCompare(CompareStats *pCompareStats)
 	m_compareStart = clock();
 }
 
+/**
+ * @brief Start or stop checking the compared folders for changes on disk.
+ */
+void CDirView::SetFolderWatchTimer(bool bEnable)
+{
+	if (bEnable)
+		SetTimer(FOLDER_WATCH, FolderWatchInterval, nullptr);
+	else
+		KillTimer(FOLDER_WATCH);
+}
+
 /**
  * @brief Called when folder compare row is double-clicked with mouse.
  * Selected item is opened to folder or file compare.
@@ -566,6 +582,7 @@ void CDirView::RedisplayChildren(DIFFITEM *diffpos, int level, UINT &index, int
  */
 void CDirView::Redisplay()
 {
+	CompareStats::ScopedPhase phase(GetDocument()->GetCompareStats(), CompareStats::PHASE_UI);
 	const CDirDoc *pDoc = GetDocument();
 	const CDiffContext &ctxt = GetDiffContext();
 	PathContext pathsParent;
@@ -1314,6 +1331,17 @@ void CDirView::OpenSpecialItems(CDirDoc *pDoc, DIFFITEM *pos1, DIFFITEM *pos2, D
 	}
 }
 
+/**
+ * @brief Extract items in archives walked without extracting them.
+ * The file or folder compare opened from the items reads the extracted
+ * items. Items missing from an archive get empty paths.
+ */
+static void ExtractArchiveItems(const CDiffContext& ctxt, PathContext& paths)
+{
+	for (int i = 0; i < paths.GetSize(); ++i)
+		paths.SetPath(i, GetPathToRead(ctxt, paths[i]), false);
+}
+
 /**
  * @brief Creates a pairing folder for unique folder item.
  * This function creates a pairing folder for unique folder item in
@@ -1326,7 +1354,7 @@ static bool CreateFoldersPair(const PathContext& paths)
 	bool created = false;
 	for (const auto& path : paths)
 	{
-		if (!paths::DoesPathExist(path))
+		if (!path.empty() && !paths::DoesPathExist(path))
 		{
 			String message =
 				strutils::format_string1( 
@@ -1462,8 +1490,6 @@ void CDirView::OpenSelection(CDirDoc *pDoc, SELECTIONTYPE selectionType /*= SELE
 		// Only one item selected, so perform diff on its sides
 		success = GetOpenOneItem(ctxt, pos1, pdi, 
 				paths, sel1, isdir, nPane, encoding, errmsg, openableForDir);
-		if (isdir)
-			CreateFoldersPair(paths);
 	}
 	if (!success)
 	{
@@ -1472,6 +1498,10 @@ void CDirView::OpenSelection(CDirDoc *pDoc, SELECTIONTYPE selectionType /*= SELE
 		return;
 	}
 
+	ExtractArchiveItems(ctxt, paths);
+	if (isdir && pos2 == nullptr)
+		CreateFoldersPair(paths);
+
 	// Now pathLeft, pathRight, di1, di2, and isdir are all set
 	// We have two items to compare, no matter whether same or different underlying DirView item
 
@@ -1546,6 +1576,7 @@ void CDirView::OpenSelectionAs(UINT id)
 			AfxMessageBox(errmsg.c_str(), MB_ICONSTOP);
 		return;
 	}
+	ExtractArchiveItems(ctxt, paths);
 
 	// Open identical and different files
 	const String sUntitled[] = { _("Untitled left"), paths.GetSize() < 3 ? _("Untitled right") : _("Untitled middle"), _("Untitled right") };
@@ -1808,7 +1839,7 @@ void CDirView::DoOpen(SIDE_TYPE stype)
 	int sel = GetSingleSelectedItem();
 	if (sel == -1) return;
 	DirItemIterator dirBegin = SelBegin();
-	String file = GetSelectedFileName(dirBegin, stype, GetDiffContext());
+	String file = GetPathToRead(GetDiffContext(), GetSelectedFileName(dirBegin, stype, GetDiffContext()));
 	if (file.empty()) return;
 	shell::Edit(file.c_str());
 }
@@ -1819,7 +1850,7 @@ void CDirView::DoOpenWith(SIDE_TYPE stype)
 	int sel = GetSingleSelectedItem();
 	if (sel == -1) return;
 	DirItemIterator dirBegin = SelBegin();
-	String file = GetSelectedFileName(dirBegin, stype, GetDiffContext());
+	String file = GetPathToRead(GetDiffContext(), GetSelectedFileName(dirBegin, stype, GetDiffContext()));
 	if (file.empty()) return;
 	shell::OpenWith(file.c_str());
 }
@@ -1830,7 +1861,7 @@ void CDirView::DoOpenWithEditor(SIDE_TYPE stype)
 	int sel = GetSingleSelectedItem();
 	if (sel == -1) return;
 	DirItemIterator dirBegin = SelBegin();
-	String file = GetSelectedFileName(dirBegin, stype, GetDiffContext());
+	String file = GetPathToRead(GetDiffContext(), GetSelectedFileName(dirBegin, stype, GetDiffContext()));
 	if (file.empty()) return;
 
 	CMergeApp::OpenFileToExternalEditor(file);
@@ -2476,6 +2507,13 @@ LRESULT CDirView::OnUpdateUIMessage(WPARAM wParam, LPARAM lParam)
 			pDoc->SetReportFile(_T(""));
 		}
 
+		// Rescans of changes on disk run in the background, don't disturb the user
+		if (m_bWatchRescan)
+		{
+			m_bWatchRescan = false;
+			return 0;
+		}
+
 		if (GetOptionsMgr()->GetBool(OPT_SCROLL_TO_FIRST))
 			OnFirstdiff();
 		else
@@ -2653,6 +2691,20 @@ void CDirView::OnTimer(UINT_PTR nIDEvent)
 		String msg = (items == 1) ? _("1 item selected") : strutils::format_string1(_("%1 items selected"), strutils::to_str(items));
 		GetParentFrame()->SetStatus(msg.c_str());
 	}
+	else if (nIDEvent == FOLDER_WATCH)
+	{
+		// Rescan only the items changed on disk
+		bool bFullRescan = false;
+		CDirDoc *pDoc = GetDocument();
+		if (pDoc->MarkChangedItems(bFullRescan))
+		{
+			m_bWatchRescan = true;
+			m_pSavedTreeState.reset(SaveTreeState(GetDiffContext()));
+			if (!bFullRescan)
+				pDoc->SetMarkedRescan();
+			pDoc->Rescan();
+		}
+	}
 	
 	CListView::OnTimer(nIDEvent);
 }
@@ -3599,7 +3651,12 @@ void CDirView::OnOptionsShowSkipped()
 {
 	m_dirfilter.show_skipped = !m_dirfilter.show_skipped;
 	GetOptionsMgr()->SaveOption(OPT_SHOW_SKIPPED, m_dirfilter.show_skipped);
-	Redisplay();
+	// Skipped files are not collected while hidden, so compare again to show them
+	CDirDoc *pDoc = GetDocument();
+	if (m_dirfilter.show_skipped && pDoc->HasDiffs() && !GetDiffContext().m_bCollectSkipped)
+		pDoc->Rescan();
+	else
+		Redisplay();
 }
 
 /**
@@ -3777,6 +3834,7 @@ void CDirView::OnMergeCompareNonHorizontally()
 		}
 		if (paths.GetSize() == 1)
 			paths.SetRight(_T(""));
+		ExtractArchiveItems(pDoc->GetDiffContext(), paths);
 		Open(GetDocument(), paths, dwFlags, encoding);
 	}
 }
@@ -80,6 +80,7 @@ public:
 	CDirFrame * GetParentFrame();
 
 	void StartCompare(CompareStats *pCompareStats);
+	void SetFolderWatchTimer(bool bEnable);
 	void Redisplay();
 	void RedisplayChildren(DIFFITEM *diffpos, int level, UINT &index, int &alldiffs);
 	void UpdateResources();
@@ -204,6 +205,7 @@ protected:
 	DirViewFilterSettings m_dirfilter;
 	std::unique_ptr<DirCompProgressBar> m_pCmpProgressBar;
 	clock_t m_compareStart; /**< Starting process time of the compare */
+	bool m_bWatchRescan; /**< `true` if the running rescan was started by changes on disk */
 	bool m_bUserCancelEdit; /**< `true` if the user cancels rename */
 	String m_lastCopyFolder; /**< Last Copy To -target folder. */
 
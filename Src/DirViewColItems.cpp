@@ -181,8 +181,8 @@ static String MakeShortSize(int64_t size)
 template<class Type>
 static Type ColFileNameGet(const CDiffContext *, const void *p) //sfilename
 {
-	const boost::flyweight<String> &lfilename = static_cast<const DIFFITEM*>(p)->diffFileInfo[0].filename;
-	const boost::flyweight<String> &rfilename = static_cast<const DIFFITEM*>(p)->diffFileInfo[1].filename;
+	const InternedString &lfilename = static_cast<const DIFFITEM*>(p)->diffFileInfo[0].filename;
+	const InternedString &rfilename = static_cast<const DIFFITEM*>(p)->diffFileInfo[1].filename;
 	if (lfilename.get().empty())
 		return rfilename;
 	else if (rfilename.get().empty() || lfilename == rfilename)
@@ -351,6 +351,8 @@ static String ColStatusGet(const CDiffContext *pCtxt, const void *p)
 			case DIFFCODE::DIFF3RDONLY: s += _("(Left and middle are identical)"); break;
 			}
 		}
+		if (di.diffcode.isUnfiltered())
+			s += _(" (line filters not applied to large files)");
 	}
 	return s;
 }
@@ -779,7 +781,7 @@ static int ColFileNameSort(const CDiffContext *pCtxt, const void *p, const void
 		return -1;
 	if (!ldi.diffcode.isDirectory() && rdi.diffcode.isDirectory())
 		return 1;
-	return strutils::compare_nocase(ColFileNameGet<boost::flyweight<String> >(pCtxt, p), ColFileNameGet<boost::flyweight<String> >(pCtxt, q));
+	return strutils::compare_nocase(ColFileNameGet<InternedString>(pCtxt, p), ColFileNameGet<InternedString>(pCtxt, q));
 }
 
 /**
@@ -0,0 +1,363 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  DirWatcher.cpp
+ *
+ * @brief Implementation file for DirWatcher
+ */
+
+#include "pch.h"
+#include "DirWatcher.h"
+#include <map>
+#include <tuple>
+#include <windows.h>
+#include <Poco/Thread.h>
+#include <Poco/Event.h>
+#include "PathContext.h"
+#include "DirTravel.h"
+#include "TFile.h"
+#include "paths.h"
+#include "DebugNew.h"
+
+namespace
+{
+
+/**
+ * @brief Backend using ReadDirectoryChangesW().
+ * One overlapped read is always pending; the thread waits for it or for
+ * the stop event, reports the changed names and issues the next read.
+ */
+class NativeBackend : public DirWatcher::Backend
+{
+public:
+	NativeBackend()
+		: m_hDir(INVALID_HANDLE_VALUE)
+		, m_hStop(nullptr)
+		, m_bRecursive(false)
+		, m_buffer(16 * 1024)
+	{
+		ZeroMemory(&m_overlapped, sizeof(m_overlapped));
+	}
+
+	~NativeBackend()
+	{
+		Stop();
+	}
+
+	bool Start(const String& path, bool bRecursive, DirWatcher::NotifyFunc notify) override
+	{
+		m_hDir = CreateFile(TFile(path).wpath().c_str(), FILE_LIST_DIRECTORY,
+			FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+			OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+		if (m_hDir == INVALID_HANDLE_VALUE)
+			return false;
+		m_overlapped.hEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+		m_hStop = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+		m_bRecursive = bRecursive;
+		m_notify = notify;
+		// Fails for file systems without change notifications
+		if (m_overlapped.hEvent == nullptr || m_hStop == nullptr || !ReadChanges())
+		{
+			Close();
+			return false;
+		}
+		m_thread.startFunc([this]() { Run(); });
+		return true;
+	}
+
+	void Stop() override
+	{
+		if (m_hStop != nullptr)
+			SetEvent(m_hStop);
+		if (m_thread.isRunning())
+			m_thread.join();
+		Close();
+	}
+
+private:
+	bool ReadChanges()
+	{
+		ResetEvent(m_overlapped.hEvent);
+		return !!ReadDirectoryChangesW(m_hDir, m_buffer.data(),
+			static_cast<DWORD>(m_buffer.size() * sizeof(DWORD)), m_bRecursive,
+			FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
+			FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE |
+			FILE_NOTIFY_CHANGE_ATTRIBUTES,
+			nullptr, &m_overlapped, nullptr);
+	}
+
+	void Run()
+	{
+		HANDLE handles[2] = { m_overlapped.hEvent, m_hStop };
+		while (WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_OBJECT_0)
+		{
+			DWORD dwBytes = 0;
+			if (!GetOverlappedResult(m_hDir, &m_overlapped, &dwBytes, FALSE) || dwBytes == 0)
+			{
+				// Buffer overflowed or the folder went away: changes are unknown
+				m_notify(_T(""));
+			}
+			else
+			{
+				const unsigned char *p = reinterpret_cast<const unsigned char *>(m_buffer.data());
+				for (;;)
+				{
+					const FILE_NOTIFY_INFORMATION *info = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(p);
+					m_notify(String(info->FileName, info->FileNameLength / sizeof(WCHAR)));
+					if (info->NextEntryOffset == 0)
+						break;
+					p += info->NextEntryOffset;
+				}
+			}
+			if (!ReadChanges())
+			{
+				m_notify(_T(""));
+				break;
+			}
+		}
+	}
+
+	void Close()
+	{
+		if (m_hDir != INVALID_HANDLE_VALUE)
+		{
+			// The buffer must stay valid until the pending read is done
+			DWORD dwBytes;
+			if (CancelIoEx(m_hDir, &m_overlapped))
+				GetOverlappedResult(m_hDir, &m_overlapped, &dwBytes, TRUE);
+			CloseHandle(m_hDir);
+			m_hDir = INVALID_HANDLE_VALUE;
+		}
+		if (m_overlapped.hEvent != nullptr)
+		{
+			CloseHandle(m_overlapped.hEvent);
+			m_overlapped.hEvent = nullptr;
+		}
+		if (m_hStop != nullptr)
+		{
+			CloseHandle(m_hStop);
+			m_hStop = nullptr;
+		}
+	}
+
+	HANDLE m_hDir;
+	HANDLE m_hStop;
+	OVERLAPPED m_overlapped;
+	bool m_bRecursive;
+	std::vector<DWORD> m_buffer; /**< DWORD-aligned as required by ReadDirectoryChangesW() */
+	DirWatcher::NotifyFunc m_notify;
+	Poco::Thread m_thread;
+};
+
+/**
+ * @brief Backend comparing snapshots of the folder tree at intervals.
+ */
+class PollingBackend : public DirWatcher::Backend
+{
+public:
+	explicit PollingBackend(int nIntervalMs)
+		: m_nIntervalMs(nIntervalMs)
+		, m_bRecursive(false)
+		, m_stop(Poco::Event::EVENT_MANUALRESET)
+	{
+	}
+
+	~PollingBackend()
+	{
+		Stop();
+	}
+
+	bool Start(const String& path, bool bRecursive, DirWatcher::NotifyFunc notify) override
+	{
+		if (paths::DoesPathExist(path) != paths::IS_EXISTING_DIR)
+			return false;
+		m_path = path;
+		m_bRecursive = bRecursive;
+		m_notify = notify;
+		m_snapshot.clear();
+		TakeSnapshot(_T(""), m_snapshot);
+		m_stop.reset();
+		m_thread.startFunc([this]() { Run(); });
+		return true;
+	}
+
+	void Stop() override
+	{
+		m_stop.set();
+		if (m_thread.isRunning())
+			m_thread.join();
+	}
+
+private:
+	/** @brief Modification time, size and attributes of an item. */
+	typedef std::tuple<int64_t, int64_t, unsigned> State;
+	typedef std::map<String, State> Snapshot;
+
+	void TakeSnapshot(const String& subdir, Snapshot& snapshot) const
+	{
+		DirItemArray dirs, files;
+		LoadAndSortFiles(paths::ConcatPath(m_path, subdir), &dirs, &files, false);
+		for (const auto& file : files)
+			snapshot[paths::ConcatPath(subdir, file.filename)] =
+				State(file.mtime.epochMicroseconds(), file.size, file.flags.attributes);
+		for (const auto& dir : dirs)
+		{
+			String relpath = paths::ConcatPath(subdir, dir.filename);
+			snapshot[relpath] = State(0, 0, dir.flags.attributes);
+			if (m_bRecursive)
+				TakeSnapshot(relpath, snapshot);
+		}
+	}
+
+	void Run()
+	{
+		while (!m_stop.tryWait(m_nIntervalMs))
+		{
+			Snapshot snapshot;
+			TakeSnapshot(_T(""), snapshot);
+			// Both maps are sorted, so walk them side by side
+			auto it0 = m_snapshot.begin(), it1 = snapshot.begin();
+			while (it0 != m_snapshot.end() || it1 != snapshot.end())
+			{
+				if (it1 == snapshot.end() || (it0 != m_snapshot.end() && it0->first < it1->first))
+					m_notify((it0++)->first);
+				else if (it0 == m_snapshot.end() || it1->first < it0->first)
+					m_notify((it1++)->first);
+				else
+				{
+					if (it0->second != it1->second)
+						m_notify(it1->first);
+					++it0;
+					++it1;
+				}
+			}
+			m_snapshot.swap(snapshot);
+		}
+	}
+
+	int m_nIntervalMs;
+	String m_path;
+	bool m_bRecursive;
+	DirWatcher::NotifyFunc m_notify;
+	Snapshot m_snapshot; /**< Tree at previous poll, used by the thread only */
+	Poco::Event m_stop;
+	Poco::Thread m_thread;
+};
+
+}
+
+std::unique_ptr<DirWatcher::Backend> DirWatcher::CreateNativeBackend()
+{
+	return std::unique_ptr<Backend>(new NativeBackend());
+}
+
+std::unique_ptr<DirWatcher::Backend> DirWatcher::CreatePollingBackend(int nIntervalMs)
+{
+	return std::unique_ptr<Backend>(new PollingBackend(nIntervalMs));
+}
+
+/**
+ * @brief Constructor.
+ * @param [in] nDebounceMs Time without new changes before changes are handed out.
+ * @param [in] nPollIntervalMs Interval of polling, for folders without notifications.
+ * @param [in] nMaxLatencyMs Time after the first change when changes are handed
+ * out even if new changes keep arriving.
+ */
+DirWatcher::DirWatcher(int nDebounceMs, int nPollIntervalMs, int nMaxLatencyMs)
+: m_nDebounceMs(nDebounceMs)
+, m_nPollIntervalMs(nPollIntervalMs)
+, m_nMaxLatencyMs(nMaxLatencyMs)
+, m_nDirs(0)
+, m_bPolling{}
+{
+}
+
+DirWatcher::~DirWatcher()
+{
+	Stop();
+}
+
+/**
+ * @brief Start watching folders.
+ * Folders that do not support change notifications are polled.
+ * @param [in] paths Folders to watch.
+ * @param [in] bRecursive Watch subfolders too.
+ * @param [in] bForcePolling Poll all folders.
+ * @return `true` if all folders are watched.
+ */
+bool DirWatcher::Start(const PathContext& paths, bool bRecursive, bool bForcePolling)
+{
+	Stop();
+	for (int nIndex = 0; nIndex < paths.GetSize(); ++nIndex)
+	{
+		NotifyFunc notify = [this, nIndex](const String& relpath) { AddChange(nIndex, relpath); };
+		m_bPolling[nIndex] = bForcePolling;
+		if (!bForcePolling)
+		{
+			m_backends[nIndex] = CreateNativeBackend();
+			if (!m_backends[nIndex]->Start(paths[nIndex], bRecursive, notify))
+				m_bPolling[nIndex] = true;
+		}
+		if (m_bPolling[nIndex])
+		{
+			m_backends[nIndex] = CreatePollingBackend(m_nPollIntervalMs);
+			if (!m_backends[nIndex]->Start(paths[nIndex], bRecursive, notify))
+			{
+				m_nDirs = nIndex;
+				Stop();
+				return false;
+			}
+		}
+	}
+	m_nDirs = paths.GetSize();
+	return true;
+}
+
+/**
+ * @brief Stop watching and forget changes not handed out yet.
+ */
+void DirWatcher::Stop()
+{
+	for (int nIndex = 0; nIndex < 3; ++nIndex)
+	{
+		if (m_backends[nIndex] != nullptr)
+			m_backends[nIndex]->Stop();
+		m_backends[nIndex].reset();
+		m_bPolling[nIndex] = false;
+	}
+	m_nDirs = 0;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto& changes : m_changes)
+		changes.clear();
+}
+
+void DirWatcher::AddChange(int nIndex, const String& relpath)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_lastChange = std::chrono::steady_clock::now();
+	if (std::all_of(m_changes, m_changes + 3, [](const std::set<String>& c) { return c.empty(); }))
+		m_firstChange = m_lastChange;
+	m_changes[nIndex].insert(relpath);
+}
+
+/**
+ * @brief Take the changes, if no new change arrived for the debounce interval
+ * or the oldest change is the maximum latency old.
+ * @param [out] changes Changed paths relative to each folder, sorted.
+ * @return `true` if there were changes to take.
+ */
+bool DirWatcher::GetChanges(std::vector<String> changes[3])
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (std::all_of(m_changes, m_changes + 3, [](const std::set<String>& c) { return c.empty(); }))
+		return false;
+	const auto now = std::chrono::steady_clock::now();
+	if (now - m_lastChange < std::chrono::milliseconds(m_nDebounceMs) &&
+		now - m_firstChange < std::chrono::milliseconds(m_nMaxLatencyMs))
+		return false;
+	for (int nIndex = 0; nIndex < 3; ++nIndex)
+	{
+		changes[nIndex].assign(m_changes[nIndex].begin(), m_changes[nIndex].end());
+		m_changes[nIndex].clear();
+	}
+	return true;
+}
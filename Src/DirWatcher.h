@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  DirWatcher.h
+ *
+ * @brief Declaration file for DirWatcher
+ */
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+#include <chrono>
+#include <functional>
+#include "UnicodeString.h"
+
+class PathContext;
+
+/**
+ * @brief Watches compared folders for changes on disk.
+ *
+ * Each folder is watched by a backend. The native backend uses the change
+ * notifications of the file system. The polling backend compares snapshots
+ * of the folder tree, for folders that do not support notifications (such
+ * as some network shares).
+ *
+ * Changed paths are collected relative to their folder. They are handed out
+ * only after no new change has arrived for the debounce interval, so that
+ * a burst of changes (e.g. a build writing its output) gives one update.
+ * Changes are handed out at the latest after the maximum latency, so that
+ * continuous changes can't hold back updates for ever.
+ * An empty path means that the changes are not known (the notification
+ * buffer overflowed, or watching failed) and the whole folder must be
+ * rescanned.
+ */
+class DirWatcher
+{
+public:
+	/** @brief Called by a backend with a changed path relative to its folder. */
+	typedef std::function<void(const String& relpath)> NotifyFunc;
+
+	/** @brief Source of change notifications for one folder. */
+	class Backend
+	{
+	public:
+		virtual ~Backend() {}
+		virtual bool Start(const String& path, bool bRecursive, NotifyFunc notify) = 0;
+		virtual void Stop() = 0;
+	};
+
+	static std::unique_ptr<Backend> CreateNativeBackend();
+	static std::unique_ptr<Backend> CreatePollingBackend(int nIntervalMs);
+
+	explicit DirWatcher(int nDebounceMs = 500, int nPollIntervalMs = 2000, int nMaxLatencyMs = 5000);
+	~DirWatcher();
+	bool Start(const PathContext& paths, bool bRecursive, bool bForcePolling = false);
+	void Stop();
+	bool IsWatching() const { return m_nDirs > 0; }
+	bool IsPolling(int nIndex) const { return m_bPolling[nIndex]; }
+	bool GetChanges(std::vector<String> changes[3]);
+
+private:
+	void AddChange(int nIndex, const String& relpath);
+
+	int m_nDebounceMs; /**< Quiet time before changes are handed out */
+	int m_nPollIntervalMs; /**< Interval of the polling backend */
+	int m_nMaxLatencyMs; /**< Longest time a change is held back */
+	int m_nDirs; /**< Count of watched folders, 0 if not watching */
+	std::unique_ptr<Backend> m_backends[3];
+	bool m_bPolling[3]; /**< Is folder watched by the polling backend */
+	std::mutex m_mutex; /**< Guards changes, backends notify from their threads */
+	std::set<String> m_changes[3]; /**< Changed paths not handed out yet */
+	std::chrono::steady_clock::time_point m_firstChange; /**< Time of oldest change not handed out */
+	std::chrono::steady_clock::time_point m_lastChange; /**< Time of latest change */
+};
@@ -6,8 +6,12 @@
 
 #include "pch.h"
 #include "FilterList.h"
+#include <algorithm>
+#include <string_view>
 #include <vector>
 #include <Poco/RegularExpression.h>
+#include "ParallelFor.h"
+#include "coretools.h"
 #include "unicoder.h"
 
 using Poco::RegularExpression;
@@ -17,6 +21,7 @@ using Poco::RegularExpression;
  */
  FilterList::FilterList()
 : m_lastMatchExpression(nullptr)
+, m_bPrefilterAll(false)
 {
 }
 
@@ -45,6 +50,86 @@ void FilterList::AddRegExp(const std::string& regularExpression)
 	{
 		// TODO:
 	}
+	Combine();
+}
+
+/**
+ * @brief Can expression be put in a group of a larger expression?
+ * Not if it refers to groups by number or name, as groups are renumbered,
+ * nor if it uses constructs that could reach past the group.
+ */
+static bool CanCombine(const std::string& pattern)
+{
+	const size_t len = pattern.length();
+	for (size_t i = 0; i < len; ++i)
+	{
+		if (pattern[i] == '\\')
+		{
+			const char e = (i + 1 < len) ? pattern[++i] : '\0';
+			if ((e >= '0' && e <= '9') || e == 'g' || e == 'k' || e == 'Q')
+				return false;
+		}
+		else if (pattern[i] == '(' && i + 1 < len)
+		{
+			if (pattern[i + 1] == '*')
+				return false;
+			if (pattern[i + 1] == '?')
+			{
+				const std::string_view rest = std::string_view(pattern).substr(i + 2);
+				if (rest.substr(0, 1) != ":" && rest.substr(0, 1) != "=" && rest.substr(0, 1) != "!" &&
+					rest.substr(0, 2) != "<=" && rest.substr(0, 2) != "<!")
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Compile all expressions to one alternation.
+ * A line is then searched once instead of once for each expression.
+ */
+void FilterList::Combine()
+{
+	m_pCombined.reset();
+	m_bPrefilterAll = std::all_of(m_list.begin(), m_list.end(),
+		[](const filter_item_ptr& item) { return item->prefilter.HasLiteral(); });
+	if (m_list.size() < 2)
+		return;
+	std::string combined;
+	for (const auto& item : m_list)
+	{
+		if (!CanCombine(item->filterAsString))
+			return;
+		if (!combined.empty())
+			combined += '|';
+		combined += "(?:" + item->filterAsString + ")";
+	}
+	try
+	{
+		m_pCombined = std::make_shared<const RegularExpression>(combined, RegularExpression::RE_UTF8);
+	}
+	catch (...)
+	{
+		// Expressions are matched one by one
+	}
+}
+
+/**
+ * @brief Get text as UTF-8 for matching.
+ * Plain ASCII text is not converted, as it is the same in UTF-8.
+ */
+static void AssignUTF8(std::string& subject, const char *text, size_t len, int codepage, ucr::buffer& buf)
+{
+	if (codepage == ucr::CP_UTF_8 || ucr::FindNonAscii(text, len) == len)
+	{
+		subject.assign(text, len);
+		return;
+	}
+	buf.resize(len * 2);
+	ucr::convert(ucr::NONE, codepage, reinterpret_cast<const unsigned char *>(text),
+		len, ucr::UTF8, ucr::CP_UTF_8, &buf);
+	subject.assign(reinterpret_cast<const char *>(buf.ptr), buf.size);
 }
 
 /** 
@@ -58,28 +143,25 @@ void FilterList::AddRegExp(const std::string& regularExpression)
  */
 bool FilterList::Match(const std::string& string, int codepage/*=CP_UTF8*/)
 {
-	bool retval = false;
-	const size_t count = m_list.size();
-
-	// convert string into UTF-8
-	ucr::buffer buf(string.length() * 2);
-
+	std::string converted;
+	const std::string *subject = &string;
 	if (codepage != ucr::CP_UTF_8)
-			ucr::convert(ucr::NONE, codepage, reinterpret_cast<const unsigned char *>(string.c_str()), 
-					string.length(), ucr::UTF8, ucr::CP_UTF_8, &buf);
+	{
+		// convert string into UTF-8
+		ucr::buffer buf(string.length() * 2);
+		AssignUTF8(converted, string.c_str(), string.length(), codepage, buf);
+		subject = &converted;
+	}
 
-	unsigned i = 0;
-	while (i < count && !retval)
+	for (const auto& item : m_list)
 	{
-		const filter_item_ptr& item = m_list[i];
+		if (!item->prefilter.MayMatch(*subject))
+			continue;
 		int result = 0;
 		RegularExpression::Match match;
 		try
 		{
-			if (buf.size > 0)
-				result = item->regexp.match(std::string(reinterpret_cast<const char *>(buf.ptr), buf.size), 0, match);
-			else
-				result = item->regexp.match(string, 0, match);
+			result = item->regexp.match(*subject, 0, match);
 		}
 		catch (...)
 		{
@@ -88,12 +170,76 @@ bool FilterList::Match(const std::string& string, int codepage/*=CP_UTF8*/)
 		if (result > 0)
 		{
 			m_lastMatchExpression = &item->filterAsString;
-			retval = true;
+			return true;
 		}
-		else
-			++i;
 	}
 
-	return retval;
+	return false;
 }
 
+/**
+ * @brief Does a line match any of the expressions?
+ * @param [in] line Line in UTF-8, without EOL.
+ * @param [in] match Scratch space for the match.
+ */
+bool FilterList::MatchLine(const std::string& line, RegularExpression::Match& match) const
+{
+	if (m_bPrefilterAll && std::none_of(m_list.begin(), m_list.end(),
+			[&line](const filter_item_ptr& item) { return item->prefilter.MayMatch(line); }))
+		return false;
+
+	if (m_pCombined)
+	{
+		try
+		{
+			return m_pCombined->match(line, 0, match) > 0;
+		}
+		catch (...)
+		{
+			// Try expressions one by one
+		}
+	}
+	for (const auto& item : m_list)
+	{
+		try
+		{
+			if (item->prefilter.MayMatch(line) && item->regexp.match(line, 0, match) > 0)
+				return true;
+		}
+		catch (...)
+		{
+			// TODO:
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Match all lines of a file against the list of expressions.
+ * Used by diffutils to evaluate line filters once for each line, instead
+ * of for each line of each difference. Large files are matched in
+ * parallel. Unlike Match(), this does not remember the matched expression.
+ * @param [in] lines Start of each line, lines[nlines] is the end of the last line.
+ * @param [in] nlines Count of lines.
+ * @param [out] flags Set to 1 for lines matching any expression, 0 for others.
+ * @param [in] codepage Codepage of lines.
+ */
+void FilterList::MatchLines(const char *const *lines, int nlines, char *flags, int codepage/*=CP_UTF8*/) const
+{
+	if (nlines <= 0)
+		return;
+	const int64_t work = static_cast<int64_t>(lines[nlines] - lines[0]) * static_cast<int64_t>(m_list.size());
+	ParallelFor(nlines, work, [&](int begin, int end)
+		{
+			// Buffers reused for all lines
+			std::string line;
+			ucr::buffer buf(256);
+			RegularExpression::Match match;
+			for (int i = begin; i < end; ++i)
+			{
+				const size_t len = linelen(lines[i], lines[i + 1] - lines[i]);
+				AssignUTF8(line, lines[i], len, codepage, buf);
+				flags[i] = MatchLine(line, match) ? 1 : 0;
+			}
+		});
+}
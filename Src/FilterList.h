@@ -8,6 +8,7 @@
 #include <vector>
 #include <memory>
 #include <Poco/RegularExpression.h>
+#include "RegexPrefilter.h"
 #include "unicoder.h"
 
 /**
@@ -20,7 +21,8 @@ struct filter_item
 {
 	std::string filterAsString; /** Original regular expression string */
 	Poco::RegularExpression regexp; /**< Compiled regular expression */
-	filter_item(const std::string &filter, int reOpts) : filterAsString(filter), regexp(filter, reOpts) {}
+	RegexPrefilter prefilter; /**< Skips lines the expression cannot match */
+	filter_item(const std::string &filter, int reOpts) : filterAsString(filter), regexp(filter, reOpts), prefilter(filter, reOpts) {}
 };
 
 typedef std::shared_ptr<filter_item> filter_item_ptr;
@@ -41,11 +43,17 @@ public:
 	void RemoveAllFilters();
 	bool HasRegExps() const;
 	bool Match(const std::string& string, int codepage = ucr::CP_UTF_8);
+	void MatchLines(const char *const *lines, int nlines, char *flags, int codepage = ucr::CP_UTF_8) const;
 	const char * GetLastMatchExpression() const;
 
 private:
+	void Combine();
+	bool MatchLine(const std::string& line, Poco::RegularExpression::Match& match) const;
+
 	std::vector <filter_item_ptr> m_list;
 	const std::string *m_lastMatchExpression;
+	std::shared_ptr<const Poco::RegularExpression> m_pCombined; /**< All expressions as one, if they can be combined */
+	bool m_bPrefilterAll; /**< Do all expressions have a prefilter literal? */
 
 };
 
@@ -55,6 +63,8 @@ private:
 inline void FilterList::RemoveAllFilters()
 {
 	m_list.clear();
+	m_pCombined.reset();
+	m_bPrefilterAll = false;
 }
 
 /** 
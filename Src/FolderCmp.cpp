@@ -8,11 +8,15 @@
 #include "diff.h"
 #include "FolderCmp.h"
 #include <cassert>
+#include <algorithm>
+#include <numeric>
 #include "Wrap_DiffUtils.h"
 #include "ByteCompare.h"
 #include "paths.h"
 #include "FilterList.h"
+#include "SubstitutionList.h"
 #include "DiffContext.h"
+#include "CompareStats.h"
 #include "DiffList.h"
 #include "DiffWrapper.h"
 #include "FileTransform.h"
@@ -20,7 +24,9 @@
 #include "BinaryCompare.h"
 #include "TimeSizeCompare.h"
 #include "TFile.h"
+#include "unicoder.h"
 #include "FileFilterHelper.h"
+#include "ArchiveCache.h"
 #include "MergeApp.h"
 #include "DebugNew.h"
 
@@ -37,6 +43,8 @@ FolderCmp::FolderCmp(CDiffContext *pCtxt)
 , m_pTimeSizeCompare(nullptr)
 , m_ndiffs(CDiffContext::DIFFS_UNKNOWN)
 , m_ntrivialdiffs(CDiffContext::DIFFS_UNKNOWN)
+, m_pIoScheduler(nullptr)
+, m_volumes{}
 {
 }
 
@@ -44,6 +52,64 @@ FolderCmp::~FolderCmp()
 {
 }
 
+/**
+ * @brief Limit file reads by an I/O scheduler.
+ * Only the reads hold a permit of the scheduler; plugins, encoding
+ * detection and diffutils work on data already read without one.
+ * @param [in] pIoScheduler Scheduler, or nullptr to read without limits.
+ * @param [in] volumes Volume of each compared root in the scheduler.
+ */
+void FolderCmp::SetIoScheduler(IoScheduler *pIoScheduler, const int volumes[])
+{
+	m_pIoScheduler = pIoScheduler;
+	if (pIoScheduler != nullptr)
+		std::copy(volumes, volumes + m_pCtxt->GetCompareDirs(), m_volumes);
+}
+
+/**
+ * @brief Acquire a read permit for the existing sides of an item.
+ * @return Permit to hold while reading, nullptr if reads are not limited.
+ */
+std::unique_ptr<IoScheduler::Permit> FolderCmp::AcquireReadPermit(const DIFFITEM &di)
+{
+	if (m_pIoScheduler == nullptr || di.diffcode.isDirectory())
+		return nullptr;
+	const int nDirs = m_pCtxt->GetCompareDirs();
+	int volumes[3];
+	for (int i = 0; i < nDirs; ++i)
+		volumes[i] = di.diffcode.exists(i) ? m_volumes[i] : -1;
+	return std::unique_ptr<IoScheduler::Permit>(new IoScheduler::Permit(m_pIoScheduler, volumes, nDirs));
+}
+
+/**
+ * @brief Count the existing files of an item as read under a permit.
+ * Used for compare engines which read the files while they compare.
+ */
+static void AddFileSizes(IoScheduler::Permit *pPermit, const DIFFITEM &di, int nDirs)
+{
+	if (pPermit == nullptr)
+		return;
+	for (int i = 0; i < nDirs; ++i)
+	{
+		if (di.diffcode.exists(i) && di.diffFileInfo[i].size != DirItem::FILE_SIZE_NONE)
+			pPermit->AddBytes(i, di.diffFileInfo[i].size);
+	}
+}
+
+/**
+ * @brief Return total size of the existing files of an item.
+ */
+static int64_t GetFileSizes(const DIFFITEM &di, int nDirs)
+{
+	int64_t total = 0;
+	for (int i = 0; i < nDirs; ++i)
+	{
+		if (di.diffcode.exists(i) && di.diffFileInfo[i].size != DirItem::FILE_SIZE_NONE)
+			total += di.diffFileInfo[i].size;
+	}
+	return total;
+}
+
 bool FolderCmp::RunPlugins(PluginsContext * plugCtxt, String &errStr)
 {
 	// FIXME:
@@ -54,6 +120,310 @@ void FolderCmp::CleanupAfterPlugins(PluginsContext *plugCtxt)
 {
 }
 
+/** @brief Size of the first block diffutils checks for zero bytes. */
+static const int BinaryCheckSize = 8 * 1024;
+/** @brief Size of blocks read by precompareFiles(). */
+static const int PrecompareBufSize = 256 * 1024;
+
+/**
+ * @brief Count EOL and zero bytes of a block into text stats.
+ * @param [in,out] crflag Did previous block end with CR?
+ */
+static void CountTextStats(FileTextStats &stats, const char *ptr, const char *end, bool &crflag)
+{
+	for (; ptr < end; ++ptr)
+	{
+		const char ch = *ptr;
+		if (crflag)
+		{
+			crflag = false;
+			if (ch == '\n')
+			{
+				++stats.ncrlfs;
+				continue;
+			}
+			++stats.ncrs;
+		}
+		if (ch == '\r')
+			crflag = true;
+		else if (ch == '\n')
+			++stats.nlfs;
+		else if (ch == 0)
+			++stats.nzeros;
+	}
+}
+
+/**
+ * @brief Decide full content compare result from file bytes, if possible.
+ * This is run before encoding detection, plugins and diffutils:
+ * - files of equal size are compared byte by byte, and identical files
+ *   are SAME whatever ignore options are set, as those can only make
+ *   more files equal
+ * - files looking binary (zero byte in the first block, no BOM) which
+ *   differ are binary different, as diffutils does not apply ignore
+ *   options to binary files. This is only done without plugins which
+ *   could turn binary files into text, and for two files only.
+ * Files with UCS-2/UCS-4 BOM are left to diffutils which transcodes them.
+ * When diffutils must decide, the files are left open in m_files with
+ * the bytes read so far, so that diffutils does not read them again.
+ * @param [in] di Compared item, all sides must exist.
+ * @param [in] tFiles Paths of compared files.
+ * @param [out] encoding Encodings of files, guessed from the first block.
+ * @return DIFFCODE, or 0 if diffutils must decide.
+ */
+int FolderCmp::precompareFiles(const DIFFITEM &di, const PathContext &tFiles, FileTextEncoding encoding[])
+{
+	const int nDirs = tFiles.GetSize();
+	bool bSameSize = true;
+	bool bKeep = nDirs == 2;
+	for (int i = 0; i < nDirs; ++i)
+	{
+		if (di.diffFileInfo[i].size != di.diffFileInfo[0].size)
+			bSameSize = false;
+		// Larger files are compared by quick compare, which reads files itself
+		if (di.diffFileInfo[i].size > m_pCtxt->m_nQuickCompareLimit)
+			bKeep = false;
+	}
+	if (!bSameSize && (nDirs > 2 || m_pCtxt->m_piPluginInfos != nullptr))
+		return 0;
+
+	CompareStats *pStats = m_pCtxt->m_pCompareStats;
+	std::unique_ptr<IoScheduler::Permit> permit = AcquireReadPermit(di);
+	for (int i = 0; i < nDirs; ++i)
+	{
+		CompareStats::ScopedPhase phase(pStats, CompareStats::PHASE_READ);
+		if (!m_files[i].Open(tFiles[i]))
+			break;
+		m_pCtxt->AddCounter(CompareStats::COUNTER_FILES_OPENED);
+	}
+
+	int code = 0;
+	unsigned binsides = 0;
+	FileTextStats stats;
+	bool crflag = false;
+	for (bool bFirstBlock = true; m_files[nDirs - 1].IsOpen(); bFirstBlock = false)
+	{
+		if (m_pCtxt->ShouldAbort())
+			break;
+		// Read only what encoding detection needs when files already differ by size
+		const int bufsize = bSameSize ? PrecompareBufSize : codepage_detect::BufSize;
+		int size[3];
+		const char *block[3];
+		{
+			CompareStats::ScopedPhase phase(pStats, CompareStats::PHASE_READ);
+			for (int i = 0; i < nDirs; ++i)
+			{
+				if (!bKeep)
+					m_files[i].Discard();
+				size[i] = m_files[i].Read(bufsize);
+				block[i] = m_files[i].GetData() + m_files[i].GetSize() - (std::max)(size[i], 0);
+			}
+		}
+		if (std::any_of(size, size + nDirs, [](int n) { return n < 0; }))
+			break;
+		m_pCtxt->AddCounter(CompareStats::COUNTER_BYTES_READ, std::accumulate(size, size + nDirs, 0));
+		if (permit != nullptr)
+		{
+			for (int i = 0; i < nDirs; ++i)
+				permit->AddBytes(i, size[i]);
+		}
+		if (bFirstBlock)
+		{
+			bool bWideUnicode = false;
+			for (int i = 0; i < nDirs && !bWideUnicode; ++i)
+			{
+				const unsigned char *buf = reinterpret_cast<const unsigned char *>(block[i]);
+				bool bBom = false;
+				ucr::UNICODESET unicoding = ucr::DetermineEncoding(buf, size[i], &bBom);
+				if (bBom && unicoding != ucr::UTF8)
+					bWideUnicode = true;
+				else if (!bBom && memchr(buf, 0, (std::min)(size[i], BinaryCheckSize)) != nullptr)
+					binsides |= DIFFCODE::BINSIDE1 << i;
+				CompareStats::ScopedPhase phase(pStats, CompareStats::PHASE_ENCODING);
+				encoding[i] = m_files[i].GuessEncoding(m_pCtxt->m_iGuessEncodingType);
+			}
+			if (bWideUnicode)
+				break;
+			if (!bSameSize)
+			{
+				if (binsides != 0)
+					code = DIFFCODE::FILE | DIFFCODE::BIN | DIFFCODE::DIFF | binsides;
+				break;
+			}
+		}
+		bool bEqual = true;
+		{
+			CompareStats::ScopedPhase phase(pStats, CompareStats::PHASE_COMPARE);
+			for (int i = 1; i < nDirs; ++i)
+			{
+				if (size[i] != size[0] || memcmp(block[0], block[i], size[0]) != 0)
+					bEqual = false;
+			}
+		}
+		if (!bEqual)
+		{
+			if (binsides != 0 && nDirs == 2 && m_pCtxt->m_piPluginInfos == nullptr)
+				code = DIFFCODE::FILE | DIFFCODE::BIN | DIFFCODE::DIFF | binsides;
+			break;
+		}
+		if (size[0] == 0)
+		{
+			if (binsides != 0)
+				code = DIFFCODE::FILE | DIFFCODE::BIN | DIFFCODE::SAME | (nDirs == 2 ? binsides : 0);
+			else
+				code = DIFFCODE::FILE | DIFFCODE::TEXT | DIFFCODE::SAME;
+			break;
+		}
+		if (binsides == 0)
+			CountTextStats(stats, block[0], block[0] + size[0], crflag);
+	}
+
+	if (code == 0)
+		return 0;
+	for (int i = 0; i < nDirs; ++i)
+		m_files[i].Close();
+	if ((code & DIFFCODE::TEXT) != 0)
+	{
+		if (crflag)
+			++stats.ncrs;
+		for (int i = 0; i < nDirs; ++i)
+			m_diffFileData.m_textStats[i] = stats;
+		m_ndiffs = 0;
+		m_ntrivialdiffs = 0;
+	}
+	else
+	{
+		m_ndiffs = CDiffContext::DIFFS_UNKNOWN;
+		m_ntrivialdiffs = CDiffContext::DIFFS_UNKNOWN;
+	}
+	return code;
+}
+
+/**
+ * @brief Decide result from sizes and CRCs stored in archive directories.
+ * Only used for quick contents and binary compare, whose results have no
+ * text statistics or difference counts anyway: files of same size and
+ * CRC-32 are identical and need not be extracted. Binary compare, which
+ * reports any different byte, needs only a different size or CRC to tell
+ * two files differ.
+ * @param [in] di Compared item.
+ * @param [in] nCompMethod Compare method used for the item.
+ * @return DIFFCODE, or 0 if files must be compared by contents.
+ */
+int FolderCmp::compareStoredChecksums(const DIFFITEM &di, int nCompMethod)
+{
+	const int nDirs = m_pCtxt->GetCompareDirs();
+	if (!di.diffcode.existAll())
+		return 0;
+	PathContext tFiles;
+	m_pCtxt->GetComparePaths(di, tFiles);
+	uint64_t size[3];
+	uint32_t crc[3];
+	for (int i = 0; i < nDirs; ++i)
+	{
+		if (!m_pCtxt->m_pArchiveCache->GetStoredChecksum(tFiles[i], size[i], crc[i]))
+			return 0;
+	}
+	bool bSame = true;
+	for (int i = 1; i < nDirs; ++i)
+	{
+		if (size[i] != size[0] || crc[i] != crc[0])
+			bSame = false;
+	}
+	if (!bSame && (nCompMethod != CMP_BINARY_CONTENT || nDirs > 2))
+		return 0;
+
+	for (int i = 0; i < nDirs; ++i)
+	{
+		m_diffFileData.m_textStats[i].clear();
+		m_diffFileData.m_FileLocation[i].encoding = FileTextEncoding();
+	}
+	m_ndiffs = CDiffContext::DIFFS_UNKNOWN;
+	m_ntrivialdiffs = CDiffContext::DIFFS_UNKNOWN;
+	m_pCtxt->AddCounter(CompareStats::COUNTER_STORED_CHECKSUMS, nDirs);
+	return DIFFCODE::FILE | (bSame ? DIFFCODE::SAME : DIFFCODE::DIFF);
+}
+
+/**
+ * @brief Get paths of compared files, extracting files in archives.
+ * Files in archives walked by CDiffContext::m_pArchiveCache are extracted
+ * to temporary files, which are deleted at end of prepAndCompareFiles().
+ */
+void FolderCmp::GetComparePaths(const DIFFITEM &di, PathContext &tFiles)
+{
+	m_pCtxt->GetComparePaths(di, tFiles);
+	ArchiveCache *pArchives = m_pCtxt->m_pArchiveCache;
+	if (pArchives == nullptr)
+		return;
+	std::unique_ptr<IoScheduler::Permit> permit;
+	for (int i = 0; i < tFiles.GetSize(); ++i)
+	{
+		if (!di.diffcode.exists(i) || !pArchives->IsInArchive(tFiles[i]))
+			continue;
+		if (permit == nullptr)
+			permit = AcquireReadPermit(di);
+		CompareStats::ScopedPhase phase(m_pCtxt->m_pCompareStats, CompareStats::PHASE_READ);
+		const String tempPath = pArchives->ExtractToTempFile(tFiles[i]);
+		if (tempPath.empty())
+			continue;
+		m_pCtxt->AddCounter(CompareStats::COUNTER_BYTES_READ, di.diffFileInfo[i].size);
+		if (permit != nullptr)
+			permit->AddBytes(i, di.diffFileInfo[i].size);
+		m_archiveTempFiles.push_back(tempPath);
+		tFiles.SetPath(i, tempPath, false);
+	}
+}
+
+/**
+ * @brief Read both files of an item completely before diffutils compares them.
+ * Files not left open by precompareFiles() are opened here. Only these
+ * reads hold a read permit, diffutils then works from memory.
+ * @param [in] di Compared item, both sides must exist.
+ * @param [in] filepaths Paths of files to read.
+ * @return false if the files could not be read, diffutils then opens
+ * and reads them itself.
+ */
+bool FolderCmp::ReadFilesToEnd(const DIFFITEM &di, const String filepaths[])
+{
+	if (!di.diffcode.existAll())
+		return false;
+	if (!m_files[0].IsOpen() || !m_files[1].IsOpen())
+	{
+		m_files[0].Close();
+		m_files[1].Close();
+		// diffutils reads a file compared to itself only once
+		if (strutils::compare_nocase(filepaths[0], filepaths[1]) == 0)
+			return false;
+	}
+	std::unique_ptr<IoScheduler::Permit> permit = AcquireReadPermit(di);
+	for (int i = 0; i < 2; ++i)
+	{
+		if (!m_files[i].IsOpen())
+		{
+			if (!m_files[i].Open(filepaths[i]))
+				break;
+			m_pCtxt->AddCounter(CompareStats::COUNTER_FILES_OPENED);
+		}
+		while (!m_files[i].IsEof())
+		{
+			const int size = m_files[i].Read(PrecompareBufSize);
+			if (size < 0)
+			{
+				m_files[i].Close();
+				break;
+			}
+			m_pCtxt->AddCounter(CompareStats::COUNTER_BYTES_READ, size);
+			if (permit != nullptr)
+				permit->AddBytes(i, size);
+		}
+	}
+	if (m_files[0].IsOpen() && m_files[1].IsOpen())
+		return true;
+	m_files[0].Close();
+	m_files[1].Close();
+	return false;
+}
+
 /**
  * @brief Prepare files (run plugins) & compare them, and return diffcode.
  * This is function to compare two files in folder compare. It is not used in
@@ -87,6 +457,16 @@ int FolderCmp::prepAndCompareFiles(DIFFITEM &di)
 		}
 	}
 
+	// Full contents and image compare extract the files to report diff
+	// counts and file types even for identical files
+	if (m_pCtxt->m_pArchiveCache != nullptr &&
+		(nCompMethod == CMP_QUICK_CONTENT || nCompMethod == CMP_BINARY_CONTENT))
+	{
+		const int storedCode = compareStoredChecksums(di, nCompMethod);
+		if (storedCode != 0)
+			return storedCode;
+	}
+
 	if (nCompMethod == CMP_CONTENT ||
 		nCompMethod == CMP_QUICK_CONTENT)
 	{
@@ -96,7 +476,7 @@ int FolderCmp::prepAndCompareFiles(DIFFITEM &di)
 			m_diffFileData.m_textStats[nIndex].clear();
 
 		PathContext tFiles;
-		m_pCtxt->GetComparePaths(di, tFiles);
+		GetComparePaths(di, tFiles);
 		struct change *script10 = nullptr;
 		struct change *script12 = nullptr;
 		struct change *script02 = nullptr;
@@ -124,6 +504,20 @@ int FolderCmp::prepAndCompareFiles(DIFFITEM &di)
 		FileTextEncoding encoding[3];
 		bool bForceUTF8 = m_pCtxt->GetCompareOptions(nCompMethod)->m_bIgnoreCase;
 
+		// Most files in a tree are identical: check that with a plain
+		// byte compare before running plugins and diffutils
+		if (nCompMethod == CMP_CONTENT && di.diffcode.existAll())
+		{
+			code = precompareFiles(di, tFiles, encoding);
+			if (code != 0)
+			{
+				for (nIndex = 0; nIndex < nDirs; nIndex++)
+					m_diffFileData.m_FileLocation[nIndex].encoding = encoding[nIndex];
+				goto exitPrepAndCompare;
+			}
+			code = DIFFCODE::FILE | DIFFCODE::CMPERR;
+		}
+
 		for (nIndex = 0; nIndex < nDirs; nIndex++)
 		{
 		// plugin may alter filepaths to temp copies (which we delete before returning in all cases)
@@ -133,6 +527,7 @@ int FolderCmp::prepAndCompareFiles(DIFFITEM &di)
 			// Invoke unpacking plugins
 			if (infoUnpacker && strutils::compare_nocase(filepathUnpacked[nIndex], _T("NUL")) != 0)
 			{
+				CompareStats::ScopedPhase phase(m_pCtxt->m_pCompareStats, CompareStats::PHASE_PLUGIN);
 				if (!infoUnpacker->Unpacking(nullptr, filepathUnpacked[nIndex], filteredFilenames, { tFiles[nIndex] }))
 					goto exitPrepAndCompare;
 			}
@@ -141,7 +536,19 @@ int FolderCmp::prepAndCompareFiles(DIFFITEM &di)
 			// Unpacked files will be deleted at end of this function.
 			filepathTransformed[nIndex] = filepathUnpacked[nIndex];
 
-			encoding[nIndex] = codepage_detect::Guess(filepathTransformed[nIndex], m_pCtxt->m_iGuessEncodingType);
+			// Reuse detection of precompareFiles() if file was not unpacked
+			if (m_files[nIndex].IsOpen() && filepathUnpacked[nIndex] == tFiles[nIndex])
+			{
+				encoding[nIndex] = m_files[nIndex].GuessEncoding(m_pCtxt->m_iGuessEncodingType);
+				m_pCtxt->AddCounter(CompareStats::COUNTER_ENCODINGS_REUSED);
+			}
+			else
+			{
+				m_files[nIndex].Close();
+				CompareStats::ScopedPhase phase(m_pCtxt->m_pCompareStats, CompareStats::PHASE_ENCODING);
+				encoding[nIndex] = codepage_detect::Guess(filepathTransformed[nIndex], m_pCtxt->m_iGuessEncodingType);
+				m_pCtxt->AddCounter(CompareStats::COUNTER_FILES_OPENED);
+			}
 			m_diffFileData.m_FileLocation[nIndex].encoding = encoding[nIndex];
 		}
 
@@ -151,27 +558,101 @@ int FolderCmp::prepAndCompareFiles(DIFFITEM &di)
 		for (nIndex = 0; nIndex < nDirs; nIndex++)
 		{
 		// Invoke prediff'ing plugins
-			if (infoPrediffer && !m_diffFileData.Filepath_Transform(bForceUTF8, encoding[nIndex], filepathUnpacked[nIndex], filepathTransformed[nIndex], filteredFilenames, *infoPrediffer))
-				goto exitPrepAndCompare;
+			if (infoPrediffer)
+			{
+				CompareStats::ScopedPhase phase(m_pCtxt->m_pCompareStats, CompareStats::PHASE_PLUGIN);
+				if (!m_diffFileData.Filepath_Transform(bForceUTF8, encoding[nIndex], filepathUnpacked[nIndex], filepathTransformed[nIndex], filteredFilenames, *infoPrediffer))
+					goto exitPrepAndCompare;
+			}
+			if (filepathTransformed[nIndex] != tFiles[nIndex])
+				m_files[nIndex].Close();
+		}
+
+		// Identical and clearly binary-different files were already
+		// decided by precompareFiles() above
+
+		// Diff text files too large for diffutils in one pass with bounded
+		// memory. UCS-2 files were converted to UTF-8 only if prediffed.
+		if (nCompMethod == CMP_CONTENT && nDirs == 2 && di.diffcode.existAll() &&
+			m_pCtxt->m_nStreamingCompareLimit > 0 &&
+			(di.diffFileInfo[0].size > m_pCtxt->m_nStreamingCompareLimit ||
+			di.diffFileInfo[1].size > m_pCtxt->m_nStreamingCompareLimit) &&
+			(infoPrediffer != nullptr || std::none_of(encoding, encoding + nDirs, [](const FileTextEncoding& enc) {
+				return enc.m_unicoding == ucr::UCS2LE || enc.m_unicoding == ucr::UCS2BE; })))
+		{
+			CompareStats::ScopedPhase phase(m_pCtxt->m_pCompareStats, CompareStats::PHASE_COMPARE);
+			m_files[0].Close();
+			m_files[1].Close();
+			std::unique_ptr<IoScheduler::Permit> permit = AcquireReadPermit(di);
+			AddFileSizes(permit.get(), di, nDirs);
+			if (m_pStreamingDiff == nullptr)
+			{
+				m_pStreamingDiff.reset(new CompareEngines::StreamingDiff());
+				m_pStreamingDiff->SetCompareOptions(*m_pCtxt->GetCompareOptions(CMP_CONTENT));
+				m_pStreamingDiff->SetAbortable(m_pCtxt->GetAbortable());
+			}
+			code = DIFFCODE::FILE | m_pStreamingDiff->CompareFiles(PathContext(filepathTransformed[0], filepathTransformed[1]));
+			m_pStreamingDiff->GetDiffCounts(m_ndiffs, m_ntrivialdiffs);
+			m_pStreamingDiff->GetTextStats(0, &m_diffFileData.m_textStats[0]);
+			m_pStreamingDiff->GetTextStats(1, &m_diffFileData.m_textStats[1]);
+			// The differences might all be ignored by the filters
+			if ((code & DIFFCODE::COMPAREFLAGS) == DIFFCODE::DIFF &&
+				((m_pCtxt->m_pFilterList != nullptr && m_pCtxt->m_pFilterList->HasRegExps()) ||
+				(m_pCtxt->m_pSubstitutionList != nullptr && m_pCtxt->m_pSubstitutionList->HasRegExps())))
+				code |= DIFFCODE::UNFILTERED;
+			m_pCtxt->AddCounter(CompareStats::COUNTER_FILES_OPENED, 2);
+			m_pCtxt->AddCounter(CompareStats::COUNTER_BYTES_READ, GetFileSizes(di, nDirs));
+			goto exitPrepAndCompare;
 		}
 
-		// If options are binary equivalent, we could check for filesize
-		// difference here, and bail out if files are clearly different
-		// But, then we don't know if file is ascii or binary, and this
-		// affects behavior (also, we don't have an icon for unknown type)
+		// If either file is larger than limit compare files by quick contents
+		// This allows us to (faster) compare big binary files
+		if (nCompMethod == CMP_CONTENT && 
+			(di.diffFileInfo[0].size > m_pCtxt->m_nQuickCompareLimit ||
+			di.diffFileInfo[1].size > m_pCtxt->m_nQuickCompareLimit ||
+			(nDirs > 2 && di.diffFileInfo[2].size > m_pCtxt->m_nQuickCompareLimit)))
+		{
+			nCompMethod = CMP_QUICK_CONTENT;
+		}
 
 		// Actually compare the files
 		// `diffutils_compare_files()` is a fairly thin front-end to GNU diffutils
 
 		if (tFiles.GetSize() == 2)
 		{
+			CompareStats::ScopedPhase phase(m_pCtxt->m_pCompareStats, CompareStats::PHASE_READ);
 			m_diffFileData.SetDisplayFilepaths(tFiles[0], tFiles[1]); // store true names for diff utils patch file
+			const bool bReused = m_files[0].IsOpen() && m_files[1].IsOpen();
+			// diffutils gets the files read completely, quick compare
+			// reads files from the beginning by itself
+			if (nCompMethod == CMP_CONTENT)
+				ReadFilesToEnd(di, filepathTransformed);
+			else if (bReused)
+			{
+				m_files[0].Rewind();
+				m_files[1].Rewind();
+			}
 			// This opens & fstats both files (if it succeeds)
-			if (!m_diffFileData.OpenFiles(filepathTransformed[0], filepathTransformed[1]))
+			if (m_files[0].IsOpen() && m_files[1].IsOpen())
+			{
+				if (!m_diffFileData.OpenFiles(m_files[0], m_files[1]))
+					goto exitPrepAndCompare;
+				if (bReused)
+					m_pCtxt->AddCounter(CompareStats::COUNTER_FILES_REUSED, 2);
+			}
+			else if (!m_diffFileData.OpenFiles(filepathTransformed[0], filepathTransformed[1]))
 				goto exitPrepAndCompare;
+			else
+			{
+				m_pCtxt->AddCounter(CompareStats::COUNTER_FILES_OPENED, 2);
+				// diffutils reads files not read by ReadFilesToEnd() by itself
+				if (nCompMethod == CMP_CONTENT)
+					m_pCtxt->AddCounter(CompareStats::COUNTER_BYTES_READ, GetFileSizes(di, nDirs));
+			}
 		}
 		else
 		{
+			CompareStats::ScopedPhase phase(m_pCtxt->m_pCompareStats, CompareStats::PHASE_READ);
 			diffdata10.SetDisplayFilepaths(tFiles[1], tFiles[0]); // store true names for diff utils patch file
 			diffdata12.SetDisplayFilepaths(tFiles[1], tFiles[2]); // store true names for diff utils patch file
 			diffdata02.SetDisplayFilepaths(tFiles[0], tFiles[2]); // store true names for diff utils patch file
@@ -184,20 +665,12 @@ int FolderCmp::prepAndCompareFiles(DIFFITEM &di)
 
 			if (!diffdata02.OpenFiles(filepathTransformed[0], filepathTransformed[2]))
 				goto exitPrepAndCompare;
-		}
-
-		// If either file is larger than limit compare files by quick contents
-		// This allows us to (faster) compare big binary files
-		if (nCompMethod == CMP_CONTENT && 
-			(di.diffFileInfo[0].size > m_pCtxt->m_nQuickCompareLimit ||
-			di.diffFileInfo[1].size > m_pCtxt->m_nQuickCompareLimit ||
-			(nDirs > 2 && di.diffFileInfo[2].size > m_pCtxt->m_nQuickCompareLimit)))
-		{
-			nCompMethod = CMP_QUICK_CONTENT;
+			m_pCtxt->AddCounter(CompareStats::COUNTER_FILES_OPENED, 6);
 		}
 
 		if (nCompMethod == CMP_CONTENT)
 		{
+			CompareStats::ScopedPhase phase(m_pCtxt->m_pCompareStats, CompareStats::PHASE_COMPARE);
 			if (m_pDiffUtilsEngine == nullptr)
 			{
 				m_pDiffUtilsEngine.reset(new CompareEngines::DiffUtils());
@@ -232,6 +705,11 @@ int FolderCmp::prepAndCompareFiles(DIFFITEM &di)
 			{
 				bool bRet;
 				int bin_flag10 = 0, bin_flag12 = 0, bin_flag02 = 0;
+				// diffutils reads the files while it compares them
+				std::unique_ptr<IoScheduler::Permit> permit = AcquireReadPermit(di);
+				AddFileSizes(permit.get(), di, nDirs);
+				// Each file is read for two of the three pairs
+				m_pCtxt->AddCounter(CompareStats::COUNTER_BYTES_READ, 2 * GetFileSizes(di, nDirs));
 
 				m_pDiffUtilsEngine->SetFileData(2, diffdata10.m_inf);
 				bRet = m_pDiffUtilsEngine->Diff2Files(&script10, 0, &bin_flag10, false, nullptr);
@@ -247,6 +725,7 @@ int FolderCmp::prepAndCompareFiles(DIFFITEM &di)
 				bRet = m_pDiffUtilsEngine->Diff2Files(&script02, 0, &bin_flag02, false, nullptr);
 				m_pDiffUtilsEngine->GetTextStats(0, &m_diffFileData.m_textStats[0]);
 				m_pDiffUtilsEngine->GetTextStats(1, &m_diffFileData.m_textStats[2]);
+				permit.reset();
 
 				code = DIFFCODE::FILE;
 
@@ -319,6 +798,10 @@ int FolderCmp::prepAndCompareFiles(DIFFITEM &di)
 		}
 		else if (nCompMethod == CMP_QUICK_CONTENT)
 		{
+			CompareStats::ScopedPhase phase(m_pCtxt->m_pCompareStats, CompareStats::PHASE_COMPARE);
+			// Quick compare reads the files while it compares them
+			std::unique_ptr<IoScheduler::Permit> permit = AcquireReadPermit(di);
+			AddFileSizes(permit.get(), di, nDirs);
 			// use our own byte-by-byte compare
 			if (m_pByteCompare == nullptr)
 			{
@@ -334,6 +817,7 @@ int FolderCmp::prepAndCompareFiles(DIFFITEM &di)
 
 				// use our own byte-by-byte compare
 				code = m_pByteCompare->CompareFiles(m_diffFileData.m_FileLocation);
+				m_pCtxt->AddCounter(CompareStats::COUNTER_BYTES_READ, m_pByteCompare->GetBytesRead());
 
 				m_pByteCompare->GetTextStats(0, &m_diffFileData.m_textStats[0]);
 				m_pByteCompare->GetTextStats(1, &m_diffFileData.m_textStats[1]);
@@ -350,6 +834,7 @@ int FolderCmp::prepAndCompareFiles(DIFFITEM &di)
 
 				// use our own byte-by-byte compare
 				int code10 = m_pByteCompare->CompareFiles(diffdata10.m_FileLocation);
+				m_pCtxt->AddCounter(CompareStats::COUNTER_BYTES_READ, m_pByteCompare->GetBytesRead());
 
 				m_pByteCompare->GetTextStats(0, &m_diffFileData.m_textStats[1]);
 				m_pByteCompare->GetTextStats(1, &m_diffFileData.m_textStats[0]);
@@ -359,6 +844,7 @@ int FolderCmp::prepAndCompareFiles(DIFFITEM &di)
 
 				// use our own byte-by-byte compare
 				int code12 = m_pByteCompare->CompareFiles(diffdata12.m_FileLocation);
+				m_pCtxt->AddCounter(CompareStats::COUNTER_BYTES_READ, m_pByteCompare->GetBytesRead());
 
 				m_pByteCompare->GetTextStats(0, &m_diffFileData.m_textStats[1]);
 				m_pByteCompare->GetTextStats(1, &m_diffFileData.m_textStats[2]);
@@ -368,6 +854,7 @@ int FolderCmp::prepAndCompareFiles(DIFFITEM &di)
 
 				// use our own byte-by-byte compare
 				int code02 = m_pByteCompare->CompareFiles(diffdata02.m_FileLocation);
+				m_pCtxt->AddCounter(CompareStats::COUNTER_BYTES_READ, m_pByteCompare->GetBytesRead());
 
 				m_pByteCompare->GetTextStats(0, &m_diffFileData.m_textStats[0]);
 				m_pByteCompare->GetTextStats(1, &m_diffFileData.m_textStats[2]);
@@ -407,6 +894,8 @@ int FolderCmp::prepAndCompareFiles(DIFFITEM &di)
 			}
 		}
 exitPrepAndCompare:
+		for (nIndex = 0; nIndex < nDirs; nIndex++)
+			m_files[nIndex].Close();
 		m_diffFileData.Reset();
 		diffdata10.Reset();
 		diffdata12.Reset();
@@ -437,8 +926,12 @@ exitPrepAndCompare:
 			m_pBinaryCompare.reset(new BinaryCompare());
 		m_pBinaryCompare->SetAbortable(m_pCtxt->GetAbortable());
 		PathContext tFiles;
-		m_pCtxt->GetComparePaths(di, tFiles);
+		GetComparePaths(di, tFiles);
+		CompareStats::ScopedPhase phase(m_pCtxt->m_pCompareStats, CompareStats::PHASE_COMPARE);
+		std::unique_ptr<IoScheduler::Permit> permit = AcquireReadPermit(di);
+		AddFileSizes(permit.get(), di, nDirs);
 		code = m_pBinaryCompare->CompareFiles(tFiles, di);
+		m_pCtxt->AddCounter(CompareStats::COUNTER_BYTES_READ, m_pBinaryCompare->GetBytesRead());
 	}
 	else if (nCompMethod == CMP_DATE || nCompMethod == CMP_DATE_SIZE || nCompMethod == CMP_SIZE)
 	{
@@ -454,11 +947,16 @@ exitPrepAndCompare:
 		{
 			m_pImageCompare.reset(new ImageCompare());
 			m_pImageCompare->SetColorDistanceThreshold(m_pCtxt->m_dColorDistanceThreshold);
+			m_pImageCompare->SetSignatureCache(m_pCtxt->m_pImageSignatureCache);
 		}
 
 		PathContext tFiles;
-		m_pCtxt->GetComparePaths(di, tFiles);
+		GetComparePaths(di, tFiles);
+		CompareStats::ScopedPhase phase(m_pCtxt->m_pCompareStats, CompareStats::PHASE_COMPARE);
+		std::unique_ptr<IoScheduler::Permit> permit = AcquireReadPermit(di);
+		AddFileSizes(permit.get(), di, nDirs);
 		code = DIFFCODE::IMAGE | m_pImageCompare->CompareFiles(tFiles, di);
+		m_pCtxt->AddCounter(CompareStats::COUNTER_BYTES_READ, m_pImageCompare->GetBytesRead());
 	}
 	else
 	{
@@ -466,6 +964,10 @@ exitPrepAndCompare:
 		throw "Invalid compare type, DiffFileData can't handle it";
 	}
 
+	for (const String& tempPath : m_archiveTempFiles)
+		try { TFile(tempPath).remove(); } catch (...) { LogErrorString(strutils::format(_T("DeleteFile(%s) failed"), tempPath)); }
+	m_archiveTempFiles.clear();
+
 	return code;
 }
 
@@ -6,13 +6,17 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 #include "DiffFileData.h"
 #include "Wrap_DiffUtils.h"
 #include "ByteCompare.h"
 #include "BinaryCompare.h"
 #include "TimeSizeCompare.h"
 #include "ImageCompare.h"
+#include "StreamingDiff.h"
 #include "PathContext.h"
+#include "OpenedFile.h"
+#include "IoScheduler.h"
 
 class CDiffContext;
 class PackingInfo;
@@ -41,9 +45,12 @@ class FolderCmp
 public:
 	explicit FolderCmp(CDiffContext *pCtxt);
 	~FolderCmp();
+	void SetIoScheduler(IoScheduler *pIoScheduler, const int volumes[]);
 	bool RunPlugins(PluginsContext * plugCtxt, String &errStr);
 	void CleanupAfterPlugins(PluginsContext *plugCtxt);
 	int prepAndCompareFiles(DIFFITEM &di);
+	int precompareFiles(const DIFFITEM &di, const PathContext &tFiles, FileTextEncoding encoding[]);
+	int compareStoredChecksums(const DIFFITEM &di, int nCompMethod);
 
 	int m_ndiffs;
 	int m_ntrivialdiffs;
@@ -52,9 +59,18 @@ public:
 	CDiffContext *const m_pCtxt;
 
 private:
+	void GetComparePaths(const DIFFITEM &di, PathContext &tFiles);
+	std::unique_ptr<IoScheduler::Permit> AcquireReadPermit(const DIFFITEM &di);
+	bool ReadFilesToEnd(const DIFFITEM &di, const String filepaths[]);
+
+	OpenedFile m_files[3]; /**< Files opened by precompareFiles(), reused by diffutils */
 	std::unique_ptr<CompareEngines::DiffUtils> m_pDiffUtilsEngine;
 	std::unique_ptr<CompareEngines::ByteCompare> m_pByteCompare;
+	std::unique_ptr<CompareEngines::StreamingDiff> m_pStreamingDiff;
 	std::unique_ptr<CompareEngines::BinaryCompare> m_pBinaryCompare;
 	std::unique_ptr<CompareEngines::TimeSizeCompare> m_pTimeSizeCompare;
 	std::unique_ptr<CompareEngines::ImageCompare> m_pImageCompare;
+	std::vector<String> m_archiveTempFiles; /**< Archive entries extracted for the current compare */
+	IoScheduler *m_pIoScheduler; /**< Limits concurrent reads per volume, or nullptr */
+	int m_volumes[3]; /**< Volumes of compared roots in m_pIoScheduler */
 };
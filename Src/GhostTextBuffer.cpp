@@ -394,13 +394,13 @@ CopyRevisionNumbers(int nStartLine, int nEndLine) const
 }
 
 void CGhostTextBuffer::			/* virtual override */
-RestoreRevisionNumbers(int nStartLine, CDWordArray *paSavedRevisionNumbers)
+RestoreRevisionNumbers(int nStartLine, const DWORD *pdwSavedRevisionNumbers, size_t nCount)
 {
-	for (int i = 0, j = 0; i < paSavedRevisionNumbers->GetSize(); j++)
+	for (int i = 0, j = 0; i < static_cast<int>(nCount); j++)
 	{
 		if ((GetLineFlags(nStartLine + j) & LF_GHOST) == 0)
 		{
-			m_aLines[nStartLine + j].m_dwRevisionNumber = (*paSavedRevisionNumbers)[i];
+			m_aLines[nStartLine + j].m_dwRevisionNumber = pdwSavedRevisionNumbers[i];
 			++i;
 		}
 	}
@@ -454,6 +454,16 @@ bool CGhostTextBuffer::InsertGhostLine (CCrystalTextView * pSource, int nLine)
 }
 #endif
 
+/**
+ * @brief Swap line array, the new lines may have ghost lines anywhere.
+ */
+void CGhostTextBuffer::			/* virtual override */
+SwapLines(std::vector<LineInfo> & aLines)
+{
+	CCrystalTextBuffer::SwapLines(aLines);
+	RecomputeRealityMapping();
+}
+
 /**
  * @brief Remove all the ghost lines from the buffer.
  */
@@ -869,7 +879,8 @@ UndoInsert(CCrystalTextView * pSource, CPoint & ptCursorPos, const CPoint appare
 		//  Try to ensure that we are undoing correctly...
 		//  Just compare the text as it was before Undo operation
         GetTextWithoutEmptys (apparent_ptStartPos.y, apparent_ptStartPos.x, apparent_ptEndPos.y, apparent_ptEndPos.x, text, CRLFSTYLE::AUTOMATIC, false);
-        if (static_cast<size_t>(text.GetLength()) == ur.GetTextLength() && memcmp(text, ur.GetText(), text.GetLength() * sizeof(TCHAR)) == 0)
+        LPCTSTR pszUndoText = GetUndoText(ur);
+        if (pszUndoText != nullptr && static_cast<size_t>(text.GetLength()) == ur.GetTextLength() && memcmp(text, pszUndoText, text.GetLength() * sizeof(TCHAR)) == 0)
         {
 			if (CCrystalTextBuffer::UndoInsert(pSource, ptCursorPos, apparent_ptStartPos, apparent_ptEndPos, ur))
 			{
@@ -887,7 +898,7 @@ UndoInsert(CCrystalTextView * pSource, CPoint & ptCursorPos, const CPoint appare
 			apparentEnd2.x = static_cast<LONG>(m_aLines[apparentEnd2.y].FullLength());
 			text.Empty();
 			GetTextWithoutEmptys(apparent_ptStartPos.y, apparent_ptStartPos.x, apparent_ptEndPos.y, apparentEnd2.x, text, CRLFSTYLE::AUTOMATIC, false);
-			if (static_cast<size_t>(text.GetLength()) == ur.GetTextLength() && memcmp(text, ur.GetText(), text.GetLength() * sizeof(TCHAR)) == 0)
+			if (pszUndoText != nullptr && static_cast<size_t>(text.GetLength()) == ur.GetTextLength() && memcmp(text, pszUndoText, text.GetLength() * sizeof(TCHAR)) == 0)
 			{
 				if (CCrystalTextBuffer::UndoInsert(pSource, ptCursorPos, apparent_ptStartPos, apparentEnd2, ur))
 				{
@@ -97,7 +97,7 @@ public :
 							const CPoint apparent_ptStartPos, CPoint const apparent_ptEndPos, const UndoRecord & ur) override;
 
 	virtual CDWordArray *CopyRevisionNumbers(int nStartLine, int nEndLine) const override;
-	virtual void RestoreRevisionNumbers(int nStartLine, CDWordArray *paSavedRevisionNumbers) override;
+	virtual void RestoreRevisionNumbers(int nStartLine, const DWORD *pdwSavedRevisionNumbers, size_t nCount) override;
 
 public:
 	//@{
@@ -132,6 +132,7 @@ private:
 
 protected:
 	virtual void OnNotifyLineHasBeenEdited(int nLine);
+	virtual void SwapLines(std::vector<LineInfo> & aLines) override;
 
 
 protected:
@@ -14,6 +14,8 @@
 #include "stdafx.h"
 #include "HexMergeDoc.h"
 #include <afxinet.h>
+#include <atomic>
+#include <Poco/Thread.h>
 #include "UnicodeString.h"
 #include "HexMergeFrm.h"
 #include "HexMergeView.h"
@@ -35,6 +37,7 @@
 #include "Merge.h"
 #include "Constants.h"
 #include "MainFrm.h"
+#include "IAbortable.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -58,7 +61,7 @@ static void UpdateDiffItem(int nBuffers, DIFFITEM &di, CDiffContext *pCtxt)
 			di.diffcode.diffcode |= DIFFCODE::FIRST << nBuffer;
 	}
 	// Clear flags
-	di.diffcode.diffcode &= ~(DIFFCODE::TEXTFLAGS | DIFFCODE::COMPAREFLAGS | DIFFCODE::COMPAREFLAGS3WAY);
+	di.diffcode.diffcode &= ~(DIFFCODE::TEXTFLAGS | DIFFCODE::COMPAREFLAGS | DIFFCODE::COMPAREFLAGS3WAY | DIFFCODE::UNFILTEREDFLAGS);
 	// Really compare
 	FolderCmp folderCmp(pCtxt);
 	di.diffcode.diffcode |= folderCmp.prepAndCompareFiles(di);
@@ -72,6 +75,96 @@ static int Try(HRESULT hr, UINT type)
 	return hr ? CInternetException(hr).ReportError(type) : 0;
 }
 
+/**
+ * @brief Finds the changed bytes of two panes on a worker thread.
+ *
+ * Files unchanged since loading are mapped to memory and diffed on disk,
+ * otherwise copies of the pane buffers are diffed, so that the user can go
+ * on editing meanwhile. The frame gets MSG_HEXDIFF_DONE when done.
+ */
+class CHexMergeDoc::DiffWorker : public IAbortable
+{
+public:
+	DiffWorker(HWND hwndNotify, unsigned nGeneration)
+	: m_hwndNotify(hwndNotify)
+	, m_nGeneration(nGeneration)
+	, m_bMapFiles(false)
+	, m_bAbort(false)
+	, m_bStarted(false)
+	, m_nResult(DIFFCODE::CMPABORT)
+	{
+	}
+
+	~DiffWorker()
+	{
+		Abort();
+		Join();
+	}
+
+	/** @brief Diff two files, mapping them to memory. */
+	void Start(const PathContext& paths)
+	{
+		m_paths = paths;
+		m_bMapFiles = true;
+		Start();
+	}
+
+	/** @brief Diff two buffers, which are taken over. */
+	void Start(std::vector<unsigned char> buffers[2])
+	{
+		m_buffers[0].swap(buffers[0]);
+		m_buffers[1].swap(buffers[1]);
+		Start();
+	}
+
+	void Abort() { m_bAbort = true; }
+
+	void Join()
+	{
+		if (m_bStarted)
+			m_thread.join();
+		m_bStarted = false;
+	}
+
+	bool ShouldAbort() const override { return m_bAbort; }
+	int GetResult() const { return m_nResult; }
+	std::vector<CompareEngines::BinaryDiff::Range>& GetRanges() { return m_ranges; }
+
+private:
+	void Start()
+	{
+		m_thread.startFunc([this]() { Run(); });
+		m_bStarted = true;
+	}
+
+	void Run()
+	{
+		CompareEngines::BinaryDiff binaryDiff;
+		binaryDiff.SetAbortable(this);
+		if (m_bMapFiles)
+			m_nResult = binaryDiff.CompareFiles(m_paths);
+		else if (binaryDiff.Diff(m_buffers[0].data(), static_cast<int64_t>(m_buffers[0].size()),
+			m_buffers[1].data(), static_cast<int64_t>(m_buffers[1].size())))
+			m_nResult = binaryDiff.GetRanges().empty() ? DIFFCODE::SAME : DIFFCODE::DIFF;
+		m_ranges = binaryDiff.GetRanges();
+		std::vector<unsigned char>().swap(m_buffers[0]);
+		std::vector<unsigned char>().swap(m_buffers[1]);
+		if (!m_bAbort)
+			::PostMessage(m_hwndNotify, MSG_HEXDIFF_DONE, m_nGeneration, 0);
+	}
+
+	HWND m_hwndNotify; /**< Frame notified when done */
+	unsigned m_nGeneration; /**< Generation of the ranges being found */
+	PathContext m_paths;
+	std::vector<unsigned char> m_buffers[2];
+	bool m_bMapFiles;
+	std::atomic<bool> m_bAbort;
+	bool m_bStarted;
+	int m_nResult;
+	std::vector<CompareEngines::BinaryDiff::Range> m_ranges;
+	Poco::Thread m_thread;
+};
+
 /////////////////////////////////////////////////////////////////////////////
 // CHexMergeDoc
 
@@ -117,6 +210,9 @@ CHexMergeDoc::CHexMergeDoc()
 , m_nBuffers(m_nBuffersTemp)
 , m_pView{}
 , m_nBufferType{BUFFERTYPE::NORMAL, BUFFERTYPE::NORMAL, BUFFERTYPE::NORMAL}
+, m_nCurDiff(-1)
+, m_nDiffGeneration(0)
+, m_bDiffsValid(false)
 {
 	m_filePaths.SetSize(m_nBuffers);
 }
@@ -159,6 +255,8 @@ int CHexMergeDoc::UpdateDiffItem(CDirDoc *pDirDoc)
 			::UpdateDiffItem(m_nBuffers, di, &ctxt);
 		}
 	}
+	StopDiff();
+	InvalidateDiffs();
 	bool bDiff = false;
 	int lengthFirst = m_pView[0]->GetLength();
 	void *bufferFirst = m_pView[0]->GetBuffer(lengthFirst);
@@ -175,10 +273,98 @@ int CHexMergeDoc::UpdateDiffItem(CDirDoc *pDirDoc)
 		if (bDiff)
 			break;
 	}
+	// Find inserted and deleted bytes, so that one inserted byte
+	// doesn't make the rest of the file different
+	if (m_nBuffers == 2 && bDiff)
+		StartDiff();
+	else
+		m_bDiffsValid = true;
 	GetParentFrame()->SetLastCompareResult(bDiff);
 	return bDiff ? 1 : 0;
 }
 
+/**
+ * @brief Start finding the changed bytes of two panes on a worker thread
+ */
+void CHexMergeDoc::StartDiff()
+{
+	// Files on disk are the pane content if unchanged and not unpacked
+	bool bMapFiles = m_infoUnpacker.GetPluginPipeline().empty();
+	for (int nBuffer = 0; nBuffer < 2 && bMapFiles; nBuffer++)
+	{
+		const String& path = m_filePaths[nBuffer];
+		if (path.empty() || m_pView[nBuffer]->GetModified() ||
+			m_pView[nBuffer]->GetLength() != m_pView[nBuffer]->m_fileInfo.size ||
+			m_pView[nBuffer]->IsFileChangedOnDisk(path.c_str()) != IMergeDoc::FileChange::NoChange)
+			bMapFiles = false;
+	}
+	m_pDiffWorker.reset(new DiffWorker(GetParentFrame()->GetSafeHwnd(), m_nDiffGeneration));
+	if (bMapFiles)
+	{
+		m_pDiffWorker->Start(m_filePaths);
+		return;
+	}
+	try
+	{
+		std::vector<unsigned char> buffers[2];
+		for (int nBuffer = 0; nBuffer < 2; nBuffer++)
+		{
+			int length = m_pView[nBuffer]->GetLength();
+			const BYTE *buffer = m_pView[nBuffer]->GetBuffer(length);
+			buffers[nBuffer].assign(buffer, buffer + length);
+		}
+		m_pDiffWorker->Start(buffers);
+	}
+	catch (std::bad_alloc&)
+	{
+		// No ranges, next/prev diff then use the bytewise diff of the control
+		m_pDiffWorker.reset();
+	}
+}
+
+/**
+ * @brief Stop the worker thread, so that the files it maps can be written
+ */
+void CHexMergeDoc::StopDiff()
+{
+	if (m_pDiffWorker != nullptr)
+	{
+		InvalidateDiffs();
+		m_pDiffWorker.reset();
+	}
+}
+
+/**
+ * @brief Forget the changed bytes after the content has been edited
+ */
+void CHexMergeDoc::InvalidateDiffs()
+{
+	++m_nDiffGeneration;
+	m_diffRanges.clear();
+	m_nCurDiff = -1;
+	m_bDiffsValid = false;
+	if (m_pDiffWorker != nullptr)
+		m_pDiffWorker->Abort();
+}
+
+/**
+ * @brief Take the changed bytes found by the worker thread
+ * @param [in] nGeneration Generation of the ranges when the worker was started,
+ * the ranges are stale if the content has been edited since.
+ */
+void CHexMergeDoc::OnDiffDone(unsigned nGeneration)
+{
+	if (m_pDiffWorker == nullptr || nGeneration != m_nDiffGeneration)
+		return;
+	m_pDiffWorker->Join();
+	if (m_pDiffWorker->GetResult() == DIFFCODE::DIFF || m_pDiffWorker->GetResult() == DIFFCODE::SAME)
+	{
+		m_diffRanges.swap(m_pDiffWorker->GetRanges());
+		m_bDiffsValid = true;
+	}
+	m_pDiffWorker.reset();
+}
+
 /**
  * @brief Asks and then saves modified files
  */
@@ -311,6 +497,7 @@ bool CHexMergeDoc::DoFileSave(int nBuffer)
 		else
 		{
 			const String &path = m_filePaths.GetPath(nBuffer);
+			StopDiff();
 			HRESULT hr = m_pView[nBuffer]->SaveFile(path.c_str());
 			if (Try(hr) == IDCANCEL)
 				return false;
@@ -337,6 +524,7 @@ bool CHexMergeDoc::DoFileSaveAs(int nBuffer, bool packing)
 		title = _("Save Middle File As");
 	if (SelectFile(AfxGetMainWnd()->GetSafeHwnd(), strPath, false, path.c_str(), title))
 	{
+		StopDiff();
 		HRESULT hr = m_pView[nBuffer]->SaveFile(strPath.c_str());
 		if (Try(hr) == IDCANCEL)
 			return false;
@@ -411,9 +599,54 @@ void CHexMergeDoc::OnFileSaveAsRight()
 void CHexMergeDoc::OnUpdateStatusNum(CCmdUI* pCmdUI) 
 {
 	String s;
+	const int nDiffs = GetDiffCount();
+	if (m_nBuffers == 2 && m_bDiffsValid)
+	{
+		if (nDiffs <= 0)
+			s = _("Identical");
+		else if (m_nCurDiff < 0)
+			s = strutils::format_string1(nDiffs == 1 ? _("1 Difference Found") : _("%1 Differences Found"),
+				strutils::to_str(nDiffs));
+		else
+			s = strutils::format_string2(_("Difference %1 of %2"),
+				strutils::to_str(m_nCurDiff + 1), strutils::to_str(nDiffs));
+	}
 	pCmdUI->SetText(s.c_str());
 }
 
+/**
+ * @brief Find the diff after or before a byte offset in a pane
+ * @param [in] pane Pane of the offset.
+ * @param [in] offset Byte offset, usually the caret position.
+ * @param [in] bForward Find the diff after the offset, else the one before.
+ * @return Index of the diff, -1 if there is none.
+ */
+int CHexMergeDoc::FindDiff(int pane, int64_t offset, bool bForward) const
+{
+	auto it = bForward ?
+		std::upper_bound(m_diffRanges.begin(), m_diffRanges.end(), offset,
+			[pane](int64_t value, const CompareEngines::BinaryDiff::Range& range) { return value < range.begin[pane]; }) :
+		std::lower_bound(m_diffRanges.begin(), m_diffRanges.end(), offset,
+			[pane](const CompareEngines::BinaryDiff::Range& range, int64_t value) { return range.begin[pane] < value; });
+	if (bForward)
+		return it == m_diffRanges.end() ? -1 : static_cast<int>(it - m_diffRanges.begin());
+	return it == m_diffRanges.begin() ? -1 : static_cast<int>(it - m_diffRanges.begin()) - 1;
+}
+
+/**
+ * @brief Select the changed bytes of a diff in all panes
+ * @param [in] nDiff Index of the diff, nothing is done if out of range.
+ */
+void CHexMergeDoc::SelectDiff(int nDiff)
+{
+	if (nDiff < 0 || nDiff >= GetDiffCount())
+		return;
+	m_nCurDiff = nDiff;
+	const CompareEngines::BinaryDiff::Range& range = m_diffRanges[nDiff];
+	for (int pane = 0; pane < m_nBuffers; pane++)
+		m_pView[pane]->SelectRange(range.begin[pane], range.end[pane]);
+}
+
 /**
  * @brief DirDoc gives us its identity just after it creates us
  */
@@ -726,6 +959,7 @@ void CHexMergeDoc::OnL2r()
 	int dstPane = (GetActiveMergeView()->m_nThisPane < m_nBuffers - 1) ? GetActiveMergeView()->m_nThisPane + 1 : m_nBuffers - 1;
 	int srcPane = dstPane - 1;
 	CHexMergeView::CopySel(m_pView[srcPane], m_pView[dstPane]);
+	InvalidateDiffs();
 }
 
 /**
@@ -736,6 +970,7 @@ void CHexMergeDoc::OnR2l()
 	int dstPane = (GetActiveMergeView()->m_nThisPane > 0) ? GetActiveMergeView()->m_nThisPane - 1 : 0;
 	int srcPane = dstPane + 1;
 	CHexMergeView::CopySel(m_pView[srcPane], m_pView[dstPane]);
+	InvalidateDiffs();
 }
 
 /**
@@ -746,6 +981,7 @@ void CHexMergeDoc::OnCopyFromLeft()
 	int dstPane = GetActiveMergeView()->m_nThisPane;
 	int srcPane = (dstPane - 1 < 0) ? 0 : dstPane - 1;
 	CHexMergeView::CopySel(m_pView[srcPane], m_pView[dstPane]);
+	InvalidateDiffs();
 }
 
 /**
@@ -756,6 +992,7 @@ void CHexMergeDoc::OnCopyFromRight()
 	int dstPane = GetActiveMergeView()->m_nThisPane;
 	int srcPane = (dstPane + 1 > m_nBuffers - 1) ? m_nBuffers - 1 : dstPane + 1;
 	CHexMergeView::CopySel(m_pView[srcPane], m_pView[dstPane]);
+	InvalidateDiffs();
 }
 
 /**
@@ -766,6 +1003,7 @@ void CHexMergeDoc::OnAllRight()
 	int dstPane = (GetActiveMergeView()->m_nThisPane < m_nBuffers - 1) ? GetActiveMergeView()->m_nThisPane + 1 : m_nBuffers - 1;
 	int srcPane = dstPane - 1;
 	CHexMergeView::CopyAll(m_pView[srcPane], m_pView[dstPane]);
+	InvalidateDiffs();
 }
 
 /**
@@ -776,6 +1014,7 @@ void CHexMergeDoc::OnAllLeft()
 	int dstPane = (GetActiveMergeView()->m_nThisPane > 0) ? GetActiveMergeView()->m_nThisPane - 1 : 0;
 	int srcPane = dstPane + 1;
 	CHexMergeView::CopyAll(m_pView[srcPane], m_pView[dstPane]);
+	InvalidateDiffs();
 }
 
 /**
@@ -10,10 +10,13 @@
  */
 #pragma once
 
+#include <vector>
+#include <memory>
 #include "PathContext.h"
 #include "FileLocation.h"
 #include "IMergeDoc.h"
 #include "FileTransform.h"
+#include "BinaryDiff.h"
 
 class CDirDoc;
 class CHexMergeFrame;
@@ -84,7 +87,15 @@ public:
 	void CheckFileChanged(void) override;
 	String GetDescription(int pane) const { return m_strDesc[pane]; };
 	void SaveAs(int nBuffer, bool packing = true) { DoFileSaveAs(nBuffer, packing); }
+	int GetDiffCount() const { return static_cast<int>(m_diffRanges.size()); }
+	int FindDiff(int pane, int64_t offset, bool bForward) const;
+	void SelectDiff(int nDiff);
+	void InvalidateDiffs();
+	void OnDiffDone(unsigned nGeneration);
 private:
+	class DiffWorker;
+	void StartDiff();
+	void StopDiff();
 	bool DoFileSave(int nBuffer);
 	bool DoFileSaveAs(int nBuffer, bool packing = true);
 	HRESULT LoadOneFile(int index, LPCTSTR filename, bool readOnly, const String& strDesc);
@@ -96,6 +107,11 @@ protected:
 	String m_strDesc[3]; /**< Left/right side description text */
 	BUFFERTYPE m_nBufferType[3];
 	PackingInfo m_infoUnpacker;
+	std::vector<CompareEngines::BinaryDiff::Range> m_diffRanges; /**< Changed bytes of two files */
+	int m_nCurDiff; /**< Selected diff, -1 if none */
+	std::unique_ptr<DiffWorker> m_pDiffWorker; /**< Finds m_diffRanges on a worker thread */
+	unsigned m_nDiffGeneration; /**< Incremented when m_diffRanges become stale */
+	bool m_bDiffsValid; /**< Are m_diffRanges those of the current content? */
 
 // Generated message map functions
 protected:
@@ -39,6 +39,7 @@ BEGIN_MESSAGE_MAP(CHexMergeFrame, CMergeFrameCommon)
 	ON_UPDATE_COMMAND_UI(ID_VIEW_LOCATION_BAR, OnUpdateControlBarMenu)
 	ON_COMMAND_EX(ID_VIEW_LOCATION_BAR, OnBarCheck)
 	ON_MESSAGE(MSG_STORE_PANESIZES, OnStorePaneSizes)
+	ON_MESSAGE(MSG_HEXDIFF_DONE, OnHexDiffDone)
 	//}}AFX_MSG_MAP
 END_MESSAGE_MAP()
 
@@ -401,3 +402,12 @@ LRESULT CHexMergeFrame::OnStorePaneSizes(WPARAM wParam, LPARAM lParam)
 	SavePosition();
 	return 0;
 }
+
+/**
+ * @brief Take the changed bytes found by the document's worker thread.
+ */
+LRESULT CHexMergeFrame::OnHexDiffDone(WPARAM wParam, LPARAM lParam)
+{
+	m_pMergeDoc->OnDiffDone(static_cast<unsigned>(wParam));
+	return 0;
+}
@@ -66,6 +66,8 @@ BEGIN_MESSAGE_MAP(CHexMergeView, CView)
 	ON_WM_VSCROLL()
 	ON_WM_MOUSEWHEEL()
 	ON_WM_NCCALCSIZE()
+	ON_WM_CHAR()
+	ON_WM_KEYDOWN()
 	ON_COMMAND(ID_HELP, OnHelp)
 	ON_COMMAND(ID_EDIT_FIND, OnEditFind)
 	ON_COMMAND(ID_EDIT_REPLACE, OnEditReplace)
@@ -153,6 +155,35 @@ void CHexMergeView::OnNcCalcSize(BOOL, NCCALCSIZE_PARAMS *)
 {
 }
 
+/**
+ * @brief Typed bytes change the content
+ */
+void CHexMergeView::OnChar(UINT nChar, UINT nRepCnt, UINT nFlags)
+{
+	CView::OnChar(nChar, nRepCnt, nFlags);
+	if (nChar >= _T(' '))
+		InvalidateDiffs();
+}
+
+/**
+ * @brief Delete and Backspace keys change the content
+ */
+void CHexMergeView::OnKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags)
+{
+	CView::OnKeyDown(nChar, nRepCnt, nFlags);
+	if (nChar == VK_DELETE || nChar == VK_BACK)
+		InvalidateDiffs();
+}
+
+/**
+ * @brief Tell the document that the changed bytes it found are stale
+ */
+void CHexMergeView::InvalidateDiffs()
+{
+	if (!GetReadOnly())
+		static_cast<CHexMergeDoc *>(GetDocument())->InvalidateDiffs();
+}
+
 /**
  * @brief Synchronize all involved scrollbars
  */
@@ -439,6 +470,7 @@ void CHexMergeView::OnEditFind()
 void CHexMergeView::OnEditReplace()
 {
 	m_pif->CMD_replace();
+	InvalidateDiffs();
 }
 
 /**
@@ -466,6 +498,7 @@ void CHexMergeView::OnUpdateEditUndo(CCmdUI* pCmdUI)
 void CHexMergeView::OnEditUndo()
 {
 	m_pif->CMD_edit_undo();
+	InvalidateDiffs();
 }
 
 /**
@@ -482,6 +515,7 @@ void CHexMergeView::OnUpdateEditRedo(CCmdUI* pCmdUI)
 void CHexMergeView::OnEditRedo()
 {
 	m_pif->CMD_edit_redo();
+	InvalidateDiffs();
 }
 
 /**
@@ -490,6 +524,7 @@ void CHexMergeView::OnEditRedo()
 void CHexMergeView::OnEditCut()
 {
 	m_pif->CMD_edit_cut();
+	InvalidateDiffs();
 }
 
 /**
@@ -506,6 +541,7 @@ void CHexMergeView::OnEditCopy()
 void CHexMergeView::OnEditPaste()
 {
 	m_pif->CMD_edit_paste();
+	InvalidateDiffs();
 }
 
 /**
@@ -522,6 +558,7 @@ void CHexMergeView::OnEditSelectAll()
 void CHexMergeView::OnEditClear()
 {
 	m_pif->CMD_edit_clear();
+	InvalidateDiffs();
 }
 
 /**
@@ -548,7 +585,11 @@ BOOL CHexMergeView::PreTranslateMessage(MSG* pMsg)
  */
 void CHexMergeView::OnFirstdiff()
 {
-	m_pif->select_next_diff(TRUE);
+	CHexMergeDoc *pDoc = static_cast<CHexMergeDoc *>(GetDocument());
+	if (pDoc->GetDiffCount() > 0)
+		pDoc->SelectDiff(0);
+	else
+		m_pif->select_next_diff(TRUE);
 }
 
 /**
@@ -556,7 +597,11 @@ void CHexMergeView::OnFirstdiff()
  */
 void CHexMergeView::OnLastdiff()
 {
-	m_pif->select_prev_diff(TRUE);
+	CHexMergeDoc *pDoc = static_cast<CHexMergeDoc *>(GetDocument());
+	if (pDoc->GetDiffCount() > 0)
+		pDoc->SelectDiff(pDoc->GetDiffCount() - 1);
+	else
+		m_pif->select_prev_diff(TRUE);
 }
 
 /**
@@ -564,7 +609,11 @@ void CHexMergeView::OnLastdiff()
  */
 void CHexMergeView::OnNextdiff()
 {
-	m_pif->select_next_diff(FALSE);
+	CHexMergeDoc *pDoc = static_cast<CHexMergeDoc *>(GetDocument());
+	if (pDoc->GetDiffCount() > 0)
+		pDoc->SelectDiff(pDoc->FindDiff(m_nThisPane, m_pif->get_status()->iCurByte, true));
+	else
+		m_pif->select_next_diff(FALSE);
 }
 
 /**
@@ -572,7 +621,31 @@ void CHexMergeView::OnNextdiff()
  */
 void CHexMergeView::OnPrevdiff()
 {
-	m_pif->select_prev_diff(FALSE);
+	CHexMergeDoc *pDoc = static_cast<CHexMergeDoc *>(GetDocument());
+	if (pDoc->GetDiffCount() > 0)
+		pDoc->SelectDiff(pDoc->FindDiff(m_nThisPane, m_pif->get_status()->iCurByte, false));
+	else
+		m_pif->select_prev_diff(FALSE);
+}
+
+/**
+ * @brief Select bytes and scroll them to the top of the view
+ * @param [in] begin First byte to select.
+ * @param [in] end Byte after the last one to select, same as begin to
+ * only move the caret.
+ */
+void CHexMergeView::SelectRange(int64_t begin, int64_t end)
+{
+	IHexEditorWindow::Status *pStatus = m_pif->get_status();
+	const int nBytesPerLine = (std::max)(m_pif->get_settings()->iBytesPerLine, 1);
+	pStatus->iCurByte = static_cast<int>(begin);
+	pStatus->iCurNibble = 0;
+	pStatus->bSelected = end > begin;
+	pStatus->iStartOfSelection = static_cast<int>(begin);
+	pStatus->iEndOfSelection = static_cast<int>(end > begin ? end - 1 : begin);
+	pStatus->iVscrollPos = static_cast<int>(begin / nBytesPerLine);
+	m_pif->adjust_vscrollbar();
+	Invalidate();
 }
 
 /** @brief Open help from mainframe when user presses F1*/
@@ -45,6 +45,8 @@ public:
 	void ResizeWindow();
 	IMergeDoc::FileChange IsFileChangedOnDisk(LPCTSTR);
 	void ZoomText(int amount);
+	void SelectRange(int64_t begin, int64_t end);
+	void InvalidateDiffs();
 	static void CopySel(const CHexMergeView *src, CHexMergeView *dst);
 	static void CopyAll(const CHexMergeView *src, CHexMergeView *dst);
 	static bool IsLoadable();
@@ -71,6 +73,8 @@ protected:
 	afx_msg void OnVScroll(UINT nSBCode, UINT nPos, CScrollBar * pScrollBar);
     afx_msg BOOL OnMouseWheel(UINT nFlags, short zDelta, CPoint pt);
 	afx_msg void OnNcCalcSize(BOOL bCalcValidRects, NCCALCSIZE_PARAMS* lpncsp);
+	afx_msg void OnChar(UINT nChar, UINT nRepCnt, UINT nFlags);
+	afx_msg void OnKeyDown(UINT nChar, UINT nRepCnt, UINT nFlags);
 	afx_msg void OnEditFind();
 	afx_msg void OnEditReplace();
 	afx_msg void OnEditRepeat();
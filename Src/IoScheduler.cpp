@@ -0,0 +1,289 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  IoScheduler.cpp
+ *
+ * @brief Implementation of IoScheduler class
+ */
+
+#include "pch.h"
+#include "IoScheduler.h"
+#include <algorithm>
+#include <windows.h>
+#include <winioctl.h>
+#include "DebugNew.h"
+
+using Poco::FastMutex;
+using Poco::Timestamp;
+
+/** @brief Shortest time window used for measuring throughput (microseconds). */
+static const Timestamp::TimeDiff MinWindowTime = 250000;
+/** @brief Fewest reads in a window used for measuring throughput. */
+static const int MinWindowReads = 8;
+/** @brief Largest number of concurrent reads on a spinning disk. */
+static const int MaxHddConcurrency = 4;
+
+/**
+ * @brief Acquire a permit for reading given sides.
+ * Sides may share a volume (eg. left and right side on the same disk),
+ * each volume is counted once.
+ * @param [in] sideVolumes Volume of each side, -1 for sides not read.
+ */
+IoScheduler::Permit::Permit(IoScheduler *pScheduler, const int sideVolumes[], int nSides)
+: m_pScheduler(pScheduler)
+, m_count(0)
+{
+	for (int i = 0; i < nSides; ++i)
+	{
+		m_sideIndex[i] = -1;
+		if (sideVolumes[i] < 0)
+			continue;
+		const int *pos = std::find(m_volumes, m_volumes + m_count, sideVolumes[i]);
+		if (pos == m_volumes + m_count)
+		{
+			m_bytes[m_count] = 0;
+			m_volumes[m_count++] = sideVolumes[i];
+		}
+		m_sideIndex[i] = static_cast<int>(pos - m_volumes);
+	}
+	m_pScheduler->Acquire(m_volumes, m_count);
+}
+
+IoScheduler::Permit::~Permit()
+{
+	m_pScheduler->Release(m_volumes, m_bytes, m_count);
+}
+
+/**
+ * @brief Count bytes read from a side, for the throughput of its volume.
+ */
+void IoScheduler::Permit::AddBytes(int side, int64_t bytes)
+{
+	if (m_sideIndex[side] >= 0)
+		m_bytes[m_sideIndex[side]] += bytes;
+}
+
+/**
+ * @brief Constructor.
+ * @param [in] nMaxConcurrency Number of compare threads.
+ */
+IoScheduler::IoScheduler(int nMaxConcurrency)
+: m_nMaxConcurrency((std::max)(nMaxConcurrency, 1))
+{
+}
+
+/**
+ * @brief Register the volume a compared path is on.
+ * @param [in] path Path on the volume.
+ * @return Index of volume to use with Permit.
+ */
+int IoScheduler::AddPath(const String& path)
+{
+	String root = GetVolumeRoot(path);
+	{
+		FastMutex::ScopedLock lock(m_mutex);
+		for (size_t i = 0; i < m_volumes.size(); ++i)
+			if (strutils::compare_nocase(m_volumes[i].root, root) == 0)
+				return static_cast<int>(i);
+	}
+	return AddVolume(root, DetectDeviceType(root));
+}
+
+/**
+ * @brief Register a volume of known device type.
+ * @param [in] root Volume mount point.
+ * @param [in] type Device type of volume.
+ * @return Index of volume to use with Permit.
+ */
+int IoScheduler::AddVolume(const String& root, DeviceType type)
+{
+	Volume volume;
+	volume.root = root;
+	volume.type = type;
+	switch (volume.type)
+	{
+	case DEVICE_HDD:
+		volume.limit = 1;
+		volume.maxLimit = (std::min)(MaxHddConcurrency, m_nMaxConcurrency);
+		break;
+	case DEVICE_REMOTE:
+		volume.limit = (std::min)(2, m_nMaxConcurrency);
+		volume.maxLimit = m_nMaxConcurrency;
+		break;
+	default:
+		volume.limit = m_nMaxConcurrency;
+		volume.maxLimit = m_nMaxConcurrency;
+		break;
+	}
+	volume.active = 0;
+	volume.direction = 1;
+	volume.completed = 0;
+	volume.bytes = 0;
+	volume.totalBytes = 0;
+	volume.lastThroughput = 0;
+
+	FastMutex::ScopedLock lock(m_mutex);
+	m_volumes.push_back(volume);
+	return static_cast<int>(m_volumes.size() - 1);
+}
+
+/**
+ * @brief Return the number of concurrent reads currently allowed on a volume.
+ */
+int IoScheduler::GetLimit(int volume) const
+{
+	FastMutex::ScopedLock lock(m_mutex);
+	return m_volumes[volume].limit;
+}
+
+/**
+ * @brief Return the number of reads currently running on a volume.
+ */
+int IoScheduler::GetActive(int volume) const
+{
+	FastMutex::ScopedLock lock(m_mutex);
+	return m_volumes[volume].active;
+}
+
+/**
+ * @brief Return the number of bytes read from a volume under permits.
+ */
+int64_t IoScheduler::GetBytesRead(int volume) const
+{
+	FastMutex::ScopedLock lock(m_mutex);
+	return m_volumes[volume].totalBytes;
+}
+
+IoScheduler::DeviceType IoScheduler::GetDeviceType(int volume) const
+{
+	FastMutex::ScopedLock lock(m_mutex);
+	return m_volumes[volume].type;
+}
+
+/**
+ * @brief Return true if any registered volume needs its reads limited.
+ */
+bool IoScheduler::IsLimited() const
+{
+	FastMutex::ScopedLock lock(m_mutex);
+	return std::any_of(m_volumes.begin(), m_volumes.end(),
+		[](const Volume& volume) { return volume.type != DEVICE_SSD; });
+}
+
+void IoScheduler::Acquire(const int volumes[], int count)
+{
+	FastMutex::ScopedLock lock(m_mutex);
+	for (;;)
+	{
+		bool bAvailable = true;
+		for (int i = 0; i < count; ++i)
+		{
+			if (m_volumes[volumes[i]].active >= m_volumes[volumes[i]].limit)
+				bAvailable = false;
+		}
+		if (bAvailable)
+			break;
+		m_cond.wait(m_mutex);
+	}
+	for (int i = 0; i < count; ++i)
+		++m_volumes[volumes[i]].active;
+}
+
+void IoScheduler::Release(const int volumes[], const int64_t bytes[], int count)
+{
+	FastMutex::ScopedLock lock(m_mutex);
+	for (int i = 0; i < count; ++i)
+	{
+		Volume& volume = m_volumes[volumes[i]];
+		--volume.active;
+		volume.bytes += bytes[i];
+		volume.totalBytes += bytes[i];
+		++volume.completed;
+		Adapt(volume);
+	}
+	m_cond.broadcast();
+}
+
+/**
+ * @brief Compute the next permit limit from the throughput of the last window.
+ * The limit keeps moving in the same direction as long as throughput
+ * improves, turns back when throughput drops, and drifts down to fewer
+ * concurrent reads when there is no clear difference.
+ * @param [in,out] direction Direction of last limit change, +1 or -1.
+ * @param [in] lastThroughput Throughput of previous window, 0 if none.
+ * @return New limit, between 1 and maxLimit.
+ */
+int IoScheduler::NextLimit(int limit, int maxLimit, int& direction, double throughput, double lastThroughput)
+{
+	if (lastThroughput > 0)
+	{
+		if (throughput < lastThroughput * 0.9)
+			direction = -direction;
+		else if (throughput < lastThroughput * 1.05)
+			direction = -1;
+	}
+	return (std::max)(1, (std::min)(limit + direction, maxLimit));
+}
+
+/**
+ * @brief Tune the limit of a volume once a measuring window is complete.
+ */
+void IoScheduler::Adapt(Volume& volume)
+{
+	if (volume.type == DEVICE_SSD)
+		return;
+	Timestamp::TimeDiff elapsed = volume.windowStart.elapsed();
+	if (elapsed < MinWindowTime || volume.completed < MinWindowReads)
+		return;
+
+	double throughput = static_cast<double>(volume.bytes) * 1000000 / elapsed;
+	volume.limit = NextLimit(volume.limit, volume.maxLimit, volume.direction, throughput, volume.lastThroughput);
+	volume.lastThroughput = throughput;
+	volume.bytes = 0;
+	volume.completed = 0;
+	volume.windowStart.update();
+}
+
+/**
+ * @brief Get the mount point of the volume a path is on.
+ */
+String IoScheduler::GetVolumeRoot(const String& path)
+{
+	TCHAR root[MAX_PATH];
+	if (GetVolumePathName(path.c_str(), root, MAX_PATH))
+		return root;
+	return path;
+}
+
+/**
+ * @brief Detect what kind of device a volume is on.
+ * Volumes whose type cannot be detected are treated as SSDs, so they are
+ * read with full concurrency as before.
+ * @param [in] root Volume mount point, as returned by GetVolumeRoot().
+ */
+IoScheduler::DeviceType IoScheduler::DetectDeviceType(const String& root)
+{
+	if (GetDriveType(root.c_str()) == DRIVE_REMOTE)
+		return DEVICE_REMOTE;
+
+	TCHAR volumeName[MAX_PATH];
+	if (!GetVolumeNameForVolumeMountPoint(root.c_str(), volumeName, MAX_PATH))
+		return DEVICE_SSD;
+	String device = volumeName;
+	if (!device.empty() && device.back() == '\\')
+		device.pop_back();
+
+	HANDLE hDevice = CreateFile(device.c_str(), 0, FILE_SHARE_READ | FILE_SHARE_WRITE,
+		nullptr, OPEN_EXISTING, 0, nullptr);
+	if (hDevice == INVALID_HANDLE_VALUE)
+		return DEVICE_SSD;
+
+	STORAGE_PROPERTY_QUERY query = {};
+	query.PropertyId = StorageDeviceSeekPenaltyProperty;
+	query.QueryType = PropertyStandardQuery;
+	DEVICE_SEEK_PENALTY_DESCRIPTOR desc = {};
+	DWORD dwReturned = 0;
+	BOOL bResult = DeviceIoControl(hDevice, IOCTL_STORAGE_QUERY_PROPERTY,
+		&query, sizeof(query), &desc, sizeof(desc), &dwReturned, nullptr);
+	CloseHandle(hDevice);
+	return (bResult && desc.IncursSeekPenalty) ? DEVICE_HDD : DEVICE_SSD;
+}
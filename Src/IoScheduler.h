@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  IoScheduler.h
+ *
+ * @brief Declaration of IoScheduler class
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#define POCO_NO_UNWINDOWS 1
+#include <Poco/Mutex.h>
+#include <Poco/Condition.h>
+#include <Poco/Timestamp.h>
+#include "UnicodeString.h"
+
+/**
+ * @brief Limits concurrent file reads per physical volume in folder compare.
+ *
+ * The compare workers are sized by processor count, which is right for
+ * SSDs but makes spinning disks and network shares seek back and forth
+ * between files. Each compared root is mapped to its volume (two roots
+ * on the same volume share one entry), and a worker must get a permit
+ * for every volume it reads from while it reads the files of an item.
+ * The permit is not held while the data read is compared.
+ *
+ * The permit limit of a volume starts from a guess based on the device
+ * type and is then tuned by hill climbing on the measured throughput:
+ * the limit keeps moving in one direction while throughput improves and
+ * turns back when it drops. SSDs are not limited at all.
+ */
+class IoScheduler
+{
+public:
+	enum DeviceType
+	{
+		DEVICE_SSD, /**< No seek penalty, not limited */
+		DEVICE_HDD, /**< Local disk with seek penalty */
+		DEVICE_REMOTE, /**< Network share */
+	};
+
+	/**
+	 * @brief Permit for reading the sides of an item, released on destruction.
+	 * Sides on the same volume take one permit of that volume.
+	 */
+	class Permit
+	{
+	public:
+		Permit(IoScheduler *pScheduler, const int sideVolumes[], int nSides);
+		~Permit();
+		void AddBytes(int side, int64_t bytes);
+	private:
+		Permit(const Permit&) = delete;
+		Permit& operator=(const Permit&) = delete;
+		IoScheduler *m_pScheduler;
+		int m_volumes[3]; /**< Distinct volumes read */
+		int64_t m_bytes[3]; /**< Bytes read from each of m_volumes */
+		int m_sideIndex[3]; /**< Index in m_volumes of each side, -1 if side is not read */
+		int m_count;
+	};
+
+	explicit IoScheduler(int nMaxConcurrency);
+	int AddPath(const String& path);
+	int AddVolume(const String& root, DeviceType type);
+	int GetLimit(int volume) const;
+	int GetActive(int volume) const;
+	int64_t GetBytesRead(int volume) const;
+	DeviceType GetDeviceType(int volume) const;
+	bool IsLimited() const;
+
+	static String GetVolumeRoot(const String& path);
+	static DeviceType DetectDeviceType(const String& root);
+	static int NextLimit(int limit, int maxLimit, int& direction, double throughput, double lastThroughput);
+
+private:
+	struct Volume
+	{
+		String root; /**< Volume mount point */
+		DeviceType type;
+		int limit; /**< Concurrent reads allowed now */
+		int maxLimit;
+		int active; /**< Concurrent reads running now */
+		int direction; /**< Direction of last limit change, +1 or -1 */
+		int completed; /**< Reads completed in current window */
+		int64_t bytes; /**< Bytes read in current window */
+		int64_t totalBytes; /**< Bytes read since the volume was added */
+		Poco::Timestamp windowStart;
+		double lastThroughput; /**< Bytes per second in previous window */
+	};
+
+	void Acquire(const int volumes[], int count);
+	void Release(const int volumes[], const int64_t bytes[], int count);
+	void Adapt(Volume& volume);
+
+	mutable Poco::FastMutex m_mutex;
+	Poco::Condition m_cond;
+	std::vector<Volume> m_volumes;
+	int m_nMaxConcurrency;
+};
@@ -0,0 +1,316 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  LineAligner.cpp
+ *
+ * @brief Implementation of LineAligner class
+ */
+
+#include "pch.h"
+#include "LineAligner.h"
+#include <algorithm>
+#include <atomic>
+#include <utility>
+#include "CompareOptions.h"
+#include "ParallelFor.h"
+#include "DebugNew.h"
+
+namespace
+{
+
+/** @brief Length of character grams the line signatures are built from. */
+const size_t GramLength = 3;
+/** @brief Minimum number of equal MinHash values for lines to be similar. */
+const int MinScore = LineAligner::SIGNATURE_SIZE / 4;
+/** @brief Score of lines equal after normalization. */
+const int ExactScore = LineAligner::SIGNATURE_SIZE + 1;
+/** @brief Minimum band half width in lines. */
+const int64_t MinBandWidth = 8;
+
+/** @brief SplitMix64 finalizer, spreads bits of a value over the result. */
+inline uint64_t Mix(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+/**
+ * @brief Multipliers and increments of the multiply-shift hash functions,
+ * one function per MinHash value.
+ */
+struct HashFunctions
+{
+	uint64_t mul[LineAligner::SIGNATURE_SIZE];
+	uint64_t add[LineAligner::SIGNATURE_SIZE];
+	HashFunctions()
+	{
+		for (int k = 0; k < LineAligner::SIGNATURE_SIZE; ++k)
+		{
+			mul[k] = Mix(2 * k + 1) | 1;
+			add[k] = Mix(2 * k + 2);
+		}
+	}
+};
+
+const HashFunctions& GetHashFunctions()
+{
+	static const HashFunctions s_functions;
+	return s_functions;
+}
+
+}
+
+/**
+ * @brief Constructor.
+ * @param [in] bCaseSensitive Are lines differing only by case different?
+ * @param [in] ignoreWhitespace Whitespace compare mode (WHITESPACE_*).
+ */
+LineAligner::LineAligner(bool bCaseSensitive, int ignoreWhitespace)
+: m_bCaseSensitive(bCaseSensitive)
+, m_ignoreWhitespace(ignoreWhitespace)
+, m_maxCells(4 * 1024 * 1024)
+, m_timeLimit(0)
+{
+	m_stopwatch.start();
+}
+
+/**
+ * @brief Set time budget shared by all following Align() calls.
+ * @param [in] milliseconds Budget, 0 for no limit.
+ */
+void LineAligner::SetTimeLimit(int milliseconds)
+{
+	m_timeLimit = static_cast<Poco::Clock::ClockDiff>(milliseconds) * 1000;
+	m_stopwatch.restart();
+}
+
+/**
+ * @brief Is the time budget used up?
+ */
+bool LineAligner::IsTimeOver() const
+{
+	return m_timeLimit > 0 && m_stopwatch.elapsed() > m_timeLimit;
+}
+
+/**
+ * @brief Remove what the compare options ignore from a line.
+ */
+String LineAligner::Normalize(const String& line) const
+{
+	String result;
+	result.reserve(line.length());
+	bool bSpace = false;
+	for (TCHAR ch : line)
+	{
+		if (ch == '\r' || ch == '\n')
+			continue;
+		if (ch == ' ' || ch == '\t')
+		{
+			if (m_ignoreWhitespace == WHITESPACE_IGNORE_ALL)
+				continue;
+			if (m_ignoreWhitespace == WHITESPACE_IGNORE_CHANGE)
+			{
+				// Whitespace runs are equal to one space, trailing ones are dropped
+				bSpace = true;
+				continue;
+			}
+		}
+		else if (bSpace)
+		{
+			result += ' ';
+			bSpace = false;
+		}
+		result += m_bCaseSensitive ? ch : static_cast<TCHAR>(_totlower(ch));
+	}
+	return result;
+}
+
+/**
+ * @brief Compute MinHash signature of character trigrams of a line.
+ */
+void LineAligner::ComputeSketch(const String& line, Sketch& sketch) const
+{
+	const HashFunctions& functions = GetHashFunctions();
+	const String str = Normalize(line);
+	sketch.length = static_cast<unsigned>(str.length());
+	sketch.hash = 14695981039346656037ULL;
+	for (TCHAR ch : str)
+		sketch.hash = (sketch.hash ^ static_cast<uint64_t>(ch)) * 1099511628211ULL;
+	std::fill(std::begin(sketch.minhash), std::end(sketch.minhash), UINT32_MAX);
+
+	const size_t grams = str.length() >= GramLength ? str.length() - GramLength + 1 : (str.empty() ? 0 : 1);
+	for (size_t g = 0; g < grams; ++g)
+	{
+		uint64_t gram = 0;
+		for (size_t c = g; c < g + GramLength && c < str.length(); ++c)
+			gram = (gram << 21) ^ static_cast<uint64_t>(str[c]);
+		gram = Mix(gram);
+		for (int k = 0; k < SIGNATURE_SIZE; ++k)
+		{
+			const uint32_t value = static_cast<uint32_t>((functions.mul[k] * gram + functions.add[k]) >> 32);
+			if (value < sketch.minhash[k])
+				sketch.minhash[k] = value;
+		}
+	}
+}
+
+void LineAligner::ComputeSketches(const std::vector<String>& lines, std::vector<Sketch>& sketches) const
+{
+	sketches.resize(lines.size());
+	int64_t work = 0;
+	for (const String& line : lines)
+		work += line.length();
+	ParallelFor(static_cast<int>(lines.size()), work, [&](int begin, int end)
+		{
+			for (int i = begin; i < end; ++i)
+				ComputeSketch(lines[i], sketches[i]);
+		});
+}
+
+/**
+ * @brief Return similarity score of two lines, 0 if they are not similar.
+ * The score is the number of equal MinHash values, which estimates the
+ * Jaccard similarity of the trigram sets, or ExactScore for equal lines.
+ */
+int LineAligner::Score(const Sketch& a, const Sketch& b)
+{
+	if (a.hash == b.hash && a.length == b.length)
+		return ExactScore;
+	// Trigram sets of lines this different in length cannot be similar enough
+	if ((std::min)(a.length, b.length) * 3 < (std::max)(a.length, b.length))
+		return 0;
+	int score = 0;
+	for (int k = 0; k < SIGNATURE_SIZE; ++k)
+	{
+		if (a.minhash[k] == b.minhash[k])
+			++score;
+	}
+	return score >= MinScore ? score : 0;
+}
+
+/**
+ * @brief Map lines of left side to lines of right side.
+ * @param [in] lines0 Lines of left side of the diff block.
+ * @param [in] lines1 Lines of right side of the diff block.
+ * @param [out] map For each left line, index of the right line it is
+ *   aligned with, or GHOST. Indexes are increasing.
+ * @return false if time budget ran out, map is not valid then.
+ */
+bool LineAligner::Align(const std::vector<String>& lines0, const std::vector<String>& lines1, std::vector<int>& map)
+{
+	const int n0 = static_cast<int>(lines0.size());
+	const int n1 = static_cast<int>(lines1.size());
+	map.assign(n0, GHOST);
+	if (n0 == 0 || n1 == 0)
+		return true;
+	if (IsTimeOver())
+		return false;
+
+	std::vector<Sketch> sketches0, sketches1;
+	ComputeSketches(lines0, sketches0);
+	ComputeSketches(lines1, sketches1);
+	if (IsTimeOver())
+		return false;
+
+	// Row i of the band covers right lines [lo[i], hi[i]] around the
+	// diagonal, the band is as wide as m_maxCells allows
+	const int64_t width = (std::max)(MinBandWidth, (m_maxCells / n0 - n1 / n0 - 1) / 2);
+	std::vector<int> lo(n0), hi(n0);
+	std::vector<int64_t> offsets(n0 + 1);
+	for (int i = 0; i < n0; ++i)
+	{
+		lo[i] = static_cast<int>((std::max)(static_cast<int64_t>(i) * n1 / n0 - width, int64_t(0)));
+		hi[i] = static_cast<int>((std::min)(static_cast<int64_t>(i + 1) * n1 / n0 + width, static_cast<int64_t>(n1 - 1)));
+		offsets[i + 1] = offsets[i] + hi[i] - lo[i] + 1;
+	}
+	const int64_t cells = offsets[n0];
+
+	std::vector<uint8_t> scores(static_cast<size_t>(cells));
+	std::atomic<bool> bTimeOver(false);
+	ParallelFor(n0, cells, [&](int begin, int end)
+		{
+			for (int i = begin; i < end && !bTimeOver; ++i)
+			{
+				uint8_t *rowScores = &scores[static_cast<size_t>(offsets[i])];
+				for (int j = lo[i]; j <= hi[i]; ++j)
+					rowScores[j - lo[i]] = static_cast<uint8_t>(Score(sketches0[i], sketches1[j]));
+				if ((i & 63) == 0 && IsTimeOver())
+					bTimeOver = true;
+			}
+		});
+	if (bTimeOver)
+		return false;
+
+	// best[] holds the highest total score of aligned pairs up to the
+	// cell, left[i] the one left of the band in row i
+	std::vector<int32_t> best(static_cast<size_t>(cells));
+	std::vector<int32_t> left(n0);
+	auto total = [&](int i, int j) -> int32_t
+	{
+		if (i < 0 || j < 0)
+			return 0;
+		if (j < lo[i])
+			return left[i];
+		return best[static_cast<size_t>(offsets[i] + (std::min)(j, hi[i]) - lo[i])];
+	};
+	for (int i = 0; i < n0; ++i)
+	{
+		left[i] = lo[i] == 0 ? 0 : total(i - 1, lo[i] - 1);
+		int32_t *rowBest = &best[static_cast<size_t>(offsets[i])];
+		const uint8_t *rowScores = &scores[static_cast<size_t>(offsets[i])];
+		for (int j = lo[i]; j <= hi[i]; ++j)
+		{
+			int32_t value = (std::max)(total(i - 1, j), j > lo[i] ? rowBest[j - lo[i] - 1] : left[i]);
+			if (rowScores[j - lo[i]] > 0)
+				value = (std::max)(value, total(i - 1, j - 1) + rowScores[j - lo[i]]);
+			rowBest[j - lo[i]] = value;
+		}
+		if ((i & 255) == 0 && IsTimeOver())
+			return false;
+	}
+
+	// Trace back the aligned pairs
+	std::vector<std::pair<int, int>> pairs;
+	for (int i = n0 - 1, j = n1 - 1; i >= 0 && j >= 0; )
+	{
+		if (j > hi[i])
+			j = hi[i];
+		if (j < lo[i])
+		{
+			--i;
+			continue;
+		}
+		const size_t cell = static_cast<size_t>(offsets[i] + j - lo[i]);
+		if (scores[cell] > 0 && best[cell] == total(i - 1, j - 1) + scores[cell])
+		{
+			pairs.emplace_back(i, j);
+			--i;
+			--j;
+		}
+		else if (best[cell] == total(i - 1, j))
+			--i;
+		else
+			--j;
+	}
+	std::reverse(pairs.begin(), pairs.end());
+
+	// Lines between aligned pairs are paired from the top, the rest are ghosts
+	int next0 = 0, next1 = 0;
+	auto fill = [&](int end0, int end1)
+	{
+		for (; next0 < end0; ++next0)
+			map[next0] = next1 < end1 ? next1++ : GHOST;
+	};
+	for (const auto& pair : pairs)
+	{
+		fill(pair.first, pair.second);
+		map[pair.first] = pair.second;
+		next0 = pair.first + 1;
+		next1 = pair.second + 1;
+	}
+	fill(n0, n1);
+	return true;
+}
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  LineAligner.h
+ *
+ * @brief Declaration of LineAligner class
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#define POCO_NO_UNWINDOWS 1
+#include <Poco/Stopwatch.h>
+#include "UnicodeString.h"
+
+/**
+ * @brief Aligns similar lines of the two sides of a diff block.
+ *
+ * Comparing every line pair with a word diff is quadratic and is only
+ * affordable for a handful of lines. This class instead describes each
+ * line with a MinHash signature of its character trigrams, so that the
+ * similarity of two lines is estimated by comparing a few integers.
+ * Line pairs are scored only in a band around the block diagonal and
+ * when their lengths make a match possible, and a dynamic programming
+ * pass over the band finds the monotonic set of pairs with the highest
+ * total similarity. Lines between matched pairs are paired from the top.
+ *
+ * Scoring is split between threads for large blocks. All blocks aligned
+ * by one object share one time budget, after which Align() gives up.
+ */
+class LineAligner
+{
+public:
+	enum
+	{
+		GHOST = -1, /**< Map value of a line without counterpart */
+		SIGNATURE_SIZE = 32, /**< MinHash values per line */
+	};
+
+	LineAligner(bool bCaseSensitive, int ignoreWhitespace);
+	void SetTimeLimit(int milliseconds);
+	void SetMaxCells(int64_t cells) { m_maxCells = cells; }
+	bool Align(const std::vector<String>& lines0, const std::vector<String>& lines1, std::vector<int>& map);
+	bool IsTimeOver() const;
+
+private:
+	/** @brief Similarity sketch of one line */
+	struct Sketch
+	{
+		uint64_t hash; /**< Hash of whole normalized line */
+		unsigned length; /**< Length of normalized line */
+		uint32_t minhash[SIGNATURE_SIZE];
+	};
+
+	String Normalize(const String& line) const;
+	void ComputeSketch(const String& line, Sketch& sketch) const;
+	void ComputeSketches(const std::vector<String>& lines, std::vector<Sketch>& sketches) const;
+	static int Score(const Sketch& a, const Sketch& b);
+
+	bool m_bCaseSensitive;
+	int m_ignoreWhitespace;
+	int64_t m_maxCells; /**< Max number of line pairs scored for one block */
+	Poco::Clock::ClockDiff m_timeLimit; /**< Budget in microseconds, 0 for none */
+	Poco::Stopwatch m_stopwatch;
+};
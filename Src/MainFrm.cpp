@@ -43,6 +43,7 @@
 #include "Plugins.h"
 #include "ConfigLog.h"
 #include "7zCommon.h"
+#include "ArchiveCache.h"
 #include "Merge7zFormatMergePluginImpl.h"
 #include "FileFiltersDlg.h"
 #include "OptionsMgr.h"
@@ -682,17 +683,6 @@ void CMainFrame::OnFileOpen()
 	DoFileOpen();
 }
 
-/**
- * @brief Check for BOM, and also, if bGuessEncoding, try to deduce codepage
- *
- * Unpacks info from FileLocation & delegates all work to codepage_detect module
- */
-static void
-FileLocationGuessEncodings(FileLocation & fileloc, int iGuessEncoding)
-{
-	fileloc.encoding = codepage_detect::Guess(fileloc.filepath, iGuessEncoding);
-}
-
 bool CMainFrame::ShowAutoMergeDoc(CDirDoc * pDirDoc,
 	int nFiles, const FileLocation ifileloc[],
 	const DWORD dwFlags[], const String strDesc[], const String& sReportFile /*= _T("")*/,
@@ -808,17 +798,23 @@ bool CMainFrame::ShowTextOrTableMergeDoc(std::optional<bool> table, CDirDoc * pD
 	// (through menu : "Plugins"->"Open with unpacker")
 	pMergeDoc->SetUnpacker(infoUnpacker);
 
-	// detect codepage
+	// detect codepage, of all files at once
 	int iGuessEncodingType = GetOptionsMgr()->GetInt(OPT_CP_DETECT);
+	std::vector<int> guessPanes;
+	std::vector<String> guessPaths;
 	for (int pane = 0; pane < nFiles; pane++)
 	{
 		if (fileloc[pane].encoding.m_unicoding == -1)
 			fileloc[pane].encoding.m_unicoding = ucr::NONE;
 		if (fileloc[pane].encoding.m_unicoding == ucr::NONE && fileloc[pane].encoding.m_codepage == -1)
 		{
-			FileLocationGuessEncodings(fileloc[pane], iGuessEncodingType);
+			guessPanes.push_back(pane);
+			guessPaths.push_back(fileloc[pane].filepath);
 		}
 	}
+	std::vector<FileTextEncoding> encodings = codepage_detect::GuessFiles(guessPaths, iGuessEncodingType);
+	for (size_t i = 0; i < guessPanes.size(); ++i)
+		fileloc[guessPanes[i]].encoding = encodings[i];
 
 	pMergeDoc->SetEnableTableEditing(table);
 
@@ -1132,7 +1128,10 @@ bool CMainFrame::DoFileOpen(const PathContext * pFiles /*= nullptr*/,
 	}
 
 	CTempPathContext *pTempPathContext = nullptr;
-	if (pathsType == paths::IS_EXISTING_DIR)
+	// Zip and tar files are walked by the folder compare without extracting
+	// them, see CDirDoc::OpenArchives()
+	if (pathsType == paths::IS_EXISTING_DIR && !std::all_of(tFiles.begin(), tFiles.end(), [](const String& path)
+		{ return paths::DoesPathExist(path) == paths::IS_EXISTING_DIR || ArchiveCache::IsArchive(path); }))
 	{
 		DecompressResult res= DecompressArchive(m_hWnd, tFiles);
 		if (res.pTempPathContext)
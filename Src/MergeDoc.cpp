@@ -38,6 +38,7 @@
 #include "OptionsMgr.h"
 #include "OptionsDiffOptions.h"
 #include "MergeLineFlags.h"
+#include "DiffCopyLines.h"
 #include "FileOrFolderSelect.h"
 #include "LineFiltersList.h"
 #include "SubstitutionFiltersList.h"
@@ -54,6 +55,7 @@
 #include "charsets.h"
 #include "markdown.h"
 #include "stringdiffs.h"
+#include "TableDiff.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -135,6 +137,7 @@ CMergeDoc::CMergeDoc()
 	for (int nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
 	{
 		m_ptBuf[nBuffer].reset(new CDiffTextBuffer(this, nBuffer));
+		m_ptBuf[nBuffer]->SetUndoMemoryLimit(static_cast<size_t>((std::max)(GetOptionsMgr()->GetInt(OPT_UNDO_MEMORY_LIMIT), 0)) * 1024 * 1024);
 		m_pSaveFileInfo[nBuffer].reset(new DiffFileInfo());
 		m_pRescanFileInfo[nBuffer].reset(new DiffFileInfo());
 		m_nBufferType[nBuffer] = BUFFERTYPE::NORMAL;
@@ -394,7 +397,13 @@ int CMergeDoc::Rescan(bool &bBinary, IDENTLEVEL &identical,
 
 	DIFFSTATUS status;
 
-	if (!HasSyncPoints())
+	if (IsTableRowMatching())
+	{
+		// Rows are diffed from the buffers, diffutils is not run
+		DiffTableRows(status);
+		diffSuccess = true;
+	}
+	else if (!HasSyncPoints())
 	{
 		// Save text buffer to file
 		for (nBuffer = 0; nBuffer < m_nBuffers; nBuffer++)
@@ -857,6 +866,20 @@ void CMergeDoc::CopyMultipleList(int srcPane, int dstPane, int firstDiff, int la
 	firstDiff = max(0, firstDiff);
 	if (firstDiff > lastDiff)
 		return;
+
+	if (firstDiff < lastDiff && firstWordDiff <= 0 && lastWordDiff == -1)
+	{
+		// Whole diffs are copied at once. Like with ListCopy() of the
+		// current diff below, the last diff is copied even if ignored.
+		std::vector<std::pair<int, int>> diffs;
+		for (int i = firstDiff; i <= lastDiff; ++i)
+		{
+			if (i == lastDiff || m_diffList.IsDiffSignificant(i))
+				diffs.emplace_back(i, srcPane);
+		}
+		BulkListCopy(diffs, dstPane);
+		return;
+	}
 	
 	RescanSuppress suppressRescan(*this);
 
@@ -1049,7 +1072,6 @@ void CMergeDoc::DoAutoMerge(int dstPane)
 {
 	const int lastDiff = m_diffList.GetSize() - 1;
 	const int firstDiff = 0;
-	bool bGroupWithPrevious = false;
 	int autoMergedCount = 0;
 	int unresolvedConflictCount = 0;
 
@@ -1073,59 +1095,24 @@ void CMergeDoc::DoAutoMerge(int dstPane)
 	else if (mergedEOLStyle.first == Conflict)
 		ShowMessageBox(_("The changes of EOL are conflicting."), MB_ICONINFORMATION);
 
-	RescanSuppress suppressRescan(*this);
-
-	// Note we don't care about m_nDiffs count to become zero,
-	// because we don't rescan() so it does not change
-
-	SetCurrentDiff(lastDiff);
-
-	SetEditedAfterRescan(dstPane);
-
-	int nGroup = GetActiveMergeView()->m_nThisGroup;
-	CMergeEditView *pViewDst = m_pView[nGroup][dstPane];
-	CPoint currentPosDst = pViewDst->GetCursorPos();
-	currentPosDst.x = 0;
-
-	CPoint pt(0, 0);
-	pViewDst->SetCursorPos(pt);
-	pViewDst->SetNewSelection(pt, pt, false);
-	pViewDst->SetNewAnchor(pt);
-
-	// copy from bottom up is more efficient
-	for (int i = lastDiff; i >= firstDiff; --i)
+	std::vector<std::pair<int, int>> diffs;
+	for (int i = firstDiff; i <= lastDiff; ++i)
 	{
-		const DIFFRANGE *pdi = m_diffList.DiffRangeAt(i);
 		const int srcPane = m_diffList.GetMergeableSrcIndex(i, dstPane);
 		if (srcPane != -1)
-		{
-			SetCurrentDiff(i);
-			if (currentPosDst.y > pdi->dend)
-			{
-				if (pdi->blank[dstPane] >= 0)
-					currentPosDst.y -= pdi->dend - pdi->blank[dstPane] + 1;
-				else if (pdi->blank[srcPane] >= 0)
-					currentPosDst.y -= pdi->dend - pdi->blank[srcPane] + 1;
-			}			
-			// Group merge with previous (merge undo data to one action)
-			if (!ListCopy(srcPane, dstPane, -1, bGroupWithPrevious, false))
-				break; // sync failure
-			if (!bGroupWithPrevious)
-				bGroupWithPrevious = true;
-			++autoMergedCount;
-		}
-		if (pdi->op == OP_DIFF)
+			diffs.emplace_back(i, srcPane);
+		if (m_diffList.DiffRangeAt(i)->op == OP_DIFF)
 			++unresolvedConflictCount;
 	}
 
-	ForEachView(dstPane, [currentPosDst](auto& pView) {
-		pView->SetCursorPos(currentPosDst);
-		pView->SetNewSelection(currentPosDst, currentPosDst, false);
-		pView->SetNewAnchor(currentPosDst);
-	});
-
-	suppressRescan.Clear(); // done suppress Rescan
-	FlushAndRescan();
+	// Copy all mergeable diffs at once
+	if (!diffs.empty() && BulkListCopy(diffs, dstPane))
+		autoMergedCount = static_cast<int>(diffs.size());
+	else
+	{
+		SetEditedAfterRescan(dstPane);
+		FlushAndRescan();
+	}
 	UpdateHeaderPath(dstPane);
 
 	if (autoMergedCount > 0)
@@ -1134,7 +1121,7 @@ void CMergeDoc::DoAutoMerge(int dstPane)
 	// move to first conflict 
 	const int nDiff = m_diffList.FirstSignificant3wayDiff(THREEWAYDIFFTYPE_CONFLICT);
 	if (nDiff != -1)
-		pViewDst->SelectDiff(nDiff, true, false);
+		m_pView[GetActiveMergeView()->m_nThisGroup][dstPane]->SelectDiff(nDiff, true, false);
 
 	ShowMessageBox(
 		strutils::format_string2(
@@ -1305,6 +1292,126 @@ bool CMergeDoc::ListCopy(int srcPane, int dstPane, int nDiff /* = -1*/,
 	return true;
 }
 
+/**
+ * @brief Copy many differences from side to side at once.
+ *
+ * Copying differences one by one with ListCopy() edits the destination
+ * buffer, its ghost lines and the views for each difference, and every
+ * difference adds undo records with a copy of its text. Here the new
+ * destination lines are built in one pass from the destination and
+ * source buffers, and replace the destination lines at once. That is
+ * one undo record, which keeps the previous lines, and one view update.
+ * @param [in] diffs Differences to copy and their source sides, in
+ *  ascending order of differences.
+ * @param [in] dstPane Destination side
+ * @return true if ok, false if sync failure
+ */
+bool CMergeDoc::BulkListCopy(const std::vector<std::pair<int, int>>& diffs, int dstPane)
+{
+	if (diffs.empty())
+		return true;
+
+	for (const auto& diff : diffs)
+	{
+		if (!SanityCheckDiff(*m_diffList.DiffRangeAt(diff.first)))
+		{
+			LangMessageBox(IDS_VIEWS_OUTOFSYNC, MB_ICONSTOP);
+			return false; // abort copying
+		}
+	}
+
+	RescanSuppress suppressRescan(*this);
+
+	SetEditedAfterRescan(dstPane);
+
+	int nGroup = GetActiveMergeView()->m_nThisGroup;
+	CMergeEditView *pViewDst = m_pView[nGroup][dstPane];
+	CPoint currentPosDst = pViewDst->GetCursorPos();
+	currentPosDst.x = 0;
+	const int nCursorLine = currentPosDst.y;
+
+	CDiffTextBuffer& dbuf = *m_ptBuf[dstPane];
+	const int nLineCount = dbuf.GetLineCount();
+	const DWORD dwRevisionNumber = ++dbuf.m_dwCurrentRevisionNumber;
+	const std::vector<std::vector<int>> syncpoints = GetSyncPointList();
+
+	static_assert(LF_NOT_COPIED == (LF_GHOST | LF_INVISIBLE), "LF_NOT_COPIED must match the line flags");
+	std::vector<DiffCopyRange> ranges;
+	ranges.reserve(diffs.size());
+	for (const auto& diff : diffs)
+	{
+		const DIFFRANGE *pdi = m_diffList.DiffRangeAt(diff.first);
+		const int srcPane = diff.second;
+		ranges.push_back({ pdi->dbegin, pdi->dend, srcPane });
+
+		for (const auto& syncpnt : syncpoints)
+		{
+			if (syncpnt[dstPane] >= pdi->dbegin && syncpnt[dstPane] <= pdi->dend)
+				DeleteSyncPoint(dstPane, syncpnt[dstPane], false);
+		}
+
+		if (nCursorLine > pdi->dend)
+		{
+			if (pdi->blank[dstPane] >= 0)
+				currentPosDst.y -= pdi->dend - pdi->blank[dstPane] + 1;
+			else if (pdi->blank[srcPane] >= 0)
+				currentPosDst.y -= pdi->dend - pdi->blank[srcPane] + 1;
+		}
+	}
+
+	// Visible real lines of the sources replace all lines of the differences
+	std::vector<LineInfo> aLines;
+	aLines.reserve(nLineCount);
+	ForEachCopiedLine(nLineCount, dstPane, ranges,
+		[this](int nPane, int nLine) { return m_ptBuf[nPane]->GetLineFlags(nLine); },
+		[&](int nPane, int nLine)
+		{
+			const CDiffTextBuffer& buf = *m_ptBuf[nPane];
+			const bool bKept = nPane == dstPane;
+			aLines.emplace_back();
+			aLines.back().Create(buf.GetLineChars(nLine), buf.GetFullLineLength(nLine));
+			aLines.back().m_dwFlags = bKept ? buf.GetLineFlags(nLine) : 0;
+			aLines.back().m_dwRevisionNumber = bKept ? buf.GetLineRevisionNumber(nLine) : dwRevisionNumber;
+		});
+
+	// All real lines have EOL except the last one, as if the text were
+	// edited line by line
+	int nLastRealLine = static_cast<int>(aLines.size()) - 1;
+	while (nLastRealLine >= 0 && (aLines[nLastRealLine].m_dwFlags & LF_GHOST) != 0)
+		--nLastRealLine;
+	const LPCTSTR pszEol = dbuf.GetDefaultEol();
+	for (int i = 0; i < nLastRealLine; ++i)
+	{
+		if ((aLines[i].m_dwFlags & LF_GHOST) == 0 && !aLines[i].HasEol())
+			aLines[i].Append(pszEol, _tcslen(pszEol));
+	}
+	if (nLastRealLine >= 0)
+		aLines[nLastRealLine].RemoveEol();
+
+	CPoint pt(0, 0);
+	pViewDst->SetCursorPos(pt);
+	pViewDst->SetNewSelection(pt, pt, false);
+	pViewDst->SetNewAnchor(pt);
+
+	dbuf.BeginUndoGroup();
+	bool bResult = dbuf.ReplaceAllLines(pViewDst, std::move(aLines),
+		m_diffList.DiffRangeAt(diffs.front().first)->dbegin, CE_ACTION_MERGE);
+	dbuf.FlushUndoGroup(pViewDst);
+
+	// remove the diff
+	SetCurrentDiff(-1);
+
+	ForEachView(dstPane, [currentPosDst](auto& pView) {
+		pView->SetCursorPos(currentPosDst);
+		pView->SetNewSelection(currentPosDst, currentPosDst, false);
+		pView->SetNewAnchor(currentPosDst);
+	});
+
+	suppressRescan.Clear(); // done suppress Rescan
+	FlushAndRescan();
+	return bResult;
+}
+
 bool CMergeDoc::PartialListCopy(int srcPane, int dstPane, int nDiff, int firstLine, int lastLine /*= -1*/,
 	bool bGroupWithPrevious /*= false*/, bool bUpdateView /*= true*/)
 {
@@ -2848,6 +2955,70 @@ void CMergeDoc::SetTableProperties()
 	}
 }
 
+/**
+ * @brief Are table rows matched by key column instead of by position?
+ * Only 2-way compares without sync points are supported.
+ */
+bool CMergeDoc::IsTableRowMatching()
+{
+	return m_nBuffers == 2 && m_ptBuf[0]->GetTableEditing() && !HasSyncPoints() &&
+		GetOptionsMgr()->GetBool(OPT_CMP_TBL_MATCH_ROWS);
+}
+
+/**
+ * @brief Diff table rows matched by key column, in place of diffutils.
+ * Rows with the same key that are out of order are reported as moved
+ * lines. Line filters and substitution filters do not apply, as the
+ * option text says. EOLs are compared unless EOL differences are ignored.
+ * @param [out] status Diff status, as diffutils would give it.
+ */
+void CMergeDoc::DiffTableRows(DIFFSTATUS &status)
+{
+	DIFFOPTIONS diffOptions = {0};
+	m_diffWrapper.GetOptions(&diffOptions);
+	TableDiff tableDiff(m_ptBuf[0]->GetFieldDelimiter(), m_ptBuf[0]->GetFieldEnclosure(),
+		!diffOptions.bIgnoreCase, diffOptions.nIgnoreWhitespace);
+	tableDiff.SetKeyColumn(GetOptionsMgr()->GetInt(OPT_CMP_TBL_KEY_COLUMN));
+
+	// Rows are real lines, like the lines diffutils would read from temp files
+	std::vector<StringView> rows[2];
+	for (int nBuffer = 0; nBuffer < 2; nBuffer++)
+	{
+		const CDiffTextBuffer& buf = *m_ptBuf[nBuffer];
+		const int nLineCount = buf.GetLineCount();
+		rows[nBuffer].reserve(nLineCount);
+		for (int nLine = 0; nLine < nLineCount; nLine++)
+		{
+			if ((buf.GetLineFlags(nLine) & LF_GHOST) == 0)
+				rows[nBuffer].emplace_back(buf.GetLineChars(nLine),
+					diffOptions.bIgnoreEol ? buf.GetLineLength(nLine) : buf.GetFullLineLength(nLine));
+		}
+	}
+	tableDiff.Diff(rows[0], rows[1]);
+
+	for (const TableDiff::Range& range : tableDiff.GetRanges())
+	{
+		DIFFRANGE dr;
+		for (int nBuffer = 0; nBuffer < 2; nBuffer++)
+		{
+			dr.begin[nBuffer] = range.begin[nBuffer];
+			dr.end[nBuffer] = range.end[nBuffer] - 1;
+		}
+		dr.begin[2] = dr.end[2] = -1;
+		dr.op = OP_DIFF;
+		m_diffList.AddDiff(dr);
+	}
+	if (m_diffWrapper.GetDetectMovedBlocks())
+	{
+		for (const TableDiff::MovedRow& moved : tableDiff.GetMovedRows())
+		{
+			m_diffWrapper.GetMovedLines(0)->Add(MovedLines::SIDE::RIGHT, moved.row[0], moved.row[1]);
+			m_diffWrapper.GetMovedLines(1)->Add(MovedLines::SIDE::LEFT, moved.row[1], moved.row[0]);
+		}
+	}
+	status.Identical = tableDiff.GetRanges().empty() ? IDENTLEVEL::ALL : IDENTLEVEL::NONE;
+}
+
 /**
  * @brief Loads files and does initial rescan.
  * @param fileloc [in] File to open to left/middle/right side (path & encoding info)
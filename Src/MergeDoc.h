@@ -121,6 +121,7 @@ class CMergeEditFrame;
 class CDirDoc;
 class CEncodingErrorBar;
 class CLocationView;
+class LineAligner;
 
 /**
  * @brief Document class for merging two files
@@ -177,6 +178,7 @@ public:
 	bool WordListCopy(int srcPane, int dstPane, int nDiff, int nFirstWordDiff, int nLastWordDiff, const std::vector<int> *pWordDiffIndice, bool bGroupWithPrevious = false, bool bUpdateView = true);
 	bool PartialListCopy(int srcPane, int dstPane, int nDiff, int firstLine, int lastLine = -1, bool bGroupWithPrevious = false, bool bUpdateView = true);
 	bool ListCopy(int srcPane, int dstPane, int nDiff = -1, bool bGroupWithPrevious = false, bool bUpdateView = true);
+	bool BulkListCopy(const std::vector<std::pair<int, int>>& diffs, int dstPane);
 	bool TrySaveAs(String& strPath, int &nLastErrorCode, String & sError,
 		int nBuffer, PackingInfo& infoTempUnpacker);
 	bool DoSave(LPCTSTR szPath, bool &bSaveSuccess, int nBuffer);
@@ -328,6 +330,7 @@ private:
 	void SanityCheckCodepage(FileLocation & fileinfo);
 	DWORD LoadOneFile(int index, String filename, bool readOnly, const String& strDesc, const FileTextEncoding & encoding);
 	void SetTableProperties();
+	bool IsTableRowMatching();
 
 // Implementation data
 protected:
@@ -405,7 +408,9 @@ private:
 	void HideLines();
 	void AdjustDiffBlocks();
 	void AdjustDiffBlock(DiffMap & diffmap, const DIFFRANGE & diffrange, int lo0, int hi0, int lo1, int hi1);
+	bool AlignDiffBlock(LineAligner & aligner, DiffMap & diffmap, const DIFFRANGE & diffrange);
 	int GetMatchCost(const String &Line0, const String &Line1);
+	void DiffTableRows(DIFFSTATUS &status);
 	void FlagTrivialLines();
 	void FlagMovedLines();
 	String GetFileExt(LPCTSTR sFileName, LPCTSTR sDescription) const;
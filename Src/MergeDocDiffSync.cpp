@@ -12,6 +12,9 @@
 #include "Merge.h"
 #include "DiffList.h"
 #include "stringdiffs.h"
+#include "LineAligner.h"
+#include "OptionsDef.h"
+#include "OptionsMgr.h"
 
 #ifdef _DEBUG
 #define new DEBUG_NEW
@@ -27,6 +30,11 @@ void CMergeDoc::AdjustDiffBlocks()
 	int nDiff;
 	int nDiffCount = m_diffList.GetSize();
 
+	DIFFOPTIONS diffOptions = {0};
+	m_diffWrapper.GetOptions(&diffOptions);
+	LineAligner aligner(!diffOptions.bIgnoreCase, diffOptions.nIgnoreWhitespace);
+	aligner.SetTimeLimit(GetOptionsMgr()->GetInt(OPT_CMP_MATCH_SIMILAR_LINES_MAX_TIME));
+
 	// Go through and do our best to line up lines within each diff block
 	// between left side and right side
 	DiffList newDiffList;
@@ -44,7 +52,9 @@ void CMergeDoc::AdjustDiffBlocks()
 			int lo1 = 0, hi1 = nlines1-1;
 			DiffMap diffmap;
 			diffmap.InitDiffMap(nlines0);
-			AdjustDiffBlock(diffmap, diffrange, lo0, hi0, lo1, hi1);
+			// Word diff of every line pair is affordable for small blocks only
+			if ((nlines0 <= 15 && nlines1 <= 15) || !AlignDiffBlock(aligner, diffmap, diffrange))
+				AdjustDiffBlock(diffmap, diffrange, lo0, hi0, lo1, hi1);
 
 			// divide diff blocks
 			DIFFRANGE dr;
@@ -158,6 +168,34 @@ int CMergeDoc::GetMatchCost(const String &sLine0, const String &sLine1)
 	return -static_cast<int>(sLine0.length() - nDiffLenSum);
 }
 
+/**
+ * @brief Map lines from left to right in a large diff block by line similarity
+ * @return false if the time budget of the aligner ran out
+ */
+bool CMergeDoc::AlignDiffBlock(LineAligner & aligner, DiffMap & diffMap, const DIFFRANGE & diffrange)
+{
+	if (aligner.IsTimeOver())
+		return false;
+
+	std::vector<String> lines[2];
+	CString sLine;
+	for (int nBuffer = 0; nBuffer < 2; nBuffer++)
+	{
+		for (int nLine = diffrange.begin[nBuffer]; nLine <= diffrange.end[nBuffer]; nLine++)
+		{
+			m_ptBuf[nBuffer]->GetLine(nLine, sLine);
+			lines[nBuffer].emplace_back((LPCTSTR)sLine, sLine.GetLength());
+		}
+	}
+
+	std::vector<int> map;
+	if (!aligner.Align(lines[0], lines[1], map))
+		return false;
+	for (size_t i = 0; i < map.size(); ++i)
+		diffMap.m_map[i] = (map[i] == LineAligner::GHOST) ? DiffMap::GHOST_MAP_ENTRY : map[i];
+	return true;
+}
+
 /**
  * @brief Map lines from left to right for specified range in diff block, as best we can
  * Map left side range [lo0;hi0] to right side range [lo1;hi1]
@@ -189,6 +227,7 @@ void CMergeDoc::AdjustDiffBlock(DiffMap & diffMap, const DIFFRANGE & diffrange,
 	}
 
 	// Bail out if range is large
+	// (large blocks are aligned by AlignDiffBlock() unless it runs out of time)
 	if (lines0 > 15 || lines1 > 15)
 	{
 		// Do simple 1:1 mapping
@@ -14,6 +14,7 @@
 #include "stringdiffs.h"
 #include "UnicodeString.h"
 #include "SubstitutionFiltersList.h"
+#include "TableDiff.h"
 #include "Merge.h"
 
 #ifdef _DEBUG
@@ -132,6 +133,36 @@ static inline bool IsDiffPerLine(bool bTableEditing, const DIFFRANGE& cd)
 	return (bTableEditing || (cd.dend - cd.dbegin > LineLimit)) ? true : false;
 }
 
+/**
+ * @brief Compute word diffs of two table rows cell by cell.
+ * A difference never spans cells, so changed cells are highlighted
+ * separately even when their neighbours differ too.
+ */
+static std::vector<strdiff::wdiff> ComputeCellDiffs(const TableDiff& tableDiff, const String str[2],
+	bool casitive, bool eolSensitive, int xwhite, int breakType, bool byteColoring)
+{
+	std::vector<strdiff::wdiff> wdiffs;
+	std::vector<TableDiff::Range> cells;
+	tableDiff.DiffCells(str[0], str[1], cells);
+	for (const TableDiff::Range& cell : cells)
+	{
+		String cellStr[2];
+		for (int file = 0; file < 2; file++)
+			cellStr[file] = str[file].substr(cell.begin[file], cell.end[file] - cell.begin[file]);
+		std::vector<strdiff::wdiff> cellDiffs = strdiff::ComputeWordDiffs(2, cellStr, casitive, eolSensitive, xwhite, breakType, byteColoring);
+		for (strdiff::wdiff& wd : cellDiffs)
+		{
+			for (int file = 0; file < 2; file++)
+			{
+				wd.begin[file] += cell.begin[file];
+				wd.end[file] += cell.begin[file];
+			}
+			wdiffs.push_back(wd);
+		}
+	}
+	return wdiffs;
+}
+
 /**
  * @brief Returns rectangles to highlight in both views (to show differences in line specified)
  */
@@ -402,7 +433,16 @@ std::vector<WordDiff> CMergeDoc::GetWordDiffArray(int nLineIndex)
 	bool byteColoring = GetByteColoringOption();
 
 	// Make the call to stringdiffs, which does all the hard & tedious computations
-	std::vector<strdiff::wdiff> wdiffs = strdiff::ComputeWordDiffs(m_nBuffers, str, casitive, eolSensitive, xwhite, breakType, byteColoring);
+	std::vector<strdiff::wdiff> wdiffs;
+	if (diffPerLine && IsTableRowMatching() &&
+		(m_ptBuf[0]->GetLineFlags(nLineIndex) & LF_GHOST) == 0 && (m_ptBuf[1]->GetLineFlags(nLineIndex) & LF_GHOST) == 0)
+	{
+		// Rows matched by key are compared cell by cell
+		TableDiff tableDiff(m_ptBuf[0]->GetFieldDelimiter(), m_ptBuf[0]->GetFieldEnclosure(), casitive, xwhite);
+		wdiffs = ComputeCellDiffs(tableDiff, str, casitive, eolSensitive, xwhite, breakType, byteColoring);
+	}
+	else
+		wdiffs = strdiff::ComputeWordDiffs(m_nBuffers, str, casitive, eolSensitive, xwhite, breakType, byteColoring);
 
 	int i;
 	std::vector<strdiff::wdiff>::iterator it;
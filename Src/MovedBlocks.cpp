@@ -6,89 +6,93 @@
  */
 
 #include "pch.h"
-#include <map>
+#include <algorithm>
 #include <cassert>
+#include <unordered_map>
+#include <vector>
 #include "diff.h"
 
-class IntSet
-{
-public:
-	void Add(int val) { m_map[val] = 1; }
-	void Remove(int val) { m_map.erase(val); }
-	size_t count() const { return m_map.size(); }
-	bool isPresent(int val) const { return m_map.find(val) != m_map.end(); }
-	int getSingle() const { return m_map.begin()->first; }
-private:
-	std::map<int, int> m_map;
-};
-
 /** 
  * @brief  Set of equivalent lines
  * This uses diffutils line numbers, which are counted from the prefix
  */
 struct EqGroup
 {
-	IntSet m_lines0; // equivalent lines on side#0
-	IntSet m_lines1; // equivalent lines on side#1
+	int m_count0 = 0; // number of equivalent lines on side#0
+	int m_count1 = 0; // number of equivalent lines on side#1
+	int m_line0 = -1; // equivalent line on side#0, if only one
+	int m_line1 = -1; // equivalent line on side#1, if only one
 
-	bool isPerfectMatch() const { return m_lines0.count()==1 && m_lines1.count()==1; }
+	bool isPerfectMatch() const { return m_count0==1 && m_count1==1; }
 };
 
-
-/** @brief  Maps equivalency code to equivalency group */
-class CodeToGroupMap
+/**
+ * @brief  Index of equivalency groups of changed lines
+ * Each changed line is mapped to its group with a flat array, so that
+ * finding the group of a line, and testing if a line is in a diff block
+ * at all, take constant time. Splitting diff blocks does not change
+ * which lines are changed, so the index stays valid while the script
+ * is fragmented.
+ */
+class ChangedLineIndex
 {
 public:
-	std::map<int, EqGroup *> m_map;
-	/** @brief Add a line to the appropriate equivalency group */
-	void Add(int lineno, int eqcode, int nside)
+	explicit ChangedLineIndex(const change *script, const file_data fd[])
 	{
-		EqGroup *pgroup = find(eqcode);
-		if (pgroup == nullptr)
+		int nlines[2] = { 0, 0 };
+		size_t nchanged = 0;
+		for (const change *e = script; e; e = e->link)
 		{
-			pgroup = new EqGroup;
-			m_map[eqcode] = pgroup;
+			nlines[0] = (std::max)(nlines[0], e->line0 + e->deleted);
+			nlines[1] = (std::max)(nlines[1], e->line1 + e->inserted);
+			nchanged += e->deleted + e->inserted;
 		}
-		if (nside)
-			pgroup->m_lines1.Add(lineno);
-		else
-			pgroup->m_lines0.Add(lineno);
-	}
+		m_group[0].assign(nlines[0], -1);
+		m_group[1].assign(nlines[1], -1);
 
-	/** @brief Return the appropriate equivalency group */
-	EqGroup * find(int eqcode)
-	{
-		std::map<int, EqGroup *>::const_iterator it = m_map.find(eqcode);
-		return it != m_map.end() ? it->second : nullptr;
+		std::unordered_map<int, int> codeToGroup;
+		codeToGroup.reserve(nchanged);
+		for (const change *e = script; e; e = e->link)
+		{
+			for (int i = e->line0; i - (e->line0) < (e->deleted); ++i)
+				Add(codeToGroup, 0, i, fd[0].equivs[i]);
+			for (int i = e->line1; i - (e->line1) < (e->inserted); ++i)
+				Add(codeToGroup, 1, i, fd[1].equivs[i]);
+		}
 	}
 
-	~CodeToGroupMap()
+	/** @brief Return group of a changed line, or -1 if line is not changed */
+	int groupOf(int nside, int lineno) const
 	{
-		std::map<int, EqGroup *>::const_iterator pos = m_map.begin();
-		while (pos != m_map.end())
-			delete pos++->second;
+		const std::vector<int>& group = m_group[nside];
+		return (lineno >= 0 && lineno < static_cast<int>(group.size())) ? group[lineno] : -1;
 	}
-};
 
-static bool isLineInDiffBlock(int nside, int lineno, change *script)
-{
-	change *p = nullptr;
-	for (change *e = script; e; e = p)
+	const EqGroup& group(int id) const { return m_groups[id]; }
+
+private:
+	void Add(std::unordered_map<int, int>& codeToGroup, int nside, int lineno, int eqcode)
 	{
-		p = e->link;
-		if (nside == 0)
+		auto it = codeToGroup.emplace(eqcode, static_cast<int>(m_groups.size())).first;
+		if (it->second == static_cast<int>(m_groups.size()))
+			m_groups.emplace_back();
+		EqGroup& group = m_groups[it->second];
+		if (nside)
 		{
-			if (e->line0 <= lineno && lineno < e->line0 + e->deleted)
-				return true;
+			++group.m_count1;
+			group.m_line1 = lineno;
 		}
 		else
 		{
-			if (e->line1 <= lineno && lineno < e->line1 + e->inserted)
-				return true;
+			++group.m_count0;
+			group.m_line0 = lineno;
 		}
+		m_group[nside][lineno] = it->second;
 	}
-	return false;
-}
+
+	std::vector<int> m_group[2]; /**< Group of each line of both sides, -1 for unchanged lines */
+	std::vector<EqGroup> m_groups;
+};
 
 /*
  WinMerge moved block code
@@ -102,20 +106,11 @@ static bool isLineInDiffBlock(int nside, int lineno, change *script)
 */
 extern "C" void moved_block_analysis(struct change ** pscript, struct file_data fd[])
 {
-	// Hash all altered lines
-	CodeToGroupMap map;
-
 	struct change * script = *pscript;
 	struct change *p,*e;
-	for (e = script; e; e = p)
-	{
-		p = e->link;
-		int i=0;
-		for (i = e->line0; i - (e->line0) < (e->deleted); ++i)
-			map.Add(i, fd[0].equivs[i], 0);
-		for (i = e->line1; i - (e->line1) < (e->inserted); ++i)
-			map.Add(i, fd[1].equivs[i], 1);
-	}
+
+	// Hash all altered lines
+	const ChangedLineIndex index(script, fd);
 
 
 	// Scan through diff blocks, finding moved sections from left side
@@ -125,14 +120,14 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 	{
 		// scan down block for a match
 		p = e->link;
-		EqGroup * pgroup = nullptr;
+		const EqGroup * pgroup = nullptr;
 		int i=0;
 		for (i=e->line0; i-(e->line0) < (e->deleted); ++i)
 		{
-			EqGroup * tempgroup = map.find(fd[0].equivs[i]);
-			if (tempgroup->isPerfectMatch())
+			const EqGroup & tempgroup = index.group(index.groupOf(0, i));
+			if (tempgroup.isPerfectMatch())
 			{
-				pgroup = tempgroup;
+				pgroup = &tempgroup;
 				break;
 			}
 		}
@@ -142,7 +137,7 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 			continue;
 
 		// found a match
-		int j = pgroup->m_lines1.getSingle();
+		int j = pgroup->m_line1;
 		// Ok, now our moved block is the single line i,j
 
 		// extend moved block upward as far as possible
@@ -150,9 +145,8 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 		int j1 = j-1;
 		for ( ; i1>=e->line0; --i1, --j1)
 		{
-			EqGroup * pgroup0 = map.find(fd[0].equivs[i1]);
-			EqGroup * pgroup1 = map.find(fd[1].equivs[j1]);
-			if (pgroup0 != pgroup1 || !isLineInDiffBlock(1, j1, script))
+			// lines outside diff blocks have no group
+			if (index.groupOf(0, i1) != index.groupOf(1, j1))
 				break;
 //			pgroup0->m_lines0.Remove(i1); // commented out this line although I'm not sure what this line means because this line causes the bug sf.net#2174
 //			pgroup1->m_lines1.Remove(j1);
@@ -166,9 +160,8 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 		int j2 = j+1;
 		for ( ; i2-(e->line0) < (e->deleted); ++i2,++j2)
 		{
-			EqGroup * pgroup0 = map.find(fd[0].equivs[i2]);
-			EqGroup * pgroup1 = map.find(fd[1].equivs[j2]);
-			if (pgroup0 != pgroup1 || !isLineInDiffBlock(1, j2, script))
+			// lines outside diff blocks have no group
+			if (index.groupOf(0, i2) != index.groupOf(1, j2))
 				break;
 //			pgroup0->m_lines0.Remove(i2); // commented out this line although I'm not sure what this line means because this line causes the bug sf.net#2174
 //			pgroup1->m_lines1.Remove(j2);
@@ -243,14 +236,14 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 	{
 		// scan down block for a match
 		p = e->link;
-		EqGroup * pgroup = nullptr;
+		const EqGroup * pgroup = nullptr;
 		int j=0;
 		for (j=e->line1; j-(e->line1) < (e->inserted); ++j)
 		{
-			EqGroup * tempgroup = map.find(fd[1].equivs[j]);
-			if (tempgroup->isPerfectMatch())
+			const EqGroup & tempgroup = index.group(index.groupOf(1, j));
+			if (tempgroup.isPerfectMatch())
 			{
-				pgroup = tempgroup;
+				pgroup = &tempgroup;
 				break;
 			}
 		}
@@ -260,7 +253,7 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 			continue;
 
 		// found a match
-		int i = pgroup->m_lines0.getSingle();
+		int i = pgroup->m_line0;
 		// Ok, now our moved block is the single line i,j
 
 		// extend moved block upward as far as possible
@@ -268,9 +261,8 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 		int j1 = j-1;
 		for ( ; j1>=e->line1; --i1, --j1)
 		{
-			EqGroup * pgroup0 = map.find(fd[0].equivs[i1]);
-			EqGroup * pgroup1 = map.find(fd[1].equivs[j1]);
-			if (pgroup0 != pgroup1 || !isLineInDiffBlock(0, i1, script))
+			// lines outside diff blocks have no group
+			if (index.groupOf(0, i1) != index.groupOf(1, j1))
 				break;
 //			pgroup0->m_lines0.Remove(i1); // commented out this line although I'm not sure what this line means because this line causes the bug sf.net#2174
 //			pgroup1->m_lines1.Remove(j1);
@@ -284,9 +276,8 @@ extern "C" void moved_block_analysis(struct change ** pscript, struct file_data
 		int j2 = j+1;
 		for ( ; j2-(e->line1) < (e->inserted); ++i2,++j2)
 		{
-			EqGroup * pgroup0 = map.find(fd[0].equivs[i2]);
-			EqGroup * pgroup1 = map.find(fd[1].equivs[j2]);
-			if (pgroup0 != pgroup1 || !isLineInDiffBlock(0, i2, script))
+			// lines outside diff blocks have no group
+			if (index.groupOf(0, i2) != index.groupOf(1, j2))
 				break;
 //			pgroup0->m_lines0.Remove(i2); // commented out this line although I'm not sure what this line means because this line causes the bug sf.net#2174
 //			pgroup1->m_lines1.Remove(j2);
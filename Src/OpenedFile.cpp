@@ -0,0 +1,185 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  OpenedFile.cpp
+ *
+ * @brief Implementation of OpenedFile class
+ */
+
+#include "pch.h"
+#include "OpenedFile.h"
+#include <algorithm>
+#include <cstdlib>
+#include <climits>
+#include <io.h>
+#include <fcntl.h>
+#include "TFile.h"
+#include "paths.h"
+#include "codepage_detect.h"
+#include "DebugNew.h"
+
+OpenedFile::OpenedFile()
+: m_fd(-1)
+, m_buffer(nullptr)
+, m_capacity(0)
+, m_size(0)
+, m_offset(0)
+, m_bEof(false)
+, m_bEncodingGuessed(false)
+, m_guessEncodingType(0)
+{
+}
+
+OpenedFile::~OpenedFile()
+{
+	Close();
+}
+
+/**
+ * @brief Open file for reading, closing previously opened file.
+ * @param [in] path Path of file to open.
+ * @return true if file was opened.
+ */
+bool OpenedFile::Open(const String& path)
+{
+	Close();
+	// Always use binary mode, to avoid terminating file read on ctrl-Z (DOS EOF)
+	_tsopen_s(&m_fd, TFile(path).wpath().c_str(), O_BINARY | O_RDONLY, _SH_DENYNO, _S_IREAD);
+	if (m_fd == -1)
+		return false;
+	m_path = path;
+	return true;
+}
+
+/**
+ * @brief Close file and free buffer.
+ */
+void OpenedFile::Close()
+{
+	if (m_fd != -1)
+		_close(m_fd);
+	free(m_buffer);
+	m_fd = -1;
+	m_buffer = nullptr;
+	m_capacity = 0;
+	m_size = 0;
+	m_offset = 0;
+	m_bEof = false;
+	m_bEncodingGuessed = false;
+	m_path.clear();
+}
+
+/**
+ * @brief Read next bytes of file to the end of buffer.
+ * @param [in] len Number of bytes to read.
+ * @return Number of bytes read, 0 at end of file, -1 on error.
+ */
+int OpenedFile::Read(size_t len)
+{
+	if (m_fd == -1)
+		return -1;
+	len = (std::min)(len, static_cast<size_t>(INT_MAX));
+	if (m_size + len > m_capacity)
+	{
+		const size_t capacity = (std::max)(m_size + len, m_capacity * 2);
+		char *buffer = static_cast<char *>(realloc(m_buffer, capacity));
+		if (buffer == nullptr)
+			return -1;
+		m_buffer = buffer;
+		m_capacity = capacity;
+	}
+	size_t total = 0;
+	while (total < len)
+	{
+		const int n = _read(m_fd, m_buffer + m_size + total, static_cast<unsigned>(len - total));
+		if (n < 0)
+			return -1;
+		if (n == 0)
+		{
+			m_bEof = true;
+			break;
+		}
+		total += n;
+	}
+	m_size += total;
+	return static_cast<int>(total);
+}
+
+/**
+ * @brief Drop buffered bytes, next Read() continues from current position.
+ */
+void OpenedFile::Discard()
+{
+	m_offset += m_size;
+	m_size = 0;
+}
+
+/**
+ * @brief Move back to beginning of file and drop buffered bytes.
+ */
+bool OpenedFile::Rewind()
+{
+	if (m_fd == -1)
+		return false;
+	if (_lseeki64(m_fd, 0, SEEK_SET) != 0)
+		return false;
+	m_offset = 0;
+	m_size = 0;
+	m_bEof = false;
+	return true;
+}
+
+/**
+ * @brief Guess encoding of file from the file head.
+ * The result is remembered, so later calls don't read the file again.
+ * The head is read to the buffer if it is not there yet.
+ * @param [in] guessEncodingType Try to guess codepage (not just unicode encoding).
+ */
+FileTextEncoding OpenedFile::GuessEncoding(int guessEncodingType)
+{
+	if (m_bEncodingGuessed && m_guessEncodingType == guessEncodingType)
+		return m_encoding;
+	if (HasHead() && (m_size < codepage_detect::BufSize && !m_bEof))
+		Read(codepage_detect::BufSize - m_size);
+	if (HasHead())
+		m_encoding = codepage_detect::Guess(paths::FindExtension(m_path), m_buffer,
+			(std::min)(m_size, static_cast<size_t>(codepage_detect::BufSize)), guessEncodingType,
+			m_size > static_cast<size_t>(codepage_detect::BufSize) || !m_bEof);
+	else
+		m_encoding = codepage_detect::Guess(m_path, guessEncodingType);
+	m_bEncodingGuessed = true;
+	m_guessEncodingType = guessEncodingType;
+	return m_encoding;
+}
+
+/**
+ * @brief Hand descriptor and buffer over to the caller.
+ * The caller must close the descriptor and free() the buffer. If the buffer
+ * doesn't start from beginning of the file, the file is rewound first so
+ * that the caller can always read it from the start.
+ * @param [out] fd File descriptor, positioned after the buffered bytes.
+ * @param [out] buffer Buffered bytes from beginning of the file, or nullptr
+ *   if nothing was read yet.
+ * @param [out] bufsize Allocated size of buffer.
+ * @param [out] buffered Number of bytes in buffer.
+ * @return false if file could not be rewound, file stays open then.
+ */
+bool OpenedFile::Detach(int& fd, char*& buffer, size_t& bufsize, size_t& buffered)
+{
+	if (!HasHead() && !Rewind())
+		return false;
+	if (m_size == 0 && !m_bEof)
+	{
+		// Nothing read yet, let the caller allocate its own buffer
+		free(m_buffer);
+		m_buffer = nullptr;
+		m_capacity = 0;
+	}
+	fd = m_fd;
+	buffer = m_buffer;
+	bufsize = m_capacity;
+	buffered = m_size;
+	m_fd = -1;
+	m_buffer = nullptr;
+	Close();
+	return true;
+}
@@ -0,0 +1,64 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  OpenedFile.h
+ *
+ * @brief Declaration of OpenedFile class
+ */
+#pragma once
+
+#include <cstdint>
+#include "UnicodeString.h"
+#include "FileTextEncoding.h"
+
+/**
+ * @brief File opened once for the whole compare pipeline.
+ *
+ * Folder compare used to open and read each file several times: the
+ * byte compare, encoding detection (which maps the file head) and
+ * diffutils (which opens the file again and reads it all). This class
+ * keeps the descriptor open and the bytes read so far in one buffer, so
+ * that each step continues from where the previous one stopped:
+ * - Read() appends to the buffer, Discard() drops buffered bytes when
+ *   only streaming is needed
+ * - GuessEncoding() detects the encoding from the buffered file head
+ *   and remembers the result
+ * - Detach() hands descriptor and buffer over to diffutils, which reads
+ *   the rest of the file from the current position
+ */
+class OpenedFile
+{
+public:
+	OpenedFile();
+	~OpenedFile();
+	bool Open(const String& path);
+	void Close();
+	bool IsOpen() const { return m_fd != -1; }
+	const String& GetPath() const { return m_path; }
+
+	int Read(size_t len);
+	void Discard();
+	bool Rewind();
+	const char *GetData() const { return m_buffer; }
+	size_t GetSize() const { return m_size; }
+	/** @brief Does buffer start from beginning of the file? */
+	bool HasHead() const { return m_offset == 0; }
+	bool IsEof() const { return m_bEof; }
+
+	FileTextEncoding GuessEncoding(int guessEncodingType);
+	bool Detach(int& fd, char*& buffer, size_t& bufsize, size_t& buffered);
+
+private:
+	OpenedFile(const OpenedFile&) = delete;
+	OpenedFile& operator=(const OpenedFile&) = delete;
+
+	String m_path;
+	int m_fd;
+	char *m_buffer; /**< Allocated with malloc(), diffutils frees it after Detach() */
+	size_t m_capacity;
+	size_t m_size; /**< Bytes in buffer */
+	int64_t m_offset; /**< File offset of first byte in buffer */
+	bool m_bEof;
+	bool m_bEncodingGuessed;
+	int m_guessEncodingType; /**< Detection type m_encoding was guessed with */
+	FileTextEncoding m_encoding;
+};
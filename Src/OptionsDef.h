@@ -83,6 +83,8 @@ extern const String OPT_ALLOW_MIXED_EOL OP("Settings/AllowMixedEOL");
 extern const String OPT_COPY_FULL_LINE OP("Settings/CopyFullLine");
 extern const String OPT_TAB_SIZE OP("Settings/TabSize");
 extern const String OPT_TAB_TYPE OP("Settings/TabType");
+// Memory in MB undo history of a file may take before older history is moved to a temp file, hidden option
+extern const String OPT_UNDO_MEMORY_LIMIT OP("Settings/UndoMemoryLimit");
 extern const String OPT_WORDWRAP OP("Settings/WordWrap");
 extern const String OPT_VIEW_LINENUMBERS OP("Settings/ViewLineNumbers");
 extern const String OPT_VIEW_FILEMARGIN OP("Settings/ViewFileMargin");
@@ -204,12 +206,16 @@ extern const String OPT_CMP_IGNORE_CODEPAGE OP("Settings/IgnoreCodepage");
 extern const String OPT_CMP_METHOD OP("Settings/CompMethod2");
 extern const String OPT_CMP_MOVED_BLOCKS OP("Settings/MovedBlocks");
 extern const String OPT_CMP_MATCH_SIMILAR_LINES OP("Settings/MatchSimilarLines");
+extern const String OPT_CMP_MATCH_SIMILAR_LINES_MAX_TIME OP("Settings/MatchSimilarLinesMaxTime");
 extern const String OPT_CMP_STOP_AFTER_FIRST OP("Settings/StopAfterFirst");
 extern const String OPT_CMP_QUICK_LIMIT OP("Settings/QuickMethodLimit");
 extern const String OPT_CMP_BINARY_LIMIT OP("Settings/BinaryMethodLimit");
+extern const String OPT_CMP_STREAMING_LIMIT OP("Settings/StreamingMethodLimit");
 extern const String OPT_CMP_COMPARE_THREADS OP("Settings/CompareThreads");
+extern const String OPT_CMP_IO_SCHEDULING OP("Settings/CompareIOScheduling");
 extern const String OPT_CMP_WALK_UNIQUE_DIRS OP("Settings/ScanUnpairedDir");
 extern const String OPT_CMP_IGNORE_REPARSE_POINTS OP("Settings/IgnoreReparsePoints");
+extern const String OPT_CMP_WATCH_FOLDERS OP("Settings/WatchFolders");
 extern const String OPT_CMP_INCLUDE_SUBDIRS OP("Settings/Recurse");
 extern const String OPT_CMP_DIFF_ALGORITHM OP("Settings/DiffAlgorithm");
 extern const String OPT_CMP_INDENT_HEURISTIC OP("Settings/IndentHeuristic");
@@ -242,6 +248,8 @@ extern const String OPT_CMP_DSV_FILEPATTERNS OP("Settings/DSVFilePatterns");
 extern const String OPT_CMP_DSV_DELIM_CHAR   OP("Settings/DSVDelimiterCharacter");
 extern const String OPT_CMP_TBL_ALLOW_NEWLINES_IN_QUOTES OP("Settings/TableAllowNewlinesInQuotes");
 extern const String OPT_CMP_TBL_QUOTE_CHAR   OP("Settings/TableQuoteCharacter");
+extern const String OPT_CMP_TBL_MATCH_ROWS   OP("Settings/TableMatchRows");
+extern const String OPT_CMP_TBL_KEY_COLUMN   OP("Settings/TableKeyColumn");
 
 /// Are regular expression linefilters enabled?
 extern const String OPT_LINEFILTER_ENABLED OP("Settings/IgnoreRegExp");
@@ -113,6 +113,7 @@ void Init(COptionsMgr *pOptions)
 	pOptions->InitOption(OPT_COPY_FULL_LINE, false);
 	pOptions->InitOption(OPT_TAB_SIZE, (int)4);
 	pOptions->InitOption(OPT_TAB_TYPE, (int)0);	// 0 means tabs inserted
+	pOptions->InitOption(OPT_UNDO_MEMORY_LIMIT, 64); // MB, 0 for no limit
 
 	pOptions->InitOption(OPT_EXT_EDITOR_CMD, _T("%windir%\\NOTEPAD.EXE"));
 	pOptions->InitOption(OPT_USE_RECYCLE_BIN, true);
@@ -132,12 +133,16 @@ void Init(COptionsMgr *pOptions)
 	pOptions->InitOption(OPT_CMP_METHOD, (int)CMP_CONTENT);
 	pOptions->InitOption(OPT_CMP_MOVED_BLOCKS, false);
 	pOptions->InitOption(OPT_CMP_MATCH_SIMILAR_LINES, false);
+	pOptions->InitOption(OPT_CMP_MATCH_SIMILAR_LINES_MAX_TIME, 2000); // milliseconds
 	pOptions->InitOption(OPT_CMP_STOP_AFTER_FIRST, false);
 	pOptions->InitOption(OPT_CMP_QUICK_LIMIT, 4 * 1024 * 1024); // 4 Megs
 	pOptions->InitOption(OPT_CMP_BINARY_LIMIT, 64 * 1024 * 1024); // 64 Megs
+	pOptions->InitOption(OPT_CMP_STREAMING_LIMIT, 1024); // Megs, 0 disables
 	pOptions->InitOption(OPT_CMP_COMPARE_THREADS, -1);
+	pOptions->InitOption(OPT_CMP_IO_SCHEDULING, true);
 	pOptions->InitOption(OPT_CMP_WALK_UNIQUE_DIRS, true);
 	pOptions->InitOption(OPT_CMP_IGNORE_REPARSE_POINTS, false);
+	pOptions->InitOption(OPT_CMP_WATCH_FOLDERS, false);
 	pOptions->InitOption(OPT_CMP_IGNORE_CODEPAGE, false);
 	pOptions->InitOption(OPT_CMP_INCLUDE_SUBDIRS, true);
 	pOptions->InitOption(OPT_CMP_ENABLE_IMGCMP_IN_DIRCMP, false);
@@ -150,6 +155,8 @@ void Init(COptionsMgr *pOptions)
 	pOptions->InitOption(OPT_CMP_DSV_DELIM_CHAR, _T(";"));
 	pOptions->InitOption(OPT_CMP_TBL_ALLOW_NEWLINES_IN_QUOTES, true);
 	pOptions->InitOption(OPT_CMP_TBL_QUOTE_CHAR, _T("\""));
+	pOptions->InitOption(OPT_CMP_TBL_MATCH_ROWS, false);
+	pOptions->InitOption(OPT_CMP_TBL_KEY_COLUMN, 1); // 0 for all columns
 
 	pOptions->InitOption(OPT_CMP_IMG_FILEPATTERNS, _T("*.bmp;*.cut;*.dds;*.exr;*.g3;*.gif;*.hdr;*.ico;*.iff;*.lbm;*.j2k;*.j2c;*.jng;*.jp2;*.jpg;*.jif;*.jpeg;*.jpe;*.jxr;*.wdp;*.hdp;*.koa;*.mng;*.pcd;*.pcx;*.pfm;*.pct;*.pict;*.pic;*.png;*.pbm;*.pgm;*.ppm;*.psd;*.ras;*.sgi;*.rgb;*.rgba;*.bw;*.tga;*.targa;*.tif;*.tiff;*.wap;*.wbmp;*.wbm;*.webp;*.xbm;*.xpm"));
 	pOptions->InitOption(OPT_CMP_IMG_SHOWDIFFERENCES, true);
@@ -0,0 +1,70 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  ParallelFor.h
+ *
+ * @brief Declaration of ParallelFor() helper
+ */
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <Poco/Environment.h>
+#include <Poco/Thread.h>
+
+namespace parallel
+{
+/** @brief Work items below which ParallelFor() starts no threads. */
+inline constexpr int64_t MinWork = 32768;
+
+/** @brief Does ParallelFor() run all work on the calling thread? */
+inline thread_local bool bSerialThread = false;
+
+/**
+ * @brief Make ParallelFor() start no threads from this thread while in scope.
+ * For threads which already run beside others, like the folder compare
+ * workers, so that they don't start more threads than there are processors.
+ */
+class SerialScope
+{
+public:
+	explicit SerialScope(bool bSerial = true) : m_bPrevious(bSerialThread) { bSerialThread = bSerialThread || bSerial; }
+	~SerialScope() { bSerialThread = m_bPrevious; }
+
+private:
+	SerialScope(const SerialScope&) = delete;
+	SerialScope& operator=(const SerialScope&) = delete;
+	bool m_bPrevious;
+};
+}
+
+/**
+ * @brief Run fn(begin, end) over [0, count) split to one range per processor.
+ * Nothing runs in parallel inside a parallel::SerialScope, or inside fn.
+ * @param [in] work Estimated amount of work, small jobs are run on this thread.
+ */
+template<typename Function>
+void ParallelFor(int count, int64_t work, Function fn)
+{
+	int nthreads = static_cast<int>((std::min)(Poco::Environment::processorCount(), 8u));
+	if (parallel::bSerialThread || work < parallel::MinWork || nthreads < 2 || count < nthreads)
+	{
+		fn(0, count);
+		return;
+	}
+	std::vector<std::unique_ptr<Poco::Thread>> threads;
+	for (int t = 1; t < nthreads; ++t)
+	{
+		const int begin = static_cast<int>(static_cast<int64_t>(count) * t / nthreads);
+		const int end = static_cast<int>(static_cast<int64_t>(count) * (t + 1) / nthreads);
+		threads.emplace_back(new Poco::Thread());
+		threads.back()->startFunc([fn, begin, end]() { parallel::SerialScope serial; fn(begin, end); });
+	}
+	{
+		parallel::SerialScope serial;
+		fn(0, count / nthreads);
+	}
+	for (auto& thread : threads)
+		thread->join();
+}
@@ -337,11 +337,11 @@ int CPatchTool::GetItemsForPatchList(const PathContext& paths, const String subd
 
 		unsigned nDiffCode = DIFFCODE::DIR;
 		// Comparing directories leftDirs[i].name to rightDirs[j].name
-		if (i < dirs[0].size() && (j == dirs[1].size() || collstr(dirs[0][i].filename, dirs[1][j].filename, false) < 0))
+		if (i < dirs[0].size() && (j == dirs[1].size() || collkeycmp(dirs[0][i], dirs[1][j]) < 0))
 		{
 			nDiffCode |= DIFFCODE::FIRST;
 		}
-		else if (j < dirs[1].size() && (i == dirs[0].size() || collstr(dirs[1][j].filename, dirs[0][i].filename, false) < 0))
+		else if (j < dirs[1].size() && (i == dirs[0].size() || collkeycmp(dirs[1][j], dirs[0][i]) < 0))
 		{
 			nDiffCode |= DIFFCODE::SECOND;
 		}
@@ -370,13 +370,13 @@ int CPatchTool::GetItemsForPatchList(const PathContext& paths, const String subd
 	while (true)
 	{
 		// Comparing file aFiles[0][i].name to aFiles[1][j].name
-		if (i < aFiles[0].size() && (j == aFiles[1].size() || collstr(aFiles[0][i].filename, aFiles[1][j].filename, false) < 0))
+		if (i < aFiles[0].size() && (j == aFiles[1].size() || collkeycmp(aFiles[0][i], aFiles[1][j]) < 0))
 		{
 			AddFilesToList(subdir[0], subdir[1], &aFiles[0][i], nullptr, fileList);
 			++i;
 			continue;
 		}
-		if (j < aFiles[1].size() && (i == aFiles[0].size() || collstr(aFiles[0][i].filename, aFiles[1][j].filename, false) > 0))
+		if (j < aFiles[1].size() && (i == aFiles[0].size() || collkeycmp(aFiles[0][i], aFiles[1][j]) > 0))
 		{
 			AddFilesToList(subdir[0], subdir[1], nullptr, &aFiles[1][j], fileList);
 			++j;
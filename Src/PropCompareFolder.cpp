@@ -29,8 +29,10 @@ PropCompareFolder::PropCompareFolder(COptionsMgr *optionsMgr)
  , m_bIncludeSubdirs(false)
  , m_bExpandSubdirs(false)
  , m_bIgnoreReparsePoints(false)
+ , m_bWatchFolders(false)
  , m_nQuickCompareLimit(4 * Mega)
  , m_nBinaryCompareLimit(64 * Mega)
+ , m_nStreamingCompareLimit(1024)
  , m_nCompareThreads(-1)
 {
 }
@@ -46,8 +48,10 @@ void PropCompareFolder::DoDataExchange(CDataExchange* pDX)
 	DDX_Check(pDX, IDC_RECURS_CHECK, m_bIncludeSubdirs);
 	DDX_Check(pDX, IDC_EXPAND_SUBDIRS, m_bExpandSubdirs);
 	DDX_Check(pDX, IDC_IGNORE_REPARSEPOINTS, m_bIgnoreReparsePoints);
+	DDX_Check(pDX, IDC_COMPARE_WATCH_FOLDERS, m_bWatchFolders);
 	DDX_Text(pDX, IDC_COMPARE_QUICKC_LIMIT, m_nQuickCompareLimit);
 	DDX_Text(pDX, IDC_COMPARE_BINARYC_LIMIT, m_nBinaryCompareLimit);
+	DDX_Text(pDX, IDC_COMPARE_STREAMING_LIMIT, m_nStreamingCompareLimit);
 	DDX_Text(pDX, IDC_COMPARE_THREAD_COUNT, m_nCompareThreads);
 	//}}AFX_DATA_MAP
 	UpdateControls();
@@ -76,8 +80,10 @@ void PropCompareFolder::ReadOptions()
 	m_bIncludeSubdirs = GetOptionsMgr()->GetBool(OPT_CMP_INCLUDE_SUBDIRS);
 	m_bExpandSubdirs = GetOptionsMgr()->GetBool(OPT_DIRVIEW_EXPAND_SUBDIRS);
 	m_bIgnoreReparsePoints = GetOptionsMgr()->GetBool(OPT_CMP_IGNORE_REPARSE_POINTS);
+	m_bWatchFolders = GetOptionsMgr()->GetBool(OPT_CMP_WATCH_FOLDERS);
 	m_nQuickCompareLimit = GetOptionsMgr()->GetInt(OPT_CMP_QUICK_LIMIT) / Mega ;
 	m_nBinaryCompareLimit = GetOptionsMgr()->GetInt(OPT_CMP_BINARY_LIMIT) / Mega ;
+	m_nStreamingCompareLimit = GetOptionsMgr()->GetInt(OPT_CMP_STREAMING_LIMIT);
 	m_nCompareThreads = GetOptionsMgr()->GetInt(OPT_CMP_COMPARE_THREADS);
 }
 
@@ -95,6 +101,7 @@ void PropCompareFolder::WriteOptions()
 	GetOptionsMgr()->SaveOption(OPT_CMP_INCLUDE_SUBDIRS, m_bIncludeSubdirs);
 	GetOptionsMgr()->SaveOption(OPT_DIRVIEW_EXPAND_SUBDIRS, m_bExpandSubdirs);
 	GetOptionsMgr()->SaveOption(OPT_CMP_IGNORE_REPARSE_POINTS, m_bIgnoreReparsePoints);
+	GetOptionsMgr()->SaveOption(OPT_CMP_WATCH_FOLDERS, m_bWatchFolders);
 
 	if (m_nQuickCompareLimit > 2000)
 		m_nQuickCompareLimit = 2000;
@@ -102,6 +109,7 @@ void PropCompareFolder::WriteOptions()
 	if (m_nBinaryCompareLimit > 2000)
 		m_nBinaryCompareLimit = 2000;
 	GetOptionsMgr()->SaveOption(OPT_CMP_BINARY_LIMIT, m_nBinaryCompareLimit * Mega);
+	GetOptionsMgr()->SaveOption(OPT_CMP_STREAMING_LIMIT, m_nStreamingCompareLimit);
 	GetOptionsMgr()->SaveOption(OPT_CMP_COMPARE_THREADS, m_nCompareThreads);
 }
 
@@ -142,8 +150,10 @@ void PropCompareFolder::OnDefaults()
 	m_bIncludeSubdirs = GetOptionsMgr()->GetDefault<bool>(OPT_CMP_INCLUDE_SUBDIRS);
 	m_bExpandSubdirs = GetOptionsMgr()->GetDefault<bool>(OPT_DIRVIEW_EXPAND_SUBDIRS);
 	m_bIgnoreReparsePoints = GetOptionsMgr()->GetDefault<bool>(OPT_CMP_IGNORE_REPARSE_POINTS);
+	m_bWatchFolders = GetOptionsMgr()->GetDefault<bool>(OPT_CMP_WATCH_FOLDERS);
 	m_nQuickCompareLimit = GetOptionsMgr()->GetDefault<unsigned>(OPT_CMP_QUICK_LIMIT) / Mega;
 	m_nBinaryCompareLimit = GetOptionsMgr()->GetDefault<unsigned>(OPT_CMP_BINARY_LIMIT) / Mega;
+	m_nStreamingCompareLimit = GetOptionsMgr()->GetDefault<unsigned>(OPT_CMP_STREAMING_LIMIT);
 	m_nCompareThreads = GetOptionsMgr()->GetDefault<unsigned>(OPT_CMP_COMPARE_THREADS);
 	UpdateData(FALSE);
 }
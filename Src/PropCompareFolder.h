@@ -42,8 +42,10 @@ public:
 	bool    m_bIncludeSubdirs;
 	bool    m_bExpandSubdirs;
 	bool    m_bIgnoreReparsePoints;
+	bool    m_bWatchFolders;
 	unsigned m_nQuickCompareLimit;
 	unsigned m_nBinaryCompareLimit;
+	unsigned m_nStreamingCompareLimit;
 	int     m_nCompareThreads;
 	//}}AFX_DATA
 
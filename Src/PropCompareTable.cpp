@@ -24,6 +24,8 @@ PropCompareTable::PropCompareTable(COptionsMgr *optionsMgr)
 , m_bAllowNewlinesInQuotes(true)
 , m_sDSVDelimiterChar(_T(";"))
 , m_sQuoteChar(_T("\""))
+, m_bMatchRows(false)
+, m_nKeyColumn(1)
 {
 }
 
@@ -40,6 +42,8 @@ void PropCompareTable::DoDataExchange(CDataExchange* pDX)
 	DDX_Text(pDX, IDC_COMPARETABLE_DSV_DELIM_CHAR, m_sDSVDelimiterChar);
 	DDX_Check(pDX, IDC_COMPARETABLE_ALLOWNEWLINE, m_bAllowNewlinesInQuotes);
 	DDX_Text(pDX, IDC_COMPARETABLE_QUOTE_CHAR, m_sQuoteChar);
+	DDX_Check(pDX, IDC_COMPARETABLE_MATCH_ROWS, m_bMatchRows);
+	DDX_Text(pDX, IDC_COMPARETABLE_KEY_COLUMN, m_nKeyColumn);
 	//}}AFX_DATA_MAP
 }
 
@@ -69,6 +73,8 @@ void PropCompareTable::ReadOptions()
 	m_sDSVDelimiterChar = GetOptionsMgr()->GetString(OPT_CMP_DSV_DELIM_CHAR).substr(0, 1);
 	m_bAllowNewlinesInQuotes = GetOptionsMgr()->GetBool(OPT_CMP_TBL_ALLOW_NEWLINES_IN_QUOTES);
 	m_sQuoteChar = GetOptionsMgr()->GetString(OPT_CMP_TBL_QUOTE_CHAR).substr(0, 1);
+	m_bMatchRows = GetOptionsMgr()->GetBool(OPT_CMP_TBL_MATCH_ROWS);
+	m_nKeyColumn = GetOptionsMgr()->GetInt(OPT_CMP_TBL_KEY_COLUMN);
 }
 
 /** 
@@ -87,6 +93,8 @@ void PropCompareTable::WriteOptions()
 	GetOptionsMgr()->SaveOption(OPT_CMP_DSV_DELIM_CHAR, m_sDSVDelimiterChar.substr(0, 1));
 	GetOptionsMgr()->SaveOption(OPT_CMP_TBL_ALLOW_NEWLINES_IN_QUOTES, m_bAllowNewlinesInQuotes);
 	GetOptionsMgr()->SaveOption(OPT_CMP_TBL_QUOTE_CHAR, m_sQuoteChar.substr(0, 1));
+	GetOptionsMgr()->SaveOption(OPT_CMP_TBL_MATCH_ROWS, m_bMatchRows);
+	GetOptionsMgr()->SaveOption(OPT_CMP_TBL_KEY_COLUMN, m_nKeyColumn);
 }
 
 /** 
@@ -100,6 +108,8 @@ void PropCompareTable::OnDefaults()
 	m_sDSVDelimiterChar = GetOptionsMgr()->GetDefault<String>(OPT_CMP_DSV_DELIM_CHAR);
 	m_bAllowNewlinesInQuotes = GetOptionsMgr()->GetDefault<bool>(OPT_CMP_TBL_ALLOW_NEWLINES_IN_QUOTES);
 	m_sQuoteChar = GetOptionsMgr()->GetDefault<String>(OPT_CMP_TBL_QUOTE_CHAR);
+	m_bMatchRows = GetOptionsMgr()->GetDefault<bool>(OPT_CMP_TBL_MATCH_ROWS);
+	m_nKeyColumn = GetOptionsMgr()->GetDefault<unsigned>(OPT_CMP_TBL_KEY_COLUMN);
 	UpdateData(FALSE);
 }
 
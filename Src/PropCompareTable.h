@@ -35,6 +35,8 @@ public:
 	String m_sDSVDelimiterChar;
 	bool m_bAllowNewlinesInQuotes;
 	String m_sQuoteChar;
+	bool m_bMatchRows;
+	int m_nKeyColumn;
 	//}}AFX_DATA
 
 
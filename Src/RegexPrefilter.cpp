@@ -0,0 +1,192 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  RegexPrefilter.cpp
+ *
+ * @brief Implementation of RegexPrefilter class
+ */
+
+#include "pch.h"
+#include "RegexPrefilter.h"
+#include <cstring>
+#include <string_view>
+#include <Poco/RegularExpression.h>
+#include "DebugNew.h"
+
+using Poco::RegularExpression;
+
+static inline char AsciiToLower(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+RegexPrefilter::RegexPrefilter(const std::string& pattern, int regexpCompileOptions)
+	: m_literal(FindRequiredLiteral(pattern, regexpCompileOptions))
+	, m_bCaseless((regexpCompileOptions & RegularExpression::RE_CASELESS) != 0)
+{
+}
+
+/**
+ * @brief Find the longest literal text every match of a pattern contains.
+ * Only the top level of the pattern is looked at: groups and character
+ * classes end a literal run, and a quantifier allowing zero repeats drops
+ * the character before it.
+ * @return Literal, in lower case for caseless patterns. Empty if the
+ * pattern has no literal or is not understood.
+ */
+std::string RegexPrefilter::FindRequiredLiteral(const std::string& pattern, int regexpCompileOptions)
+{
+	if (regexpCompileOptions & RegularExpression::RE_EXTENDED)
+		return std::string();
+	const bool bCaseless = (regexpCompileOptions & RegularExpression::RE_CASELESS) != 0;
+
+	std::string best, run;
+	auto flush = [&best, &run]()
+	{
+		if (run.length() > best.length())
+			best = run;
+		run.clear();
+	};
+	const size_t len = pattern.length();
+	int depth = 0;
+	for (size_t i = 0; i < len; ++i)
+	{
+		const char c = pattern[i];
+		if (c == '\\')
+		{
+			if (++i >= len)
+				return std::string();
+			const char e = pattern[i];
+			if (strchr("QEcxopPNgku0123456789", e) != nullptr)
+				return std::string(); // escapes with arguments or changing meaning
+			if (depth > 0)
+				continue;
+			if (e == 't' || e == 'n' || e == 'r' || e == 'f')
+				run += (e == 't') ? '\t' : (e == 'n') ? '\n' : (e == 'r') ? '\r' : '\f';
+			else if ((e >= 'a' && e <= 'z') || (e >= 'A' && e <= 'Z'))
+				flush(); // \d, \w, \b etc.
+			else if (bCaseless && (static_cast<unsigned char>(e) >= 0x80))
+				flush();
+			else
+				run += bCaseless ? AsciiToLower(e) : e;
+			continue;
+		}
+		if (c == '[')
+		{
+			// Skip character class, a ']' right after '[' or '[^' is literal
+			size_t j = i + 1;
+			if (j < len && pattern[j] == '^')
+				++j;
+			if (j < len && pattern[j] == ']')
+				++j;
+			for (; j < len && pattern[j] != ']'; ++j)
+			{
+				if (pattern[j] == '\\')
+					++j;
+				else if (pattern[j] == '[' && j + 1 < len && pattern[j + 1] == ':')
+				{
+					const size_t close = pattern.find(":]", j + 2);
+					if (close != std::string::npos)
+						j = close + 1;
+				}
+			}
+			if (j >= len)
+				return std::string();
+			i = j;
+			if (depth == 0)
+				flush();
+			continue;
+		}
+		if (c == '(')
+		{
+			if (i + 1 < len && pattern[i + 1] == '?')
+				return std::string(); // inline options, lookarounds etc.
+			if (depth++ == 0)
+				flush();
+			continue;
+		}
+		if (c == ')')
+		{
+			if (--depth < 0)
+				return std::string();
+			continue;
+		}
+		if (c == '|')
+		{
+			if (depth == 0)
+				return std::string();
+			continue;
+		}
+		if (depth > 0)
+			continue;
+		switch (c)
+		{
+		case '?': case '*':
+			if (!run.empty())
+				run.pop_back();
+			flush();
+			break;
+		case '{':
+		{
+			const size_t close = pattern.find('}', i);
+			const std::string_view bounds = close != std::string::npos ?
+				std::string_view(pattern).substr(i + 1, close - i - 1) : std::string_view();
+			if (!bounds.empty() && bounds.find_first_not_of("0123456789,") == std::string_view::npos && bounds[0] != ',')
+			{
+				// {n}, {n,} or {n,m}, the character stays required only if n > 0
+				if (!run.empty() && bounds.find_first_not_of('0') != 0)
+					run.pop_back();
+				flush();
+				i = close;
+			}
+			else
+				run += c; // not a quantifier
+			break;
+		}
+		case '+':
+			flush();
+			break;
+		case '.': case '^': case '$':
+			flush();
+			break;
+		default:
+			if (bCaseless && static_cast<unsigned char>(c) >= 0x80)
+				flush();
+			else
+				run += bCaseless ? AsciiToLower(c) : c;
+			break;
+		}
+	}
+	if (depth != 0)
+		return std::string();
+	flush();
+	return best;
+}
+
+/**
+ * @brief Can the pattern match in text?
+ * @return false only if the text lacks the required literal.
+ */
+bool RegexPrefilter::MayMatch(const char *text, size_t len) const
+{
+	const size_t n = m_literal.length();
+	if (n == 0)
+		return true;
+	if (len < n)
+		return false;
+	if (!m_bCaseless)
+		return std::string_view(text, len).find(m_literal) != std::string_view::npos;
+
+	const char first = m_literal[0];
+	const char firstUpper = (first >= 'a' && first <= 'z') ? static_cast<char>(first - 'a' + 'A') : first;
+	for (const char *p = text, *last = text + len - n; p <= last; ++p)
+	{
+		if (*p != first && *p != firstUpper)
+			continue;
+		size_t k = 1;
+		while (k < n && AsciiToLower(p[k]) == m_literal[k])
+			++k;
+		if (k == n)
+			return true;
+	}
+	return false;
+}
@@ -0,0 +1,37 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  RegexPrefilter.h
+ *
+ * @brief Declaration of RegexPrefilter class
+ */
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief Quick test whether a regular expression can match some text.
+ *
+ * Finds the longest run of literal text every match of the pattern must
+ * contain. Text without that literal is rejected without running the
+ * regular expression. Patterns the simple parser does not understand
+ * (alternation, inline options, \\Q...\\E etc.) get no literal, and then
+ * every text may match.
+ */
+class RegexPrefilter
+{
+public:
+	RegexPrefilter() : m_bCaseless(false) {}
+	RegexPrefilter(const std::string& pattern, int regexpCompileOptions);
+
+	static std::string FindRequiredLiteral(const std::string& pattern, int regexpCompileOptions);
+
+	bool HasLiteral() const { return !m_literal.empty(); }
+	const std::string& GetLiteral() const { return m_literal; }
+	bool MayMatch(const char *text, size_t len) const;
+	bool MayMatch(const std::string& text) const { return MayMatch(text.data(), text.length()); }
+
+private:
+	std::string m_literal; /**< Required literal, lower case if m_bCaseless */
+	bool m_bCaseless;
+};
@@ -0,0 +1,271 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  ShardedFactory.h
+ *
+ * @brief Declaration of a concurrent Boost.Flyweight factory used for
+ * interning file and folder names.
+ */
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <boost/flyweight/factory_tag.hpp>
+#include <boost/flyweight/tracking_tag.hpp>
+#define POCO_NO_UNWINDOWS 1
+#include <Poco/Mutex.h>
+
+/**
+ * @brief Flyweight entry with a reference count maintained by sharded_factory_class.
+ */
+template<typename Value, typename Key>
+class sharded_entry
+{
+public:
+	explicit sharded_entry(const Value& x) : m_value(x), m_refs(0) {}
+	explicit sharded_entry(Value&& x) : m_value(std::move(x)), m_refs(0) {}
+	sharded_entry(const sharded_entry& e) : m_value(e.m_value), m_refs(0) {}
+	sharded_entry(sharded_entry&& e) : m_value(std::move(e.m_value)), m_refs(0) {}
+
+	operator const Value&() const { return m_value; }
+	operator const Key&() const { return m_value; }
+
+	void add_ref() const { m_refs.fetch_add(1, std::memory_order_relaxed); }
+	/** @brief Drop a reference if it is not the last one. */
+	bool release_unless_last() const
+	{
+		long refs = m_refs.load(std::memory_order_relaxed);
+		while (refs > 1)
+		{
+			if (m_refs.compare_exchange_weak(refs, refs - 1, std::memory_order_acq_rel))
+				return true;
+		}
+		return false;
+	}
+	/** @brief Drop a reference, return true if it was the last one. */
+	bool release() const { return m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+
+private:
+	Value m_value;
+	mutable std::atomic<long> m_refs;
+};
+
+/**
+ * @brief Flyweight handle for the sharded_tracking policy.
+ * The factory has already counted the reference a new handle is created
+ * from, copies add one and destruction gives it back to the factory.
+ */
+template<typename Handle, typename TrackingHelper>
+class sharded_handle
+{
+public:
+	explicit sharded_handle(const Handle& h) : m_h(h) {}
+	sharded_handle(const sharded_handle& x) : m_h(x.m_h) { TrackingHelper::entry(*this).add_ref(); }
+	sharded_handle& operator=(sharded_handle x) { std::swap(m_h, x.m_h); return *this; }
+	~sharded_handle() { TrackingHelper::erase(*this, check_erase); }
+
+	operator const Handle&() const { return m_h; }
+
+private:
+	/** @brief The factory decides itself whether the entry is still referenced. */
+	static bool check_erase(const sharded_handle&) { return true; }
+
+	Handle m_h;
+};
+
+/**
+ * @brief Tracking policy to be used with sharded_factory.
+ * Unlike boost::flyweights::refcounted this does not depend on the
+ * flyweight lock: the count only drops to zero, and entries are only
+ * found again, under the lock of the entry's shard.
+ */
+struct sharded_tracking : boost::flyweights::tracking_marker
+{
+	struct entry_type
+	{
+		template<typename Value, typename Key>
+		struct apply
+		{
+			typedef sharded_entry<Value, Key> type;
+		};
+	};
+
+	struct handle_type
+	{
+		template<typename Handle, typename TrackingHelper>
+		struct apply
+		{
+			typedef sharded_handle<Handle, TrackingHelper> type;
+		};
+	};
+};
+
+/**
+ * @brief Flyweight factory whose table is split into independently locked shards.
+ *
+ * The default hashed_factory is guarded by one global lock which every
+ * DirItem name/path assignment has to take, so the folder scan and the
+ * compare threads serialize on it. This factory only locks the shard
+ * the value hashes to. Before that it looks the value up in a small
+ * direct-mapped per-thread cache, so repeated values (like the sub-folder
+ * path stored into every item of a folder) take no lock at all.
+ *
+ * Entries are reference counted and erased when the last flyweight (or
+ * per-thread cache slot) referring to them is gone. Cache slots share the
+ * ownership of the shards, so a slot of a destroyed factory neither
+ * matches a new factory at the same address nor releases into freed
+ * memory. The factory must be used together with the sharded_tracking
+ * and no_locking policies.
+ */
+template<typename Entry, typename Key>
+class sharded_factory_class : public boost::flyweights::factory_marker
+{
+public:
+	typedef const Entry* handle_type;
+
+	enum : size_t
+	{
+		SHARD_COUNT = 64, /**< Number of independently locked tables */
+		CACHE_SIZE = 256, /**< Slots in the per-thread cache */
+	};
+
+	handle_type insert(const Entry& x) { return insert_entry(x); }
+	handle_type insert(Entry&& x) { return insert_entry(std::move(x)); }
+
+	/** @brief Release a reference returned by insert(). */
+	void erase(handle_type h) { release(*m_pShards, h); }
+
+	static const Entry& entry(handle_type h) { return *h; }
+
+	size_t size();
+
+private:
+	struct Shard
+	{
+		Poco::FastMutex mutex;
+		std::unordered_multimap<size_t, Entry> entries;
+	};
+	typedef std::array<Shard, SHARD_COUNT> Shards;
+	struct CacheSlot
+	{
+		std::shared_ptr<Shards> owner; /**< Shards of the factory the entry is in */
+		size_t hash;
+		handle_type handle;
+	};
+	/** @brief Per-thread cache, each slot holds a reference to its entry. */
+	struct Cache
+	{
+		std::array<CacheSlot, CACHE_SIZE> slots{};
+		~Cache()
+		{
+			for (CacheSlot& slot : slots)
+			{
+				if (slot.owner != nullptr)
+					release(*slot.owner, slot.handle);
+			}
+		}
+	};
+
+	static CacheSlot *cache()
+	{
+		static thread_local Cache s_cache;
+		return s_cache.slots.data();
+	}
+
+	static size_t hash_of(const Key& key) { return std::hash<Key>()(key); }
+
+	/** @brief Use other hash bits for the shard than for the cache slot. */
+	static Shard& shard_of(Shards& shards, size_t hash) { return shards[(hash / CACHE_SIZE) % SHARD_COUNT]; }
+
+	template<typename T>
+	handle_type insert_entry(T&& x)
+	{
+		const size_t hash = hash_of(static_cast<const Key&>(x));
+		CacheSlot& slot = cache()[hash % CACHE_SIZE];
+		if (slot.owner == m_pShards && slot.hash == hash &&
+			static_cast<const Key&>(*slot.handle) == static_cast<const Key&>(x))
+		{
+			slot.handle->add_ref();
+			return slot.handle;
+		}
+
+		Shard& shard = shard_of(*m_pShards, hash);
+		handle_type h = nullptr;
+		{
+			Poco::FastMutex::ScopedLock lock(shard.mutex);
+			auto range = shard.entries.equal_range(hash);
+			for (auto it = range.first; it != range.second; ++it)
+			{
+				if (static_cast<const Key&>(it->second) == static_cast<const Key&>(x))
+				{
+					h = &it->second;
+					break;
+				}
+			}
+			if (h == nullptr)
+				h = &shard.entries.emplace(hash, std::forward<T>(x))->second;
+			h->add_ref(); // for the caller
+			h->add_ref(); // for the cache slot
+		}
+		if (slot.owner != nullptr)
+			release(*slot.owner, slot.handle);
+		slot.owner = m_pShards;
+		slot.hash = hash;
+		slot.handle = h;
+		return h;
+	}
+
+	static void release(Shards& shards, handle_type h)
+	{
+		if (h->release_unless_last())
+			return;
+		// The last reference can only be dropped while no other thread
+		// can find the entry in the shard
+		const size_t hash = hash_of(static_cast<const Key&>(*h));
+		Shard& shard = shard_of(shards, hash);
+		Poco::FastMutex::ScopedLock lock(shard.mutex);
+		if (!h->release())
+			return;
+		auto range = shard.entries.equal_range(hash);
+		for (auto it = range.first; it != range.second; ++it)
+		{
+			if (&it->second == h)
+			{
+				shard.entries.erase(it);
+				break;
+			}
+		}
+	}
+
+	std::shared_ptr<Shards> m_pShards = std::make_shared<Shards>();
+};
+
+/**
+ * @brief Return number of interned entries.
+ */
+template<typename Entry, typename Key>
+size_t sharded_factory_class<Entry, Key>::size()
+{
+	size_t count = 0;
+	for (Shard& shard : *m_pShards)
+	{
+		Poco::FastMutex::ScopedLock lock(shard.mutex);
+		count += shard.entries.size();
+	}
+	return count;
+}
+
+/**
+ * @brief Factory specifier for sharded_factory_class.
+ */
+struct sharded_factory : boost::flyweights::factory_marker
+{
+	template<typename Entry, typename Key>
+	struct apply
+	{
+		typedef sharded_factory_class<Entry, Key> type;
+	};
+};
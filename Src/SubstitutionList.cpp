@@ -6,16 +6,48 @@
 
 #include "pch.h"
 #include "SubstitutionList.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
 #include <vector>
+#include <list>
+#include <string_view>
+#include <Poco/Mutex.h>
 #include <Poco/RegularExpression.h>
+#include "ParallelFor.h"
 #include "unicoder.h"
 
+namespace
+{
+
+/** @brief Most substituted files kept, two for each open file compare. */
+const size_t MaxCachedFiles = 8;
+/** @brief Larger files are not cached, as the cache keeps a copy of them. */
+const size_t MaxCachedLength = 32 * 1024 * 1024;
+/** @brief Length of the parts of whole lines substituted in parallel. */
+const size_t PartLength = 64 * 1024;
+
+struct CachedLines
+{
+	std::string signature;
+	size_t hash;
+	std::string original;
+	int nlines;
+	std::shared_ptr<const SubstitutedLines> lines;
+};
+
+Poco::FastMutex f_cacheMutex;
+std::list<CachedLines> f_cache; /**< Most recently used first */
+
+}
+
 SubstitutionItem::SubstitutionItem(const std::string& pattern,
 	const std::string& replacement, int regexpCompileOptions)
 	: pattern(pattern)
 	, replacement(replacement)
 	, regexpCompileOptions(regexpCompileOptions)
 	, regexp(pattern, regexpCompileOptions)
+	, prefilter(pattern, regexpCompileOptions)
 {
 }
 
@@ -24,12 +56,14 @@ SubstitutionItem::SubstitutionItem(const SubstitutionItem& other)
 	, replacement(other.replacement)
 	, regexpCompileOptions(other.regexpCompileOptions)
 	, regexp(other.pattern, other.regexpCompileOptions)
+	, prefilter(other.prefilter)
 {
 }
 
 void SubstitutionList::Add(const std::string& pattern, const std::string& replacement, int regexpCompileOptions)
 {
 	m_list.emplace_back(pattern, replacement, regexpCompileOptions);
+	m_signature += pattern + '\0' + replacement + '\0' + std::to_string(regexpCompileOptions) + '\n';
 }
 
 void SubstitutionList::Add(
@@ -54,8 +88,144 @@ void SubstitutionList::Add(
 		rePattern.push_back(c);
 	}
 	if (matchWholeWordOnly)
-		rePattern = "\b" + rePattern + "\b";
-	m_list.emplace_back(rePattern, replacement, regexpCompileOptions);
+		rePattern = "\\b" + rePattern + "\\b";
+	Add(rePattern, replacement, regexpCompileOptions);
+}
+
+/**
+ * @brief Append replacement of a match, with $0..$9 replaced by the groups
+ * matched like Poco::RegularExpression::subst() does.
+ */
+static void AppendReplacement(std::string& result, const std::string& replacement,
+	const std::string& subject, const Poco::RegularExpression::MatchVec& groups)
+{
+	const size_t len = replacement.length();
+	for (size_t i = 0; i < len; ++i)
+	{
+		const char c = replacement[i];
+		if (c != '$' || i + 1 == len)
+		{
+			result += c;
+			continue;
+		}
+		const char d = replacement[++i];
+		if (d >= '0' && d <= '9')
+		{
+			const size_t n = d - '0';
+			if (n < groups.size() && groups[n].offset != std::string::npos)
+				result.append(subject, groups[n].offset, groups[n].length);
+		}
+		else
+		{
+			result += '$';
+			result += d;
+		}
+	}
+}
+
+/**
+ * @brief Replace all matches of one item in text.
+ * Poco's RE_GLOBAL substitution copies the rest of the text after each
+ * match, here the result is built in one pass. Line starts in @p offsets
+ * move with the text; a line starting inside a match starts after its
+ * replacement.
+ */
+static void ReplaceAll(const SubstitutionItem& item, std::string& text,
+	std::vector<size_t> *offsets, Poco::RegularExpression::MatchVec& groups)
+{
+	if (!item.prefilter.MayMatch(text))
+		return;
+
+	const size_t len = text.length();
+	std::string result;
+	bool bReplaced = false;
+	size_t pos = 0; // text before pos is in result
+	size_t start = 0;
+	size_t line = 0;
+	while (start < len)
+	{
+		if (item.regexp.match(text, start, groups) <= 0 || groups[0].offset == std::string::npos)
+			break;
+		const size_t matchBegin = groups[0].offset;
+		const size_t matchEnd = matchBegin + groups[0].length;
+		if (!bReplaced)
+		{
+			result.reserve(len);
+			bReplaced = true;
+		}
+		result.append(text, pos, matchBegin - pos);
+		if (offsets)
+		{
+			for (; line < offsets->size() && (*offsets)[line] <= matchBegin; ++line)
+				(*offsets)[line] = result.length() - (matchBegin - (*offsets)[line]);
+		}
+		AppendReplacement(result, item.replacement, text, groups);
+		if (offsets)
+		{
+			for (; line < offsets->size() && (*offsets)[line] < matchEnd; ++line)
+				(*offsets)[line] = result.length();
+		}
+		pos = matchEnd;
+		// Step over empty matches, the skipped character is copied with the next match
+		start = (matchEnd > matchBegin) ? matchEnd : matchEnd + 1;
+	}
+	if (!bReplaced)
+		return;
+	result.append(text, pos, std::string::npos);
+	if (offsets)
+	{
+		for (; line < offsets->size(); ++line)
+			(*offsets)[line] = result.length() - (len - (*offsets)[line]);
+	}
+	text.swap(result);
+}
+
+void SubstitutionList::SubstAll(std::string& text, std::vector<size_t> *offsets) const
+{
+	Poco::RegularExpression::MatchVec groups;
+	for (const auto& item : m_list)
+	{
+		try
+		{
+			ReplaceAll(item, text, offsets, groups);
+		}
+		catch (...)
+		{
+			// TODO:
+		}
+	}
+}
+
+/**
+ * @brief Can the regular expression of an item match differently when the
+ * text is substituted in parts of whole lines?
+ * That is when it may match a line break, or anchors to the start or end of
+ * the subject, which is the start or end of each part. Errs on the side of
+ * yes: negated classes, and escapes which may stand for a line break, for
+ * any character or for the end of the subject, count as matching one.
+ */
+static bool MayMatchAcrossParts(const SubstitutionItem& item)
+{
+	const std::string& pattern = item.pattern;
+	if (pattern.find_first_of("\r\n") != std::string::npos ||
+		pattern.find("[^") != std::string::npos || pattern.find("[:") != std::string::npos)
+		return true;
+	// ^ and $ match at the start and end of the subject only, unless RE_MULTILINE
+	if (pattern.find_first_of("^$") != std::string::npos &&
+		((item.regexpCompileOptions & Poco::RegularExpression::RE_MULTILINE) == 0 || pattern.find("(?") != std::string::npos))
+		return true;
+	// Dot matches line breaks with RE_DOTALL or the (?s) option
+	if (pattern.find('.') != std::string::npos &&
+		((item.regexpCompileOptions & Poco::RegularExpression::RE_DOTALL) != 0 || pattern.find("(?") != std::string::npos))
+		return true;
+	for (size_t pos = pattern.find('\\'); pos != std::string::npos && pos + 1 < pattern.length(); pos = pattern.find('\\', pos + 2))
+	{
+		const char c = pattern[pos + 1];
+		if (isupper(static_cast<unsigned char>(c)) || isdigit(static_cast<unsigned char>(c)) ||
+			(c != '\0' && strchr("cenoprsvxz", c) != nullptr))
+			return true;
+	}
+	return false;
 }
 
 std::string SubstitutionList::Subst(const std::string& subject, int codepage/*=CP_UTF8*/) const
@@ -77,23 +247,103 @@ std::string SubstitutionList::Subst(const std::string& subject, int codepage/*=C
 		replaced = subject;
 	}
 
-	for (const auto& item : m_list)
+	SubstAll(replaced, nullptr);
+
+	return replaced;
+}
+
+/**
+ * @brief Do substitutions on all lines of a file at once.
+ * Diff hunks then take their text from the result instead of substituting
+ * each hunk again. Results are cached by the text and the filters, so the
+ * side of a file compare not edited is not substituted again on rescan.
+ * Large files are split to parts of whole lines substituted in parallel.
+ * Parts are cut by their length, so that results don't depend on the count
+ * of processors, and files are not split when a match may span lines or
+ * depends on where the text starts or ends.
+ * @param [in] lines Start of each line, and end of the last line at lines[nlines].
+ * @param [in] nlines Count of lines.
+ */
+std::shared_ptr<const SubstitutedLines> SubstitutionList::SubstLines(const char *const *lines, int nlines) const
+{
+	if (nlines <= 0)
 	{
-		try
+		auto empty = std::make_shared<SubstitutedLines>();
+		empty->offsets.push_back(0);
+		return empty;
+	}
+	const size_t length = lines[nlines] - lines[0];
+	const size_t hash = std::hash<std::string_view>()(std::string_view(lines[0], length));
+	{
+		Poco::FastMutex::ScopedLock lock(f_cacheMutex);
+		for (auto it = f_cache.begin(); it != f_cache.end(); ++it)
 		{
-			item.regexp.subst(replaced, item.replacement, Poco::RegularExpression::RE_GLOBAL);
+			if (it->hash == hash && it->nlines == nlines && it->original.length() == length &&
+				it->signature == m_signature && memcmp(it->original.data(), lines[0], length) == 0)
+			{
+				f_cache.splice(f_cache.begin(), f_cache, it);
+				return f_cache.front().lines;
+			}
 		}
-		catch (...)
+	}
+
+	// First line of each part, a part ends where it reaches PartLength
+	std::vector<int> partLines{ 0 };
+	if (std::none_of(m_list.begin(), m_list.end(), MayMatchAcrossParts))
+	{
+		for (int i = 1; i < nlines; ++i)
 		{
-			// TODO:
+			if (static_cast<size_t>(lines[i] - lines[partLines.back()]) >= PartLength)
+				partLines.push_back(i);
 		}
 	}
+	partLines.push_back(nlines);
+	std::vector<SubstitutedLines> parts(partLines.size() - 1);
+	ParallelFor(static_cast<int>(parts.size()), static_cast<int64_t>(length * m_list.size()), [&](int begin, int end)
+		{
+			for (int p = begin; p < end; ++p)
+			{
+				const int first = partLines[p];
+				const int last = partLines[p + 1];
+				SubstitutedLines& part = parts[p];
+				part.text.assign(lines[first], lines[last] - lines[first]);
+				part.offsets.reserve(last - first + 1);
+				for (int i = first; i <= last; ++i)
+					part.offsets.push_back(lines[i] - lines[first]);
+				SubstAll(part.text, &part.offsets);
+			}
+		});
 
-	return replaced;
+	auto result = std::make_shared<SubstitutedLines>();
+	if (parts.size() == 1)
+	{
+		*result = std::move(parts.front());
+	}
+	else
+	{
+		result->offsets.reserve(nlines + 1);
+		for (auto& part : parts)
+		{
+			const size_t base = result->text.length();
+			for (size_t i = 0; i + 1 < part.offsets.size(); ++i)
+				result->offsets.push_back(base + part.offsets[i]);
+			result->text += part.text;
+		}
+		result->offsets.push_back(result->text.length());
+	}
+
+	if (length <= MaxCachedLength)
+	{
+		Poco::FastMutex::ScopedLock lock(f_cacheMutex);
+		f_cache.push_front({ m_signature, hash, std::string(lines[0], length), nlines, result });
+		if (f_cache.size() > MaxCachedFiles)
+			f_cache.pop_back();
+	}
+	return result;
 }
 
 void SubstitutionList::RemoveAllFilters()
 {
 	m_list.clear();
+	m_signature.clear();
 }
-
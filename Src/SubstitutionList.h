@@ -7,7 +7,9 @@
 
 #include <vector>
 #include <memory>
+#include <string>
 #include <Poco/RegularExpression.h>
+#include "RegexPrefilter.h"
 #include "unicoder.h"
 
 
@@ -21,6 +23,21 @@ struct SubstitutionItem
 	const std::string replacement;
 	const int regexpCompileOptions;
 	Poco::RegularExpression regexp; /**< Compiled regular expression */
+	RegexPrefilter prefilter; /**< Skips texts the regular expression cannot match */
+};
+
+/**
+ * @brief Lines of a file with substitutions done.
+ */
+struct SubstitutedLines
+{
+	std::string text;
+	std::vector<size_t> offsets; /**< Start of each line in text, one more than lines */
+
+	std::string GetLines(int first, int count) const
+	{
+		return text.substr(offsets[first], offsets[first + count] - offsets[first]);
+	}
 };
 
 class SubstitutionList
@@ -34,9 +51,12 @@ public:
 	bool HasRegExps() const { return !m_list.empty(); }
 	size_t GetCount() const { return m_list.size(); }
 	std::string Subst(const std::string& subject, int codepage = CP_UTF8) const;
+	std::shared_ptr<const SubstitutedLines> SubstLines(const char *const *lines, int nlines) const;
 	const SubstitutionItem& operator[](int index) const { return m_list[index]; }
 
 private:
+	void SubstAll(std::string& text, std::vector<size_t> *offsets) const;
+
 	std::vector<SubstitutionItem> m_list;
+	std::string m_signature; /**< Patterns and replacements, identifies the filters in cached results */
 };
-
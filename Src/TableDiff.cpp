@@ -0,0 +1,349 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  TableDiff.cpp
+ *
+ * @brief Implementation of TableDiff class
+ */
+
+#include "pch.h"
+#include "TableDiff.h"
+#include <algorithm>
+#include <unordered_map>
+#include "CompareOptions.h"
+#include "ParallelFor.h"
+#include "DebugNew.h"
+
+namespace
+{
+
+/** @brief FNV-1a offset basis, hash of an empty string. */
+const uint64_t FnvOffsetBasis = 14695981039346656037ULL;
+/** @brief FNV-1a prime. */
+const uint64_t FnvPrime = 1099511628211ULL;
+
+/** @brief SplitMix64 finalizer, spreads bits of a value over the result. */
+inline uint64_t Mix(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+	return x;
+}
+
+/** @brief Split the EOL off the end of a row. */
+inline StringView SplitEol(StringView row, StringView& eol)
+{
+	size_t length = row.length();
+	while (length > 0 && (row[length - 1] == '\r' || row[length - 1] == '\n'))
+		--length;
+	eol = row.substr(length);
+	return row.substr(0, length);
+}
+
+}
+
+/**
+ * @brief Constructor.
+ * @param [in] cDelimiter Field delimiter.
+ * @param [in] cQuote Field enclosure, delimiters within it do not split fields.
+ * @param [in] bCaseSensitive Are cells differing only by case different?
+ * @param [in] ignoreWhitespace Whitespace compare mode (WHITESPACE_*).
+ */
+TableDiff::TableDiff(TCHAR cDelimiter, TCHAR cQuote, bool bCaseSensitive, int ignoreWhitespace)
+: m_cDelimiter(cDelimiter)
+, m_cQuote(cQuote)
+, m_bCaseSensitive(bCaseSensitive)
+, m_ignoreWhitespace(ignoreWhitespace)
+, m_nKeyColumn(AllColumns)
+{
+}
+
+/**
+ * @brief Call fn for each char of a string the compare options do not ignore.
+ */
+template<typename Function>
+void TableDiff::ForEachChar(StringView str, Function fn) const
+{
+	bool bSpace = false;
+	for (TCHAR ch : str)
+	{
+		if (ch == ' ' || ch == '\t')
+		{
+			if (m_ignoreWhitespace == WHITESPACE_IGNORE_ALL)
+				continue;
+			if (m_ignoreWhitespace == WHITESPACE_IGNORE_CHANGE)
+			{
+				// Whitespace runs are equal to one space, trailing ones are dropped
+				bSpace = true;
+				continue;
+			}
+		}
+		else if (bSpace)
+		{
+			fn(static_cast<TCHAR>(' '));
+			bSpace = false;
+		}
+		fn(m_bCaseSensitive ? ch : static_cast<TCHAR>(_totlower(ch)));
+	}
+}
+
+uint64_t TableDiff::Hash(StringView str) const
+{
+	uint64_t hash = FnvOffsetBasis;
+	ForEachChar(str, [&hash](TCHAR ch) { hash = (hash ^ static_cast<uint64_t>(ch)) * FnvPrime; });
+	return hash;
+}
+
+String TableDiff::Normalize(StringView str) const
+{
+	String result;
+	result.reserve(str.length());
+	ForEachChar(str, [&result](TCHAR ch) { result += ch; });
+	return result;
+}
+
+/**
+ * @brief Split a row to fields at delimiters outside the enclosure.
+ */
+void TableDiff::SplitFields(StringView row, std::vector<StringView>& fields) const
+{
+	fields.clear();
+	bool bInQuote = false;
+	size_t begin = 0;
+	for (size_t i = 0; i < row.length(); ++i)
+	{
+		if (row[i] == m_cQuote)
+			bInQuote = !bInQuote;
+		else if (row[i] == m_cDelimiter && !bInQuote)
+		{
+			fields.push_back(row.substr(begin, i - begin));
+			begin = i + 1;
+		}
+	}
+	fields.push_back(row.substr(begin));
+}
+
+/**
+ * @brief Hash key column and whole row of each row.
+ * Row hashes combine field hashes, so that ignored whitespace cannot
+ * move text from one field to another.
+ */
+void TableDiff::HashRows(const std::vector<StringView>& rows, std::vector<RowHash>& hashes) const
+{
+	hashes.resize(rows.size());
+	int64_t work = 0;
+	for (const StringView& row : rows)
+		work += row.length();
+	ParallelFor(static_cast<int>(rows.size()), work, [&](int begin, int end)
+		{
+			std::vector<StringView> fields;
+			StringView eol;
+			for (int i = begin; i < end; ++i)
+			{
+				SplitFields(SplitEol(rows[i], eol), fields);
+				uint64_t hash = FnvOffsetBasis;
+				for (const StringView& field : fields)
+					hash = Mix(hash ^ Hash(field));
+				hashes[i].row = eol.empty() ? hash : Mix(hash ^ Hash(eol));
+				if (m_nKeyColumn == AllColumns)
+					hashes[i].key = hash;
+				else if (static_cast<size_t>(m_nKeyColumn) <= fields.size())
+					hashes[i].key = Hash(fields[m_nKeyColumn - 1]);
+				else
+					hashes[i].key = FnvOffsetBasis;
+			}
+		});
+}
+
+/**
+ * @brief Are fields of two rows equal with the compare options?
+ * @param [in] nColumn 1-based column to compare, or AllColumns.
+ * A missing field equals an empty one, as their hashes are equal.
+ */
+bool TableDiff::IsSameFields(StringView row0, StringView row1, int nColumn) const
+{
+	StringView eol;
+	row0 = SplitEol(row0, eol);
+	row1 = SplitEol(row1, eol);
+	if (row0 == row1)
+		return true;
+	std::vector<StringView> fields[2];
+	SplitFields(row0, fields[0]);
+	SplitFields(row1, fields[1]);
+	if (nColumn != AllColumns)
+	{
+		const size_t c = static_cast<size_t>(nColumn - 1);
+		return Normalize(c < fields[0].size() ? fields[0][c] : StringView()) ==
+			Normalize(c < fields[1].size() ? fields[1][c] : StringView());
+	}
+	if (fields[0].size() != fields[1].size())
+		return false;
+	for (size_t c = 0; c < fields[0].size(); ++c)
+	{
+		if (Normalize(fields[0][c]) != Normalize(fields[1][c]))
+			return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Are two rows equal with the compare options, EOLs included?
+ */
+bool TableDiff::IsSameRow(StringView row0, StringView row1) const
+{
+	StringView eol0, eol1;
+	SplitEol(row0, eol0);
+	SplitEol(row1, eol1);
+	return eol0 == eol1 && IsSameFields(row0, row1, AllColumns);
+}
+
+/**
+ * @brief Add differing rows, joining them to the previous range if both
+ * are aligned row by row.
+ */
+void TableDiff::AddRange(int begin0, int end0, int begin1, int end1)
+{
+	if (!m_ranges.empty())
+	{
+		Range& last = m_ranges.back();
+		if (last.end[0] == begin0 && last.end[1] == begin1 &&
+			last.end[0] - last.begin[0] == last.end[1] - last.begin[1] &&
+			end0 - begin0 == end1 - begin1)
+		{
+			last.end[0] = end0;
+			last.end[1] = end1;
+			return;
+		}
+	}
+	m_ranges.push_back({ { begin0, begin1 }, { end0, end1 } });
+}
+
+/**
+ * @brief Diff rows of two tables.
+ * Rows are compared by 64-bit hashes of their fields, and by content if
+ * the hashes are equal.
+ * @param [in] rows0 Rows of first table, EOLs are compared if included.
+ * @param [in] rows1 Rows of second table, EOLs are compared if included.
+ */
+void TableDiff::Diff(const std::vector<StringView>& rows0, const std::vector<StringView>& rows1)
+{
+	m_ranges.clear();
+	m_movedRows.clear();
+
+	std::vector<RowHash> hashes[2];
+	HashRows(rows0, hashes[0]);
+	HashRows(rows1, hashes[1]);
+	const int n0 = static_cast<int>(rows0.size());
+	const int n1 = static_cast<int>(rows1.size());
+
+	// Hash join: chain rows of second table with the same key in row order
+	// and match each row of first table to the next row of its chain
+	std::unordered_map<uint64_t, int> heads;
+	heads.reserve(n1);
+	std::vector<int> next(n1, -1);
+	for (int j = n1 - 1; j >= 0; --j)
+	{
+		auto result = heads.emplace(hashes[1][j].key, j);
+		if (!result.second)
+		{
+			next[j] = result.first->second;
+			result.first->second = j;
+		}
+	}
+	std::vector<int> match(n0, -1);
+	for (int i = 0; i < n0; ++i)
+	{
+		auto it = heads.find(hashes[0][i].key);
+		if (it != heads.end() && it->second >= 0 && IsSameFields(rows0[i], rows1[it->second], m_nKeyColumn))
+		{
+			match[i] = it->second;
+			it->second = next[it->second];
+		}
+	}
+
+	// Longest increasing subsequence of matched rows aligns the tables
+	std::vector<int> tails; // Last row of best subsequence of each length
+	std::vector<int> prev(n0, -1);
+	for (int i = 0; i < n0; ++i)
+	{
+		if (match[i] < 0)
+			continue;
+		auto it = std::lower_bound(tails.begin(), tails.end(), match[i],
+			[&match](int t, int j) { return match[t] < j; });
+		if (it != tails.begin())
+			prev[i] = *(it - 1);
+		if (it == tails.end())
+			tails.push_back(i);
+		else
+			*it = i;
+	}
+	std::vector<bool> aligned(n0, false);
+	for (int i = tails.empty() ? -1 : tails.back(); i >= 0; i = prev[i])
+		aligned[i] = true;
+
+	int p0 = 0, p1 = 0;
+	for (int i = 0; i <= n0; ++i)
+	{
+		if (i < n0 && !aligned[i])
+		{
+			if (match[i] >= 0)
+				m_movedRows.push_back({ { i, match[i] } });
+			continue;
+		}
+		const int j = (i < n0) ? match[i] : n1;
+		if (p0 < i || p1 < j)
+			AddRange(p0, i, p1, j);
+		if (i < n0 && (hashes[0][i].row != hashes[1][j].row || !IsSameRow(rows0[i], rows1[j])))
+			AddRange(i, i + 1, j, j + 1);
+		p0 = i + 1;
+		p1 = j + 1;
+	}
+}
+
+/**
+ * @brief Find cells that differ in two rows.
+ * Cells are compared by column. A cell missing from one row gives an empty
+ * range on that side, and the range on the other side includes the
+ * delimiter before the cell.
+ * @param [out] cells Ranges of differing cells, offsets in the rows.
+ */
+void TableDiff::DiffCells(StringView row0, StringView row1, std::vector<Range>& cells) const
+{
+	cells.clear();
+	const StringView rows[2] = { row0, row1 };
+	std::vector<StringView> fields[2];
+	SplitFields(row0, fields[0]);
+	SplitFields(row1, fields[1]);
+	const size_t count = (std::max)(fields[0].size(), fields[1].size());
+	for (size_t c = 0; c < count; ++c)
+	{
+		Range cell;
+		bool bMissing = false;
+		for (int i = 0; i < 2; ++i)
+		{
+			if (c < fields[i].size())
+			{
+				cell.begin[i] = static_cast<int>(fields[i][c].data() - rows[i].data());
+				cell.end[i] = cell.begin[i] + static_cast<int>(fields[i][c].length());
+			}
+			else
+			{
+				cell.begin[i] = cell.end[i] = static_cast<int>(rows[i].length());
+				bMissing = true;
+			}
+		}
+		if (bMissing)
+		{
+			for (int i = 0; i < 2; ++i)
+			{
+				if (c < fields[i].size())
+					--cell.begin[i];
+			}
+			cells.push_back(cell);
+		}
+		else if (Normalize(fields[0][c]) != Normalize(fields[1][c]))
+			cells.push_back(cell);
+	}
+}
@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  TableDiff.h
+ *
+ * @brief Declaration of TableDiff class
+ */
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "UnicodeString.h"
+
+/**
+ * @brief Diff of table rows matched by a key column instead of by position.
+ *
+ * A line diff of CSV/TSV exports shows most of the file as changed when
+ * rows are reordered. This class hashes the key column of every row (or
+ * the whole row) and matches rows of both sides with a hash join, rows
+ * with the same key being matched in order. The longest run of matched
+ * rows that are in the same order on both sides is kept as the alignment
+ * (longest increasing subsequence); other matched rows are reported as
+ * moved. Matched rows whose content differs are changed rows, and the rows
+ * between them are added or removed. Rows with equal hashes are compared
+ * by content too, so that a hash collision can't hide a change.
+ *
+ * Rows are hashed on several threads for large tables. The ignore-case
+ * and whitespace options apply to keys and cells. EOLs at the end of rows
+ * are not part of any cell, but rows with different EOLs differ.
+ */
+class TableDiff
+{
+public:
+	/** @brief Key column to match rows by all their columns. */
+	static const int AllColumns = 0;
+
+	/** @brief Differing rows or cells, [begin, end) on each side, one side may be empty. */
+	struct Range
+	{
+		int begin[2];
+		int end[2];
+	};
+
+	/** @brief Rows with the same key that are out of order. */
+	struct MovedRow
+	{
+		int row[2];
+	};
+
+	TableDiff(TCHAR cDelimiter, TCHAR cQuote, bool bCaseSensitive, int ignoreWhitespace);
+	void SetKeyColumn(int nColumn) { m_nKeyColumn = nColumn; }
+	void Diff(const std::vector<StringView>& rows0, const std::vector<StringView>& rows1);
+	const std::vector<Range>& GetRanges() const { return m_ranges; }
+	const std::vector<MovedRow>& GetMovedRows() const { return m_movedRows; }
+	void DiffCells(StringView row0, StringView row1, std::vector<Range>& cells) const;
+	void SplitFields(StringView row, std::vector<StringView>& fields) const;
+
+private:
+	/** @brief Hashes of one row. */
+	struct RowHash
+	{
+		uint64_t key; /**< Hash of key column */
+		uint64_t row; /**< Hash of whole row */
+	};
+
+	template<typename Function>
+	void ForEachChar(StringView str, Function fn) const;
+	uint64_t Hash(StringView str) const;
+	String Normalize(StringView str) const;
+	void HashRows(const std::vector<StringView>& rows, std::vector<RowHash>& hashes) const;
+	bool IsSameFields(StringView row0, StringView row1, int nColumn) const;
+	bool IsSameRow(StringView row0, StringView row1) const;
+	void AddRange(int begin0, int end0, int begin1, int end1);
+
+	TCHAR m_cDelimiter;
+	TCHAR m_cQuote;
+	bool m_bCaseSensitive;
+	int m_ignoreWhitespace;
+	int m_nKeyColumn; /**< 1-based key column, or AllColumns */
+	std::vector<Range> m_ranges;
+	std::vector<MovedRow> m_movedRows;
+};
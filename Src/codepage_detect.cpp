@@ -9,14 +9,21 @@
 #include "codepage_detect.h"
 #include <cstdio>
 #include <cstring>
+#include <climits>
 #include <algorithm>
 #include <memory>
+#include <unordered_map>
+#include <io.h>
+#include <fcntl.h>
+#include <Poco/Mutex.h>
+#include <Poco/Thread.h>
 #include "unicoder.h"
 #include "ExConverter.h"
 #include "charsets.h"
 #include "FileTextEncoding.h"
 #include "paths.h"
 #include "markdown.h"
+#include "TFile.h"
 
 /**
  * @brief Prefixes to handle when searching for codepage names
@@ -185,28 +192,43 @@ static unsigned demoGuessEncoding_rc(const char *src, size_t len, int defcodepag
 	return cp;
 }
 
-namespace codepage_detect
+/**
+ * @brief Length of buffer without an incomplete UTF-8 character at its end.
+ * Used when the buffer is only a part of a file, so that a character cut
+ * in two does not make valid UTF-8 look invalid.
+ */
+static size_t TrimPartialUtf8(const char *src, size_t len)
 {
+	size_t i = len;
+	while (i > 0 && len - i < 3 && (static_cast<unsigned char>(src[i - 1]) & 0xC0) == 0x80)
+		--i;
+	if (i == 0)
+		return len;
+	const unsigned char lead = static_cast<unsigned char>(src[i - 1]);
+	const size_t charlen = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+	return len - (i - 1) < charlen ? i - 1 : len;
+}
+
 /**
- * @brief Try to deduce encoding for this file.
+ * @brief Guess encoding from a sample of a file.
  * @param [in] ext File extension.
- * @param [in] src File contents (as a string).
- * @param [in] len Size of the file contents string.
- * @return Codepage number.
+ * @param [in] src Sample, beginning with the file head.
+ * @param [in] len Size of the sample.
+ * @param [in] headlen Size of the file head in the sample. Only the head
+ * is searched for BOM and for encoding declarations.
+ * @param [in] guessEncodingType Try to guess codepage (not just unicode encoding).
+ * @param [in] bTruncated Does the file continue after the sample?
  */
-FileTextEncoding Guess(const String& ext, const void * src, size_t len, int guessEncodingType)
+static FileTextEncoding GuessSample(const String& ext, const char *src, size_t len, size_t headlen, int guessEncodingType, bool bTruncated)
 {
 	FileTextEncoding encoding;
-	int bomsize = 0;
-	encoding.SetUnicoding(ucr::DetermineEncoding(reinterpret_cast<const unsigned char *>(src), len, &encoding.m_bom));
-	if (bomsize > 0)
-		encoding.m_bom = true;
+	encoding.SetUnicoding(ucr::DetermineEncoding(reinterpret_cast<const unsigned char *>(src), headlen, &encoding.m_bom));
 	if (encoding.m_unicoding != ucr::NONE)
 		return encoding;
 	unsigned cp = ucr::getDefaultCodepage();
 	if (guessEncodingType != 0)
 	{
-		if (!ucr::CheckForInvalidUtf8(reinterpret_cast<const char*>(src), len))
+		if (!ucr::CheckForInvalidUtf8(src, bTruncated ? TrimPartialUtf8(src, len) : len))
 			cp = ucr::CP_UTF_8;
 		else if (guessEncodingType & 2)
 		{
@@ -214,23 +236,24 @@ FileTextEncoding Guess(const String& ext, const void * src, size_t len, int gues
 			if (pexconv != nullptr && src != nullptr)
 			{
 				int autodetectType = (unsigned)guessEncodingType >> 16;
-				cp = pexconv->detectInputCodepage(autodetectType, cp, reinterpret_cast<const char *>(src), len);
+				cp = pexconv->detectInputCodepage(autodetectType, cp, src, len);
 			}
 		}
+		// Markup parsers only run for the file types that declare encodings
 		if (guessEncodingType & 1)
 		{
 			String lower_ext = strutils::makelower(ext);
 			if (lower_ext == _T(".rc"))
 			{
-				cp = demoGuessEncoding_rc(reinterpret_cast<const char *>(src), len, cp);
+				cp = demoGuessEncoding_rc(src, headlen, cp);
 			}
 			else if (lower_ext == _T(".htm") || lower_ext == _T(".html"))
 			{
-				cp = demoGuessEncoding_html(reinterpret_cast<const char *>(src), len, cp);
+				cp = demoGuessEncoding_html(src, headlen, cp);
 			}
 			else if (lower_ext == _T(".xml") || lower_ext == _T(".xsl"))
 			{
-				cp = demoGuessEncoding_xml(reinterpret_cast<const char *>(src), len, cp);
+				cp = demoGuessEncoding_xml(src, headlen, cp);
 			}
 		}
 	}
@@ -238,17 +261,211 @@ FileTextEncoding Guess(const String& ext, const void * src, size_t len, int gues
 	return encoding;
 }
 
+/**
+ * @brief Read the part of a file encoding detection looks at.
+ * The head of the file is read first. A head with non-ASCII bytes decides
+ * the encoding by itself. If the head is plain ASCII and the file is
+ * longer, SampleBlockCount blocks spread evenly over the rest of the file
+ * are added, so that non-ASCII text after a long ASCII head is still found
+ * without reading the whole file. Pieces are cut at UTF-8 character
+ * boundaries.
+ * @param [in] filesize Size of the file.
+ * @param [in] maxhead Largest head read, not negative.
+ * @param [in] bSampleRest Add blocks from the rest of the file?
+ * @param [out] sample Bytes read.
+ * @param [out] headlen Size of the head in sample.
+ * @return false if file could not be read.
+ */
+static bool ReadSample(const String& filepath, int64_t filesize, int64_t maxhead, bool bSampleRest,
+	std::vector<char>& sample, size_t& headlen)
+{
+	int fd = -1;
+	// Always use binary mode, to avoid terminating file read on ctrl-Z (DOS EOF)
+	_tsopen_s(&fd, TFile(filepath).wpath().c_str(), O_BINARY | O_RDONLY, _SH_DENYNO, _S_IREAD);
+	if (fd == -1)
+		return false;
+	sample.resize(static_cast<size_t>((std::min)(filesize, maxhead)));
+	// A whole file may be more than one read returns
+	size_t nread = 0;
+	while (nread < sample.size())
+	{
+		const int n = _read(fd, sample.data() + nread, static_cast<unsigned>((std::min)(sample.size() - nread, static_cast<size_t>(INT_MAX))));
+		if (n < 0)
+		{
+			_close(fd);
+			return false;
+		}
+		if (n == 0)
+			break;
+		nread += n;
+	}
+	const bool bTruncated = static_cast<int64_t>(nread) < filesize;
+	headlen = bTruncated ? TrimPartialUtf8(sample.data(), nread) : nread;
+	sample.resize(headlen);
+
+	if (bSampleRest && bTruncated && ucr::FindNonAscii(sample.data(), headlen) == headlen)
+	{
+		// Continue from the character cut off the head
+		const int64_t base = headlen;
+		const int64_t rest = filesize - base;
+		char block[SampleBlockSize];
+		for (int i = 0; i < SampleBlockCount; ++i)
+		{
+			const int64_t offset = rest <= static_cast<int64_t>(SampleBlockSize) * SampleBlockCount ?
+				base + static_cast<int64_t>(i) * SampleBlockSize :
+				base + (rest - SampleBlockSize) * (i + 1) / SampleBlockCount;
+			if (offset >= filesize || _lseeki64(fd, offset, SEEK_SET) != offset)
+				break;
+			const int n = _read(fd, block, SampleBlockSize);
+			if (n <= 0)
+				break;
+			size_t begin = 0;
+			while (begin < 3 && begin < static_cast<size_t>(n) && (static_cast<unsigned char>(block[begin]) & 0xC0) == 0x80)
+				++begin;
+			const size_t end = offset + n < filesize ? TrimPartialUtf8(block, n) : n;
+			if (begin < end)
+			{
+				sample.push_back('\n');
+				sample.insert(sample.end(), block + begin, block + end);
+			}
+		}
+	}
+	_close(fd);
+	return true;
+}
+
+namespace
+{
+
+/** @brief Largest number of files whose guessed encoding is remembered. */
+const size_t MaxCachedGuesses = 8192;
+
+/**
+ * @brief Encodings guessed for files, by path.
+ * A file is guessed again when its size or modification time changes, so
+ * reopening the same files or refreshing a compare does not read them again.
+ * Files without a detected encoding get the default codepage, so a guess is
+ * also only valid for the default codepage it was made with.
+ */
+class GuessCache
+{
+public:
+	bool Lookup(const String& path, int64_t size, int64_t mtime, int guessEncodingType, ptrdiff_t maxlen, FileTextEncoding& encoding) const
+	{
+		Poco::FastMutex::ScopedLock lock(m_mutex);
+		auto it = m_entries.find(path);
+		if (it == m_entries.end() || it->second.size != size || it->second.mtime != mtime ||
+			it->second.guessEncodingType != guessEncodingType || it->second.maxlen != maxlen ||
+			it->second.defaultCodepage != ucr::getDefaultCodepage())
+			return false;
+		encoding = it->second.encoding;
+		return true;
+	}
+
+	void Add(const String& path, int64_t size, int64_t mtime, int guessEncodingType, ptrdiff_t maxlen, const FileTextEncoding& encoding)
+	{
+		Poco::FastMutex::ScopedLock lock(m_mutex);
+		if (m_entries.size() >= MaxCachedGuesses)
+			m_entries.clear();
+		m_entries[path] = { size, mtime, guessEncodingType, maxlen, ucr::getDefaultCodepage(), encoding };
+	}
+
+private:
+	struct Entry
+	{
+		int64_t size;
+		int64_t mtime;
+		int guessEncodingType;
+		ptrdiff_t maxlen;
+		int defaultCodepage;
+		FileTextEncoding encoding;
+	};
+	mutable Poco::FastMutex m_mutex;
+	std::unordered_map<String, Entry> m_entries;
+};
+
+GuessCache f_guessCache;
+
+}
+
+namespace codepage_detect
+{
 /**
  * @brief Try to deduce encoding for this file.
+ * @param [in] ext File extension.
+ * @param [in] src File contents (as a string).
+ * @param [in] len Size of the file contents string.
+ * @param [in] bTruncated Is src only the head of a longer file?
+ * @return Codepage number.
+ */
+FileTextEncoding Guess(const String& ext, const void * src, size_t len, int guessEncodingType, bool bTruncated)
+{
+	return GuessSample(ext, reinterpret_cast<const char *>(src), len, len, guessEncodingType, bTruncated);
+}
+
+/**
+ * @brief Try to deduce encoding for this file.
+ * Only a bounded sample of the file is read, see ReadSample(). Results
+ * are remembered until the size or modification time of the file changes.
  * @param [in] filepath Full path to the file.
  * @param [in] bGuessEncoding Try to guess codepage (not just unicode encoding).
+ * @param [in] mapmaxlen Largest head of the file read, negative for the whole file.
  * @return Structure getting the encoding info.
  */
 FileTextEncoding Guess(const String& filepath, int guessEncodingType, ptrdiff_t mapmaxlen)
 {
-	CMarkdown::FileImage fi(filepath != _T("NUL") ? filepath.c_str() : nullptr, mapmaxlen);
 	String ext = paths::FindExtension(filepath);
-	return Guess(ext, fi.pImage, fi.cbImage, guessEncodingType);
+	int64_t filesize = 0;
+	int64_t mtime = 0;
+	try
+	{
+		if (filepath == _T("NUL"))
+			return Guess(ext, nullptr, 0, guessEncodingType);
+		TFile file(filepath);
+		filesize = file.getSize();
+		mtime = file.getLastModified().epochMicroseconds();
+	}
+	catch (...)
+	{
+		return Guess(ext, nullptr, 0, guessEncodingType);
+	}
+
+	FileTextEncoding encoding;
+	if (f_guessCache.Lookup(filepath, filesize, mtime, guessEncodingType, mapmaxlen, encoding))
+		return encoding;
+	std::vector<char> sample;
+	size_t headlen = 0;
+	if (!ReadSample(filepath, filesize, mapmaxlen < 0 ? filesize : mapmaxlen, guessEncodingType != 0, sample, headlen))
+		return Guess(ext, nullptr, 0, guessEncodingType);
+	// Pieces of the sample are already cut at character boundaries
+	encoding = GuessSample(ext, sample.data(), sample.size(), headlen, guessEncodingType, false);
+	f_guessCache.Add(filepath, filesize, mtime, guessEncodingType, mapmaxlen, encoding);
+	return encoding;
+}
+
+/**
+ * @brief Try to deduce encodings of the files of a compare.
+ * The files after the first one are detected by threads of their own, so
+ * opening a compare waits for the slowest file, not for all of them.
+ * @param [in] filepaths Full paths to the files.
+ * @param [in] guessEncodingType Try to guess codepage (not just unicode encoding).
+ * @return Encodings of the files, in same order.
+ */
+std::vector<FileTextEncoding> GuessFiles(const std::vector<String>& filepaths, int guessEncodingType)
+{
+	std::vector<FileTextEncoding> encodings(filepaths.size());
+	std::vector<std::unique_ptr<Poco::Thread>> threads;
+	for (size_t i = 1; i < filepaths.size(); ++i)
+	{
+		threads.emplace_back(new Poco::Thread());
+		threads.back()->startFunc([&filepaths, &encodings, i, guessEncodingType]()
+			{ encodings[i] = Guess(filepaths[i], guessEncodingType); });
+	}
+	if (!filepaths.empty())
+		encodings[0] = Guess(filepaths[0], guessEncodingType);
+	for (auto& thread : threads)
+		thread->join();
+	return encodings;
 }
 
 }
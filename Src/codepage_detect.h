@@ -5,6 +5,7 @@
  */
 #pragma once
 
+#include <vector>
 #include "UnicodeString.h"
 #include "FileTextEncoding.h"
 
@@ -12,7 +13,12 @@ namespace codepage_detect
 {
 /** @brief Buffer size used in this file. */
 constexpr int BufSize = 65536;
+/** @brief Size of blocks sampled after a plain ASCII file head. */
+constexpr int SampleBlockSize = 4096;
+/** @brief Number of blocks sampled after a plain ASCII file head. */
+constexpr int SampleBlockCount = 8;
 
 FileTextEncoding Guess(const String& filepath, int guessEncodingType, ptrdiff_t mapmaxlen = BufSize);
-FileTextEncoding Guess(const String& ext, const void* src, size_t len, int guessEncodingType);
+FileTextEncoding Guess(const String& ext, const void* src, size_t len, int guessEncodingType, bool bTruncated = false);
+std::vector<FileTextEncoding> GuessFiles(const std::vector<String>& filepaths, int guessEncodingType);
 }
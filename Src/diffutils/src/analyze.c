@@ -1128,6 +1128,9 @@ void cleanup_file_buffers(struct file_data fd[])
 	
 	for (i = 1; i >= 0; --i)
 		free (fd[i].equivs);
+
+	for (i = 0; i < 2; ++i)
+		free (fd[i].filtered_flag);
 	
 	for (i = 0; i < 2; ++i)
 		free ((void *)(fd[i].linbuf + fd[i].linbuf_base));
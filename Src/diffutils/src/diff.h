@@ -162,6 +162,13 @@ EXTERN int	unidirectional_new_file_flag;
 /* Pipe each file's output through pr (-l).  */
 EXTERN int	paginate_flag;
 
+/* WinMerge: line filters (ignore lines matching regular expressions).
+   When set, called once for each file after its lines are hashed, with
+   the lines that may differ; sets flags[i] to 1 if lines[i] matches a
+   filter.  lines[nlines] is the end of the last line.  */
+EXTERN void	(*line_filter_fn) (void *, char const *const *lines, int nlines, char *flags);
+EXTERN void	*line_filter_data;
+
 enum line_class {
   /* Lines taken from just the first file.  */
   OLD,
@@ -291,6 +298,12 @@ struct file_data {
     /* 1 if file ends in a line with no final newline. */
     int		    missing_newline;
 
+    /* WinMerge: vector, indexed by line number like linbuf, containing
+       1 for a line matching a line filter.  Set by line_filter_fn for
+       linbuf[0 ... filtered_lines - 1], NULL if there are no filters.  */
+    char	   *filtered_flag;
+    int		    filtered_lines;
+
     /* 1 more than the maximum equivalence value used for this or its
        sibling file. */
     int equiv_max;
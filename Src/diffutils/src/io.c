@@ -148,6 +148,21 @@ sip (struct file_data *current, int skip_test)
       current->bufsize = sizeof (word);
       current->buffered_chars = 0;
     }
+  else if (current->buffer != NULL)
+    {
+      /* WinMerge: the caller has already read the start of the file
+         (see DiffFileData::OpenFiles), and the descriptor is positioned
+         after the buffered chars.  Test the same amount of the file
+         as if we had read it here.  */
+      if (current->bufsize < current->buffered_chars + sizeof (word) + 1)
+        {
+          current->bufsize = current->buffered_chars + sizeof (word) + 1;
+          current->buffer = xrealloc (current->buffer, current->bufsize);
+        }
+      if (!skip_test && !get_unicode_signature(current, NULL))
+        isbinary = binary_file_p(current->buffer,
+          min (current->buffered_chars, (FSIZE)STAT_BLOCKSIZE (current->stat)));
+    }
   else
     {
       current->bufsize = current->buffered_chars
@@ -466,6 +481,16 @@ hashing_done:;
   equivs = eqs;
   equivs_alloc = eqs_alloc;
   equivs_index = eqs_index;
+
+  /* WinMerge: match line filters once for each line that may differ,
+     instead of for each line of each hunk.  */
+  if (line_filter_fn)
+    {
+      current->filtered_lines = current->buffered_lines;
+      current->filtered_flag = (char *) xmalloc (current->buffered_lines + 1);
+      (*line_filter_fn) (line_filter_data, (char const *const *) linbuf,
+                         current->buffered_lines, current->filtered_flag);
+    }
 }
 
 /* Convert any non octet encoded unicode text to UTF-8.
@@ -1041,12 +1066,14 @@ read_files (struct file_data filevec[], int pretend_binary, int *bin_file)
 		FSIZE tmin_bufsize = max(filevec[0].buffered_chars, filevec[1].buffered_chars);
 		tmax_bufsize = max (tmax_bufsize, tmin_bufsize);
 
-		if (tmax_bufsize > filevec[0].bufsize)
+		// WinMerge: buffers taken over from the caller may be larger,
+		// so make them the same size also by shrinking
+		if (tmax_bufsize != filevec[0].bufsize)
 		  {
 			filevec[0].buffer = xrealloc (filevec[0].buffer, tmax_bufsize);
 			filevec[0].bufsize = tmax_bufsize;
 		  }
-		if (filevec[0].desc != filevec[1].desc && tmax_bufsize > filevec[1].bufsize)
+		if (filevec[0].desc != filevec[1].desc && tmax_bufsize != filevec[1].bufsize)
 		  {
 			filevec[1].buffer = xrealloc (filevec[1].buffer, tmax_bufsize);
 			filevec[1].bufsize = tmax_bufsize;
@@ -575,6 +575,12 @@
 #define IDC_MARKER1_BKGD_COLOR          1616
 #define IDC_MARKER2_BKGD_COLOR          1617
 #define IDC_MARKER3_BKGD_COLOR          1618
+#define IDC_STAT_PHASES                 1619
+#define IDC_STAT_EXPORT_TRACE           1620
+#define IDC_COMPARE_STREAMING_LIMIT     1621
+#define IDC_COMPARE_WATCH_FOLDERS       1622
+#define IDC_COMPARETABLE_MATCH_ROWS     1623
+#define IDC_COMPARETABLE_KEY_COLUMN     1624
 // CrystalEdit dialog controls
 #define IDC_EDIT_WHOLE_WORD             8603
 #define IDC_EDIT_MATCH_CASE             8604
@@ -1515,7 +1521,7 @@
 #define _APS_3D_CONTROLS                     1
 #define _APS_NEXT_RESOURCE_VALUE        253
 #define _APS_NEXT_COMMAND_VALUE         34194
-#define _APS_NEXT_CONTROL_VALUE         1619
+#define _APS_NEXT_CONTROL_VALUE         1625
 #define _APS_NEXT_SYMED_VALUE           118
 #endif
 #endif
@@ -1,21 +1,29 @@
 #include "pch.h"
 #include <io.h>
+#include <algorithm>
 #include <sys/stat.h>
 #include "CompareOptions.h"
 extern "C" {
 #include "../Externals/xdiff/xinclude.h"
 }
 
-static bool read_mmfile(int fd, mmfile_t& mmfile)
+static bool read_mmfile(struct file_data& filevec, mmfile_t& mmfile)
 {
 	struct _stat64 st;
-	if (myfstat(fd, &st) == -1)
+	if (myfstat(filevec.desc, &st) == -1)
 		return false;
 	if (st.st_size < 0 || st.st_size > INT32_MAX)
 		return false;
 	size_t sz = static_cast<size_t>(st.st_size);
-	mmfile.ptr = static_cast<char *>(malloc(sz ? sz : 1));
-	if (sz && _read(fd, mmfile.ptr, static_cast<unsigned>(sz)) == -1) {
+	// Take over start of the file the caller has already read
+	size_t buffered = filevec.buffer ? (std::min)(static_cast<size_t>(filevec.buffered_chars), sz) : 0;
+	mmfile.ptr = static_cast<char *>(realloc(filevec.buffer, sz ? sz : 1));
+	if (!mmfile.ptr)
+		return false;
+	filevec.buffer = nullptr;
+	filevec.bufsize = 0;
+	filevec.buffered_chars = 0;
+	if (sz > buffered && _read(filevec.desc, mmfile.ptr + buffered, static_cast<unsigned>(sz - buffered)) == -1) {
 		return false;
 	}
 	mmfile.size = static_cast<long>(sz);
@@ -127,9 +135,9 @@ struct change * diff_2_files_xdiff (struct file_data filevec[], int bMoved_block
 	xdemitconf_t xecfg = { 0 };
 	xdemitcb_t ecb = { 0 };
 
-	if (!read_mmfile(filevec[0].desc, mmfile1))
+	if (!read_mmfile(filevec[0], mmfile1))
 		goto abort;
-	if (!read_mmfile(filevec[1].desc, mmfile2))
+	if (!read_mmfile(filevec[1], mmfile2))
 		goto abort;
 
 	xpp.flags = xdl_flags;
@@ -175,6 +183,18 @@ struct change * diff_2_files_xdiff (struct file_data filevec[], int bMoved_block
 		filevec[0].missing_newline = is_missing_newline(mmfile1);
 		filevec[1].missing_newline = is_missing_newline(mmfile2);
 
+		if (line_filter_fn)
+		{
+			for (int i = 0; i < 2; ++i)
+			{
+				filevec[i].filtered_lines = filevec[i].valid_lines;
+				filevec[i].filtered_flag = static_cast<char *>(malloc(filevec[i].valid_lines + 1));
+				if (!filevec[i].filtered_flag)
+					goto abort;
+				(*line_filter_fn)(line_filter_data, filevec[i].linbuf, filevec[i].valid_lines, filevec[i].filtered_flag);
+			}
+		}
+
 		change *prev = nullptr;
 		for (xdchange_t* xcur = xscr; xcur; xcur = xcur->next)
 		{
@@ -0,0 +1,646 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  Benchmark.cpp
+ *
+ * @brief Implementation of Benchmark class
+ */
+
+#include "pch.h"
+#include "Benchmark.h"
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <Poco/File.h>
+#include <Poco/FileStream.h>
+#include <Poco/Stopwatch.h>
+#include <Poco/Thread.h>
+#ifdef _MSC_VER
+#include <crtdbg.h>
+#endif
+#include "ByteComparator.h"
+#include "BinaryCompare.h"
+#include "CompareOptions.h"
+#include "CompareStats.h"
+#include "DiffContext.h"
+#include "DiffList.h"
+#include "DiffThread.h"
+#include "DiffWrapper.h"
+#include "DirScan.h"
+#include "FileFilterHelper.h"
+#include "FileTextStats.h"
+#include "FilterList.h"
+#include "PathContext.h"
+#include "stringdiffs.h"
+#include "UniFile.h"
+#include "unicoder.h"
+
+namespace
+{
+
+/** @brief Minimum time each benchmark is repeated for, in microseconds. */
+const Poco::Timestamp::TimeDiff MinTime = 500 * 1000;
+const int MaxIterations = 1000;
+
+/** @brief Keeps the compilers from optimizing away the benchmarked calls. */
+volatile int64_t g_sink;
+
+std::atomic<int64_t> g_nAllocs;
+std::atomic<int64_t> g_nAllocBytes;
+
+#if defined(_MSC_VER) && defined(_DEBUG)
+int AllocHook(int allocType, void *, size_t size, int blockUse, long, const unsigned char *, int)
+{
+	if ((allocType == _HOOK_ALLOC || allocType == _HOOK_REALLOC) && blockUse != _CRT_BLOCK)
+	{
+		++g_nAllocs;
+		g_nAllocBytes += size;
+	}
+	return TRUE;
+}
+#endif
+
+/**
+ * @brief Counts heap allocations made during its lifetime.
+ * Debug builds of MSVC count all CRT allocations with an allocation hook,
+ * other compilers count operator new calls. Release builds of MSVC link
+ * the operator new of MFC, so they don't count allocations.
+ */
+class AllocationCounter
+{
+public:
+	AllocationCounter() : m_nAllocs(g_nAllocs), m_nAllocBytes(g_nAllocBytes)
+	{
+#if defined(_MSC_VER) && defined(_DEBUG)
+		m_pPrevHook = _CrtSetAllocHook(AllocHook);
+#endif
+	}
+	~AllocationCounter()
+	{
+#if defined(_MSC_VER) && defined(_DEBUG)
+		_CrtSetAllocHook(m_pPrevHook);
+#endif
+	}
+	static bool IsAvailable()
+	{
+#if defined(_MSC_VER) && !defined(_DEBUG)
+		return false;
+#else
+		return true;
+#endif
+	}
+	int64_t GetAllocs() const { return g_nAllocs - m_nAllocs; }
+	int64_t GetAllocBytes() const { return g_nAllocBytes - m_nAllocBytes; }
+
+private:
+	int64_t m_nAllocs;
+	int64_t m_nAllocBytes;
+#if defined(_MSC_VER) && defined(_DEBUG)
+	_CRT_ALLOC_HOOK m_pPrevHook;
+#endif
+};
+
+const char *const Words[] =
+{
+	"int", "return", "if", "else", "for", "while", "const", "String", "value",
+	"count", "index", "result", "buffer", "std::vector<int>", "nullptr", "true",
+	"false", "// TODO", "0", "1", "42", "2021-04-01", "=", "+=", "(", ")", "{",
+	"}", ";", "Gr\xc3\xbc\xc3\x9f" "e", "caf\xc3\xa9", "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e",
+};
+
+std::string GenerateLine(std::mt19937& rng)
+{
+	if (rng() % 50 == 0)
+		return "";
+	std::string line(rng() % 4, '\t');
+	const int nWords = 1 + rng() % 12;
+	for (int i = 0; i < nWords; ++i)
+	{
+		if (i > 0)
+			line += ' ';
+		line += Words[rng() % (sizeof(Words) / sizeof(Words[0]))];
+	}
+	return line;
+}
+
+/** @brief Change a word of a line, or append one. */
+std::string ModifyLine(const std::string& line, std::mt19937& rng)
+{
+	const std::string word = Words[rng() % (sizeof(Words) / sizeof(Words[0]))];
+	const size_t pos = line.find(' ', rng() % (line.length() + 1));
+	if (pos == std::string::npos)
+		return line + " " + word;
+	const size_t end = line.find(' ', pos + 1);
+	return line.substr(0, pos + 1) + word + (end == std::string::npos ? "" : line.substr(end));
+}
+
+std::string JoinLines(const std::vector<std::string>& lines)
+{
+	std::string text;
+	for (const std::string& line : lines)
+		text += line + "\r\n";
+	return text;
+}
+
+/** @brief Decode UTF-8 to code points, the corpus has only BMP characters. */
+std::vector<unsigned> DecodeUTF8(const std::string& text)
+{
+	std::vector<unsigned> chars;
+	chars.reserve(text.length());
+	for (size_t i = 0; i < text.length(); )
+	{
+		const unsigned char ch = text[i];
+		if (ch < 0x80)
+		{
+			chars.push_back(ch);
+			i += 1;
+		}
+		else if (ch < 0xe0)
+		{
+			chars.push_back(((ch & 0x1f) << 6) | (text[i + 1] & 0x3f));
+			i += 2;
+		}
+		else
+		{
+			chars.push_back(((ch & 0x0f) << 12) | ((text[i + 1] & 0x3f) << 6) | (text[i + 2] & 0x3f));
+			i += 3;
+		}
+	}
+	return chars;
+}
+
+std::string EncodeUTF16LE(const std::vector<unsigned>& chars)
+{
+	std::string data("\xff\xfe", 2);
+	for (unsigned ch : chars)
+	{
+		data += static_cast<char>(ch & 0xff);
+		data += static_cast<char>(ch >> 8);
+	}
+	return data;
+}
+
+/** @brief Encode to Windows-1252, which equals Latin-1 for the corpus. */
+std::string EncodeAnsi(const std::vector<unsigned>& chars)
+{
+	std::string data;
+	data.reserve(chars.size());
+	for (unsigned ch : chars)
+		data += ch < 0x100 ? static_cast<char>(ch) : '?';
+	return data;
+}
+
+void WriteFile(const std::string& path, const std::string& data)
+{
+	Poco::FileOutputStream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+	file.write(data.data(), data.length());
+}
+
+/**
+ * @brief Write files of one side of a folder tree.
+ * Right side misses every 50th file of left side, has every 50th file
+ * left side doesn't have and every 7th file differs.
+ */
+void GenerateTree(const std::string& dir, int depth, int fanout, int nFiles, bool bRight, int& counter)
+{
+	Poco::File(dir).createDirectories();
+	for (int i = 0; i < nFiles; ++i)
+	{
+		const int n = counter++;
+		if (n % 50 == (bRight ? 0 : 25))
+			continue;
+		std::string data = "file " + std::to_string(n) + "\r\n";
+		for (int j = 0; j < n % 16; ++j)
+			data += "line " + std::to_string(j) + " of file " + std::to_string(n) + "\r\n";
+		if (bRight && n % 7 == 0)
+			data += "changed\r\n";
+		WriteFile(dir + "/file" + std::to_string(n) + ".txt", data);
+	}
+	if (depth > 0)
+	{
+		for (int i = 0; i < fanout; ++i)
+			GenerateTree(dir + "/folder" + std::to_string(i), depth - 1, fanout, nFiles, bRight, counter);
+	}
+}
+
+/**
+ * @brief Compare folders like the folder compare window does.
+ * @return Number of items found.
+ */
+int CompareFolders(const PathContext& paths, int nCompMethod)
+{
+	CompareStats stats(paths.GetSize());
+	FileFilterHelper filter;
+	filter.UseMask(true);
+	filter.SetMask(_T("*.*"));
+
+	DIFFOPTIONS options = {};
+	CDiffContext ctxt(paths, nCompMethod);
+	ctxt.InitDiffItemList();
+	ctxt.CreateCompareOptions(nCompMethod, options);
+	ctxt.m_nQuickCompareLimit = 4 * 1024 * 1024;
+	ctxt.m_bWalkUniques = true;
+	ctxt.m_bRecursive = true;
+	ctxt.m_pCompareStats = &stats;
+	ctxt.m_piFilterGlobal = &filter;
+
+	CDiffThread diffThread;
+	diffThread.SetContext(&ctxt);
+	diffThread.SetCollectFunction([](DiffFuncStruct* myStruct) {
+		PathContext paths = myStruct->context->GetNormalizedPaths();
+		String subdir[3] = { _T(""), _T(""), _T("") };
+		DirScan_GetItems(paths, subdir, myStruct, false, -1, nullptr, myStruct->context->m_bWalkUniques);
+	});
+	diffThread.SetCompareFunction([](DiffFuncStruct* myStruct) {
+		DirScan_CompareItems(myStruct, nullptr);
+	});
+	diffThread.CompareDirectories();
+	while (diffThread.GetThreadState() != CDiffThread::THREAD_COMPLETED)
+		Poco::Thread::sleep(1);
+	return stats.GetTotalItems();
+}
+
+}
+
+#if !defined(_MSC_VER)
+void *operator new(size_t size)
+{
+	++g_nAllocs;
+	g_nAllocBytes += size;
+	if (void *p = malloc(size > 0 ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
+#endif
+
+/**
+ * @brief Constructor.
+ * @param [in] sWorkDir Folder for the corpus, removed by destructor.
+ * @param [in] nScale Multiplier of corpus size.
+ */
+Benchmark::Benchmark(const String& sWorkDir, int nScale)
+: m_sWorkDir(sWorkDir)
+, m_nScale(nScale > 0 ? nScale : 1)
+{
+}
+
+Benchmark::~Benchmark()
+{
+	try
+	{
+		Poco::File(ucr::toUTF8(m_sWorkDir)).remove(true);
+	}
+	catch (...)
+	{
+	}
+}
+
+/**
+ * @brief Generate source-like lines.
+ * Same seed gives same lines with every compiler and platform.
+ */
+std::vector<std::string> Benchmark::GenerateLines(int nLines, unsigned seed)
+{
+	std::mt19937 rng(seed);
+	std::vector<std::string> lines;
+	lines.reserve(nLines);
+	for (int i = 0; i < nLines; ++i)
+		lines.push_back(GenerateLine(rng));
+	return lines;
+}
+
+/**
+ * @brief Return edited copy of lines.
+ * @param [in] dEditDensity Probability of a line to be changed, deleted or
+ *   followed by an inserted line.
+ */
+std::vector<std::string> Benchmark::EditLines(const std::vector<std::string>& lines, double dEditDensity, unsigned seed)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<double> dist(0.0, 1.0);
+	std::vector<std::string> result;
+	result.reserve(lines.size());
+	for (const std::string& line : lines)
+	{
+		if (dist(rng) >= dEditDensity)
+		{
+			result.push_back(line);
+			continue;
+		}
+		switch (rng() % 3)
+		{
+		case 0:
+			result.push_back(ModifyLine(line, rng));
+			break;
+		case 1:
+			break;
+		default:
+			result.push_back(line);
+			result.push_back(GenerateLine(rng));
+			break;
+		}
+	}
+	return result;
+}
+
+/**
+ * @brief Write corpus files to the work folder.
+ */
+bool Benchmark::GenerateCorpus()
+{
+	const std::string dir = ucr::toUTF8(m_sWorkDir);
+	auto path = [this](const char *name) { return m_sWorkDir + _T("/") + ucr::toTString(name); };
+	try
+	{
+		Poco::File(dir).createDirectories();
+
+		m_lines[0] = GenerateLines(100000 * m_nScale, 1);
+		m_lines[1] = EditLines(m_lines[0], 0.01, 2);
+		static const char *const textNames[] = { "left.txt", "right.txt" };
+		for (int i = 0; i < 2; ++i)
+		{
+			WriteFile(dir + "/" + textNames[i], JoinLines(m_lines[i]));
+			m_sText[i] = path(textNames[i]);
+		}
+
+		const std::string text = JoinLines(m_lines[0]);
+		const std::vector<unsigned> chars = DecodeUTF8(text);
+		WriteFile(dir + "/utf8.txt", "\xef\xbb\xbf" + text);
+		WriteFile(dir + "/utf16le.txt", EncodeUTF16LE(chars));
+		WriteFile(dir + "/ansi.txt", EncodeAnsi(chars));
+		m_sEncoded[0] = path("utf8.txt");
+		m_sEncoded[1] = path("utf16le.txt");
+		m_sEncoded[2] = path("ansi.txt");
+
+		std::mt19937 rng(3);
+		std::string data(16 * 1024 * 1024 * static_cast<size_t>(m_nScale), '\0');
+		for (char& ch : data)
+			ch = static_cast<char>(rng());
+		WriteFile(dir + "/left.bin", data);
+		WriteFile(dir + "/right.bin", data);
+		m_sBinary[0] = path("left.bin");
+		m_sBinary[1] = path("right.bin");
+
+		static const char *const sides[] = { "left", "right" };
+		for (int i = 0; i < 2; ++i)
+		{
+			int counter = 0;
+			GenerateTree(dir + "/deep/" + sides[i], 5, 3, 4 * m_nScale, i == 1, counter);
+			counter = 0;
+			GenerateTree(dir + "/flat/" + sides[i], 0, 0, 2000 * m_nScale, i == 1, counter);
+		}
+		m_sDeepTree[0] = path("deep/left");
+		m_sDeepTree[1] = path("deep/right");
+		m_sFlatTree[0] = path("flat/left");
+		m_sFlatTree[1] = path("flat/right");
+	}
+	catch (const Poco::Exception& e)
+	{
+		std::cerr << "Cannot generate corpus: " << e.displayText() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Run benchmarks and write results.
+ * @param [in] sFilter Run only benchmarks whose name contains this.
+ */
+void Benchmark::Run(const std::string& sFilter, std::ostream& out)
+{
+	m_sFilter = sFilter;
+	WriteHeader(out);
+	RunByteComparator(out);
+	RunBinaryCompare(out);
+	RunDiff(out);
+	RunWordDiff(out);
+	RunUniMemFile(out);
+	RunFilterList(out);
+	RunDirScan(out);
+}
+
+void Benchmark::WriteHeader(std::ostream& out)
+{
+	out << "benchmark,iterations,bytes,items,time_us,mb_per_s,items_per_s,allocs,alloc_bytes" << std::endl;
+}
+
+/**
+ * @brief Write result as a CSV line, fields not measured are left empty.
+ */
+void Benchmark::WriteResult(std::ostream& out, const Result& result)
+{
+	char buf[32];
+	out << result.name << "," << result.iterations << "," << result.bytes << "," << result.items << ","
+		<< result.elapsed << ",";
+	if (result.elapsed > 0 && result.bytes > 0)
+	{
+		// Bytes per microsecond equals megabytes per second
+		snprintf(buf, sizeof(buf), "%.2f", static_cast<double>(result.bytes) / result.elapsed);
+		out << buf;
+	}
+	out << ",";
+	if (result.elapsed > 0 && result.items > 0)
+	{
+		snprintf(buf, sizeof(buf), "%.0f", result.items * 1e6 / result.elapsed);
+		out << buf;
+	}
+	out << ",";
+	if (result.allocs >= 0)
+		out << result.allocs << "," << result.allocBytes;
+	else
+		out << ",";
+	out << std::endl;
+}
+
+/**
+ * @brief Repeat fn until MinTime is used and write per-iteration averages.
+ * The first call is not measured, it fills caches.
+ */
+template<typename Function>
+void Benchmark::Measure(std::ostream& out, const std::string& name, int64_t bytes, int64_t items, Function fn)
+{
+	if (!m_sFilter.empty() && name.find(m_sFilter) == std::string::npos)
+		return;
+	fn();
+
+	Result result = { name, 0, bytes, items, 0, -1, -1 };
+	{
+		AllocationCounter counter;
+		Poco::Stopwatch stopwatch;
+		stopwatch.start();
+		do
+		{
+			fn();
+			++result.iterations;
+		} while (stopwatch.elapsed() < MinTime && result.iterations < MaxIterations);
+		stopwatch.stop();
+		result.elapsed = stopwatch.elapsed() / result.iterations;
+		if (AllocationCounter::IsAvailable())
+		{
+			result.allocs = counter.GetAllocs() / result.iterations;
+			result.allocBytes = counter.GetAllocBytes() / result.iterations;
+		}
+	}
+	WriteResult(out, result);
+}
+
+void Benchmark::RunByteComparator(std::ostream& out)
+{
+	const std::string left = JoinLines(m_lines[0]);
+	const std::string right = left;
+	const int64_t bytes = static_cast<int64_t>(left.length() + right.length());
+	auto run = [&](const char *name, WhitespaceIgnoreChoices ignoreWhitespace)
+	{
+		CompareOptions options;
+		options.m_ignoreWhitespace = ignoreWhitespace;
+		QuickCompareOptions quickOptions(options);
+		Measure(out, name, bytes, m_lines[0].size(), [&]()
+			{
+				CompareEngines::ByteComparator comparator(&quickOptions);
+				FileTextStats stats0, stats1;
+				const char *ptr0 = left.data();
+				const char *ptr1 = right.data();
+				g_sink += comparator.CompareBuffers(stats0, stats1, ptr0, ptr1,
+					left.data() + left.length(), right.data() + right.length(), true, true, 0, 0);
+			});
+	};
+	run("ByteComparator/exact", WHITESPACE_COMPARE_ALL);
+	run("ByteComparator/ignore-ws-change", WHITESPACE_IGNORE_CHANGE);
+}
+
+void Benchmark::RunBinaryCompare(std::ostream& out)
+{
+	const int64_t size = Poco::File(ucr::toUTF8(m_sBinary[0])).getSize();
+	DIFFITEM di;
+	di.diffFileInfo[0].size = di.diffFileInfo[1].size = size;
+	CompareEngines::BinaryCompare compare;
+	const PathContext files(m_sBinary[0], m_sBinary[1]);
+	Measure(out, "BinaryCompare/identical", size * 2, 1, [&]()
+		{
+			g_sink += compare.CompareFiles(files, di);
+		});
+}
+
+void Benchmark::RunDiff(std::ostream& out)
+{
+	static const std::pair<const char *, int> algorithms[] =
+	{
+		{ "Diff/diffutils", DIFF_ALGORITHM_DEFAULT },
+		{ "Diff/xdiff-minimal", DIFF_ALGORITHM_MINIMAL },
+		{ "Diff/xdiff-patience", DIFF_ALGORITHM_PATIENCE },
+		{ "Diff/xdiff-histogram", DIFF_ALGORITHM_HISTOGRAM },
+	};
+	const int64_t bytes = Poco::File(ucr::toUTF8(m_sText[0])).getSize() + Poco::File(ucr::toUTF8(m_sText[1])).getSize();
+	const int64_t lines = m_lines[0].size() + m_lines[1].size();
+	const PathContext files(m_sText[0], m_sText[1]);
+	for (const auto& algorithm : algorithms)
+	{
+		Measure(out, algorithm.first, bytes, lines, [&]()
+			{
+				DIFFOPTIONS options = {};
+				options.nDiffAlgorithm = algorithm.second;
+				DiffList diffList;
+				CDiffWrapper diffWrapper;
+				diffWrapper.SetOptions(&options);
+				diffWrapper.SetCreateDiffList(&diffList);
+				diffWrapper.SetPaths(files, false);
+				diffWrapper.SetCompareFiles(files);
+				diffWrapper.RunFileDiff();
+				g_sink += diffList.GetSize();
+			});
+	}
+}
+
+void Benchmark::RunWordDiff(std::ostream& out)
+{
+	std::mt19937 rng(4);
+	std::vector<std::pair<String, String>> pairs;
+	int64_t bytes = 0;
+	const size_t nPairs = (std::min)(m_lines[0].size(), static_cast<size_t>(20000 * m_nScale));
+	for (size_t i = 0; i < nPairs; ++i)
+	{
+		pairs.emplace_back(ucr::toTString(m_lines[0][i]), ucr::toTString(ModifyLine(m_lines[0][i], rng)));
+		bytes += (pairs.back().first.length() + pairs.back().second.length()) * sizeof(TCHAR);
+	}
+	strdiff::Init();
+	auto run = [&](const char *name, bool byteLevel)
+	{
+		Measure(out, name, bytes, pairs.size(), [&]()
+			{
+				for (const auto& pair : pairs)
+					g_sink += strdiff::ComputeWordDiffs(pair.first, pair.second, true, false, WHITESPACE_COMPARE_ALL, 1, byteLevel).size();
+			});
+	};
+	run("WordDiff/words", false);
+	run("WordDiff/bytes", true);
+	strdiff::Close();
+}
+
+void Benchmark::RunUniMemFile(std::ostream& out)
+{
+	static const char *const names[] = { "UniMemFile/utf8", "UniMemFile/utf16le", "UniMemFile/ansi" };
+	for (int i = 0; i < 3; ++i)
+	{
+		const String& path = m_sEncoded[i];
+		Measure(out, names[i], Poco::File(ucr::toUTF8(path)).getSize(), m_lines[0].size(), [&]()
+			{
+				UniMemFile file;
+				if (!file.OpenReadOnly(path))
+					return;
+				file.ReadBom();
+				if (!file.HasBom())
+				{
+					file.SetUnicoding(ucr::NONE);
+					file.SetCodepage(1252);
+				}
+				String line, eol;
+				bool lossy = false;
+				while (file.ReadString(line, eol, &lossy))
+					g_sink += line.length();
+				file.Close();
+			});
+	}
+}
+
+void Benchmark::RunFilterList(std::ostream& out)
+{
+	FilterList filterList;
+	filterList.AddRegExp("^\\s*//");
+	filterList.AddRegExp("TODO|FIXME");
+	filterList.AddRegExp("[0-9]{4}-[0-9]{2}-[0-9]{2}");
+	int64_t bytes = 0;
+	for (const std::string& line : m_lines[0])
+		bytes += line.length();
+	Measure(out, "FilterList/Match", bytes, m_lines[0].size(), [&]()
+		{
+			for (const std::string& line : m_lines[0])
+				g_sink += filterList.Match(line);
+		});
+}
+
+void Benchmark::RunDirScan(std::ostream& out)
+{
+	const PathContext deep(m_sDeepTree[0], m_sDeepTree[1]);
+	const PathContext flat(m_sFlatTree[0], m_sFlatTree[1]);
+	int nItems = CompareFolders(deep, CMP_DATE_SIZE);
+	Measure(out, "DirScan/deep-datesize", 0, nItems, [&]() { CompareFolders(deep, CMP_DATE_SIZE); });
+	nItems = CompareFolders(flat, CMP_DATE_SIZE);
+	Measure(out, "DirScan/flat-datesize", 0, nItems, [&]() { CompareFolders(flat, CMP_DATE_SIZE); });
+	Measure(out, "DirScan/flat-full", 0, nItems, [&]() { CompareFolders(flat, CMP_CONTENT); });
+}
@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  Benchmark.h
+ *
+ * @brief Declaration of Benchmark class
+ */
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include "UnicodeString.h"
+
+/**
+ * @brief Micro-benchmarks of compare engines and text processing.
+ *
+ * Generates a synthetic corpus to a work folder: two versions of a large
+ * text file with a controlled edit density, the same text in several
+ * encodings, two large binary files and two versions of a deep folder tree
+ * and of a folder with many small files. Then times the compare routines
+ * WinMerge spends most of its time in against that corpus.
+ *
+ * Each benchmark writes one CSV line with per-iteration time, throughput
+ * and allocation counts, so that runs of different builds can be compared
+ * line by line.
+ */
+class Benchmark
+{
+public:
+	/** @brief Per-iteration measurements of one benchmark. */
+	struct Result
+	{
+		std::string name;
+		int iterations;
+		int64_t bytes; /**< Bytes processed */
+		int64_t items; /**< Lines, files or matches processed */
+		int64_t elapsed; /**< Microseconds */
+		int64_t allocs; /**< Allocations, -1 if they are not counted */
+		int64_t allocBytes;
+	};
+
+	enum { MaxScale = 64 }; /**< Largest multiplier of corpus size */
+
+	Benchmark(const String& sWorkDir, int nScale);
+	~Benchmark();
+	bool GenerateCorpus();
+	void Run(const std::string& sFilter, std::ostream& out);
+
+	static std::vector<std::string> GenerateLines(int nLines, unsigned seed);
+	static std::vector<std::string> EditLines(const std::vector<std::string>& lines, double dEditDensity, unsigned seed);
+	static void WriteHeader(std::ostream& out);
+	static void WriteResult(std::ostream& out, const Result& result);
+
+private:
+	template<typename Function>
+	void Measure(std::ostream& out, const std::string& name, int64_t bytes, int64_t items, Function fn);
+	void RunByteComparator(std::ostream& out);
+	void RunBinaryCompare(std::ostream& out);
+	void RunDiff(std::ostream& out);
+	void RunWordDiff(std::ostream& out);
+	void RunUniMemFile(std::ostream& out);
+	void RunFilterList(std::ostream& out);
+	void RunDirScan(std::ostream& out);
+
+	String m_sWorkDir;
+	int m_nScale; /**< Multiplier of corpus size */
+	std::string m_sFilter; /**< Run only benchmarks containing this in name */
+	std::vector<std::string> m_lines[2]; /**< Lines of both text files, UTF-8 */
+	String m_sText[2];
+	String m_sEncoded[3]; /**< UTF-8, UTF-16LE and ANSI versions of left text */
+	String m_sBinary[2];
+	String m_sDeepTree[2];
+	String m_sFlatTree[2];
+};
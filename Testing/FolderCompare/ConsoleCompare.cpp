@@ -0,0 +1,664 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  ConsoleCompare.cpp
+ *
+ * @brief Implementation of ConsoleCompare class
+ */
+
+#include "pch.h"
+#include "ConsoleCompare.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <Poco/DateTimeFormat.h>
+#include <Poco/DateTimeFormatter.h>
+#include <Poco/Stopwatch.h>
+#include <Poco/Thread.h>
+#include "ArchiveCache.h"
+#include "DiffContext.h"
+#include "DiffThread.h"
+#include "DiffWrapper.h"
+#include "DirScan.h"
+#include "FileFilterHelper.h"
+#include "FolderCmp.h"
+#include "paths.h"
+#include "StreamingDiff.h"
+#include "unicoder.h"
+
+ConsoleCompare::ConsoleCompare()
+: m_bFiles(false)
+, m_bArchives(false)
+, m_bNoArchives(false)
+, m_nCompMethod(CMP_CONTENT)
+, m_options{}
+, m_bRecursive(false)
+, m_format(OutputFormat::TEXT)
+, m_nStreamingLimit(1024 * 1024 * 1024)
+, m_bQuiet(false)
+, m_counts{}
+, m_times{}
+{
+}
+
+/**
+ * @brief Parse command line.
+ * Option names follow the WinMerge command line where there is one.
+ * @return false if the command line is not valid, see GetError().
+ */
+bool ConsoleCompare::ParseArgs(int argc, const char *const argv[])
+{
+	for (int i = 1; i < argc; ++i)
+	{
+		const char *arg = argv[i];
+		if (arg[0] != '-' && arg[0] != '/')
+		{
+			if (m_paths.GetSize() == 3)
+			{
+				m_sError = _T("Too many paths");
+				return false;
+			}
+			m_paths.SetPath(m_paths.GetSize(), ucr::toTString(arg));
+			continue;
+		}
+		const std::string name = arg + 1;
+		auto value = [&](String& str) -> bool
+		{
+			if (i + 1 >= argc)
+			{
+				m_sError = _T("Missing value for option '") + ucr::toTString(arg) + _T("'");
+				return false;
+			}
+			str = ucr::toTString(argv[++i]);
+			return true;
+		};
+		String param;
+		if (name == "r")
+			m_bRecursive = true;
+		else if (name == "f")
+		{
+			if (!value(m_sFilter))
+				return false;
+		}
+		else if (name == "m")
+		{
+			if (!value(param))
+				return false;
+			param = strutils::makelower(param);
+			if (param == _T("full"))
+				m_nCompMethod = CMP_CONTENT;
+			else if (param == _T("quick"))
+				m_nCompMethod = CMP_QUICK_CONTENT;
+			else if (param == _T("binary"))
+				m_nCompMethod = CMP_BINARY_CONTENT;
+			else if (param == _T("date"))
+				m_nCompMethod = CMP_DATE;
+			else if (param == _T("sizedate") || param == _T("datesize"))
+				m_nCompMethod = CMP_DATE_SIZE;
+			else if (param == _T("size"))
+				m_nCompMethod = CMP_SIZE;
+			else
+			{
+				m_sError = _T("Unknown compare method '") + param + _T("'");
+				return false;
+			}
+		}
+		else if (name == "ignorews")
+			m_options.nIgnoreWhitespace = WHITESPACE_IGNORE_CHANGE;
+		else if (name == "ignoreallws")
+			m_options.nIgnoreWhitespace = WHITESPACE_IGNORE_ALL;
+		else if (name == "ignoreblanklines")
+			m_options.bIgnoreBlankLines = true;
+		else if (name == "ignorecase")
+			m_options.bIgnoreCase = true;
+		else if (name == "ignoreeol")
+			m_options.bIgnoreEol = true;
+		else if (name == "format")
+		{
+			if (!value(param))
+				return false;
+			if (param == _T("text"))
+				m_format = OutputFormat::TEXT;
+			else if (param == _T("jsonl") || param == _T("json"))
+				m_format = OutputFormat::JSONL;
+			else if (param == _T("csv"))
+				m_format = OutputFormat::CSV;
+			else
+			{
+				m_sError = _T("Unknown output format '") + param + _T("'");
+				return false;
+			}
+		}
+		else if (name == "o")
+		{
+			if (i + 1 >= argc)
+			{
+				m_sError = _T("Missing value for option '-o'");
+				return false;
+			}
+			m_sOutputFile = argv[++i];
+		}
+		else if (name == "q")
+			m_bQuiet = true;
+		else if (name == "noarchives")
+			m_bNoArchives = true;
+		else if (name == "streamlimit")
+		{
+			if (!value(param))
+				return false;
+			int64_t nMegaBytes = 0;
+			if (!ParseCount(argv[i], INT64_MAX / (1024 * 1024), nMegaBytes))
+			{
+				m_sError = _T("Invalid value for option '-streamlimit': ") + param;
+				return false;
+			}
+			m_nStreamingLimit = nMegaBytes * 1024 * 1024;
+		}
+		else if (name == "patch")
+		{
+			if (i + 1 >= argc)
+			{
+				m_sError = _T("Missing value for option '-patch'");
+				return false;
+			}
+			m_sPatchFile = argv[++i];
+		}
+		else
+		{
+			m_sError = _T("Unknown option '") + ucr::toTString(arg) + _T("'");
+			return false;
+		}
+	}
+
+	if (m_paths.GetSize() < 2)
+	{
+		m_sError = _T("Two or three paths are needed");
+		return false;
+	}
+	// "compare file dir" compares the file with the file of same name in dir
+	if (paths::DoesPathExist(m_paths[0]) == paths::IS_EXISTING_FILE &&
+		paths::DoesPathExist(m_paths[1]) == paths::IS_EXISTING_DIR && m_paths.GetSize() == 2)
+		m_paths[1] = paths::ConcatPath(m_paths[1], paths::FindFileName(m_paths[0]));
+	int nFiles = 0, nDirs = 0;
+	for (int i = 0; i < m_paths.GetSize(); ++i)
+	{
+		switch (paths::DoesPathExist(m_paths[i]))
+		{
+		case paths::IS_EXISTING_FILE: ++nFiles; break;
+		case paths::IS_EXISTING_DIR: ++nDirs; break;
+		default:
+			m_sError = _T("Path does not exist: ") + m_paths[i];
+			return false;
+		}
+	}
+	if (nFiles > 0 && nDirs > 0)
+	{
+		m_sError = _T("Cannot compare files with folders");
+		return false;
+	}
+	m_bFiles = nFiles > 0;
+	// Zip and tar files are compared as folders, without extracting them
+	if (m_bFiles && !m_bNoArchives && m_sPatchFile.empty() &&
+		std::all_of(m_paths.begin(), m_paths.end(), [](const String& path) { return ArchiveCache::IsArchive(path); }))
+	{
+		m_bFiles = false;
+		m_bArchives = true;
+	}
+	if (!m_sPatchFile.empty() && (!m_bFiles || nFiles != 2 || m_nCompMethod != CMP_CONTENT))
+	{
+		m_sError = _T("-patch needs two files and full contents compare");
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Parse a count given on command line.
+ * @param [in] str Decimal digits only, no sign.
+ * @param [in] nMax Largest accepted value.
+ * @param [out] nValue Parsed value.
+ * @return false if the value is not a number or is larger than nMax.
+ */
+bool ConsoleCompare::ParseCount(const char *str, int64_t nMax, int64_t& nValue)
+{
+	if (*str == '\0')
+		return false;
+	int64_t n = 0;
+	for (const char *p = str; *p != '\0'; ++p)
+	{
+		if (*p < '0' || *p > '9')
+			return false;
+		const int digit = *p - '0';
+		if (n > (nMax - digit) / 10)
+			return false;
+		n = n * 10 + digit;
+	}
+	nValue = n;
+	return true;
+}
+
+void ConsoleCompare::PrintUsage(std::ostream& out)
+{
+	out << "Usage: FolderCompare [options] <left> [<middle>] <right>\n"
+		"       FolderCompare -bench [<name>] [-scale <n>]\n"
+		"Compares two or three folders or files and writes one line per item,\n"
+		"or runs the benchmarks whose name contains <name>.\n"
+		"\n"
+		"  -r                  Compare subfolders too\n"
+		"  -f <mask>           File filter mask, e.g. \"*.cpp;*.h\"\n"
+		"  -m <method>         full, quick, binary, date, sizedate or size\n"
+		"  -ignorews           Ignore changes in amount of whitespace\n"
+		"  -ignoreallws        Ignore all whitespace\n"
+		"  -ignoreblanklines   Ignore blank lines\n"
+		"  -ignorecase         Ignore case\n"
+		"  -ignoreeol          Ignore EOL differences\n"
+		"  -format <format>    text, jsonl or csv\n"
+		"  -o <file>           Write results to file instead of stdout\n"
+		"  -q                  Don't write summary and times to stderr\n"
+		"  -streamlimit <MB>   Diff larger text files in one pass, 0 disables\n"
+		"  -patch <file>       Write unified diff of two files, in one pass\n"
+		"  -noarchives         Compare zip and tar files as files, not as folders\n"
+		"  -scale <n>          Benchmark corpus size multiplier, 1 to 64\n"
+		"\n"
+		"Exit code: 0 identical, 1 different, 2 error\n";
+}
+
+/**
+ * @brief Run the compare and write results.
+ * @param [in] out Stream for result items, unless an output file was given.
+ * @param [in] log Stream for summary and phase times.
+ * @return Exit code.
+ */
+int ConsoleCompare::Run(std::ostream& out, std::ostream& log)
+{
+	Poco::Stopwatch total;
+	total.start();
+	std::fill(std::begin(m_counts), std::end(m_counts), 0);
+	m_times = {};
+
+	std::ofstream file;
+	if (!m_sOutputFile.empty())
+	{
+		file.open(m_sOutputFile.c_str(), std::ios::out | std::ios::trunc);
+		if (!file)
+		{
+			m_sError = _T("Cannot write ") + ucr::toTString(m_sOutputFile);
+			return EXIT_ERROR;
+		}
+	}
+	std::ostream& os = m_sOutputFile.empty() ? out : file;
+
+	const int nDirs = m_paths.GetSize();
+	PathContext roots;
+	for (int i = 0; i < nDirs; ++i)
+		roots.SetPath(i, m_bFiles ? paths::GetParentPath(m_paths[i]) : m_paths[i]);
+
+	CompareStats stats(nDirs);
+	FileFilterHelper filter;
+	filter.UseMask(true);
+	filter.SetMask(m_sFilter.empty() ? _T("*.*") : m_sFilter);
+
+	CDiffContext ctxt(roots, m_nCompMethod);
+	ctxt.InitDiffItemList();
+	ctxt.CreateCompareOptions(m_nCompMethod, m_options);
+	ctxt.m_nQuickCompareLimit = 4 * 1024 * 1024;
+	ctxt.m_nBinaryCompareLimit = 64 * 1024 * 1024;
+	ctxt.m_nStreamingCompareLimit = m_nStreamingLimit;
+	ctxt.m_bWalkUniques = true;
+	ctxt.m_bRecursive = m_bRecursive;
+	ctxt.m_pCompareStats = &stats;
+	ctxt.m_piFilterGlobal = &filter;
+
+	ArchiveCache archives;
+	if (m_bArchives)
+	{
+		for (int i = 0; i < nDirs; ++i)
+		{
+			if (!archives.AddRoot(ctxt.GetNormalizedPath(i)))
+			{
+				m_sError = _T("Cannot read archive ") + m_paths[i];
+				return EXIT_ERROR;
+			}
+		}
+		ctxt.m_pArchiveCache = &archives;
+	}
+
+	const bool bCompared = m_bFiles ? CompareFiles(ctxt) : CompareFolders(ctxt, stats);
+	if (!bCompared)
+		return EXIT_ERROR;
+
+	Poco::Stopwatch report;
+	report.start();
+	WriteHeader(os);
+	DIFFITEM *pos = ctxt.GetFirstDiffPosition();
+	while (pos != nullptr)
+	{
+		const DIFFITEM& di = ctxt.GetNextDiffPosition(pos);
+		const int result = GetItemResult(stats, di);
+		++m_counts[result];
+		WriteItem(os, stats, di, result);
+	}
+	os.flush();
+	m_times.report = report.elapsed();
+	m_times.total = total.elapsed();
+
+	const int exitCode = os ? GetExitCode() : EXIT_ERROR;
+	WriteSummary(os, log, exitCode);
+	return exitCode;
+}
+
+/**
+ * @brief Walk and compare folders the way the folder compare window does.
+ */
+bool ConsoleCompare::CompareFolders(CDiffContext& ctxt, CompareStats& stats)
+{
+	Poco::Stopwatch collect, compare;
+	CDiffThread diffThread;
+	diffThread.SetContext(&ctxt);
+	diffThread.SetCollectFunction([&collect](DiffFuncStruct* myStruct) {
+		collect.start();
+		bool casesensitive = false;
+		int depth = myStruct->context->m_bRecursive ? -1 : 0;
+		PathContext paths = myStruct->context->GetNormalizedPaths();
+		String subdir[3] = { _T(""), _T(""), _T("") }; // blank to start at roots specified in diff context
+		DirScan_GetItems(paths, subdir, myStruct,
+			casesensitive, depth, nullptr, myStruct->context->m_bWalkUniques);
+		collect.stop();
+	});
+	diffThread.SetCompareFunction([&compare](DiffFuncStruct* myStruct) {
+		compare.start();
+		DirScan_CompareItems(myStruct, nullptr);
+		compare.stop();
+	});
+	diffThread.CompareDirectories();
+
+	while (diffThread.GetThreadState() != CDiffThread::THREAD_COMPLETED)
+		Poco::Thread::sleep(20);
+
+	m_times.collect = collect.elapsed();
+	m_times.compare = compare.elapsed();
+	return true;
+}
+
+/**
+ * @brief Compare files given on command line as one item.
+ */
+bool ConsoleCompare::CompareFiles(CDiffContext& ctxt)
+{
+	Poco::Stopwatch compare;
+	compare.start();
+	DIFFITEM *di = ctxt.AddNewDiff(nullptr);
+	for (int i = 0; i < m_paths.GetSize(); ++i)
+	{
+		di->diffFileInfo[i].SetFile(paths::FindFileName(m_paths[i]));
+		if (di->diffFileInfo[i].Update(m_paths[i]))
+			di->diffcode.setSideFlag(i);
+	}
+	if (m_paths.GetSize() == 3)
+		di->diffcode.diffcode |= DIFFCODE::THREEWAY;
+	ctxt.m_pCompareStats->IncreaseTotalItems();
+
+	di->diffcode.diffcode |= DIFFCODE::INCLUDED;
+	if (!m_sPatchFile.empty())
+	{
+		// Write differences as they are found, so that files of any size
+		// can be diffed
+		std::ofstream patch(m_sPatchFile.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!patch)
+		{
+			m_sError = _T("Cannot write ") + ucr::toTString(m_sPatchFile);
+			return false;
+		}
+		CompareEngines::StreamingDiff streamingDiff;
+		streamingDiff.SetCompareOptions(*ctxt.GetCompareOptions(CMP_CONTENT));
+		streamingDiff.SetPatchStream(&patch);
+		di->diffcode.diffcode |= DIFFCODE::FILE | streamingDiff.CompareFiles(m_paths);
+		streamingDiff.GetDiffCounts(di->nsdiffs, di->nidiffs);
+	}
+	else
+	{
+		FolderCmp folderCmp(&ctxt);
+		di->diffcode.diffcode |= folderCmp.prepAndCompareFiles(*di);
+		di->nsdiffs = folderCmp.m_ndiffs;
+		di->nidiffs = folderCmp.m_ntrivialdiffs;
+	}
+	m_times.compare = compare.elapsed();
+	return true;
+}
+
+/**
+ * @brief Get result of an item, CompareStats::RESULT or RESULT_NOTCOMPARED.
+ */
+int ConsoleCompare::GetItemResult(const CompareStats& stats, const DIFFITEM& di) const
+{
+	// Subfolders existing on all sides are not walked into in non-recursive compare
+	if (di.diffcode.isDirectory() && (di.diffcode.diffcode & DIFFCODE::COMPAREFLAGS) == DIFFCODE::NOCMP &&
+		(m_paths.GetSize() < 3 ? di.diffcode.isSideBoth() : di.diffcode.isSideAll()))
+		return RESULT_NOTCOMPARED;
+	return stats.GetResultFromCode(di.diffcode.diffcode);
+}
+
+int ConsoleCompare::GetExitCode() const
+{
+	if (m_counts[CompareStats::RESULT_ERROR] > 0)
+		return EXIT_ERROR;
+	for (int result = 0; result < RESULT_ALL; ++result)
+	{
+		switch (result)
+		{
+		case CompareStats::RESULT_SAME:
+		case CompareStats::RESULT_BINSAME:
+		case CompareStats::RESULT_DIRSAME:
+		case CompareStats::RESULT_SKIP:
+		case CompareStats::RESULT_DIRSKIP:
+		case RESULT_NOTCOMPARED:
+			break;
+		default:
+			if (m_counts[result] > 0)
+				return EXIT_DIFFERENT;
+		}
+	}
+	return EXIT_IDENTICAL;
+}
+
+const char *ConsoleCompare::GetResultName(int result)
+{
+	static const char *const names[] =
+	{
+		"left-only", "middle-only", "right-only",
+		"left-missing", "middle-missing", "right-missing",
+		"different", "identical", "binary-identical", "binary-different",
+		"left-only", "middle-only", "right-only",
+		"left-missing", "middle-missing", "right-missing",
+		"skipped", "skipped", "identical", "different",
+		"error", "not-compared"
+	};
+	static_assert(sizeof(names) / sizeof(names[0]) == RESULT_ALL, "Name missing for a result");
+	return names[result];
+}
+
+void ConsoleCompare::WriteHeader(std::ostream& out) const
+{
+	if (m_format != OutputFormat::CSV)
+		return;
+	static const char *const sides[] = { "left", "middle", "right" };
+	out << "path,type,result,diffs,ignored_diffs";
+	for (int i = 0; i < m_paths.GetSize(); ++i)
+	{
+		const char *side = sides[m_paths.GetSize() < 3 && i == 1 ? 2 : i];
+		out << "," << side << "_size," << side << "_mtime";
+	}
+	out << "\n";
+}
+
+void ConsoleCompare::WriteItem(std::ostream& out, const CompareStats& stats, const DIFFITEM& di, int result) const
+{
+	const int nDirs = m_paths.GetSize();
+	int nSide = 0;
+	while (nSide < nDirs - 1 && !di.diffcode.exists(nSide))
+		++nSide;
+	const std::string path = ucr::toUTF8(di.diffFileInfo[nSide].GetFile());
+	const char *type = di.diffcode.isDirectory() ? "folder" : "file";
+	const char *name = GetResultName(result);
+
+	if (m_format == OutputFormat::TEXT)
+	{
+		out << name << "\t" << path << "\n";
+		return;
+	}
+
+	auto size = [&](int i) -> std::string
+	{
+		if (!di.diffcode.exists(i) || di.diffcode.isDirectory() || di.diffFileInfo[i].size == DirItem::FILE_SIZE_NONE)
+			return "";
+		return std::to_string(di.diffFileInfo[i].size);
+	};
+	auto mtime = [&](int i) -> std::string
+	{
+		if (!di.diffcode.exists(i) || di.diffFileInfo[i].mtime == 0)
+			return "";
+		return Poco::DateTimeFormatter::format(di.diffFileInfo[i].mtime, Poco::DateTimeFormat::ISO8601_FORMAT);
+	};
+	auto count = [](int n) -> std::string
+	{
+		return n >= 0 ? std::to_string(n) : "";
+	};
+
+	if (m_format == OutputFormat::JSONL)
+	{
+		auto json = [](const std::string& value, bool bString) -> std::string
+		{
+			if (value.empty())
+				return "null";
+			return bString ? "\"" + EscapeJson(value) + "\"" : value;
+		};
+		std::ostringstream line;
+		line << "{\"path\":\"" << EscapeJson(path) << "\",\"type\":\"" << type << "\",\"result\":\"" << name << "\""
+			<< ",\"diffs\":" << json(count(di.nsdiffs), false)
+			<< ",\"ignored_diffs\":" << json(count(di.nidiffs), false)
+			<< ",\"size\":[";
+		for (int i = 0; i < nDirs; ++i)
+			line << (i > 0 ? "," : "") << json(size(i), false);
+		line << "],\"mtime\":[";
+		for (int i = 0; i < nDirs; ++i)
+			line << (i > 0 ? "," : "") << json(mtime(i), true);
+		line << "]}\n";
+		out << line.str();
+	}
+	else
+	{
+		out << EscapeCsv(path) << "," << type << "," << name << ","
+			<< count(di.nsdiffs) << "," << count(di.nidiffs);
+		for (int i = 0; i < nDirs; ++i)
+			out << "," << size(i) << "," << mtime(i);
+		out << "\n";
+	}
+}
+
+/**
+ * @brief Write result counts and phase times.
+ * JSON lines output ends with a summary record, other formats only write
+ * the summary to the log.
+ */
+void ConsoleCompare::WriteSummary(std::ostream& out, std::ostream& log, int exitCode) const
+{
+	// Results sharing a name are counted together
+	std::vector<std::pair<const char *, int>> counts;
+	for (int result = 0; result < RESULT_ALL; ++result)
+	{
+		const char *name = GetResultName(result);
+		auto it = std::find_if(counts.begin(), counts.end(),
+			[name](const std::pair<const char *, int>& count) { return strcmp(count.first, name) == 0; });
+		if (it == counts.end())
+			counts.emplace_back(name, m_counts[result]);
+		else
+			it->second += m_counts[result];
+	}
+	const std::pair<const char *, int64_t> times[] =
+	{
+		{ "collect", m_times.collect }, { "compare", m_times.compare },
+		{ "report", m_times.report }, { "total", m_times.total }
+	};
+
+	if (m_format == OutputFormat::JSONL)
+	{
+		out << "{\"summary\":{";
+		bool bFirst = true;
+		for (const auto& count : counts)
+		{
+			if (count.second == 0)
+				continue;
+			out << (bFirst ? "" : ",") << "\"" << count.first << "\":" << count.second;
+			bFirst = false;
+		}
+		out << "},\"exit_code\":" << exitCode << ",\"time_ms\":{";
+		bFirst = true;
+		for (const auto& time : times)
+		{
+			out << (bFirst ? "" : ",") << "\"" << time.first << "\":" << time.second / 1000.0;
+			bFirst = false;
+		}
+		out << "}}\n";
+		out.flush();
+	}
+
+	if (m_bQuiet)
+		return;
+	for (const auto& count : counts)
+	{
+		if (count.second > 0)
+			log << count.first << ": " << count.second << "\n";
+	}
+	for (const auto& time : times)
+		log << time.first << " time: " << time.second / 1000 << " ms\n";
+	log.flush();
+}
+
+/**
+ * @brief Escape string for a JSON string literal.
+ */
+std::string ConsoleCompare::EscapeJson(const std::string& str)
+{
+	std::string result;
+	result.reserve(str.length());
+	for (char ch : str)
+	{
+		switch (ch)
+		{
+		case '"': result += "\\\""; break;
+		case '\\': result += "\\\\"; break;
+		case '\n': result += "\\n"; break;
+		case '\r': result += "\\r"; break;
+		case '\t': result += "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(ch) < 0x20)
+			{
+				char buf[8];
+				snprintf(buf, sizeof(buf), "\\u%04x", ch);
+				result += buf;
+			}
+			else
+				result += ch;
+		}
+	}
+	return result;
+}
+
+/**
+ * @brief Quote CSV field if it contains separators, quotes or line breaks.
+ */
+std::string ConsoleCompare::EscapeCsv(const std::string& str)
+{
+	if (str.find_first_of(",\"\r\n") == std::string::npos)
+		return str;
+	std::string result = "\"";
+	for (char ch : str)
+	{
+		if (ch == '"')
+			result += '"';
+		result += ch;
+	}
+	return result + "\"";
+}
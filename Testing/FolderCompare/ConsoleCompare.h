@@ -0,0 +1,112 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/**
+ * @file  ConsoleCompare.h
+ *
+ * @brief Declaration of ConsoleCompare class
+ */
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include "UnicodeString.h"
+#include "PathContext.h"
+#include "CompareOptions.h"
+#include "CompareStats.h"
+
+class CDiffContext;
+class DIFFITEM;
+
+/**
+ * @brief Folder and file compare driven from the command line.
+ *
+ * Runs the same compare engine as the folder compare window (DirScan,
+ * CDiffThread and FolderCmp) without any user interface, and writes one
+ * result line per compared item as plain text, JSON lines or CSV. Item
+ * lines go to the output stream, the summary and time spent in each phase
+ * of the compare go to the log stream, so that the output can be piped to
+ * other tools.
+ *
+ * The exit code tells the overall result: EXIT_IDENTICAL when nothing
+ * differs, EXIT_DIFFERENT when something differs or is missing from one
+ * side, EXIT_ERROR when an item could not be compared or the command line
+ * was invalid. ConsoleCompareTest.cmd checks the exit codes and the output
+ * formats, ConsoleCompareTest.sh does the same from a POSIX shell
+ * ("make check"), so Linux CI agents can run a mingw build under wine
+ * with RUNNER=wine.
+ *
+ * @todo Build natively on non-Windows. The compare core still depends
+ * on the Windows API (file access, code pages, plugins), so the tool only
+ * builds with MSVC and mingw for now.
+ */
+class ConsoleCompare
+{
+public:
+	enum
+	{
+		EXIT_IDENTICAL = 0,
+		EXIT_DIFFERENT = 1,
+		EXIT_ERROR = 2,
+	};
+
+	enum class OutputFormat
+	{
+		TEXT,
+		JSONL,
+		CSV,
+	};
+
+	/** @brief Wall clock time spent in each compare phase, in microseconds. */
+	struct PhaseTimes
+	{
+		int64_t collect; /**< Walking the folders */
+		int64_t compare; /**< Comparing files, overlaps with collect */
+		int64_t report; /**< Writing the results */
+		int64_t total;
+	};
+
+	ConsoleCompare();
+	bool ParseArgs(int argc, const char *const argv[]);
+	int Run(std::ostream& out, std::ostream& log);
+	const String& GetError() const { return m_sError; }
+	const PhaseTimes& GetPhaseTimes() const { return m_times; }
+	static void PrintUsage(std::ostream& out);
+	static bool ParseCount(const char *str, int64_t nMax, int64_t& nValue);
+
+	static std::string EscapeJson(const std::string& str);
+	static std::string EscapeCsv(const std::string& str);
+
+private:
+	/** @brief Result of an item, CompareStats::RESULT or one of these. */
+	enum
+	{
+		RESULT_NOTCOMPARED = CompareStats::RESULT_COUNT, /**< Folder not walked into */
+		RESULT_ALL
+	};
+
+	bool CompareFolders(CDiffContext& ctxt, CompareStats& stats);
+	bool CompareFiles(CDiffContext& ctxt);
+	void WriteHeader(std::ostream& out) const;
+	void WriteItem(std::ostream& out, const CompareStats& stats, const DIFFITEM& di, int result) const;
+	void WriteSummary(std::ostream& out, std::ostream& log, int exitCode) const;
+	int GetItemResult(const CompareStats& stats, const DIFFITEM& di) const;
+	int GetExitCode() const;
+	static const char *GetResultName(int result);
+
+	PathContext m_paths; /**< Folders or files to compare */
+	bool m_bFiles; /**< Are m_paths files? */
+	bool m_bArchives; /**< Are m_paths archives compared as folders? */
+	bool m_bNoArchives; /**< Compare archives as files */
+	int m_nCompMethod;
+	DIFFOPTIONS m_options;
+	bool m_bRecursive;
+	String m_sFilter;
+	OutputFormat m_format;
+	std::string m_sOutputFile; /**< Output file, stdout if empty */
+	std::string m_sPatchFile; /**< Unified diff of compared files, none if empty */
+	int64_t m_nStreamingLimit; /**< Streaming diff size limit in bytes */
+	bool m_bQuiet; /**< Don't write summary and times to the log */
+	String m_sError;
+	int m_counts[RESULT_ALL];
+	PhaseTimes m_times;
+};
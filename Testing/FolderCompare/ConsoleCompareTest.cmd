@@ -0,0 +1,64 @@
+@echo off
+rem Checks exit codes and result lines of the console compare.
+rem Usage: ConsoleCompareTest.cmd [path of FolderCompare.exe]
+setlocal enabledelayedexpansion
+set exepath=%~1
+if not defined exepath set exepath=%~dp0\Release\FolderCompare.exe
+set testdir=%TEMP%\ConsoleCompareTest
+set failed=0
+
+if exist "%testdir%" rmdir /s /q "%testdir%"
+mkdir "%testdir%\left\sub" "%testdir%\right\sub"
+echo same> "%testdir%\left\same.txt"
+echo same> "%testdir%\right\same.txt"
+echo left> "%testdir%\left\sub\a,b.txt"
+echo right> "%testdir%\right\sub\a,b.txt"
+
+rem Exit codes: 0 identical, 1 different, 2 error
+call :check 0 "%testdir%\left\same.txt" "%testdir%\right\same.txt"
+call :check 0 "%testdir%\left\same.txt" "%testdir%\right"
+call :check 1 -r "%testdir%\left" "%testdir%\right"
+call :check 1 -r -m size "%testdir%\left" "%testdir%\right"
+call :check 0 -streamlimit 0 "%testdir%\left\same.txt" "%testdir%\right\same.txt"
+call :check 2 "%testdir%\left" "%testdir%\missing"
+call :check 2 -m nosuchmethod "%testdir%\left" "%testdir%\right"
+call :check 2 -format xml "%testdir%\left" "%testdir%\right"
+call :check 2 -streamlimit -1 "%testdir%\left" "%testdir%\right"
+call :check 2 -streamlimit 10x "%testdir%\left" "%testdir%\right"
+call :check 2 -streamlimit 99999999999999999999 "%testdir%\left" "%testdir%\right"
+call :check 2 "%testdir%\left" "%testdir%\right" -streamlimit
+call :check 2 -bench -scale 0
+call :check 2 -bench -scale 65
+call :check 2 -bench -scale x
+call :check 2 -bench -scale
+
+rem CSV fields with a comma are quoted, JSON strings escape backslashes
+"%exepath%" -q -r -format csv "%testdir%\left" "%testdir%\right" > "%testdir%\out.csv"
+findstr /b /l /c:"\"sub\\a,b.txt\",file,different," "%testdir%\out.csv" > nul || call :fail "CSV path not quoted"
+findstr /b /l /c:"same.txt,file,identical," "%testdir%\out.csv" > nul || call :fail "CSV path quoted"
+"%exepath%" -q -r -format jsonl "%testdir%\left" "%testdir%\right" > "%testdir%\out.jsonl"
+findstr /b /l /c:"{\"path\":\"sub\\\\a,b.txt\",\"type\":\"file\",\"result\":\"different\"" "%testdir%\out.jsonl" > nul || call :fail "JSON path not escaped"
+findstr /b /l /c:"{\"summary\":" "%testdir%\out.jsonl" > nul || call :fail "JSON summary missing"
+
+rmdir /s /q "%testdir%"
+if %failed% == 0 (echo All tests passed) else (echo %failed% tests failed)
+exit /b %failed%
+
+:check
+set expected=%~1
+shift
+set args=
+:nextarg
+if "%~1" == "" goto run
+set args=%args% %1
+shift
+goto nextarg
+:run
+"%exepath%" -q %args% > nul 2>&1
+if not "%errorlevel%" == "%expected%" call :fail "exit code %errorlevel%, expected %expected%:%args%"
+exit /b 0
+
+:fail
+echo FAILED: %~1
+set /a failed+=1
+exit /b 0
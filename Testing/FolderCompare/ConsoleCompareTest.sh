@@ -0,0 +1,74 @@
+#!/bin/sh
+# Checks exit codes and result lines of the console compare.
+# Same checks as ConsoleCompareTest.cmd, for CI agents without cmd.exe.
+# Usage: ConsoleCompareTest.sh [path of FolderCompare.exe]
+# Set RUNNER to run the tool through another program, for example
+# RUNNER=wine on Linux for a FolderCompare.exe built with mingw.
+exepath=${1:-$(dirname "$0")/FolderCompare.exe}
+case $exepath in
+/*) ;;
+*) exepath=$(pwd)/$exepath ;;
+esac
+testdir=${TMPDIR:-/tmp}/ConsoleCompareTest.$$
+failed=0
+
+fail()
+{
+	echo "FAILED: $1"
+	failed=$((failed + 1))
+}
+
+run()
+{
+	$RUNNER "$exepath" -q "$@"
+}
+
+check()
+{
+	expected=$1
+	shift
+	run "$@" > /dev/null 2>&1
+	result=$?
+	[ "$result" = "$expected" ] || fail "exit code $result, expected $expected: $*"
+}
+
+# Paths are relative to the test folder, so that they need no conversion
+# when the tool runs under wine or msys.
+rm -rf "$testdir"
+mkdir -p "$testdir/left/sub" "$testdir/right/sub" || exit 1
+cd "$testdir" || exit 1
+echo same > left/same.txt
+echo same > right/same.txt
+echo left > "left/sub/a,b.txt"
+echo right > "right/sub/a,b.txt"
+
+# Exit codes: 0 identical, 1 different, 2 error
+check 0 left/same.txt right/same.txt
+check 0 left/same.txt right
+check 1 -r left right
+check 1 -r -m size left right
+check 0 -streamlimit 0 left/same.txt right/same.txt
+check 2 left missing
+check 2 -m nosuchmethod left right
+check 2 -format xml left right
+check 2 -streamlimit -1 left right
+check 2 -streamlimit 10x left right
+check 2 -streamlimit 99999999999999999999 left right
+check 2 left right -streamlimit
+check 2 -bench -scale 0
+check 2 -bench -scale 65
+check 2 -bench -scale x
+check 2 -bench -scale
+
+# CSV fields with a comma are quoted, JSON strings escape backslashes.
+# The tool prints paths with the separator of the platform it runs on.
+run -r -format csv left right | tr -d '\r' > out.csv
+grep -q -F -e '"sub\a,b.txt",file,different,' -e '"sub/a,b.txt",file,different,' out.csv || fail "CSV path not quoted"
+grep -q '^same\.txt,file,identical,' out.csv || fail "CSV path quoted"
+run -r -format jsonl left right | tr -d '\r' > out.jsonl
+grep -q -F -e '{"path":"sub\\a,b.txt","type":"file","result":"different"' -e '{"path":"sub/a,b.txt","type":"file","result":"different"' out.jsonl || fail "JSON path not escaped"
+grep -q '^{"summary":' out.jsonl || fail "JSON summary missing"
+
+cd / && rm -rf "$testdir"
+if [ $failed = 0 ]; then echo "All tests passed"; else echo "$failed tests failed"; fi
+exit $failed
@@ -6,88 +6,170 @@
 #include "FileFilterHelper.h"
 #include "FolderCmp.h"
 #include "DirScan.h"
+#include "diff.h"
+#include "Benchmark.h"
+#include "ConsoleCompare.h"
+#include "Environment.h"
+#include "paths.h"
+#include "unicoder.h"
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+#include <boost/flyweight.hpp>
 #include <Poco/Thread.h>
+#include <Poco/Stopwatch.h>
 #ifdef _MSC_VER
 #include <crtdbg.h>
 #endif
 
-int main()
+/**
+ * @brief Time interning of synthetic file names from several threads.
+ * Names repeat the way they do in a folder compare: each "folder" path
+ * is interned for every file in it, and file names recur across folders.
+ */
+template<class Flyweight>
+static Poco::Timestamp::TimeDiff BenchmarkInterning(int nThreads, int nFolders, int nFilesPerFolder)
 {
-#ifdef _MSC_VER
-	_CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
-#endif
-	CompareStats cmpstats(2);
-
-	FileFilterHelper filter;
-	filter.UseMask(true);
-//	filter.SetMask(_T("*.cpp;*.c;*.h;*.vcproj;*.vcxproj"));
-	filter.SetMask(_T("*.*"));
-
-	CDiffContext ctx(
-		PathContext(_T("c:/windows"), _T("c:/windows")),
-		CMP_CONTENT);
-
-	DIFFOPTIONS options = {0};
-	options.nIgnoreWhitespace = false;
-	options.bIgnoreBlankLines = false;
-	options.bFilterCommentsLines = false;
-	options.bIgnoreCase = false;
-	options.bIgnoreEol = false;
+	Poco::Stopwatch stopwatch;
+	std::vector<std::thread> threads;
+	stopwatch.start();
+	for (int t = 0; t < nThreads; ++t)
+	{
+		threads.emplace_back([=]() {
+			for (int i = t; i < nFolders; i += nThreads)
+			{
+				String folder = _T("src\\module") + strutils::to_str(i);
+				for (int j = 0; j < nFilesPerFolder; ++j)
+				{
+					Flyweight path(folder);
+					Flyweight filename(_T("file") + strutils::to_str(j) + _T(".cpp"));
+				}
+			}
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	stopwatch.stop();
+	return stopwatch.elapsed();
+}
 
-	ctx.InitDiffItemList();
-	//ctx.CreateCompareOptions(CMP_CONTENT, options);
-	ctx.CreateCompareOptions(CMP_DATE, options);
+/**
+ * @brief Time moved block detection of a synthetic change script.
+ * Both sides consist of nBlocks diff blocks of nBlockLines lines, and the
+ * blocks of the right side are the blocks of the left side shuffled, so
+ * that every block is found as moved.
+ */
+static Poco::Timestamp::TimeDiff BenchmarkMovedBlocks(int nBlocks, int nBlockLines, int& nMoved)
+{
+	const int nLines = nBlocks * nBlockLines;
+	std::vector<int> order(nBlocks);
+	std::iota(order.begin(), order.end(), 0);
+	std::shuffle(order.begin(), order.end(), std::mt19937(1));
+	std::vector<int> equivs0(nLines), equivs1(nLines);
+	std::iota(equivs0.begin(), equivs0.end(), 0);
+	for (int k = 0; k < nBlocks; ++k)
+		std::iota(&equivs1[k * nBlockLines], &equivs1[k * nBlockLines] + nBlockLines, order[k] * nBlockLines);
 
-	ctx.m_iGuessEncodingType = 0;//(50001 << 16) + 2;
-	ctx.m_bIgnoreSmallTimeDiff = true;
-	ctx.m_bStopAfterFirstDiff = false;
-	ctx.m_nQuickCompareLimit = 4 * 1024 * 1024;
-	ctx.m_bPluginsEnabled = false;
-	ctx.m_bWalkUniques = true;
-	ctx.m_pCompareStats = &cmpstats;
-	ctx.m_bRecursive = true;
-	ctx.m_piFilterGlobal = &filter;
+	struct change *script = nullptr;
+	for (int k = nBlocks - 1; k >= 0; --k)
+	{
+		struct change *e = (struct change *) xmalloc (sizeof (struct change));
+		*e = {};
+		e->line0 = e->line1 = k * nBlockLines;
+		e->deleted = e->inserted = nBlockLines;
+		e->match0 = e->match1 = -1;
+		e->link = script;
+		script = e;
+	}
+	struct file_data fd[2] = {};
+	fd[0].equivs = equivs0.data();
+	fd[1].equivs = equivs1.data();
 
-	// Folder names to compare are in the compare context
-	CDiffThread diffThread;
-	diffThread.SetContext(&ctx);
-	diffThread.SetCollectFunction([](DiffFuncStruct* myStruct) {
-		bool casesensitive = false;
-		int depth = myStruct->context->m_bRecursive ? -1 : 0;
-		PathContext paths = myStruct->context->GetNormalizedPaths();
-		String subdir[3] = { _T(""), _T(""), _T("") }; // blank to start at roots specified in diff context
-		// Build results list (except delaying file comparisons until below)
-		DirScan_GetItems(paths, subdir, myStruct,
-			casesensitive, depth, nullptr, myStruct->context->m_bWalkUniques);
-	});
-	diffThread.SetCompareFunction([](DiffFuncStruct* myStruct) {
-		DirScan_CompareItems(myStruct, nullptr);
-	});
-	diffThread.CompareDirectories();
+	Poco::Stopwatch stopwatch;
+	stopwatch.start();
+	moved_block_analysis(&script, fd);
+	stopwatch.stop();
 
-	while (diffThread.GetThreadState() != CDiffThread::THREAD_COMPLETED)
+	nMoved = 0;
+	while (script)
 	{
-		Poco::Thread::sleep(200);
-		std::cout << cmpstats.GetComparedItems() << std::endl;
+		struct change *e = script;
+		if (e->match0 >= 0 || e->match1 >= 0)
+			++nMoved;
+		script = e->link;
+		free(e);
 	}
+	return stopwatch.elapsed();
+}
 
-	DIFFITEM *pos = ctx.GetFirstDiffPosition();
-	while (pos)
+int main(int argc, char *argv[])
+{
+#ifdef _MSC_VER
+	_CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
+#endif
+	if (argc > 1 && strcmp(argv[1], "-intern") == 0)
 	{
-		DIFFITEM& di = ctx.GetNextDiffRefPosition(pos);
-		if (ctx.m_piFilterGlobal->includeFile(di.diffFileInfo[0].filename, di.diffFileInfo[1].filename))
+		int nThreads = argc > 2 ? atoi(argv[2]) : static_cast<int>(std::thread::hardware_concurrency());
+		std::cout << "boost::flyweight<String>: "
+			<< BenchmarkInterning<boost::flyweight<String>>(nThreads, 20000, 100) / 1000 << "ms" << std::endl;
+		std::cout << "InternedString: "
+			<< BenchmarkInterning<InternedString>(nThreads, 20000, 100) / 1000 << "ms" << std::endl;
+		return 0;
+	}
+	if (argc > 1 && strcmp(argv[1], "-moved") == 0)
+	{
+		int nMaxLines = argc > 2 ? atoi(argv[2]) : 1000000;
+		for (int nLines = 10000; nLines <= nMaxLines; nLines *= 10)
 		{
-			FolderCmp folderCmp(&ctx);
-			folderCmp.prepAndCompareFiles(di);
-#ifdef _UNICODE
-//		std::wcout << di.diffFileInfo[0].filename << ":" << di.diffcode.isResultDiff() << std::endl;
-#else
-//		std::cout << di.diffFileInfo[0].filename << ":" << di.diffcode.isResultDiff() << std::endl;
-#endif
+			int nMoved = 0;
+			Poco::Timestamp::TimeDiff elapsed = BenchmarkMovedBlocks(nLines / 10, 10, nMoved);
+			std::cout << nLines << " lines: " << elapsed / 1000 << "ms, "
+				<< nMoved << " moved blocks" << std::endl;
 		}
+		return 0;
+	}
 
+	if (argc > 1 && strcmp(argv[1], "-bench") == 0)
+	{
+		std::string filter;
+		int64_t nScale = 1;
+		for (int i = 2; i < argc; ++i)
+		{
+			if (strcmp(argv[i], "-scale") == 0)
+			{
+				// The binary corpus alone takes 16 MB per scale step
+				if (i + 1 >= argc || !ConsoleCompare::ParseCount(argv[++i], Benchmark::MaxScale, nScale) || nScale == 0)
+				{
+					std::cerr << "-scale needs a number from 1 to " << Benchmark::MaxScale << "\n\n";
+					ConsoleCompare::PrintUsage(std::cerr);
+					return ConsoleCompare::EXIT_ERROR;
+				}
+			}
+			else
+				filter = argv[i];
+		}
+		// A folder of its own, so that concurrent runs don't remove each other's corpus
+		Benchmark benchmark(env::GetTempChildPath(), static_cast<int>(nScale));
+		if (!benchmark.GenerateCorpus())
+			return 1;
+		benchmark.Run(filter, std::cout);
+		return 0;
 	}
 
-	return 0;
+	ConsoleCompare compare;
+	if (!compare.ParseArgs(argc, argv))
+	{
+		std::cerr << ucr::toUTF8(compare.GetError()) << "\n\n";
+		ConsoleCompare::PrintUsage(std::cerr);
+		return ConsoleCompare::EXIT_ERROR;
+	}
+	const int exitCode = compare.Run(std::cout, std::cerr);
+	if (exitCode == ConsoleCompare::EXIT_ERROR && !compare.GetError().empty())
+		std::cerr << ucr::toUTF8(compare.GetError()) << std::endl;
+	return exitCode;
 }
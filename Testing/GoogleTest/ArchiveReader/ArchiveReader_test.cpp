@@ -0,0 +1,282 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <Poco/Checksum.h>
+#include <Poco/DeflatingStream.h>
+#include "ArchiveReader.h"
+
+namespace
+{
+	// The fixture for testing ArchiveReader class.
+	class ArchiveReaderTest : public testing::Test
+	{
+	protected:
+		ArchiveReaderTest()
+		{
+		}
+
+		virtual ~ArchiveReaderTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+		}
+
+		virtual void TearDown()
+		{
+		}
+	};
+
+	void PutLE(std::string& s, uint64_t v, int bytes)
+	{
+		for (int i = 0; i < bytes; ++i)
+			s += static_cast<char>(v >> (i * 8));
+	}
+
+	uint32_t Crc32(const std::string& data)
+	{
+		Poco::Checksum checksum(Poco::Checksum::TYPE_CRC32);
+		checksum.update(data.data(), static_cast<unsigned>(data.size()));
+		return checksum.checksum();
+	}
+
+	std::string Deflate(const std::string& data)
+	{
+		std::ostringstream out;
+		{
+			Poco::DeflatingOutputStream deflater(out, -15, 9);
+			deflater << data;
+			deflater.close();
+		}
+		return out.str();
+	}
+
+	/** @brief Builds a zip file in memory. */
+	class ZipBuilder
+	{
+	public:
+		void Add(const std::string& name, const std::string& data, bool deflate = false)
+		{
+			const std::string packed = deflate ? Deflate(data) : data;
+			const uint32_t offset = static_cast<uint32_t>(m_zip.size());
+			std::string header;
+			PutLE(header, deflate ? 8 : 0, 2); // method
+			PutLE(header, 0x5000, 2); // time 10:00:00
+			PutLE(header, (40 << 9) | (1 << 5) | 2, 2); // date 2020-01-02
+			PutLE(header, Crc32(data), 4);
+			PutLE(header, packed.size(), 4);
+			PutLE(header, data.size(), 4);
+			PutLE(header, name.size(), 2);
+			PutLE(header, 0, 2); // extra length
+
+			PutLE(m_zip, 0x04034b50, 4);
+			PutLE(m_zip, 20, 2); // version needed
+			PutLE(m_zip, 0, 2); // flags
+			m_zip += header + name + packed;
+
+			PutLE(m_cd, 0x02014b50, 4);
+			PutLE(m_cd, 20, 2); // version made by
+			PutLE(m_cd, 20, 2); // version needed
+			PutLE(m_cd, 0, 2); // flags
+			m_cd += header;
+			PutLE(m_cd, 0, 2); // comment length
+			PutLE(m_cd, 0, 2); // disk
+			PutLE(m_cd, 0, 2); // internal attributes
+			PutLE(m_cd, 0, 4); // external attributes
+			PutLE(m_cd, offset, 4);
+			m_cd += name;
+			++m_count;
+		}
+
+		std::string Finish() const
+		{
+			std::string zip = m_zip + m_cd;
+			PutLE(zip, 0x06054b50, 4);
+			PutLE(zip, 0, 2);
+			PutLE(zip, 0, 2);
+			PutLE(zip, m_count, 2);
+			PutLE(zip, m_count, 2);
+			PutLE(zip, m_cd.size(), 4);
+			PutLE(zip, m_zip.size(), 4);
+			PutLE(zip, 0, 2);
+			return zip;
+		}
+
+	private:
+		std::string m_zip;
+		std::string m_cd;
+		int m_count = 0;
+	};
+
+	void AddTarHeader(std::string& tar, const std::string& name, size_t size, char type)
+	{
+		char h[512] = {};
+		memcpy(h, name.data(), (std::min)(name.size(), static_cast<size_t>(100)));
+		sprintf(h + 100, "%07o", 0644);
+		sprintf(h + 108, "%07o", 0);
+		sprintf(h + 116, "%07o", 0);
+		sprintf(h + 124, "%011o", static_cast<unsigned>(size));
+		sprintf(h + 136, "%011o", 1600000000u);
+		h[156] = type;
+		memcpy(h + 257, "ustar", 6);
+		memcpy(h + 263, "00", 2);
+		memset(h + 148, ' ', 8);
+		unsigned sum = 0;
+		for (int i = 0; i < 512; ++i)
+			sum += static_cast<unsigned char>(h[i]);
+		sprintf(h + 148, "%06o", sum);
+		tar.append(h, 512);
+	}
+
+	void AddTarFile(std::string& tar, const std::string& name, const std::string& data, char type = '0')
+	{
+		AddTarHeader(tar, name, data.size(), type);
+		tar += data;
+		tar.append((512 - data.size() % 512) % 512, '\0');
+	}
+
+	std::unique_ptr<ArchiveReader> Open(const std::string& data)
+	{
+		return ArchiveReader::Open(std::unique_ptr<std::istream>(new std::istringstream(data)));
+	}
+
+	std::string ReadEntry(ArchiveReader& reader, const std::string& name)
+	{
+		const ArchiveEntry *entry = reader.FindEntry(name);
+		if (entry == nullptr)
+			return "<missing>";
+		std::unique_ptr<std::istream> stream = reader.OpenEntry(*entry);
+		if (stream == nullptr)
+			return "<unreadable>";
+		std::ostringstream out;
+		out << stream->rdbuf();
+		return out.str();
+	}
+
+	std::vector<std::string> List(const ArchiveReader& reader, const std::string& folder)
+	{
+		std::vector<std::string> names;
+		for (const ArchiveEntry *entry : reader.ListFolder(folder))
+			names.push_back(entry->name + (entry->directory ? "/" : ""));
+		std::sort(names.begin(), names.end());
+		return names;
+	}
+
+	TEST_F(ArchiveReaderTest, ZipEntries)
+	{
+		const std::string text(5000, 'a');
+		ZipBuilder zip;
+		zip.Add("stored.txt", "stored contents");
+		zip.Add("dir/sub/deflated.txt", text, true);
+		zip.Add("dir/empty/", "");
+		std::unique_ptr<ArchiveReader> reader = Open(zip.Finish());
+		ASSERT_NE(nullptr, reader);
+		EXPECT_EQ(ArchiveReader::FORMAT_ZIP, reader->GetFormat());
+
+		EXPECT_EQ((std::vector<std::string>{ "dir/", "stored.txt" }), List(*reader, ""));
+		EXPECT_EQ((std::vector<std::string>{ "dir/empty/", "dir/sub/" }), List(*reader, "dir"));
+
+		const ArchiveEntry *entry = reader->FindEntry("dir/sub/deflated.txt");
+		ASSERT_NE(nullptr, entry);
+		EXPECT_FALSE(entry->directory);
+		EXPECT_EQ(5000u, entry->size);
+		EXPECT_TRUE(entry->hasCrc);
+		EXPECT_EQ(Crc32(text), entry->crc);
+		EXPECT_EQ(1577959200, entry->mtime);
+		EXPECT_EQ(text, ReadEntry(*reader, "dir/sub/deflated.txt"));
+		EXPECT_EQ("stored contents", ReadEntry(*reader, "stored.txt"));
+		EXPECT_TRUE(reader->FindEntry("dir/empty")->directory);
+	}
+
+	TEST_F(ArchiveReaderTest, TarEntries)
+	{
+		const std::string longName = "folder/" + std::string(150, 'n') + ".txt";
+		std::string tar;
+		AddTarFile(tar, "a.txt", "first");
+		AddTarFile(tar, "folder/", "", '5');
+		AddTarFile(tar, "././@LongLink", longName + '\0', 'L');
+		AddTarFile(tar, longName.substr(0, 100), "long name");
+		AddTarFile(tar, "link", "", '2');
+		tar.append(1024, '\0');
+		std::unique_ptr<ArchiveReader> reader = Open(tar);
+		ASSERT_NE(nullptr, reader);
+		EXPECT_EQ(ArchiveReader::FORMAT_TAR, reader->GetFormat());
+
+		EXPECT_EQ((std::vector<std::string>{ "a.txt", "folder/" }), List(*reader, ""));
+		EXPECT_EQ((std::vector<std::string>{ longName }), List(*reader, "folder"));
+		EXPECT_EQ("first", ReadEntry(*reader, "a.txt"));
+		EXPECT_EQ("long name", ReadEntry(*reader, longName));
+		const ArchiveEntry *entry = reader->FindEntry("a.txt");
+		EXPECT_FALSE(entry->hasCrc);
+		EXPECT_EQ(1600000000, entry->mtime);
+	}
+
+	TEST_F(ArchiveReaderTest, NestedArchives)
+	{
+		ZipBuilder inner;
+		inner.Add("inner/file.txt", "nested contents", true);
+		const std::string innerZip = inner.Finish();
+		std::string tar;
+		AddTarFile(tar, "t.txt", "in tar");
+		tar.append(1024, '\0');
+
+		ZipBuilder outer;
+		outer.Add("stored.zip", innerZip);
+		outer.Add("deflated.zip", innerZip, true);
+		outer.Add("archive.tar", tar, true);
+		outer.Add("plain.txt", "not an archive");
+		std::unique_ptr<ArchiveReader> reader = Open(outer.Finish());
+		ASSERT_NE(nullptr, reader);
+
+		for (const char *name : { "stored.zip", "deflated.zip" })
+		{
+			std::unique_ptr<ArchiveReader> nested = reader->OpenNested(*reader->FindEntry(name));
+			ASSERT_NE(nullptr, nested) << name;
+			EXPECT_EQ((std::vector<std::string>{ "inner/" }), List(*nested, ""));
+			EXPECT_EQ("nested contents", ReadEntry(*nested, "inner/file.txt"));
+		}
+		std::unique_ptr<ArchiveReader> nestedTar = reader->OpenNested(*reader->FindEntry("archive.tar"));
+		ASSERT_NE(nullptr, nestedTar);
+		EXPECT_EQ("in tar", ReadEntry(*nestedTar, "t.txt"));
+		EXPECT_EQ(nullptr, reader->OpenNested(*reader->FindEntry("plain.txt")));
+
+		// Only compressed entries are inflated to memory
+		EXPECT_EQ(0u, reader->GetNestedMemorySize(*reader->FindEntry("stored.zip")));
+		EXPECT_EQ(innerZip.size(), reader->GetNestedMemorySize(*reader->FindEntry("deflated.zip")));
+	}
+
+	TEST_F(ArchiveReaderTest, InvalidArchives)
+	{
+		EXPECT_EQ(nullptr, Open(""));
+		EXPECT_EQ(nullptr, Open("plain text file"));
+		EXPECT_EQ(nullptr, Open(std::string(1024, '\0')));
+
+		ZipBuilder zip;
+		zip.Add("a.txt", "contents");
+		const std::string data = zip.Finish();
+		// Central directory cut off
+		EXPECT_EQ(nullptr, Open(data.substr(0, data.size() - 30)));
+
+		std::string tar;
+		AddTarFile(tar, "a.txt", "contents");
+		tar[130] = '9';
+		EXPECT_EQ(nullptr, Open(tar));
+	}
+
+	TEST_F(ArchiveReaderTest, NormalizeName)
+	{
+		EXPECT_EQ("a/b/c.txt", ArchiveReader::NormalizeName("a/b/c.txt"));
+		EXPECT_EQ("a/b", ArchiveReader::NormalizeName("./a//b/"));
+		EXPECT_EQ("a/b", ArchiveReader::NormalizeName("\\a\\b"));
+		EXPECT_EQ("", ArchiveReader::NormalizeName("a/../../b"));
+	}
+
+}  // namespace
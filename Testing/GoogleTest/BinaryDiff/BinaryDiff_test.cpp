@@ -0,0 +1,174 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <fstream>
+#include <vector>
+#include "DiffItem.h"
+#include "PathContext.h"
+#include "CompareEngines/BinaryDiff.h"
+
+namespace
+{
+	using CompareEngines::BinaryDiff;
+
+	struct TempFile
+	{
+		TempFile(const std::string& filename, const std::vector<unsigned char>& data) : m_filename(filename)
+		{
+			std::ofstream ostr(filename.c_str(), std::ios::out|std::ios::binary|std::ios::trunc);
+			ostr.write(reinterpret_cast<const char *>(data.data()), data.size());
+		}
+		~TempFile()
+		{
+			remove(m_filename.c_str());
+		}
+		std::string m_filename;
+	};
+
+	// The fixture for testing BinaryDiff class.
+	class BinaryDiffTest : public testing::Test
+	{
+	protected:
+		BinaryDiffTest()
+		{
+		}
+
+		virtual ~BinaryDiffTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+		}
+
+		virtual void TearDown()
+		{
+		}
+
+		/** @brief Pseudo-random bytes, so that chunks are unique. */
+		static std::vector<unsigned char> RandomData(size_t size, unsigned seed)
+		{
+			std::vector<unsigned char> data(size);
+			unsigned x = seed;
+			for (auto& c : data)
+			{
+				x = x * 1103515245 + 12345;
+				c = static_cast<unsigned char>(x >> 16);
+			}
+			return data;
+		}
+
+		/** @brief Rebuild second input from the first one and the ranges. */
+		static std::vector<unsigned char> Apply(const std::vector<unsigned char>& data0,
+			const std::vector<unsigned char>& data1, const std::vector<BinaryDiff::Range>& ranges)
+		{
+			std::vector<unsigned char> result;
+			int64_t pos = 0;
+			for (const auto& range : ranges)
+			{
+				result.insert(result.end(), data0.begin() + pos, data0.begin() + range.begin[0]);
+				result.insert(result.end(), data1.begin() + range.begin[1], data1.begin() + range.end[1]);
+				pos = range.end[0];
+			}
+			result.insert(result.end(), data0.begin() + pos, data0.end());
+			return result;
+		}
+	};
+
+	TEST_F(BinaryDiffTest, Identical)
+	{
+		std::vector<unsigned char> data = RandomData(100000, 1);
+		BinaryDiff diff;
+		EXPECT_TRUE(diff.Diff(data.data(), data.size(), data.data(), data.size()));
+		EXPECT_TRUE(diff.GetRanges().empty());
+	}
+
+	TEST_F(BinaryDiffTest, Empty)
+	{
+		std::vector<unsigned char> data = RandomData(1000, 1);
+		BinaryDiff diff;
+		EXPECT_TRUE(diff.Diff(nullptr, 0, nullptr, 0));
+		EXPECT_TRUE(diff.GetRanges().empty());
+		EXPECT_TRUE(diff.Diff(nullptr, 0, data.data(), data.size()));
+		ASSERT_EQ(1u, diff.GetRanges().size());
+		EXPECT_EQ(0, diff.GetRanges()[0].end[0]);
+		EXPECT_EQ(1000, diff.GetRanges()[0].end[1]);
+	}
+
+	TEST_F(BinaryDiffTest, InsertedByte)
+	{
+		std::vector<unsigned char> data0 = RandomData(1024 * 1024, 2);
+		std::vector<unsigned char> data1 = data0;
+		data1.insert(data1.begin() + 5000, 0x42);
+		BinaryDiff diff;
+		EXPECT_TRUE(diff.Diff(data0.data(), data0.size(), data1.data(), data1.size()));
+		ASSERT_EQ(1u, diff.GetRanges().size());
+		const BinaryDiff::Range& range = diff.GetRanges()[0];
+		EXPECT_EQ(range.begin[0], range.end[0]);
+		EXPECT_EQ(1, range.end[1] - range.begin[1]);
+		EXPECT_EQ(data1, Apply(data0, data1, diff.GetRanges()));
+	}
+
+	TEST_F(BinaryDiffTest, DeletedBlock)
+	{
+		std::vector<unsigned char> data0 = RandomData(1024 * 1024, 3);
+		std::vector<unsigned char> data1 = data0;
+		data1.erase(data1.begin() + 300000, data1.begin() + 400000);
+		BinaryDiff diff;
+		EXPECT_TRUE(diff.Diff(data0.data(), data0.size(), data1.data(), data1.size()));
+		ASSERT_EQ(1u, diff.GetRanges().size());
+		const BinaryDiff::Range& range = diff.GetRanges()[0];
+		EXPECT_EQ(100000, range.end[0] - range.begin[0]);
+		EXPECT_EQ(range.begin[1], range.end[1]);
+		EXPECT_EQ(data1, Apply(data0, data1, diff.GetRanges()));
+	}
+
+	TEST_F(BinaryDiffTest, ChangedBytes)
+	{
+		std::vector<unsigned char> data0 = RandomData(200000, 4);
+		std::vector<unsigned char> data1 = data0;
+		data1[1000] ^= 0xff;
+		data1[1001] ^= 0xff;
+		data1[150000] ^= 0xff;
+		BinaryDiff diff;
+		EXPECT_TRUE(diff.Diff(data0.data(), data0.size(), data1.data(), data1.size()));
+		ASSERT_EQ(2u, diff.GetRanges().size());
+		EXPECT_EQ(1000, diff.GetRanges()[0].begin[0]);
+		EXPECT_EQ(1002, diff.GetRanges()[0].end[0]);
+		EXPECT_EQ(150000, diff.GetRanges()[1].begin[1]);
+		EXPECT_EQ(150001, diff.GetRanges()[1].end[1]);
+	}
+
+	TEST_F(BinaryDiffTest, ManyEdits)
+	{
+		std::vector<unsigned char> data0 = RandomData(2 * 1024 * 1024, 5);
+		std::vector<unsigned char> data1 = data0;
+		for (size_t pos = 10000; pos < data1.size(); pos += 97531)
+		{
+			if (pos % 2)
+				data1.insert(data1.begin() + pos, 100, 0x55);
+			else
+				data1.erase(data1.begin() + pos, data1.begin() + pos + 33);
+		}
+		BinaryDiff diff;
+		EXPECT_TRUE(diff.Diff(data0.data(), data0.size(), data1.data(), data1.size()));
+		EXPECT_FALSE(diff.GetRanges().empty());
+		EXPECT_EQ(data1, Apply(data0, data1, diff.GetRanges()));
+	}
+
+	TEST_F(BinaryDiffTest, CompareFiles)
+	{
+		std::vector<unsigned char> data0 = RandomData(300000, 6);
+		std::vector<unsigned char> data1 = data0;
+		data1.insert(data1.begin() + 123456, 3, 0);
+		TempFile file0("_tmp_binarydiff0.bin", data0);
+		TempFile file1("_tmp_binarydiff1.bin", data1);
+		TempFile empty("_tmp_binarydiff2.bin", {});
+		BinaryDiff diff;
+		EXPECT_EQ(DIFFCODE::DIFF, diff.CompareFiles(PathContext(_T("_tmp_binarydiff0.bin"), _T("_tmp_binarydiff1.bin"))));
+		ASSERT_EQ(1u, diff.GetRanges().size());
+		EXPECT_EQ(123456, diff.GetRanges()[0].begin[1]);
+		EXPECT_EQ(DIFFCODE::SAME, diff.CompareFiles(PathContext(_T("_tmp_binarydiff0.bin"), _T("_tmp_binarydiff0.bin"))));
+		EXPECT_EQ(DIFFCODE::SAME, diff.CompareFiles(PathContext(_T("_tmp_binarydiff2.bin"), _T("_tmp_binarydiff2.bin"))));
+		EXPECT_EQ(DIFFCODE::CMPERR, diff.CompareFiles(PathContext(_T("_tmp_binarydiff0.bin"), _T("_tmp_nonexistent.bin"))));
+	}
+}
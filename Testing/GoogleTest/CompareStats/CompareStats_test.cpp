@@ -0,0 +1,158 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CompareStats.h"
+
+namespace
+{
+	// The fixture for testing CompareStats class.
+	class CompareStatsTest : public testing::Test
+	{
+	protected:
+		CompareStatsTest()
+		{
+		}
+
+		virtual ~CompareStatsTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+		}
+
+		virtual void TearDown()
+		{
+		}
+	};
+
+	/** @brief Check braces and brackets outside strings are balanced. */
+	bool IsBalancedJson(const std::string& json)
+	{
+		std::string open;
+		bool bString = false;
+		for (size_t i = 0; i < json.length(); ++i)
+		{
+			const char c = json[i];
+			if (bString)
+			{
+				if (c == '\\')
+					++i;
+				else if (c == '"')
+					bString = false;
+			}
+			else if (c == '"')
+				bString = true;
+			else if (c == '{' || c == '[')
+				open += c;
+			else if (c == '}' || c == ']')
+			{
+				if (open.empty() || open.back() != (c == '}' ? '{' : '['))
+					return false;
+				open.pop_back();
+			}
+		}
+		return open.empty() && !bString;
+	}
+
+	TEST_F(CompareStatsTest, CountersSummedOverThreads)
+	{
+		CompareStats stats(2);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < 4; ++t)
+		{
+			threads.emplace_back([&stats]() {
+				for (int i = 0; i < 1000; ++i)
+				{
+					stats.AddCounter(CompareStats::COUNTER_BYTES_READ, 100);
+					stats.AddCounter(CompareStats::COUNTER_FILES_OPENED);
+				}
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+		stats.AddCounter(CompareStats::COUNTER_ENCODINGS_REUSED, 3);
+		EXPECT_EQ(400000, stats.GetCounter(CompareStats::COUNTER_BYTES_READ));
+		EXPECT_EQ(4000, stats.GetCounter(CompareStats::COUNTER_FILES_OPENED));
+		EXPECT_EQ(3, stats.GetCounter(CompareStats::COUNTER_ENCODINGS_REUSED));
+		EXPECT_EQ(0, stats.GetCounter(CompareStats::COUNTER_FILES_REUSED));
+
+		stats.Reset();
+		EXPECT_EQ(0, stats.GetCounter(CompareStats::COUNTER_BYTES_READ));
+		stats.AddCounter(CompareStats::COUNTER_BYTES_READ, 5);
+		EXPECT_EQ(5, stats.GetCounter(CompareStats::COUNTER_BYTES_READ));
+	}
+
+	TEST_F(CompareStatsTest, CountersOfInstancesSeparate)
+	{
+		// The thread-local cache must not mix up instances
+		CompareStats stats1(2);
+		CompareStats stats2(2);
+		stats1.AddCounter(CompareStats::COUNTER_FILES_REUSED, 1);
+		stats2.AddCounter(CompareStats::COUNTER_FILES_REUSED, 2);
+		stats1.AddCounter(CompareStats::COUNTER_FILES_REUSED, 4);
+		EXPECT_EQ(5, stats1.GetCounter(CompareStats::COUNTER_FILES_REUSED));
+		EXPECT_EQ(2, stats2.GetCounter(CompareStats::COUNTER_FILES_REUSED));
+	}
+
+	TEST_F(CompareStatsTest, PhaseTimes)
+	{
+		CompareStats stats(2);
+		stats.AddPhaseTime(CompareStats::PHASE_READ, 10, 30);
+		std::thread([&stats]() { stats.AddPhaseTime(CompareStats::PHASE_READ, 15, 35); }).join();
+		EXPECT_EQ(40, stats.GetPhaseTime(CompareStats::PHASE_READ));
+		EXPECT_EQ(2, stats.GetPhaseCount(CompareStats::PHASE_READ));
+		EXPECT_EQ(0, stats.GetPhaseCount(CompareStats::PHASE_COMPARE));
+		{
+			// Null stats are allowed
+			CompareStats::ScopedPhase phase(nullptr, CompareStats::PHASE_COMPARE);
+		}
+		{
+			CompareStats::ScopedPhase phase(&stats, CompareStats::PHASE_COMPARE);
+		}
+		EXPECT_EQ(1, stats.GetPhaseCount(CompareStats::PHASE_COMPARE));
+		EXPECT_TRUE(stats.HasTrace());
+	}
+
+	TEST_F(CompareStatsTest, WriteTrace)
+	{
+		CompareStats stats(2);
+		EXPECT_FALSE(stats.HasTrace());
+		std::thread([&stats]() {
+			stats.AddPhaseTime(CompareStats::PHASE_COMPARE, 5, 12);
+			stats.AddCounter(CompareStats::COUNTER_FILES_REUSED, 2);
+		}).join();
+		stats.AddPhaseTime(CompareStats::PHASE_ENUMERATE, 0, 3);
+		stats.AddCounter(CompareStats::COUNTER_STORED_CHECKSUMS, 3);
+
+		std::ostringstream out;
+		stats.WriteTrace(out);
+		const std::string json = out.str();
+		EXPECT_EQ(0u, json.find("{\"traceEvents\":[\n"));
+		EXPECT_TRUE(IsBalancedJson(json)) << json;
+		EXPECT_NE(std::string::npos, json.find(
+			"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"Thread 1\"}}")) << json;
+		EXPECT_NE(std::string::npos, json.find(
+			"{\"name\":\"compare\",\"cat\":\"compare\",\"ph\":\"X\",\"ts\":5,\"dur\":7,\"pid\":1,\"tid\":1}")) << json;
+		EXPECT_NE(std::string::npos, json.find(
+			"{\"name\":\"enumerate\",\"cat\":\"compare\",\"ph\":\"X\",\"ts\":0,\"dur\":3,\"pid\":1,\"tid\":2}")) << json;
+		EXPECT_NE(std::string::npos, json.find(
+			"\"otherData\":{\"bytes_read\":0,\"files_opened\":0,\"encodings_reused\":0,"
+			"\"files_reused\":2,\"stored_checksums\":3,\"truncated\":false}}")) << json;
+		// Events are separated by commas, none trails
+		EXPECT_EQ(std::string::npos, json.find(",\n]"));
+	}
+
+	TEST_F(CompareStatsTest, WriteTraceEmpty)
+	{
+		CompareStats stats(2);
+		std::ostringstream out;
+		stats.WriteTrace(out);
+		EXPECT_TRUE(IsBalancedJson(out.str())) << out.str();
+		EXPECT_EQ(0u, out.str().find("{\"traceEvents\":[\n\n],"));
+	}
+
+}  // namespace
@@ -0,0 +1,79 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "DiffCopyLines.h"
+
+namespace
+{
+	// The fixture for testing ForEachCopiedLine function.
+	class DiffCopyLinesTest : public testing::Test
+	{
+	protected:
+		DiffCopyLinesTest()
+		{
+		}
+
+		virtual ~DiffCopyLinesTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+		}
+
+		virtual void TearDown()
+		{
+		}
+
+		/** @brief Copy differences, lines of the result are "<pane><line>". */
+		std::vector<std::string> Copy(int nLineCount, int dstPane, const std::vector<DiffCopyRange>& diffs)
+		{
+			std::vector<std::string> result;
+			ForEachCopiedLine(nLineCount, dstPane, diffs,
+				[this](int nPane, int nLine) { return m_flags[nPane][nLine]; },
+				[&result](int nPane, int nLine) { result.push_back(std::to_string(nPane) + std::to_string(nLine)); });
+			return result;
+		}
+
+		std::vector<unsigned long> m_flags[3];
+	};
+
+	const unsigned long Ghost = 0x00400000UL;
+	const unsigned long Invisible = 0x80000000UL;
+
+	TEST_F(DiffCopyLinesTest, CopyDiffs)
+	{
+		m_flags[0] = { 0, 0, 0, Ghost, 0, 0, 0 };
+		m_flags[1] = { 0, Ghost, 0, 0, 0, 0, 0 };
+		EXPECT_EQ((std::vector<std::string>{ "10", "01", "02", "14", "05", "16" }),
+			Copy(7, 1, { { 1, 3, 0 }, { 5, 5, 0 } }));
+		// Ghost lines of the source are not copied
+		EXPECT_EQ((std::vector<std::string>{ "00", "12", "03", "04", "05", "06" }),
+			Copy(7, 0, { { 1, 2, 1 } }));
+	}
+
+	TEST_F(DiffCopyLinesTest, InvisibleLinesNotCopied)
+	{
+		// Lines hidden by filters are skipped like ListCopy() skips them
+		m_flags[0] = { 0, Invisible, 0, 0 };
+		m_flags[1] = { 0, 0, 0, Invisible };
+		EXPECT_EQ((std::vector<std::string>{ "10", "02", "13" }),
+			Copy(4, 1, { { 1, 2, 0 } }));
+		// Invisible lines outside the differences stay
+		EXPECT_EQ((std::vector<std::string>{ "00", "11", "12", "13" }),
+			Copy(4, 1, { { 0, 0, 0 } }));
+	}
+
+	TEST_F(DiffCopyLinesTest, ThreeWay)
+	{
+		m_flags[0] = { 0, 0, 0, 0 };
+		m_flags[1] = { 0, 0, 0, 0 };
+		m_flags[2] = { 0, 0, Ghost, 0 };
+		EXPECT_EQ((std::vector<std::string>{ "20", "11", "22", "23" }),
+			Copy(4, 2, { { 1, 1, 1 } }));
+		EXPECT_EQ((std::vector<std::string>{ "00", "21", "13" }),
+			Copy(4, 1, { { 0, 0, 0 }, { 1, 2, 2 } }));
+	}
+
+}  // namespace
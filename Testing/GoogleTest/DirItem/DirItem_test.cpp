@@ -2,6 +2,8 @@
 #include <gtest/gtest.h>
 #include "UnicodeString.h"
 #include "DirItem.h"
+#include <thread>
+#include <vector>
 
 namespace
 {
@@ -46,5 +48,86 @@ namespace
 		EXPECT_TRUE(item.ctime == 0);
 	}
 
+	TEST_F(DirItemTest, InternedNames)
+	{
+		DirItem item1, item2;
+		item1.filename = String(_T("file.txt"));
+		item2.filename = _T("file.txt");
+		EXPECT_EQ(&item1.filename.get(), &item2.filename.get());
+		item2.filename = _T("file2.txt");
+		EXPECT_NE(&item1.filename.get(), &item2.filename.get());
+		EXPECT_EQ(_T("file.txt"), item1.filename.get());
+	}
+
+	TEST_F(DirItemTest, InternedNamesConcurrent)
+	{
+		const int nThreads = 8;
+		InternedString kept(_T("name999"));
+		std::vector<const String *> results(nThreads);
+		std::vector<std::thread> threads;
+		for (int t = 0; t < nThreads; ++t)
+		{
+			threads.emplace_back([t, &results]() {
+				for (int i = 0; i < 10000; ++i)
+				{
+					InternedString name(_T("name") + strutils::to_str(i % 1000));
+					if (i == 999)
+						results[t] = &name.get();
+				}
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+		for (int t = 0; t < nThreads; ++t)
+			EXPECT_EQ(&kept.get(), results[t]);
+	}
+
+	struct NameRep
+	{
+		explicit NameRep(const String& s) : name(s) {}
+		operator const String&() const { return name; }
+		String name;
+	};
+	typedef sharded_entry<NameRep, String> NameEntry;
+	typedef sharded_factory_class<NameEntry, String> NameFactory;
+
+	TEST_F(DirItemTest, InternedNamesReleased)
+	{
+		NameFactory factory;
+		std::thread([&factory]() {
+			NameFactory::handle_type a = factory.insert(NameEntry(NameRep(_T("a"))));
+			NameFactory::handle_type b = factory.insert(NameEntry(NameRep(_T("a"))));
+			EXPECT_EQ(a, b);
+			factory.erase(a);
+			factory.erase(b);
+			// The per-thread cache still refers to the entry
+			EXPECT_EQ(1u, factory.size());
+			for (int i = 0; i < 1000; ++i)
+				factory.erase(factory.insert(NameEntry(NameRep(strutils::to_str(i)))));
+			EXPECT_GE(static_cast<size_t>(NameFactory::CACHE_SIZE), factory.size());
+		}).join();
+		// Nothing refers to the entries after the thread has released its cache
+		EXPECT_EQ(0u, factory.size());
+
+		InternedString name(_T("released"));
+		InternedString copy = name;
+		name = _T("other");
+		EXPECT_EQ(_T("released"), copy.get());
+	}
+
+	TEST_F(DirItemTest, InternedNamesFactoryDestroyed)
+	{
+		// A factory created where a destroyed one was must not find the
+		// entries the per-thread cache kept of the old one
+		alignas(NameFactory) unsigned char storage[sizeof(NameFactory)];
+		NameFactory *factory = new (storage) NameFactory();
+		factory->erase(factory->insert(NameEntry(NameRep(_T("stale")))));
+		factory->~NameFactory();
+		factory = new (storage) NameFactory();
+		NameFactory::handle_type h = factory->insert(NameEntry(NameRep(_T("stale"))));
+		EXPECT_EQ(1u, factory->size());
+		factory->erase(h);
+		factory->~NameFactory();
+	}
 
 }  // namespace
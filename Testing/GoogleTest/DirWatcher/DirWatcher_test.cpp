@@ -0,0 +1,159 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <Poco/File.h>
+#include <Poco/Thread.h>
+#include "UnicodeString.h"
+#include "unicoder.h"
+#include "Environment.h"
+#include "PathContext.h"
+#include "paths.h"
+#include "DirWatcher.h"
+
+namespace
+{
+	// The fixture for testing DirWatcher class.
+	class DirWatcherTest : public testing::Test
+	{
+	protected:
+		DirWatcherTest()
+		{
+		}
+
+		virtual ~DirWatcherTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+			m_root = paths::ConcatPath(env::GetSystemTempPath(), _T("WinMergeDirWatcherTest"));
+			RemoveRoot();
+			for (int i = 0; i < 2; ++i)
+			{
+				m_dir[i] = paths::ConcatPath(m_root, i == 0 ? _T("left") : _T("right"));
+				paths::CreateIfNeeded(paths::ConcatPath(m_dir[i], _T("sub")));
+			}
+			WriteFile(paths::ConcatPath(m_dir[0], _T("sub\\file.txt")), "abc");
+		}
+
+		virtual void TearDown()
+		{
+			RemoveRoot();
+		}
+
+		void RemoveRoot()
+		{
+			Poco::File root(ucr::toUTF8(m_root));
+			if (root.exists())
+				root.remove(true);
+		}
+
+		static void WriteFile(const String& path, const std::string& data)
+		{
+			std::ofstream ostr(ucr::toUTF8(path).c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+			ostr << data;
+		}
+
+		/** @brief Wait until the watcher hands out changes, or give up. */
+		static bool WaitForChanges(DirWatcher& watcher, std::vector<String> changes[3])
+		{
+			for (int i = 0; i < 100; ++i)
+			{
+				if (watcher.GetChanges(changes))
+					return true;
+				Poco::Thread::sleep(50);
+			}
+			return false;
+		}
+
+		static bool Contains(const std::vector<String>& changes, const String& relpath)
+		{
+			return std::find(changes.begin(), changes.end(), relpath) != changes.end();
+		}
+
+		String m_root;
+		String m_dir[2];
+	};
+
+	TEST_F(DirWatcherTest, NoChanges)
+	{
+		DirWatcher watcher(0, 50);
+		ASSERT_TRUE(watcher.Start(PathContext(m_dir[0], m_dir[1]), true));
+		EXPECT_TRUE(watcher.IsWatching());
+		Poco::Thread::sleep(200);
+		std::vector<String> changes[3];
+		EXPECT_FALSE(watcher.GetChanges(changes));
+		watcher.Stop();
+		EXPECT_FALSE(watcher.IsWatching());
+	}
+
+	TEST_F(DirWatcherTest, NotExisting)
+	{
+		DirWatcher watcher(0, 50);
+		EXPECT_FALSE(watcher.Start(PathContext(m_dir[0], paths::ConcatPath(m_root, _T("none"))), true));
+		EXPECT_FALSE(watcher.IsWatching());
+	}
+
+	TEST_F(DirWatcherTest, Native)
+	{
+		DirWatcher watcher(0, 50);
+		ASSERT_TRUE(watcher.Start(PathContext(m_dir[0], m_dir[1]), true));
+		EXPECT_FALSE(watcher.IsPolling(0));
+		WriteFile(paths::ConcatPath(m_dir[1], _T("sub\\new.txt")), "new");
+		std::vector<String> changes[3];
+		ASSERT_TRUE(WaitForChanges(watcher, changes));
+		EXPECT_TRUE(changes[0].empty());
+		EXPECT_TRUE(Contains(changes[1], _T("sub\\new.txt")));
+	}
+
+	TEST_F(DirWatcherTest, Polling)
+	{
+		DirWatcher watcher(0, 50);
+		ASSERT_TRUE(watcher.Start(PathContext(m_dir[0], m_dir[1]), true, true));
+		EXPECT_TRUE(watcher.IsPolling(0));
+		EXPECT_TRUE(watcher.IsPolling(1));
+		WriteFile(paths::ConcatPath(m_dir[0], _T("sub\\file.txt")), "changed");
+		WriteFile(paths::ConcatPath(m_dir[1], _T("new.txt")), "new");
+		std::vector<String> changes[3];
+		ASSERT_TRUE(WaitForChanges(watcher, changes));
+		// Both files may be seen by different polls
+		if (changes[0].empty() || changes[1].empty())
+		{
+			std::vector<String> changes2[3];
+			ASSERT_TRUE(WaitForChanges(watcher, changes2));
+			for (int i = 0; i < 2; ++i)
+				changes[i].insert(changes[i].end(), changes2[i].begin(), changes2[i].end());
+		}
+		EXPECT_TRUE(Contains(changes[0], _T("sub\\file.txt")));
+		EXPECT_TRUE(Contains(changes[1], _T("new.txt")));
+
+		Poco::File(ucr::toUTF8(paths::ConcatPath(m_dir[1], _T("new.txt")))).remove();
+		ASSERT_TRUE(WaitForChanges(watcher, changes));
+		EXPECT_TRUE(Contains(changes[1], _T("new.txt")));
+	}
+
+	TEST_F(DirWatcherTest, Debounce)
+	{
+		DirWatcher watcher(60 * 1000, 50);
+		ASSERT_TRUE(watcher.Start(PathContext(m_dir[0], m_dir[1]), true, true));
+		WriteFile(paths::ConcatPath(m_dir[0], _T("new.txt")), "new");
+		Poco::Thread::sleep(500);
+		std::vector<String> changes[3];
+		EXPECT_FALSE(watcher.GetChanges(changes));
+	}
+
+	TEST_F(DirWatcherTest, MaxLatency)
+	{
+		// Changes are handed out after the maximum latency, though the
+		// debounce interval has not passed
+		DirWatcher watcher(60 * 1000, 50, 300);
+		ASSERT_TRUE(watcher.Start(PathContext(m_dir[0], m_dir[1]), true, true));
+		WriteFile(paths::ConcatPath(m_dir[0], _T("new.txt")), "new");
+		std::vector<String> changes[3];
+		ASSERT_TRUE(WaitForChanges(watcher, changes));
+		EXPECT_TRUE(Contains(changes[0], _T("new.txt")));
+	}
+
+}
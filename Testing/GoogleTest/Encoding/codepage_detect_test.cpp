@@ -1,5 +1,9 @@
 #include "pch.h"
 #include <gtest/gtest.h>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
 #include "codepage_detect.h"
 #include "charsets.h"
 
@@ -92,5 +96,47 @@ namespace
 		EXPECT_EQ(ucr::UTF8, enc.m_unicoding);
 	}
 
+	TEST_F(CodepageDetectTest, GuessTruncatedHead)
+	{
+		// UTF-8 text cut in the middle of a character
+		const char head[] = "abc\xc3\xa9 \xe2\x98";
+		FileTextEncoding enc = codepage_detect::Guess(_T(".txt"), head, sizeof(head) - 1, 1, true);
+		EXPECT_EQ(65001, enc.m_codepage);
+		EXPECT_EQ(ucr::UTF8, enc.m_unicoding);
+		enc = codepage_detect::Guess(_T(".txt"), head, sizeof(head) - 1, 1, false);
+		EXPECT_EQ(ucr::getDefaultCodepage(), enc.m_codepage);
+		EXPECT_EQ(ucr::NONE, enc.m_unicoding);
+	}
+
+	TEST_F(CodepageDetectTest, GuessSampledFile)
+	{
+		// Non-ASCII text only at the end, after a long ASCII head
+		std::string text(codepage_detect::BufSize * 4, 'a');
+		text += "\xe2\x98\xba end";
+		const String path = _T("codepage_detect_sampled.txt");
+		{
+			std::ofstream file("codepage_detect_sampled.txt", std::ios::out | std::ios::binary | std::ios::trunc);
+			file << text;
+		}
+		std::vector<FileTextEncoding> encs = codepage_detect::GuessFiles(
+			{ path, _T("../../Data/Unicode/UCS-2LE/DiffItem.h"), path }, 1);
+		ASSERT_EQ(3u, encs.size());
+		EXPECT_EQ(65001, encs[0].m_codepage);
+		EXPECT_EQ(ucr::UTF8, encs[0].m_unicoding);
+		EXPECT_EQ(ucr::UCS2LE, encs[1].m_unicoding);
+		EXPECT_EQ(65001, encs[2].m_codepage);
+		EXPECT_EQ(ucr::getDefaultCodepage(), codepage_detect::Guess(path, 0).m_codepage);
+		// Negative length reads the whole file
+		FileTextEncoding enc = codepage_detect::Guess(path, 1, -1);
+		EXPECT_EQ(65001, enc.m_codepage);
+		EXPECT_EQ(ucr::UTF8, enc.m_unicoding);
+
+		// Guesses falling back to the default codepage follow its changes
+		const int defaultCodepage = ucr::getDefaultCodepage();
+		ucr::setDefaultCodepage(defaultCodepage == 1252 ? 1251 : 1252);
+		EXPECT_EQ(ucr::getDefaultCodepage(), codepage_detect::Guess(path, 0).m_codepage);
+		ucr::setDefaultCodepage(defaultCodepage);
+		remove("codepage_detect_sampled.txt");
+	}
 
 }  // namespace
@@ -0,0 +1,111 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include "FilterList.h"
+
+namespace
+{
+	// The fixture for testing FilterList class.
+	class FilterListTest : public testing::Test
+	{
+	protected:
+		FilterListTest()
+		{
+		}
+
+		virtual ~FilterListTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+		}
+
+		virtual void TearDown()
+		{
+		}
+	};
+
+	/** @brief Match lines of text one by one, and all at once. */
+	void CheckLines(FilterList& list, const std::string& text, const std::vector<char>& expected)
+	{
+		std::vector<const char *> lines;
+		size_t pos = 0;
+		while (pos < text.length())
+		{
+			lines.push_back(text.data() + pos);
+			const size_t eol = text.find('\n', pos);
+			pos = (eol == std::string::npos) ? text.length() : eol + 1;
+		}
+		lines.push_back(text.data() + text.length());
+		const int nlines = static_cast<int>(lines.size() - 1);
+		ASSERT_EQ(expected.size(), static_cast<size_t>(nlines));
+
+		std::vector<char> flags(nlines, 2);
+		list.MatchLines(lines.data(), nlines, flags.data());
+		for (int i = 0; i < nlines; ++i)
+		{
+			std::string line(lines[i], lines[i + 1] - lines[i]);
+			while (!line.empty() && (line.back() == '\n' || line.back() == '\r'))
+				line.pop_back();
+			EXPECT_EQ(expected[i], flags[i]) << "line " << i;
+			EXPECT_EQ(expected[i] != 0, list.Match(line)) << "line " << i;
+		}
+	}
+
+	TEST_F(FilterListTest, Match)
+	{
+		FilterList list;
+		EXPECT_FALSE(list.HasRegExps());
+		list.AddRegExp("^\\s*//");
+		list.AddRegExp("Revision: \\d+");
+		EXPECT_TRUE(list.HasRegExps());
+		EXPECT_TRUE(list.Match("  // comment"));
+		EXPECT_STREQ("^\\s*//", list.GetLastMatchExpression());
+		EXPECT_TRUE(list.Match("$Revision: 42 $"));
+		EXPECT_STREQ("Revision: \\d+", list.GetLastMatchExpression());
+		EXPECT_FALSE(list.Match("int a; // comment"));
+		EXPECT_FALSE(list.Match("Revision: x"));
+	}
+
+	TEST_F(FilterListTest, MatchLines)
+	{
+		FilterList list;
+		list.AddRegExp("^\\s*//");
+		list.AddRegExp("Revision: \\d+");
+		list.AddRegExp("^$");
+		CheckLines(list, "// a\r\nint a;\r\n\r\n$Revision: 7 $\nRevision:\n  // b",
+			{ 1, 0, 1, 1, 0, 1 });
+	}
+
+	TEST_F(FilterListTest, MatchLinesNotCombined)
+	{
+		// Back reference can not be combined with other expressions
+		FilterList list;
+		list.AddRegExp("(\\w+) \\1");
+		list.AddRegExp("(?i)todo");
+		list.AddRegExp("[");
+		CheckLines(list, "word word\nword other\nTODO: x\n", { 1, 0, 1 });
+	}
+
+	TEST_F(FilterListTest, MatchLinesLarge)
+	{
+		FilterList list;
+		list.AddRegExp("^#");
+		list.AddRegExp("generated");
+		std::string text;
+		std::vector<char> expected;
+		for (int i = 0; i < 30000; ++i)
+		{
+			switch (i % 3)
+			{
+			case 0: text += "# comment " + std::to_string(i) + "\n"; expected.push_back(1); break;
+			case 1: text += "code " + std::to_string(i) + "\n"; expected.push_back(0); break;
+			default: text += "x = 1 // generated\n"; expected.push_back(1); break;
+			}
+		}
+		CheckLines(list, text, expected);
+	}
+
+}  // namespace
@@ -0,0 +1,277 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "UnicodeString.h"
+#include "CompareEngines/ImageDiff.h"
+
+using CompareEngines::ImageDiff;
+
+namespace
+{
+	// The fixture for testing ImageDiff class.
+	class ImageDiffTest : public testing::Test
+	{
+	protected:
+		ImageDiffTest()
+		{
+		}
+
+		virtual ~ImageDiffTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+		}
+
+		virtual void TearDown()
+		{
+		}
+	};
+
+	void PutBE32(std::string& s, uint32_t v)
+	{
+		s += static_cast<char>(v >> 24);
+		s += static_cast<char>(v >> 16);
+		s += static_cast<char>(v >> 8);
+		s += static_cast<char>(v);
+	}
+
+	void PutLE(std::string& s, uint32_t v, int bytes)
+	{
+		for (int i = 0; i < bytes; ++i)
+			s += static_cast<char>(v >> (i * 8));
+	}
+
+	/** @brief Add a PNG chunk, the CRC is not checked by ImageDiff. */
+	void AddChunk(std::string& png, const char *type, const std::string& data)
+	{
+		PutBE32(png, static_cast<uint32_t>(data.size()));
+		png += type;
+		png += data;
+		PutBE32(png, 0);
+	}
+
+	/** @brief Encode raw scanlines in a zlib stream of stored blocks. */
+	std::string Zlib(const std::string& raw)
+	{
+		std::string z = "\x78\x01";
+		size_t pos = 0;
+		do
+		{
+			const size_t len = std::min<size_t>(raw.size() - pos, 65535);
+			z += static_cast<char>(pos + len == raw.size() ? 1 : 0);
+			PutLE(z, static_cast<uint32_t>(len), 2);
+			PutLE(z, static_cast<uint32_t>(~len & 0xffff), 2);
+			z += raw.substr(pos, len);
+			pos += len;
+		} while (pos < raw.size());
+		uint32_t a = 1, b = 0;
+		for (unsigned char c : raw)
+		{
+			a = (a + c) % 65521;
+			b = (b + a) % 65521;
+		}
+		PutBE32(z, (b << 16) | a);
+		return z;
+	}
+
+	/**
+	 * @brief Encode an 8-bit PNG image, each row with the given filter.
+	 * @param [in] rows Unfiltered scanlines.
+	 */
+	std::string Png(int width, int height, int colorType, const std::vector<std::string>& rows, int filter = 0, const std::string& plte = "")
+	{
+		std::string png = "\x89PNG\r\n\x1a\n";
+		std::string ihdr;
+		PutBE32(ihdr, width);
+		PutBE32(ihdr, height);
+		ihdr += static_cast<char>(8);
+		ihdr += static_cast<char>(colorType);
+		ihdr += std::string(3, '\0');
+		AddChunk(png, "IHDR", ihdr);
+		if (!plte.empty())
+			AddChunk(png, "PLTE", plte);
+		const size_t bpp = (colorType == 6) ? 4 : (colorType == 2) ? 3 : 1;
+		std::string raw;
+		for (size_t y = 0; y < rows.size(); ++y)
+		{
+			raw += static_cast<char>(filter);
+			for (size_t i = 0; i < rows[y].size(); ++i)
+			{
+				const int left = (i >= bpp) ? static_cast<unsigned char>(rows[y][i - bpp]) : 0;
+				const int up = (y > 0) ? static_cast<unsigned char>(rows[y - 1][i]) : 0;
+				const int x = static_cast<unsigned char>(rows[y][i]);
+				raw += static_cast<char>(filter == 1 ? x - left : filter == 2 ? x - up : filter == 3 ? x - (left + up) / 2 : x);
+			}
+		}
+		AddChunk(png, "IDAT", Zlib(raw));
+		AddChunk(png, "IEND", "");
+		return png;
+	}
+
+	bool Decode(const std::string& data, ImageDiff::Image& image)
+	{
+		return ImageDiff::Decode(reinterpret_cast<const unsigned char *>(data.data()), data.size(), image);
+	}
+
+	TEST_F(ImageDiffTest, DecodePng)
+	{
+		std::vector<std::string> rows = {
+			std::string("\x10\x20\x30\x40\x50\x60", 6),
+			std::string("\x70\x80\x90\xa0\xb0\xc0", 6) };
+		for (int filter = 0; filter <= 3; ++filter)
+		{
+			ImageDiff::Image image;
+			ASSERT_TRUE(Decode(Png(2, 2, 2, rows, filter), image));
+			EXPECT_EQ(2, image.width);
+			EXPECT_EQ(2, image.height);
+			const std::vector<unsigned char> expected = {
+				0x10, 0x20, 0x30, 0xff, 0x40, 0x50, 0x60, 0xff,
+				0x70, 0x80, 0x90, 0xff, 0xa0, 0xb0, 0xc0, 0xff };
+			EXPECT_EQ(expected, image.pixels);
+		}
+
+		// Palette image
+		ImageDiff::Image image;
+		ASSERT_TRUE(Decode(Png(2, 1, 3, { std::string("\x01\x00", 2) }, 0, std::string("\x00\x00\x00\xff\x00\x00", 6)), image));
+		EXPECT_EQ((std::vector<unsigned char>{ 0xff, 0, 0, 0xff, 0, 0, 0, 0xff }), image.pixels);
+
+		// Truncated image data
+		std::string png = Png(2, 2, 2, rows);
+		EXPECT_FALSE(Decode(png.substr(0, png.size() - 20), image));
+	}
+
+	TEST_F(ImageDiffTest, DecodeBmp)
+	{
+		// 2x2 24-bit bottom-up BMP, rows padded to 4 bytes
+		std::string bmp = "BM";
+		PutLE(bmp, 14 + 40 + 16, 4);
+		PutLE(bmp, 0, 4);
+		PutLE(bmp, 14 + 40, 4);
+		PutLE(bmp, 40, 4);
+		PutLE(bmp, 2, 4);
+		PutLE(bmp, 2, 4);
+		PutLE(bmp, 1, 2);
+		PutLE(bmp, 24, 2);
+		bmp += std::string(24, '\0');
+		bmp += std::string("\x30\x20\x10\x60\x50\x40\0\0", 8); // bottom row, BGR
+		bmp += std::string("\x90\x80\x70\xc0\xb0\xa0\0\0", 8); // top row
+		ImageDiff::Image image;
+		ASSERT_TRUE(Decode(bmp, image));
+		const std::vector<unsigned char> expected = {
+			0x70, 0x80, 0x90, 0xff, 0xa0, 0xb0, 0xc0, 0xff,
+			0x10, 0x20, 0x30, 0xff, 0x40, 0x50, 0x60, 0xff };
+		EXPECT_EQ(expected, image.pixels);
+	}
+
+	TEST_F(ImageDiffTest, DecodePnm)
+	{
+		ImageDiff::Image image;
+		ASSERT_TRUE(Decode("P3\n# comment\n2 1\n15\n15 0 0  0 15 0\n", image));
+		EXPECT_EQ((std::vector<unsigned char>{ 255, 0, 0, 255, 0, 255, 0, 255 }), image.pixels);
+
+		ASSERT_TRUE(Decode(std::string("P6\n1 1\n255\n\x01\x02\x03", 14), image));
+		EXPECT_EQ((std::vector<unsigned char>{ 1, 2, 3, 255 }), image.pixels);
+
+		ASSERT_TRUE(Decode(std::string("P4\n3 1\n\xa0", 8), image));
+		EXPECT_EQ((std::vector<unsigned char>{ 0, 0, 0, 255, 255, 255, 255, 255, 0, 0, 0, 255 }), image.pixels);
+
+		EXPECT_FALSE(Decode(std::string("P6\n2 2\n255\n\x01\x02\x03", 14), image));
+		EXPECT_FALSE(Decode("GIF89a", image));
+	}
+
+	TEST_F(ImageDiffTest, MaxSize)
+	{
+		// Images larger than 16M pixels are left to WinIMergeLib
+		ImageDiff::Image image;
+		ASSERT_TRUE(Decode("P4\n4096 4096\n" + std::string(4096 / 8 * 4096, '\0'), image));
+		EXPECT_EQ(4096u * 4096 * 4, image.pixels.size());
+		EXPECT_FALSE(Decode("P4\n4097 4096\n" + std::string((4097 + 7) / 8 * 4096, '\0'), image));
+	}
+
+	TEST_F(ImageDiffTest, IsDifferent)
+	{
+		// Width not a multiple of 4 pixels tests the scalar tail too
+		ImageDiff::Image image0, image1;
+		image0.width = image1.width = 7;
+		image0.height = image1.height = 3;
+		image0.pixels.assign(7 * 3 * 4, 100);
+		image1.pixels = image0.pixels;
+		EXPECT_FALSE(ImageDiff::IsDifferent(image0, image1, 0.0));
+
+		for (int x : { 2, 6 })
+		{
+			image1.pixels = image0.pixels;
+			unsigned char *pixel = &image1.pixels[(1 * 7 + x) * 4];
+			pixel[0] = 103; // distance 5
+			pixel[2] = 104;
+			EXPECT_TRUE(ImageDiff::IsDifferent(image0, image1, 0.0));
+			EXPECT_TRUE(ImageDiff::IsDifferent(image0, image1, 4.9));
+			EXPECT_FALSE(ImageDiff::IsDifferent(image0, image1, 5.0));
+		}
+
+		// Different size
+		image1 = image0;
+		image1.width = 3;
+		image1.height = 7;
+		EXPECT_TRUE(ImageDiff::IsDifferent(image0, image1, 0.0));
+	}
+
+	TEST_F(ImageDiffTest, IsRowDifferent)
+	{
+		// Largest distances fit in the 32-bit sums
+		std::vector<unsigned char> row0(64 * 4, 0), row1(64 * 4, 255);
+		EXPECT_TRUE(ImageDiff::IsRowDifferent(row0.data(), row1.data(), 64, ImageDiff::MaxDistance2 - 1));
+		EXPECT_FALSE(ImageDiff::IsRowDifferent(row0.data(), row1.data(), 64, ImageDiff::MaxDistance2));
+		EXPECT_FALSE(ImageDiff::IsRowDifferent(row1.data(), row0.data(), 64, ImageDiff::MaxDistance2));
+	}
+
+	TEST_F(ImageDiffTest, Signature)
+	{
+		ImageDiff::Image image0, image1;
+		image0.width = image1.width = 20;
+		image0.height = image1.height = 10;
+		image0.pixels.assign(20 * 10 * 4, 128);
+		image1.pixels = image0.pixels;
+		for (int x = 0; x < 20; ++x)
+			image1.pixels[(9 * 20 + x) * 4 + 1] = 124; // green of last row darker by 4
+		ImageDiff::Signature signature0, signature1;
+		ImageDiff::GetSignature(image0, signature0);
+		ImageDiff::GetSignature(image1, signature1);
+		EXPECT_TRUE(ImageDiff::IsSignatureDifferent(signature0, signature1, 0.0));
+		EXPECT_TRUE(ImageDiff::IsSignatureDifferent(signature0, signature1, 1.0));
+
+		// Images equal within the threshold never have different signatures
+		EXPECT_FALSE(ImageDiff::IsDifferent(image0, image1, 4.0));
+		EXPECT_FALSE(ImageDiff::IsSignatureDifferent(signature0, signature1, 4.0));
+
+		// Equal signatures do not mean equal images
+		image1.pixels = image0.pixels;
+		image1.pixels[1] = 0;
+		image1.pixels[5] = 255;
+		ImageDiff::GetSignature(image1, signature1);
+		EXPECT_FALSE(ImageDiff::IsSignatureDifferent(signature0, signature1, 1.0));
+		EXPECT_TRUE(ImageDiff::IsDifferent(image0, image1, 1.0));
+	}
+
+	TEST_F(ImageDiffTest, SignatureCache)
+	{
+		CompareEngines::ImageSignatureCache cache;
+		ImageDiff::Signature signature, cached;
+		signature.width = 3;
+		signature.height = 2;
+		signature.luma[5] = 1000;
+		EXPECT_FALSE(cache.Lookup(_T("a.png"), 100, 1, cached));
+		cache.Add(_T("a.png"), 100, 1, signature);
+		ASSERT_TRUE(cache.Lookup(_T("a.png"), 100, 1, cached));
+		EXPECT_EQ(3, cached.width);
+		EXPECT_EQ(1000, cached.luma[5]);
+		// Changed files are not in the cache
+		EXPECT_FALSE(cache.Lookup(_T("a.png"), 100, 2, cached));
+		EXPECT_FALSE(cache.Lookup(_T("a.png"), 101, 1, cached));
+		EXPECT_FALSE(cache.Lookup(_T("b.png"), 100, 1, cached));
+	}
+}
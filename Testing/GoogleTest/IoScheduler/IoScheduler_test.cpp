@@ -0,0 +1,123 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include "IoScheduler.h"
+
+namespace
+{
+	// The fixture for testing IoScheduler class.
+	class IoSchedulerTest : public testing::Test
+	{
+	protected:
+		IoSchedulerTest()
+		{
+		}
+
+		virtual ~IoSchedulerTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+		}
+
+		virtual void TearDown()
+		{
+		}
+	};
+
+	TEST_F(IoSchedulerTest, InitialLimits)
+	{
+		IoScheduler scheduler(8);
+		EXPECT_FALSE(scheduler.IsLimited());
+		int ssd = scheduler.AddVolume(_T("C:\\"), IoScheduler::DEVICE_SSD);
+		EXPECT_FALSE(scheduler.IsLimited());
+		int hdd = scheduler.AddVolume(_T("D:\\"), IoScheduler::DEVICE_HDD);
+		int remote = scheduler.AddVolume(_T("\\\\server\\share\\"), IoScheduler::DEVICE_REMOTE);
+		EXPECT_TRUE(scheduler.IsLimited());
+		EXPECT_EQ(8, scheduler.GetLimit(ssd));
+		EXPECT_EQ(1, scheduler.GetLimit(hdd));
+		EXPECT_EQ(2, scheduler.GetLimit(remote));
+		EXPECT_EQ(IoScheduler::DEVICE_HDD, scheduler.GetDeviceType(hdd));
+	}
+
+	TEST_F(IoSchedulerTest, SidesOnSameVolume)
+	{
+		IoScheduler scheduler(4);
+		int hdd = scheduler.AddVolume(_T("D:\\"), IoScheduler::DEVICE_HDD);
+		{
+			// Both sides on the one permit of the volume, else this would block
+			const int volumes[2] = { hdd, hdd };
+			IoScheduler::Permit permit(&scheduler, volumes, 2);
+			EXPECT_EQ(1, scheduler.GetActive(hdd));
+			permit.AddBytes(0, 100);
+			permit.AddBytes(1, 50);
+		}
+		EXPECT_EQ(0, scheduler.GetActive(hdd));
+		EXPECT_EQ(150, scheduler.GetBytesRead(hdd));
+	}
+
+	TEST_F(IoSchedulerTest, BytesCreditedPerSide)
+	{
+		IoScheduler scheduler(4);
+		int hdd = scheduler.AddVolume(_T("D:\\"), IoScheduler::DEVICE_HDD);
+		int remote = scheduler.AddVolume(_T("\\\\server\\share\\"), IoScheduler::DEVICE_REMOTE);
+		{
+			const int volumes[3] = { hdd, remote, -1 };
+			IoScheduler::Permit permit(&scheduler, volumes, 3);
+			EXPECT_EQ(1, scheduler.GetActive(hdd));
+			EXPECT_EQ(1, scheduler.GetActive(remote));
+			permit.AddBytes(0, 1000);
+			permit.AddBytes(1, 7);
+			permit.AddBytes(2, 99); // side is not read
+		}
+		EXPECT_EQ(1000, scheduler.GetBytesRead(hdd));
+		EXPECT_EQ(7, scheduler.GetBytesRead(remote));
+	}
+
+	TEST_F(IoSchedulerTest, AcquireWaitsForLimit)
+	{
+		IoScheduler scheduler(4);
+		int hdd = scheduler.AddVolume(_T("D:\\"), IoScheduler::DEVICE_HDD);
+		const int volumes[2] = { hdd, -1 };
+		std::atomic<bool> acquired(false);
+		std::thread reader;
+		{
+			IoScheduler::Permit permit(&scheduler, volumes, 2);
+			reader = std::thread([&]() {
+				IoScheduler::Permit permit2(&scheduler, volumes, 2);
+				acquired = true;
+			});
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			EXPECT_FALSE(acquired);
+			EXPECT_EQ(1, scheduler.GetActive(hdd));
+		}
+		reader.join();
+		EXPECT_TRUE(acquired);
+		EXPECT_EQ(0, scheduler.GetActive(hdd));
+	}
+
+	TEST_F(IoSchedulerTest, NextLimit)
+	{
+		// Keeps climbing while throughput improves
+		int direction = 1;
+		EXPECT_EQ(2, IoScheduler::NextLimit(1, 4, direction, 100.0, 0.0));
+		EXPECT_EQ(3, IoScheduler::NextLimit(2, 4, direction, 120.0, 100.0));
+		EXPECT_EQ(1, direction);
+		// Clamped to the maximum
+		EXPECT_EQ(4, IoScheduler::NextLimit(4, 4, direction, 150.0, 120.0));
+		// Turns back when throughput drops
+		EXPECT_EQ(2, IoScheduler::NextLimit(3, 4, direction, 80.0, 150.0));
+		EXPECT_EQ(-1, direction);
+		// Dropping again turns up again
+		EXPECT_EQ(3, IoScheduler::NextLimit(2, 4, direction, 50.0, 80.0));
+		EXPECT_EQ(1, direction);
+		// No clear difference drifts down, not below one
+		EXPECT_EQ(2, IoScheduler::NextLimit(3, 4, direction, 51.0, 50.0));
+		EXPECT_EQ(-1, direction);
+		EXPECT_EQ(1, IoScheduler::NextLimit(1, 4, direction, 51.0, 51.0));
+	}
+
+}  // namespace
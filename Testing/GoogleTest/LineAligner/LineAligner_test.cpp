@@ -0,0 +1,143 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <vector>
+#include "UnicodeString.h"
+#include "CompareOptions.h"
+#include "LineAligner.h"
+#include <Poco/Thread.h>
+
+namespace
+{
+	// The fixture for testing LineAligner class.
+	class LineAlignerTest : public testing::Test
+	{
+	protected:
+		// You can remove any or all of the following functions if its body
+		// is	empty.
+
+		LineAlignerTest()
+		{
+			// You can do set-up work for each test	here.
+		}
+
+		virtual ~LineAlignerTest()
+		{
+			// You can do clean-up work	that doesn't throw exceptions here.
+		}
+
+		// If	the	constructor	and	destructor are not enough for setting up
+		// and cleaning up each test, you can define the following methods:
+
+		virtual void SetUp()
+		{
+			// Code	here will be called	immediately	after the constructor (right
+			// before each test).
+		}
+
+		virtual void TearDown()
+		{
+			// Code	here will be called	immediately	after each test	(right
+			// before the destructor).
+		}
+
+		// Objects declared here can be used by all tests in the test case for Foo.
+	};
+
+	String MakeLine(int n)
+	{
+		return strutils::format(_T("\tvalue%d = compute(item%d, \"text %d\");"), n, n * 7, n * 13);
+	}
+
+	TEST_F(LineAlignerTest, Empty)
+	{
+		LineAligner aligner(true, WHITESPACE_COMPARE_ALL);
+		std::vector<int> map;
+		EXPECT_TRUE(aligner.Align({}, { _T("a") }, map));
+		EXPECT_TRUE(map.empty());
+		EXPECT_TRUE(aligner.Align({ _T("a"), _T("b") }, {}, map));
+		EXPECT_EQ((std::vector<int>{ LineAligner::GHOST, LineAligner::GHOST }), map);
+	}
+
+	TEST_F(LineAlignerTest, InsertedLines)
+	{
+		std::vector<String> lines0, lines1;
+		for (int i = 0; i < 40; ++i)
+		{
+			lines0.push_back(MakeLine(i));
+			if (i % 10 == 0)
+				lines1.push_back(_T("/* inserted comment line */"));
+			lines1.push_back(MakeLine(i) + _T(" // changed"));
+		}
+		LineAligner aligner(true, WHITESPACE_COMPARE_ALL);
+		std::vector<int> map;
+		ASSERT_TRUE(aligner.Align(lines0, lines1, map));
+		ASSERT_EQ(lines0.size(), map.size());
+		for (int i = 0; i < 40; ++i)
+			EXPECT_EQ(i + i / 10 + 1, map[i]);
+	}
+
+	TEST_F(LineAlignerTest, DeletedLines)
+	{
+		std::vector<String> lines0, lines1;
+		for (int i = 0; i < 30; ++i)
+		{
+			lines0.push_back(MakeLine(i));
+			if (i % 3 != 0)
+				lines1.push_back(MakeLine(i) + _T(";"));
+		}
+		LineAligner aligner(true, WHITESPACE_COMPARE_ALL);
+		std::vector<int> map;
+		ASSERT_TRUE(aligner.Align(lines0, lines1, map));
+		for (int i = 0, j = 0; i < 30; ++i)
+		{
+			if (i % 3 != 0)
+				EXPECT_EQ(j++, map[i]);
+		}
+		for (size_t i = 1; i < map.size(); ++i)
+		{
+			if (map[i] != LineAligner::GHOST && map[i - 1] != LineAligner::GHOST)
+				EXPECT_LT(map[i - 1], map[i]);
+		}
+	}
+
+	TEST_F(LineAlignerTest, IgnoreCaseAndWhitespace)
+	{
+		std::vector<String> lines0 = { _T("int  a = 0;"), _T("Foo(Bar);") };
+		std::vector<String> lines1 = { _T("INT A=0;"), _T("something else entirely"), _T("foo( bar );") };
+		std::vector<int> map;
+		LineAligner aligner(false, WHITESPACE_IGNORE_ALL);
+		ASSERT_TRUE(aligner.Align(lines0, lines1, map));
+		EXPECT_EQ(0, map[0]);
+		EXPECT_EQ(2, map[1]);
+	}
+
+	TEST_F(LineAlignerTest, LargeBlock)
+	{
+		std::vector<String> lines0, lines1;
+		for (int i = 0; i < 20000; ++i)
+		{
+			lines0.push_back(MakeLine(i));
+			if (i % 100 == 50)
+				lines1.push_back(_T("}"));
+			lines1.push_back(MakeLine(i) + _T(" "));
+		}
+		LineAligner aligner(true, WHITESPACE_COMPARE_ALL);
+		aligner.SetMaxCells(2 * 1024 * 1024);
+		std::vector<int> map;
+		ASSERT_TRUE(aligner.Align(lines0, lines1, map));
+		for (int i = 0; i < 20000; i += 997)
+			EXPECT_EQ(i + (i + 49) / 100, map[i]);
+	}
+
+	TEST_F(LineAlignerTest, TimeLimit)
+	{
+		std::vector<String> lines(5000, String(_T("line")));
+		LineAligner aligner(true, WHITESPACE_COMPARE_ALL);
+		aligner.SetTimeLimit(1);
+		Poco::Thread::sleep(5);
+		std::vector<int> map;
+		EXPECT_TRUE(aligner.IsTimeOver());
+		EXPECT_FALSE(aligner.Align(lines, lines, map));
+	}
+
+}	// namespace
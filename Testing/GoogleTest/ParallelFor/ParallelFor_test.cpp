@@ -0,0 +1,79 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "ParallelFor.h"
+
+namespace
+{
+	// The fixture for testing ParallelFor function.
+	class ParallelForTest : public testing::Test
+	{
+	protected:
+		ParallelForTest()
+		{
+		}
+
+		virtual ~ParallelForTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+		}
+
+		virtual void TearDown()
+		{
+		}
+	};
+
+	TEST_F(ParallelForTest, CoversRange)
+	{
+		const int count = 1000;
+		std::vector<std::atomic<int>> visits(count);
+		ParallelFor(count, parallel::MinWork * 4, [&](int begin, int end)
+			{
+				for (int i = begin; i < end; ++i)
+					++visits[i];
+			});
+		for (int i = 0; i < count; ++i)
+			EXPECT_EQ(1, visits[i]) << "item " << i;
+	}
+
+	TEST_F(ParallelForTest, SerialScope)
+	{
+		const std::thread::id caller = std::this_thread::get_id();
+		std::atomic<int> nOtherThreads(0);
+		{
+			parallel::SerialScope serial;
+			ParallelFor(1000, parallel::MinWork * 4, [&](int begin, int end)
+				{
+					EXPECT_EQ(0, begin);
+					EXPECT_EQ(1000, end);
+					if (std::this_thread::get_id() != caller)
+						++nOtherThreads;
+				});
+			// Scopes nest
+			{
+				parallel::SerialScope notSerial(false);
+				EXPECT_TRUE(parallel::bSerialThread);
+			}
+			EXPECT_TRUE(parallel::bSerialThread);
+		}
+		EXPECT_FALSE(parallel::bSerialThread);
+		EXPECT_EQ(0, nOtherThreads);
+
+		// Ranges run by ParallelFor don't start threads of their own
+		std::atomic<int> nNested(0);
+		ParallelFor(1000, parallel::MinWork * 4, [&](int, int)
+			{
+				if (parallel::bSerialThread)
+					++nNested;
+			});
+		if (Poco::Environment::processorCount() >= 2)
+			EXPECT_GE(nNested, 1);
+		EXPECT_FALSE(parallel::bSerialThread);
+	}
+
+}  // namespace
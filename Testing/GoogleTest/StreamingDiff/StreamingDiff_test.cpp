@@ -0,0 +1,215 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include "DiffItem.h"
+#include "DiffList.h"
+#include "PathContext.h"
+#include "CompareEngines/StreamingDiff.h"
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+	struct TempFile
+	{
+		TempFile(const std::string& filename, const std::string& data) : m_filename(filename)
+		{
+			std::ofstream ostr(filename.c_str(), std::ios::out|std::ios::binary|std::ios::trunc);
+			ostr.write(data.data(), data.length());
+		}
+		~TempFile()
+		{
+			remove(m_filename.c_str());
+		}
+		std::string m_filename;
+	};
+
+	// The fixture for testing StreamingDiff class.
+	class StreamingDiffTest : public testing::Test
+	{
+	protected:
+		StreamingDiffTest()
+		{
+		}
+
+		virtual ~StreamingDiffTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+		}
+
+		virtual void TearDown()
+		{
+		}
+
+		/** @brief Diff two texts, differences go to m_diffList. */
+		int Compare(const std::string& left, const std::string& right, size_t nWindowSize = 0)
+		{
+			TempFile l("A", left);
+			TempFile r("B", right);
+			CompareEngines::StreamingDiff diff;
+			if (nWindowSize > 0)
+				diff.SetWindowSize(nWindowSize);
+			m_diffList.Clear();
+			diff.SetCreateDiffList(&m_diffList);
+			m_patch.str("");
+			diff.SetPatchStream(&m_patch);
+			const int code = diff.CompareFiles(PathContext(_T("A"), _T("B")));
+			int nTrivialDiffs;
+			diff.GetDiffCounts(m_nDiffs, nTrivialDiffs);
+			m_nLines[0] = diff.GetLineCount(0);
+			m_nLines[1] = diff.GetLineCount(1);
+			return code;
+		}
+
+		/** @brief Check a difference, an empty range has end = begin - 1. */
+		void ExpectDiff(int nDiff, int begin0, int end0, int begin1, int end1)
+		{
+			const DIFFRANGE *dr = m_diffList.DiffRangeAt(nDiff);
+			ASSERT_NE(nullptr, dr);
+			EXPECT_EQ(begin0, dr->begin[0]) << "diff " << nDiff;
+			EXPECT_EQ(end0, dr->end[0]) << "diff " << nDiff;
+			EXPECT_EQ(begin1, dr->begin[1]) << "diff " << nDiff;
+			EXPECT_EQ(end1, dr->end[1]) << "diff " << nDiff;
+		}
+
+		DiffList m_diffList;
+		std::ostringstream m_patch;
+		int m_nDiffs = 0;
+		int64_t m_nLines[2] = {};
+	};
+
+	/** @brief Return lines "<prefix><n>" for n in [first, last). */
+	std::string Lines(const char *prefix, int first, int last)
+	{
+		std::string text;
+		for (int i = first; i < last; ++i)
+			text += prefix + std::to_string(i) + "\n";
+		return text;
+	}
+
+	TEST_F(StreamingDiffTest, Identical)
+	{
+		const std::string text = Lines("line", 0, 1000);
+		EXPECT_EQ(DIFFCODE::SAME | DIFFCODE::TEXT, Compare(text, text));
+		EXPECT_EQ(0, m_nDiffs);
+		EXPECT_EQ(0, m_diffList.GetSize());
+		EXPECT_EQ(1000, m_nLines[0]);
+		EXPECT_EQ(1000, m_nLines[1]);
+		EXPECT_TRUE(m_patch.str().empty());
+
+		EXPECT_EQ(DIFFCODE::SAME | DIFFCODE::TEXT, Compare("", ""));
+	}
+
+	TEST_F(StreamingDiffTest, PrefixAndSuffix)
+	{
+		// Changed line between common prefix and suffix
+		const std::string left = Lines("line", 0, 100);
+		std::string right = Lines("line", 0, 50) + "changed\n" + Lines("line", 51, 100);
+		EXPECT_EQ(DIFFCODE::DIFF | DIFFCODE::TEXT, Compare(left, right));
+		EXPECT_EQ(1, m_nDiffs);
+		ASSERT_EQ(1, m_diffList.GetSize());
+		ExpectDiff(0, 50, 50, 50, 50);
+		EXPECT_EQ(100, m_nLines[0]);
+		EXPECT_EQ(100, m_nLines[1]);
+		EXPECT_EQ("--- A\n+++ B\n@@ -51 +51 @@\n-line50\n+changed\n", m_patch.str());
+
+		// Inserted lines
+		right = Lines("line", 0, 50) + "new1\nnew2\n" + Lines("line", 50, 100);
+		EXPECT_EQ(DIFFCODE::DIFF | DIFFCODE::TEXT, Compare(left, right));
+		ASSERT_EQ(1, m_diffList.GetSize());
+		ExpectDiff(0, 50, 49, 50, 51);
+		EXPECT_EQ("--- A\n+++ B\n@@ -50,0 +51,2 @@\n+new1\n+new2\n", m_patch.str());
+
+		// Deleted first line
+		right = Lines("line", 1, 100);
+		EXPECT_EQ(DIFFCODE::DIFF | DIFFCODE::TEXT, Compare(left, right));
+		ASSERT_EQ(1, m_diffList.GetSize());
+		ExpectDiff(0, 0, 0, 0, -1);
+	}
+
+	TEST_F(StreamingDiffTest, Anchors)
+	{
+		// Differences separated by more equal lines than an anchor needs
+		const std::string left = Lines("line", 0, 100);
+		const std::string right = Lines("line", 0, 10) + "x\ny\n" + Lines("line", 11, 20) +
+			Lines("line", 25, 90) + "z\n" + Lines("line", 90, 100);
+		EXPECT_EQ(DIFFCODE::DIFF | DIFFCODE::TEXT, Compare(left, right));
+		EXPECT_EQ(3, m_nDiffs);
+		ASSERT_EQ(3, m_diffList.GetSize());
+		ExpectDiff(0, 10, 10, 10, 11);
+		ExpectDiff(1, 20, 24, 21, 20);
+		ExpectDiff(2, 90, 89, 86, 86);
+
+		// Equal lines fewer than an anchor are diffed with the lines around
+		const std::string right2 = Lines("line", 0, 10) + "x\n" + Lines("line", 11, 13) + "y\n" + Lines("line", 14, 100);
+		EXPECT_EQ(DIFFCODE::DIFF | DIFFCODE::TEXT, Compare(left, right2));
+		EXPECT_EQ(2, m_nDiffs);
+		ExpectDiff(0, 10, 10, 10, 10);
+		ExpectDiff(1, 13, 13, 13, 13);
+	}
+
+	TEST_F(StreamingDiffTest, NoAnchorInWindow)
+	{
+		// Nothing in common until the windows get full, then a common suffix
+		const int nLines = 50000;
+		const std::string suffix = Lines("common", 0, 100);
+		const std::string left = Lines("left", 0, nLines) + suffix;
+		const std::string right = Lines("right", 0, nLines) + suffix;
+		EXPECT_EQ(DIFFCODE::DIFF | DIFFCODE::TEXT, Compare(left, right, 64 * 1024));
+		EXPECT_GT(m_diffList.GetSize(), 1);
+		EXPECT_EQ(m_nDiffs, m_diffList.GetSize());
+		// All different lines are in differences, the suffix is not
+		int64_t nDiffLines[2] = {};
+		for (int i = 0; i < m_diffList.GetSize(); ++i)
+		{
+			const DIFFRANGE *dr = m_diffList.DiffRangeAt(i);
+			for (int j = 0; j < 2; ++j)
+			{
+				EXPECT_LT(dr->end[j], nLines);
+				nDiffLines[j] += dr->end[j] - dr->begin[j] + 1;
+			}
+		}
+		EXPECT_EQ(nLines, nDiffLines[0]);
+		EXPECT_EQ(nLines, nDiffLines[1]);
+		EXPECT_EQ(nLines + 100, m_nLines[0]);
+		EXPECT_EQ(nLines + 100, m_nLines[1]);
+	}
+
+	TEST_F(StreamingDiffTest, EndOfFile)
+	{
+		// Lines appended to one file
+		const std::string left = Lines("line", 0, 10);
+		EXPECT_EQ(DIFFCODE::DIFF | DIFFCODE::TEXT, Compare(left, Lines("line", 0, 12)));
+		ASSERT_EQ(1, m_diffList.GetSize());
+		ExpectDiff(0, 10, 9, 10, 11);
+
+		// Empty file
+		EXPECT_EQ(DIFFCODE::DIFF | DIFFCODE::TEXT, Compare("", left));
+		ASSERT_EQ(1, m_diffList.GetSize());
+		ExpectDiff(0, 0, -1, 0, 9);
+		EXPECT_EQ(0, m_nLines[0]);
+		EXPECT_EQ(10, m_nLines[1]);
+
+		// Missing newline at end of file
+		EXPECT_EQ(DIFFCODE::DIFF | DIFFCODE::TEXT, Compare("a\nb", "a\nb\n"));
+		ASSERT_EQ(1, m_diffList.GetSize());
+		ExpectDiff(0, 1, 1, 1, 1);
+		EXPECT_EQ("--- A\n+++ B\n@@ -2 +2 @@\n-b\n\\ No newline at end of file\n+b\n", m_patch.str());
+	}
+
+	TEST_F(StreamingDiffTest, Binary)
+	{
+		const std::string left("a\n\0b\n", 5);
+		EXPECT_EQ(DIFFCODE::SAME | DIFFCODE::BIN | DIFFCODE::BINSIDE1 | DIFFCODE::BINSIDE2, Compare(left, left));
+	}
+
+	TEST_F(StreamingDiffTest, MissingFile)
+	{
+		TempFile l("A", "a\n");
+		CompareEngines::StreamingDiff diff;
+		EXPECT_EQ(DIFFCODE::CMPERR, diff.CompareFiles(PathContext(_T("A"), _T("nonexistent"))));
+	}
+
+}  // namespace
@@ -0,0 +1,162 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <Poco/RegularExpression.h>
+#include "SubstitutionList.h"
+#include "RegexPrefilter.h"
+
+using Poco::RegularExpression;
+
+namespace
+{
+	// The fixture for testing SubstitutionList class.
+	class SubstitutionListTest : public testing::Test
+	{
+	protected:
+		SubstitutionListTest()
+		{
+		}
+
+		virtual ~SubstitutionListTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+		}
+
+		virtual void TearDown()
+		{
+		}
+	};
+
+	std::vector<const char *> SplitLines(const std::string& text)
+	{
+		std::vector<const char *> lines;
+		size_t pos = 0;
+		while (pos < text.length())
+		{
+			lines.push_back(text.data() + pos);
+			const size_t eol = text.find('\n', pos);
+			pos = (eol == std::string::npos) ? text.length() : eol + 1;
+		}
+		lines.push_back(text.data() + text.length());
+		return lines;
+	}
+
+	TEST_F(SubstitutionListTest, RequiredLiteral)
+	{
+		EXPECT_EQ("version ", RegexPrefilter::FindRequiredLiteral("version [0-9]+", 0));
+		EXPECT_EQ("build", RegexPrefilter::FindRequiredLiteral("Build\\d+", RegularExpression::RE_CASELESS));
+		EXPECT_EQ("// Copyright ", RegexPrefilter::FindRequiredLiteral("^// Copyright (c)? \\d{4}", 0));
+		EXPECT_EQ("a.b", RegexPrefilter::FindRequiredLiteral("x?a\\.b", 0));
+		EXPECT_EQ("abcd", RegexPrefilter::FindRequiredLiteral("abcde*", 0));
+		EXPECT_EQ("abc", RegexPrefilter::FindRequiredLiteral("abc{2}", 0));
+		EXPECT_EQ("ab", RegexPrefilter::FindRequiredLiteral("abc{0,2}", 0));
+		EXPECT_EQ("", RegexPrefilter::FindRequiredLiteral("foo|bar", 0));
+		EXPECT_EQ("", RegexPrefilter::FindRequiredLiteral("(?i)foo", 0));
+		EXPECT_EQ("", RegexPrefilter::FindRequiredLiteral("\\x41BC", 0));
+		EXPECT_EQ("", RegexPrefilter::FindRequiredLiteral("foo", RegularExpression::RE_EXTENDED));
+		EXPECT_EQ("foo", RegexPrefilter::FindRequiredLiteral("(a|b)foo[|]", 0));
+
+		RegexPrefilter caseless("Build\\d+", RegularExpression::RE_CASELESS);
+		EXPECT_TRUE(caseless.MayMatch("new BUILD42"));
+		EXPECT_FALSE(caseless.MayMatch("new buil"));
+		RegexPrefilter exact("Build", 0);
+		EXPECT_FALSE(exact.MayMatch("new BUILD42"));
+		EXPECT_TRUE(RegexPrefilter("a|b", 0).MayMatch("c"));
+	}
+
+	TEST_F(SubstitutionListTest, Subst)
+	{
+		SubstitutionList list;
+		list.Add("([a-z]+)=([0-9]+)", "$2=$1", RegularExpression::RE_MULTILINE);
+		list.Add("x*", "-", 0);
+		EXPECT_EQ("1=a, 2=b", SubstitutionList().Subst("1=a, 2=b"));
+		EXPECT_EQ("-1-=-a", list.Subst("a=1"));
+
+		SubstitutionList words;
+		words.Add("a.b", "X", true, true);
+		EXPECT_EQ("X a.bc aXb", words.Subst("a.b a.bc aXb"));
+		SubstitutionList caseless;
+		caseless.Add("Foo", "bar", false, false);
+		EXPECT_EQ("bar bar $1", caseless.Subst("FOO foo $1"));
+	}
+
+	TEST_F(SubstitutionListTest, SubstLines)
+	{
+		SubstitutionList list;
+		list.Add("b\\nc", "B", RegularExpression::RE_MULTILINE);
+		list.Add("^d", "dd", RegularExpression::RE_MULTILINE);
+		const std::string text = "a\nb\nc\nd\ne";
+		std::vector<const char *> lines = SplitLines(text);
+		std::shared_ptr<const SubstitutedLines> result = list.SubstLines(lines.data(), static_cast<int>(lines.size() - 1));
+		ASSERT_EQ(6u, result->offsets.size());
+		EXPECT_EQ("a\nB\ndd\ne", result->text);
+		EXPECT_EQ("a\n", result->GetLines(0, 1));
+		// Line "c" started inside the match, it starts after the replacement now
+		EXPECT_EQ("B\n", result->GetLines(1, 2));
+		EXPECT_EQ("\n", result->GetLines(2, 1));
+		EXPECT_EQ("dd\ne", result->GetLines(3, 2));
+		EXPECT_EQ("", result->GetLines(1, 0));
+
+		// Same text and filters are substituted only once
+		EXPECT_EQ(result, list.SubstLines(lines.data(), static_cast<int>(lines.size() - 1)));
+		SubstitutionList other;
+		other.Add("^d", "dd", RegularExpression::RE_MULTILINE);
+		EXPECT_NE(result, other.SubstLines(lines.data(), static_cast<int>(lines.size() - 1)));
+	}
+
+	TEST_F(SubstitutionListTest, SubstLinesLarge)
+	{
+		SubstitutionList list;
+		list.Add("[0-9]+", "N", RegularExpression::RE_MULTILINE);
+		std::string text;
+		std::string expected;
+		for (int i = 0; i < 20000; ++i)
+		{
+			text += "line " + std::to_string(i) + "\n";
+			expected += "line N\n";
+		}
+		std::vector<const char *> lines = SplitLines(text);
+		const int nlines = static_cast<int>(lines.size() - 1);
+		std::shared_ptr<const SubstitutedLines> result = list.SubstLines(lines.data(), nlines);
+		EXPECT_EQ(expected, result->text);
+		ASSERT_EQ(static_cast<size_t>(nlines + 1), result->offsets.size());
+		for (int i = 0; i < nlines; i += 997)
+			EXPECT_EQ("line N\n", result->GetLines(i, 1));
+		EXPECT_EQ(list.Subst(text), result->text);
+
+		// Matches spanning lines are not cut at the parts substituted in parallel
+		SubstitutionList multiline;
+		multiline.Add("7\\nline", "7 line", RegularExpression::RE_MULTILINE);
+		result = multiline.SubstLines(lines.data(), nlines);
+		EXPECT_EQ(multiline.Subst(text), result->text);
+		ASSERT_EQ(static_cast<size_t>(nlines + 1), result->offsets.size());
+		EXPECT_EQ("line 17 line 18\nline 19\n", result->GetLines(17, 3));
+	}
+
+	TEST_F(SubstitutionListTest, SubstLinesLargeAnchored)
+	{
+		std::string text;
+		for (int i = 0; i < 20000; ++i)
+			text += "foo\n";
+		text += "foo";
+		std::vector<const char *> lines = SplitLines(text);
+		const int nlines = static_cast<int>(lines.size() - 1);
+
+		// Anchors to the start or end of the text match once in the whole file,
+		// not at the start or end of each part substituted in parallel
+		for (const char *pattern : { "foo\\z", "foo$", "\\Afoo", "^foo" })
+		{
+			SubstitutionList list;
+			list.Add(pattern, "bar", 0);
+			std::shared_ptr<const SubstitutedLines> result = list.SubstLines(lines.data(), nlines);
+			EXPECT_EQ(list.Subst(text), result->text) << pattern;
+			EXPECT_EQ(1, std::count(result->text.begin(), result->text.end(), 'b')) << pattern;
+		}
+	}
+
+}  // namespace
@@ -0,0 +1,172 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include <vector>
+#include "UnicodeString.h"
+#include "CompareOptions.h"
+#include "TableDiff.h"
+
+namespace
+{
+	// The fixture for testing TableDiff class.
+	class TableDiffTest : public testing::Test
+	{
+	protected:
+		TableDiffTest()
+		{
+		}
+
+		virtual ~TableDiffTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+		}
+
+		virtual void TearDown()
+		{
+		}
+
+		static std::vector<StringView> Rows(const std::vector<String>& lines)
+		{
+			return std::vector<StringView>(lines.begin(), lines.end());
+		}
+	};
+
+	/** @brief Range as { begin0, end0, begin1, end1 } */
+	std::vector<int> ToVector(const TableDiff::Range& range)
+	{
+		return { range.begin[0], range.end[0], range.begin[1], range.end[1] };
+	}
+
+	TEST_F(TableDiffTest, SplitFields)
+	{
+		TableDiff diff(',', '"', true, WHITESPACE_COMPARE_ALL);
+		std::vector<StringView> fields;
+		diff.SplitFields(_T("a,\"b,c\",,d"), fields);
+		ASSERT_EQ(4u, fields.size());
+		EXPECT_EQ(_T("a"), String(fields[0]));
+		EXPECT_EQ(_T("\"b,c\""), String(fields[1]));
+		EXPECT_EQ(_T(""), String(fields[2]));
+		EXPECT_EQ(_T("d"), String(fields[3]));
+	}
+
+	TEST_F(TableDiffTest, Identical)
+	{
+		std::vector<String> lines = { _T("id,name"), _T("1,one"), _T("2,two") };
+		TableDiff diff(',', '"', true, WHITESPACE_COMPARE_ALL);
+		diff.SetKeyColumn(1);
+		diff.Diff(Rows(lines), Rows(lines));
+		EXPECT_TRUE(diff.GetRanges().empty());
+		EXPECT_TRUE(diff.GetMovedRows().empty());
+	}
+
+	TEST_F(TableDiffTest, ChangedRow)
+	{
+		std::vector<String> lines0 = { _T("id,name"), _T("1,one"), _T("2,two"), _T("3,three") };
+		std::vector<String> lines1 = { _T("id,name"), _T("1,one"), _T("2,TWO"), _T("3,three") };
+		TableDiff diff(',', '"', true, WHITESPACE_COMPARE_ALL);
+		diff.SetKeyColumn(1);
+		diff.Diff(Rows(lines0), Rows(lines1));
+		ASSERT_EQ(1u, diff.GetRanges().size());
+		EXPECT_EQ((std::vector<int>{ 2, 3, 2, 3 }), ToVector(diff.GetRanges()[0]));
+
+		// Same rows when case is ignored
+		TableDiff diff2(',', '"', false, WHITESPACE_COMPARE_ALL);
+		diff2.SetKeyColumn(1);
+		diff2.Diff(Rows(lines0), Rows(lines1));
+		EXPECT_TRUE(diff2.GetRanges().empty());
+	}
+
+	TEST_F(TableDiffTest, InsertedAndDeletedRows)
+	{
+		std::vector<String> lines0 = { _T("1,a"), _T("2,b"), _T("3,c"), _T("4,d") };
+		std::vector<String> lines1 = { _T("1,a"), _T("3,c"), _T("5,e"), _T("4,d") };
+		TableDiff diff(',', '"', true, WHITESPACE_COMPARE_ALL);
+		diff.SetKeyColumn(1);
+		diff.Diff(Rows(lines0), Rows(lines1));
+		ASSERT_EQ(2u, diff.GetRanges().size());
+		EXPECT_EQ((std::vector<int>{ 1, 2, 1, 1 }), ToVector(diff.GetRanges()[0]));
+		EXPECT_EQ((std::vector<int>{ 3, 3, 2, 3 }), ToVector(diff.GetRanges()[1]));
+	}
+
+	TEST_F(TableDiffTest, ReorderedRows)
+	{
+		// Rows sorted by name on one side and by id on the other
+		std::vector<String> lines0 = { _T("id,name"), _T("1,d"), _T("2,c"), _T("3,b"), _T("4,a") };
+		std::vector<String> lines1 = { _T("id,name"), _T("4,a"), _T("3,b"), _T("2,c"), _T("1,D") };
+		TableDiff diff(',', '"', true, WHITESPACE_COMPARE_ALL);
+		diff.SetKeyColumn(1);
+		diff.Diff(Rows(lines0), Rows(lines1));
+		// One row stays aligned, the others are moved
+		EXPECT_EQ(3u, diff.GetMovedRows().size());
+		ASSERT_EQ(2u, diff.GetRanges().size());
+		EXPECT_EQ((std::vector<int>{ 1, 4, 1, 1 }), ToVector(diff.GetRanges()[0]));
+		EXPECT_EQ((std::vector<int>{ 5, 5, 2, 5 }), ToVector(diff.GetRanges()[1]));
+
+		// Row "1,d" has no match when all columns are the key
+		TableDiff diff2(',', '"', true, WHITESPACE_COMPARE_ALL);
+		diff2.Diff(Rows(lines0), Rows(lines1));
+		EXPECT_EQ(2u, diff2.GetMovedRows().size());
+	}
+
+	TEST_F(TableDiffTest, DuplicateKeys)
+	{
+		std::vector<String> lines0 = { _T("1,a"), _T("1,b"), _T("2,c") };
+		std::vector<String> lines1 = { _T("1,a"), _T("1,b"), _T("1,x"), _T("2,c") };
+		TableDiff diff(',', '"', true, WHITESPACE_COMPARE_ALL);
+		diff.SetKeyColumn(1);
+		diff.Diff(Rows(lines0), Rows(lines1));
+		ASSERT_EQ(1u, diff.GetRanges().size());
+		EXPECT_EQ((std::vector<int>{ 2, 2, 2, 3 }), ToVector(diff.GetRanges()[0]));
+	}
+
+	TEST_F(TableDiffTest, Eol)
+	{
+		// Rows with another EOL are changed, not added and removed
+		std::vector<String> lines0 = { _T("1,a\r\n"), _T("2,b\r\n"), _T("3,c") };
+		std::vector<String> lines1 = { _T("1,a\n"), _T("2,b\r\n"), _T("3,c") };
+		TableDiff diff(',', '"', true, WHITESPACE_COMPARE_ALL);
+		diff.SetKeyColumn(2);
+		diff.Diff(Rows(lines0), Rows(lines1));
+		ASSERT_EQ(1u, diff.GetRanges().size());
+		EXPECT_EQ((std::vector<int>{ 0, 1, 0, 1 }), ToVector(diff.GetRanges()[0]));
+		EXPECT_TRUE(diff.GetMovedRows().empty());
+
+		// Rows without EOL are compared by their cells only
+		std::vector<String> lines2 = { _T("1,a"), _T("2,b"), _T("3,c") };
+		TableDiff diff2(',', '"', true, WHITESPACE_COMPARE_ALL);
+		diff2.Diff(Rows(lines2), Rows(lines2));
+		EXPECT_TRUE(diff2.GetRanges().empty());
+	}
+
+	TEST_F(TableDiffTest, ManyRows)
+	{
+		// Reverse the order of a large table and change every 1000th row
+		std::vector<String> lines0, lines1;
+		const int nRows = 200000;
+		for (int i = 0; i < nRows; ++i)
+			lines0.push_back(strutils::format(_T("%d\tname%d\t%d"), i, i, i * 3));
+		for (int i = nRows - 1; i >= 0; --i)
+			lines1.push_back(strutils::format(_T("%d\tname%d\t%d"), i, i, (i % 1000) ? i * 3 : 0));
+		TableDiff diff('\t', '"', true, WHITESPACE_COMPARE_ALL);
+		diff.SetKeyColumn(1);
+		diff.Diff(Rows(lines0), Rows(lines1));
+		EXPECT_EQ(static_cast<size_t>(nRows - 1), diff.GetMovedRows().size());
+		for (const auto& moved : diff.GetMovedRows())
+			EXPECT_EQ(nRows - 1 - moved.row[0], moved.row[1]);
+	}
+
+	TEST_F(TableDiffTest, DiffCells)
+	{
+		TableDiff diff(',', '"', true, WHITESPACE_IGNORE_CHANGE);
+		std::vector<TableDiff::Range> cells;
+		diff.DiffCells(_T("1,a  b,c"), _T("1,a b,d"), cells);
+		ASSERT_EQ(1u, cells.size());
+		EXPECT_EQ((std::vector<int>{ 7, 8, 6, 7 }), ToVector(cells[0]));
+
+		diff.DiffCells(_T("1,a"), _T("1,a,new"), cells);
+		ASSERT_EQ(1u, cells.size());
+		EXPECT_EQ((std::vector<int>{ 3, 3, 3, 7 }), ToVector(cells[0]));
+	}
+}
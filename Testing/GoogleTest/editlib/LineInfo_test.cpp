@@ -0,0 +1,74 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include "stdafx.h"
+#include "LineInfo.h"
+
+namespace
+{
+	// The fixture for testing LineInfo class.
+	class LineInfoTest : public testing::Test
+	{
+	protected:
+		LineInfoTest()
+		{
+		}
+
+		virtual ~LineInfoTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+		}
+
+		virtual void TearDown()
+		{
+		}
+	};
+
+	std::basic_string<TCHAR> FullLine(const LineInfo& li)
+	{
+		return std::basic_string<TCHAR>(li.GetLine(), li.FullLength());
+	}
+
+	TEST_F(LineInfoTest, Edit)
+	{
+		LineInfo li;
+		li.Create(_T("abcdef\r\n"), 8);
+		EXPECT_EQ(6u, li.Length());
+		EXPECT_TRUE(li.HasEol());
+		li.Delete(1, 3);
+		EXPECT_TRUE(_T("adef\r\n") == FullLine(li));
+		EXPECT_TRUE(li.ChangeEol(_T("\n")));
+		EXPECT_FALSE(li.ChangeEol(_T("\n")));
+		EXPECT_TRUE(_T("adef\n") == FullLine(li));
+		li.RemoveEol();
+		EXPECT_FALSE(li.HasEol());
+		li.Append(_T("gh\r\n"), 4);
+		EXPECT_TRUE(_T("adefgh\r\n") == FullLine(li));
+		li.DeleteEnd(2);
+		EXPECT_TRUE(_T("ad") == FullLine(li));
+		li.FreeBuffer();
+	}
+
+	TEST_F(LineInfoTest, EmptyLinesIndependent)
+	{
+		// Empty lines, like ghost lines, each have their own text
+		LineInfo a, b;
+		a.CreateEmpty();
+		b.CreateEmpty();
+		a.Append(_T("x"), 1);
+		EXPECT_TRUE(_T("x") == FullLine(a));
+		EXPECT_EQ(0u, b.FullLength());
+		EXPECT_EQ(_T('\0'), b.GetLine()[0]);
+
+		LineInfo c;
+		c.CopyFrom(a);
+		a.DeleteEnd(0);
+		EXPECT_EQ(_T('x'), c.GetLine()[0]);
+		a.FreeBuffer();
+		b.FreeBuffer();
+		c.FreeBuffer();
+	}
+
+}  // namespace
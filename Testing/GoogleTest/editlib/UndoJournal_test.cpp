@@ -0,0 +1,138 @@
+#include "pch.h"
+#include <gtest/gtest.h>
+#include "stdafx.h"
+#include "UndoJournal.h"
+
+namespace
+{
+	// The fixture for testing UndoJournal class.
+	class UndoJournalTest : public testing::Test
+	{
+	protected:
+		UndoJournalTest()
+		{
+		}
+
+		virtual ~UndoJournalTest()
+		{
+		}
+
+		virtual void SetUp()
+		{
+		}
+
+		virtual void TearDown()
+		{
+		}
+	};
+
+	/** @brief Text of record i, long enough for a few records to fill a chunk. */
+	std::basic_string<TCHAR> RecordText(size_t i)
+	{
+		return std::basic_string<TCHAR>(7000 + i, static_cast<TCHAR>(_T('a') + i % 26));
+	}
+
+	void PushRecord(UndoJournal& journal, size_t i)
+	{
+		UndoRecord ur;
+		const std::basic_string<TCHAR> text = RecordText(i);
+		const DWORD revisions[2] = { static_cast<DWORD>(i), static_cast<DWORD>(i * 2) };
+		journal.push_back(ur, text.data(), text.length(), revisions, 2);
+	}
+
+	void CheckRecords(const UndoJournal& journal)
+	{
+		for (size_t i = 0; i < journal.size(); ++i)
+		{
+			const std::basic_string<TCHAR> expected = RecordText(i);
+			ASSERT_EQ(expected.length(), journal[i].GetTextLength()) << "record " << i;
+			LPCTSTR pszText = journal.GetText(journal[i]);
+			ASSERT_NE(nullptr, pszText) << "record " << i;
+			EXPECT_TRUE(expected == std::basic_string<TCHAR>(pszText, journal[i].GetTextLength())) << "record " << i;
+			const DWORD *pdwRevisions = journal.GetRevisionNumbers(journal[i]);
+			ASSERT_NE(nullptr, pdwRevisions) << "record " << i;
+			EXPECT_EQ(i, pdwRevisions[0]) << "record " << i;
+			EXPECT_EQ(i * 2, pdwRevisions[1]) << "record " << i;
+		}
+	}
+
+	TEST_F(UndoJournalTest, TypingMerged)
+	{
+		UndoJournal journal;
+		EXPECT_FALSE(journal.AppendText(_T("x"), 1));
+
+		UndoRecord ur;
+		journal.push_back(ur, _T("a"), 1, nullptr, 0);
+		EXPECT_TRUE(journal.AppendText(_T("bc"), 2));
+		ASSERT_EQ(1u, journal.size());
+		ASSERT_EQ(3u, journal[0].GetTextLength());
+		EXPECT_EQ(0, memcmp(_T("abc"), journal.GetText(journal[0]), 3 * sizeof(TCHAR)));
+
+		// Only the last appended text is the last edit
+		size_t cchText = 0;
+		LPCTSTR pszText = journal.GetLastText(0, cchText);
+		ASSERT_EQ(2u, cchText);
+		EXPECT_EQ(0, memcmp(_T("bc"), pszText, 2 * sizeof(TCHAR)));
+
+		journal.push_back(ur, _T("d"), 1, nullptr, 0);
+		pszText = journal.GetLastText(0, cchText);
+		EXPECT_EQ(3u, cchText);
+		pszText = journal.GetLastText(1, cchText);
+		ASSERT_EQ(1u, cchText);
+		EXPECT_EQ(_T('d'), pszText[0]);
+
+		// Text not fitting in the chunk is not merged
+		const std::basic_string<TCHAR> large(64 * 1024, _T('x'));
+		EXPECT_FALSE(journal.AppendText(large.data(), large.length()));
+		EXPECT_EQ(1u, journal[1].GetTextLength());
+
+		// Removing the last record makes the previous one the last again
+		journal.resize(1);
+		EXPECT_TRUE(journal.AppendText(_T("e"), 1));
+		ASSERT_EQ(4u, journal[0].GetTextLength());
+		EXPECT_EQ(0, memcmp(_T("abce"), journal.GetText(journal[0]), 4 * sizeof(TCHAR)));
+	}
+
+	TEST_F(UndoJournalTest, SpillToFile)
+	{
+		UndoJournal journal;
+		const size_t limit = 256 * 1024;
+		journal.SetMemoryLimit(limit);
+		for (size_t i = 0; i < 200; ++i)
+			PushRecord(journal, i);
+		// The last chunk and the chunk read last may exceed the limit
+		const size_t records = journal.size() * sizeof(UndoRecord) * 2;
+		EXPECT_GT(200 * 7000 * sizeof(TCHAR), limit * 2);
+		EXPECT_LE(journal.GetMemoryUsage(), limit + 2 * 64 * 1024 + records);
+		CheckRecords(journal);
+		EXPECT_LE(journal.GetMemoryUsage(), limit + 2 * 64 * 1024 + records);
+
+		// Lowering the limit spills more
+		journal.SetMemoryLimit(64 * 1024);
+		EXPECT_LE(journal.GetMemoryUsage(), 3 * 64 * 1024 + records);
+		CheckRecords(journal);
+	}
+
+	TEST_F(UndoJournalTest, TruncateSpilled)
+	{
+		UndoJournal journal;
+		journal.SetMemoryLimit(64 * 1024);
+		for (size_t i = 0; i < 100; ++i)
+			PushRecord(journal, i);
+
+		// Cut inside a chunk which is in the file only, then append again
+		journal.resize(21);
+		EXPECT_EQ(21u, journal.size());
+		CheckRecords(journal);
+		for (size_t i = 21; i < 60; ++i)
+			PushRecord(journal, i);
+		CheckRecords(journal);
+
+		journal.resize(0);
+		EXPECT_EQ(0u, journal.size());
+		for (size_t i = 0; i < 5; ++i)
+			PushRecord(journal, i);
+		CheckRecords(journal);
+	}
+
+}  // namespace
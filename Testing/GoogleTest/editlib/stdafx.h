@@ -0,0 +1,24 @@
+/**
+ * @file  stdafx.h
+ *
+ * @brief Replaces the MFC stdafx.h of WinMerge for the crystaledit sources
+ * built into the unit tests. Only what those sources need without MFC.
+ */
+#pragma once
+
+#include <windows.h>
+#include <tchar.h>
+#include <crtdbg.h>
+#include <atltypes.h>
+
+#ifndef ASSERT
+#define ASSERT(f) _ASSERTE(f)
+#endif
+#ifndef VERIFY
+#ifdef _DEBUG
+#define VERIFY(f) _ASSERTE(f)
+#else
+#define VERIFY(f) ((void)(f))
+#endif
+#endif
+#define DEBUG_NEW new
@@ -1,5 +1,6 @@
 #include "pch.h"
 #include <gtest/gtest.h>
+#include <string>
 #include "unicoder.h"
 
 namespace
@@ -80,6 +81,24 @@ namespace
 		EXPECT_EQ(true, ucr::CheckForInvalidUtf8(utf8.c_str(), utf8.length()));
 	}
 
+	TEST_F(UnicoderTest, FindNonAscii)
+	{
+		EXPECT_EQ(0u, ucr::FindNonAscii("", 0));
+		EXPECT_EQ(3u, ucr::FindNonAscii("abc", 3));
+		std::string text(100, 'a');
+		EXPECT_EQ(100u, ucr::FindNonAscii(text.c_str(), text.length()));
+		for (size_t pos : { 0, 15, 16, 17, 63, 99 })
+		{
+			std::string s = text;
+			s[pos] = '\xe9';
+			EXPECT_EQ(pos, ucr::FindNonAscii(s.c_str(), s.length()));
+		}
+
+		std::string utf8 = text + ucr::toUTF8(L"\u263a") + text;
+		EXPECT_EQ(false, ucr::CheckForInvalidUtf8(utf8.c_str(), utf8.length()));
+		EXPECT_EQ(true, ucr::CheckForInvalidUtf8(text.c_str(), text.length()));
+	}
+
 	TEST_F(UnicoderTest, CrossConvert)
 	{
 		wchar_t wbuf[256];